@@ -0,0 +1,738 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/hist.h>
+#include <vsa/index.h>
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/parser.h>
+
+#define BENCH_PEER "udp:127.0.0.1:161"
+#define BENCH_COMMUNITY "public"
+#define BENCH_AUTH_PROTO "SHA"
+#define BENCH_PRIV_PROTO "AES"
+#define BENCH_MAX_USERS 10000
+
+typedef struct options_s options_t;
+typedef struct bench_s bench_t;
+typedef struct request_s request_t;
+
+enum {
+    BENCH_GET,
+    BENCH_GETNEXT,
+    BENCH_GETBULK,
+    BENCH_PDUS
+};
+
+enum {
+    BENCH_SELECT_RANDOM,
+    BENCH_SELECT_WALK,
+    BENCH_SELECT_HOT
+};
+
+struct options_s {
+    char                   *mib;
+    char                   *peer;
+    long                    version;
+    char                   *community;
+    char                   *user;
+    char                   *auth_pass;
+    char                   *priv_pass;
+    char                   *auth_proto;
+    char                   *priv_proto;
+    unsigned                users;
+    unsigned                mix[BENCH_PDUS];
+    long                    max_repetitions;
+    unsigned                concurrency;
+    double                  rate;
+    double                  duration;
+    long                    timeout;
+    int                     select;
+    size_t                  hot;
+    guint32                 seed;
+};
+
+struct bench_s {
+    options_t              *options;
+    vsa_index_t            *index;
+    netsnmp_session       **sessions;
+    unsigned                next_session;
+    GRand                  *rand;
+    size_t                 *hot;
+    size_t                  position;
+    unsigned                inflight;
+    uint64_t                sent[BENCH_PDUS];
+    uint64_t                responses;
+    uint64_t                errors;
+    uint64_t                timeouts;
+    uint64_t                send_errors;
+    vsa_hist_t              latency[BENCH_PDUS];
+};
+
+// An outstanding request, passed to the response callback.
+struct request_s {
+    bench_t                *bench;
+    int                     type;
+    uint64_t                sent;
+};
+
+static const char      *pdu_names[BENCH_PDUS] = { "GET", "GETNEXT", "GETBULK" };
+
+char                   *program_invocation_name = "vsa-bench";
+
+uint64_t                now_us(void);
+size_t                  select_object(bench_t * bench);
+int                     select_type(bench_t * bench);
+int                     response_cb(int op, netsnmp_session * session, int reqid, netsnmp_pdu * pdu, void *magic);
+int                     send_request(bench_t * bench);
+void                    open_sessions(bench_t * bench);
+void                    report(bench_t * bench, double elapsed);
+void                    parse_mix(const char *str, unsigned *mix);
+unsigned                parse_users(const char *str);
+void                    parse_select(const char *str, options_t * options);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+uint64_t
+now_us(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t
+select_object(bench_t * bench)
+{
+    switch (bench->options->select) {
+    case BENCH_SELECT_WALK:
+        bench->position = (bench->position + 1) % bench->index->len;
+        return bench->position;
+
+    case BENCH_SELECT_HOT:
+        return bench->hot[g_rand_int_range(bench->rand, 0, bench->options->hot)];
+
+    default:
+        break;
+    }
+
+    return g_rand_int_range(bench->rand, 0, bench->index->len);
+}
+
+int
+select_type(bench_t * bench)
+{
+    unsigned                total, pick;
+
+    total = 0;
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        total += bench->options->mix[i];
+    }
+
+    pick = g_rand_int_range(bench->rand, 0, total);
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        if (pick < bench->options->mix[i]) {
+            return i;
+        }
+        pick -= bench->options->mix[i];
+    }
+
+    return BENCH_GET;
+}
+
+int
+response_cb(int op, netsnmp_session * session, int reqid, netsnmp_pdu * pdu, void *magic)
+{
+    request_t              *request;
+    bench_t                *bench;
+
+    (void) session;
+    (void) reqid;
+
+    request = magic;
+    bench = request->bench;
+
+    if (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE == op) {
+        bench->responses++;
+        if (SNMP_MSG_REPORT == pdu->command || pdu->errstat) {
+            bench->errors++;
+        }
+        vsa_hist_record(&bench->latency[request->type], now_us() - request->sent);
+    } else if (NETSNMP_CALLBACK_OP_TIMED_OUT == op) {
+        bench->timeouts++;
+    }
+
+    bench->inflight--;
+    free(request);
+
+    return 1;
+}
+
+int
+send_request(bench_t * bench)
+{
+    static const int        commands[BENCH_PDUS] = { SNMP_MSG_GET, SNMP_MSG_GETNEXT, SNMP_MSG_GETBULK };
+    request_t              *request;
+    netsnmp_pdu            *pdu;
+    netsnmp_session        *session;
+    vsa_object_t           *object;
+
+    request = calloc(1, sizeof (request_t));
+    if (!request) {
+        vsa_log_warnln("%s", strerror(errno));
+        return -1;
+    }
+    request->bench = bench;
+    request->type = select_type(bench);
+
+    pdu = snmp_pdu_create(commands[request->type]);
+    if (!pdu) {
+        vsa_log_warnln("snmp_pdu_create() failed");
+        free(request);
+        return -1;
+    }
+    if (BENCH_GETBULK == request->type) {
+        pdu->non_repeaters = 0;
+        pdu->max_repetitions = bench->options->max_repetitions;
+    }
+
+    object = bench->index->objects[select_object(bench)];
+    snmp_add_null_var(pdu, object->tree->oids, object->tree->len);
+
+    // SNMPv3 users take turns, as the pollers of as many managers would.
+    session = bench->sessions[bench->next_session];
+    bench->next_session = (bench->next_session + 1) % bench->options->users;
+
+    request->sent = now_us();
+    if (!snmp_async_send(session, pdu, response_cb, request)) {
+        bench->send_errors++;
+        snmp_free_pdu(pdu);
+        free(request);
+        return -1;
+    }
+
+    bench->sent[request->type]++;
+    bench->inflight++;
+
+    return 0;
+}
+
+// Opens a session per SNMPv3 user, NAME1 to NAMEn when there are several, or a single one.
+void
+open_sessions(bench_t * bench)
+{
+    char                   *name;
+    netsnmp_session         session;
+    options_t              *options;
+
+    options = bench->options;
+
+    snmp_sess_init(&session);
+    session.peername = options->peer;
+    session.version = options->version;
+    session.retries = 0;
+    session.timeout = options->timeout * 1000;
+
+    if (SNMP_VERSION_3 == options->version) {
+        session.securityLevel = SNMP_SEC_LEVEL_NOAUTH;
+
+        if (options->auth_pass) {
+            session.securityLevel = SNMP_SEC_LEVEL_AUTHNOPRIV;
+            session.securityAuthProto =
+                sc_get_auth_oid(usm_lookup_auth_type(options->auth_proto), &session.securityAuthProtoLen);
+            session.securityAuthKeyLen = USM_AUTH_KU_LEN;
+            if (SNMPERR_SUCCESS != generate_Ku(session.securityAuthProto, session.securityAuthProtoLen,
+                                               (u_char *) options->auth_pass, strlen(options->auth_pass),
+                                               session.securityAuthKey, &session.securityAuthKeyLen)) {
+                vsa_log_errorln("couldn't generate the authentication key");
+            }
+        }
+
+        if (options->priv_pass) {
+            session.securityLevel = SNMP_SEC_LEVEL_AUTHPRIV;
+            session.securityPrivProto =
+                sc_get_priv_oid(usm_lookup_priv_type(options->priv_proto), &session.securityPrivProtoLen);
+            session.securityPrivKeyLen = USM_PRIV_KU_LEN;
+            if (SNMPERR_SUCCESS != generate_Ku(session.securityAuthProto, session.securityAuthProtoLen,
+                                               (u_char *) options->priv_pass, strlen(options->priv_pass),
+                                               session.securityPrivKey, &session.securityPrivKeyLen)) {
+                vsa_log_errorln("couldn't generate the privacy key");
+            }
+        }
+    } else {
+        session.community = (u_char *) options->community;
+        session.community_len = strlen(options->community);
+    }
+
+    bench->sessions = calloc(options->users, sizeof (netsnmp_session *));
+    if (!bench->sessions) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+
+    for (unsigned i = 0; i < options->users; i++) {
+        name = NULL;
+        if (SNMP_VERSION_3 == options->version) {
+            name = options->users > 1 ? g_strdup_printf("%s%u", options->user, i + 1) : g_strdup(options->user);
+            session.securityName = name;
+            session.securityNameLen = strlen(name);
+        }
+
+        bench->sessions[i] = snmp_open(&session);
+        if (!bench->sessions[i]) {
+            snmp_sess_perror(program_invocation_name, &session);
+            vsa_log_errorln("couldn't open a session to %s", options->peer);
+        }
+        g_free(name);
+    }
+}
+
+void
+report(bench_t * bench, double elapsed)
+{
+    uint64_t                sent;
+    vsa_hist_t              total;
+
+    sent = 0;
+    vsa_hist_init(&total);
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        sent += bench->sent[i];
+        vsa_hist_merge(&total, &bench->latency[i]);
+    }
+
+    printf("duration:   %.2fs\n", elapsed);
+    printf("requests:   %" PRIu64 " sent, %" PRIu64 " responses, %" PRIu64 " errors, %" PRIu64 " timeouts, %" PRIu64
+           " send failures\n", sent, bench->responses, bench->errors, bench->timeouts, bench->send_errors);
+    printf("throughput: %.1f responses/s\n", elapsed > 0 ? bench->responses / elapsed : 0.0);
+    printf("latency:    ");
+    vsa_hist_print(&total, stdout, "us");
+
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        if (!bench->sent[i]) {
+            continue;
+        }
+        printf("  %-8s  %" PRIu64 " sent, ", pdu_names[i], bench->sent[i]);
+        vsa_hist_print(&bench->latency[i], stdout, "us");
+    }
+}
+
+// Parses GET:GETNEXT:GETBULK weights, e.g. 80:15:5.
+void
+parse_mix(const char *str, unsigned *mix)
+{
+    char                   *p;
+    unsigned long           weight, total;
+
+    total = 0;
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        errno = 0;
+        weight = strtoul(str, &p, 10);
+        if (errno || p == str || (i < BENCH_PDUS - 1 ? ':' != *p : '\0' != *p) || weight > 1000000) {
+            vsa_logln(stderr, "invalid mix '%s'", str);
+            exit(EXIT_FAILURE);
+        }
+        mix[i] = weight;
+        total += weight;
+        str = p + 1;
+    }
+
+    if (!total) {
+        vsa_logln(stderr, "the mix must include at least one request type");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Each user gets a session, and so a socket, of its own.
+unsigned
+parse_users(const char *str)
+{
+    char                   *p;
+    unsigned long           users;
+
+    errno = 0;
+    users = strtoul(str, &p, 10);
+    if (errno || p == str || *p || !users || users > BENCH_MAX_USERS) {
+        vsa_logln(stderr, "invalid number of users '%s', must be 1 to %d", str, BENCH_MAX_USERS);
+        exit(EXIT_FAILURE);
+    }
+
+    return users;
+}
+
+void
+parse_select(const char *str, options_t * options)
+{
+    char                   *p;
+
+    if (!strcmp(str, "random")) {
+        options->select = BENCH_SELECT_RANDOM;
+    } else if (!strcmp(str, "walk")) {
+        options->select = BENCH_SELECT_WALK;
+    } else if (!strncmp(str, "hot", 3) && (!str[3] || ':' == str[3])) {
+        options->select = BENCH_SELECT_HOT;
+        if (str[3]) {
+            errno = 0;
+            options->hot = strtoul(str + 4, &p, 10);
+            if (errno || p == str + 4 || *p || !options->hot) {
+                vsa_logln(stderr, "invalid hot set size '%s'", str + 4);
+                exit(EXIT_FAILURE);
+            }
+        }
+    } else {
+        vsa_logln(stderr, "invalid selection '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
+{
+    char                    c;
+    int                     index;
+
+    struct option           long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'v' },
+        { "peer", required_argument, NULL, 'p' },
+        { "protocol", required_argument, NULL, 'P' },
+        { "community", required_argument, NULL, 'c' },
+        { "user", required_argument, NULL, 'u' },
+        { "auth-pass", required_argument, NULL, 'A' },
+        { "priv-pass", required_argument, NULL, 'X' },
+        { "auth-proto", required_argument, NULL, 'a' },
+        { "priv-proto", required_argument, NULL, 'x' },
+        { "users", required_argument, NULL, 'U' },
+        { "mix", required_argument, NULL, 'm' },
+        { "max-repetitions", required_argument, NULL, 'r' },
+        { "concurrency", required_argument, NULL, 'n' },
+        { "rate", required_argument, NULL, 'R' },
+        { "duration", required_argument, NULL, 'd' },
+        { "timeout", required_argument, NULL, 't' },
+        { "select", required_argument, NULL, 's' },
+        { "seed", required_argument, NULL, 'S' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, ":hvp:P:c:u:A:X:a:x:U:m:r:n:R:d:t:s:S:", long_options, &index)) != -1) {
+        switch (c) {
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+            vsa_logln(stdout, PACKAGE_VERSION);
+            exit(EXIT_SUCCESS);
+
+        case 'p':
+            options->peer = optarg;
+            break;
+
+        case 'P':
+            if (!strcmp(optarg, "1")) {
+                options->version = SNMP_VERSION_1;
+            } else if (!strcmp(optarg, "2c")) {
+                options->version = SNMP_VERSION_2c;
+            } else if (!strcmp(optarg, "3")) {
+                options->version = SNMP_VERSION_3;
+            } else {
+                vsa_logln(stderr, "invalid protocol version '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'c':
+            options->community = optarg;
+            break;
+
+        case 'u':
+            options->user = optarg;
+            break;
+
+        case 'A':
+            options->auth_pass = optarg;
+            break;
+
+        case 'X':
+            options->priv_pass = optarg;
+            break;
+
+        case 'a':
+            if (usm_lookup_auth_type(optarg) < 0) {
+                vsa_logln(stderr, "invalid authentication protocol '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            options->auth_proto = optarg;
+            break;
+
+        case 'x':
+            if (usm_lookup_priv_type(optarg) < 0) {
+                vsa_logln(stderr, "invalid privacy protocol '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            options->priv_proto = optarg;
+            break;
+
+        case 'U':
+            options->users = parse_users(optarg);
+            break;
+
+        case 'm':
+            parse_mix(optarg, options->mix);
+            break;
+
+        case 'r':
+            options->max_repetitions = atol(optarg);
+            break;
+
+        case 'n':
+            options->concurrency = atoi(optarg);
+            break;
+
+        case 'R':
+            options->rate = atof(optarg);
+            break;
+
+        case 'd':
+            options->duration = atof(optarg);
+            break;
+
+        case 't':
+            options->timeout = atol(optarg);
+            break;
+
+        case 's':
+            parse_select(optarg, options);
+            break;
+
+        case 'S':
+            options->seed = strtoul(optarg, NULL, 10);
+            break;
+
+        default:
+            vsa_logln(stderr, "invalid option");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc) {
+        vsa_logln(stderr, "missing file name");
+        usage(EXIT_FAILURE);
+    }
+    options->mib = argv[optind];
+
+    if (!options->concurrency || !options->users || options->max_repetitions <= 0 || options->duration <= 0
+        || options->rate < 0 || options->timeout <= 0) {
+        vsa_logln(stderr, "concurrency, users, max repetitions, duration and timeout must be positive");
+        exit(EXIT_FAILURE);
+    }
+    if (SNMP_VERSION_1 == options->version && options->mix[BENCH_GETBULK]) {
+        vsa_logln(stderr, "GETBULK requires SNMPv2c or SNMPv3");
+        exit(EXIT_FAILURE);
+    }
+    if (SNMP_VERSION_3 == options->version && !options->user) {
+        vsa_logln(stderr, "SNMPv3 requires a user name");
+        exit(EXIT_FAILURE);
+    }
+    if (options->priv_pass && !options->auth_pass) {
+        vsa_logln(stderr, "a privacy passphrase requires an authentication passphrase");
+        exit(EXIT_FAILURE);
+    }
+    if (SNMP_VERSION_3 != options->version && options->users > 1) {
+        vsa_logln(stderr, "several users require SNMPv3");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void
+usage(int status)
+{
+    FILE                   *out;
+
+    out = status ? stderr : stdout;
+
+    /* *INDENT-OFF* */
+    fprintf(out,
+"vsa-bench - generate SNMP load against a " PACKAGE " agent and measure its latency\n\n"
+
+"    vsa-bench is part of " PACKAGE_FULL_NAME " toolset\n\n\n"
+
+
+"Usage: vsa-bench [OPTION].. FILE\n\n"
+
+"The vsa-bench program sends GET, GETNEXT and GETBULK requests for the objects in FILE, the SNMP walk output served by the\n"
+"agent under test, for a fixed duration. It then reports the throughput, the number of errors and timeouts, and the\n"
+"latency percentiles of each request type.\n\n\n"
+
+
+"OPTIONS\n\n"
+
+"        -h, --help                 Print this help message.\n"
+"        -v, --version              Print version.\n\n"
+
+"        -p, --peer=ADDRESS         Agent to query, in net-snmp address syntax (default " BENCH_PEER ").\n"
+"        -P, --protocol=VERSION     SNMP version: 1, 2c or 3 (default 2c).\n"
+"        -c, --community=NAME       SNMPv1/v2c community (default " BENCH_COMMUNITY ").\n"
+"        -u, --user=NAME            SNMPv3 user.\n"
+"        -A, --auth-pass=PASS       SNMPv3 authentication passphrase.\n"
+"        -X, --priv-pass=PASS       SNMPv3 privacy passphrase.\n"
+"        -a, --auth-proto=PROTO     SNMPv3 authentication protocol: MD5, SHA, SHA-224, SHA-256, SHA-384 or SHA-512\n"
+"                                   (default SHA).\n"
+"        -x, --priv-proto=PROTO     SNMPv3 privacy protocol: DES or AES (default AES).\n"
+"        -U, --users=N              Spread SNMPv3 requests over the N users NAME1 to NAMEn, a session each, rather than\n"
+"                                   the single user NAME (default 1, at most 10000).\n\n"
+
+"        -m, --mix=GET:GETNEXT:GETBULK\n"
+"                                   Relative weights of the request types (default 1:0:0).\n"
+"        -r, --max-repetitions=N    GETBULK max-repetitions (default 10).\n"
+"        -n, --concurrency=N        Requests kept in flight (default 1).\n"
+"        -R, --rate=N               Target requests per second, 0 for as fast as possible (default 0).\n"
+"        -d, --duration=SECONDS     How long to send requests for (default 10).\n"
+"        -t, --timeout=MS           Time after which a request counts as timed out (default 1000).\n"
+"        -s, --select=MODE          How objects are picked: random, walk (in OID order) or hot[:N] (among N objects\n"
+"                                   picked at random once, default 100) (default random).\n"
+"        -S, --seed=N               Random seed, for repeatable runs (default 1).\n\n\n"
+
+
+PACKAGE_COPYRIGHT "\n\n"
+            );
+    /* *INDENT-ON* */
+    exit(status);
+}
+
+void
+run(int argc, char *argv[])
+{
+    int                     numfds, block;
+    uint64_t                start, end, now, next, total;
+    fd_set                  fds;
+    struct timeval          tv;
+    GList                  *objects;
+    bench_t                 bench;
+    options_t               options = {
+        NULL, BENCH_PEER, SNMP_VERSION_2c, BENCH_COMMUNITY, NULL, NULL, NULL, BENCH_AUTH_PROTO, BENCH_PRIV_PROTO, 1,
+        { 1, 0, 0 }, 10, 1, 0, 10, 1000, BENCH_SELECT_RANDOM, 100, 1
+    };
+
+    parse_args(argc, argv, &options);
+
+    memset(&bench, 0, sizeof (bench));
+    bench.options = &options;
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        vsa_hist_init(&bench.latency[i]);
+    }
+
+    objects = vsa_parser_parse_mib(options.mib);
+    if (!objects) {
+        vsa_log_errorln(VSA_PARSER_PARSE_MIB_ERROR_MSG);
+    }
+    bench.index = vsa_index_new(objects);
+    if (!bench.index) {
+        vsa_log_errorln(VSA_INDEX_NEW_ERROR_MSG);
+    }
+
+    bench.rand = g_rand_new_with_seed(options.seed);
+    if (BENCH_SELECT_HOT == options.select) {
+        if (options.hot > bench.index->len) {
+            options.hot = bench.index->len;
+        }
+        bench.hot = calloc(options.hot, sizeof (size_t));
+        if (!bench.hot) {
+            vsa_log_errorln("%s", strerror(errno));
+        }
+        for (size_t i = 0; i < options.hot; i++) {
+            bench.hot[i] = g_rand_int_range(bench.rand, 0, bench.index->len);
+        }
+    }
+
+    init_snmp(program_invocation_name);
+    open_sessions(&bench);
+
+    start = now_us();
+    end = start + options.duration * 1000000;
+    total = 0;
+
+    for (now = start; now < end || bench.inflight; now = now_us()) {
+        // Requests are paced from the start time so that a slow period is made up for afterwards.
+        next = now;
+        while (now < end && bench.inflight < options.concurrency) {
+            if (options.rate) {
+                next = start + total * 1000000 / options.rate;
+                if (next > now) {
+                    break;
+                }
+            }
+            total++;
+            if (send_request(&bench)) {
+                break;
+            }
+        }
+
+        FD_ZERO(&fds);
+        numfds = 0;
+        block = 0;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        if (next > now && next - now < (uint64_t) tv.tv_usec) {
+            tv.tv_usec = next - now;
+        }
+        snmp_select_info(&numfds, &fds, &tv, &block);
+
+        if (select(numfds, &fds, NULL, NULL, &tv) > 0) {
+            snmp_read(&fds);
+        } else {
+            snmp_timeout();
+        }
+    }
+
+    report(&bench, (now - start) / 1000000.0);
+
+    for (unsigned i = 0; i < options.users; i++) {
+        snmp_close(bench.sessions[i]);
+    }
+    free(bench.sessions);
+    snmp_shutdown(program_invocation_name);
+    g_rand_free(bench.rand);
+    free(bench.hot);
+    vsa_index_free(bench.index);
+}
+
+int
+main(int argc, char *argv[])
+{
+    run(argc, argv);
+    return EXIT_SUCCESS;
+}
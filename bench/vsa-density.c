@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/hist.h>
+#include <vsa/log.h>
+
+#define DENSITY_VSA "../src/vsa"
+#define DENSITY_STEPS "1,10,100,1000"
+#define DENSITY_PORT_BASE 20000
+#define DENSITY_COMMUNITY "public"
+
+// How often an agent that's starting is probed, and for how long.
+#define DENSITY_PROBE_MS 10
+#define DENSITY_STARTUP_TIMEOUT_S 120
+
+typedef struct options_s options_t;
+typedef struct agent_s agent_t;
+typedef struct step_s step_t;
+
+struct options_s {
+    char                   *vsa;
+    char                   *community;
+    unsigned                port_base;
+    unsigned                idle;
+    unsigned               *steps;
+    size_t                  nsteps;
+    char                  **walks;
+    size_t                  nwalks;
+    char                  **args;
+    size_t                  nargs;
+};
+
+struct agent_s {
+    pid_t                   pid;
+    unsigned                port;
+    guint64                 startup_us;
+    unsigned long           ticks;
+};
+
+// Measurements of all the agents running at one step.
+struct step_s {
+    vsa_hist_t              startup;
+    unsigned long           rss_kb;
+    unsigned long           pss_kb;
+    unsigned long           max_rss_kb;
+    double                  idle_cpu;
+    double                  max_idle_cpu;
+    long                    mem_used_kb;
+    unsigned                failed;
+};
+
+char                   *program_invocation_name = "vsa-density";
+
+guint64                 now_us(void);
+pid_t                   spawn_agent(options_t * options, agent_t * agent, const char *walk);
+int                     probe_agent(options_t * options, agent_t * agent, guint64 spawned);
+int                     read_ticks(pid_t pid, unsigned long *ticks);
+int                     read_mem(pid_t pid, unsigned long *rss_kb, unsigned long *pss_kb);
+long                    read_mem_available(void);
+void                    print_step(options_t * options, size_t nagents, step_t * step);
+void                    stop_agents(agent_t * agents, size_t nagents);
+void                    parse_steps(const char *str, options_t * options);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+guint64
+now_us(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+pid_t
+spawn_agent(options_t * options, agent_t * agent, const char *walk)
+{
+    int                     fd;
+    char                   *listen, **argv;
+    size_t                  argc;
+
+    if (-1 == asprintf(&listen, "--listen=udp:127.0.0.1:%u", agent->port)) {
+        vsa_log_warnln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
+        return -1;
+    }
+
+    argv = calloc(options->nargs + 4, sizeof (char *));
+    if (!argv) {
+        vsa_log_warnln("%s", strerror(errno));
+        free(listen);
+        return -1;
+    }
+    argc = 0;
+    argv[argc++] = options->vsa;
+    argv[argc++] = listen;
+    for (size_t i = 0; i < options->nargs; i++) {
+        argv[argc++] = options->args[i];
+    }
+    argv[argc++] = (char *) walk;
+
+    agent->pid = fork();
+    if (!agent->pid) {
+        fd = open("/dev/null", O_RDWR);
+        if (-1 != fd) {
+            dup2(fd, STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execv(options->vsa, argv);
+        _exit(127);
+    }
+    if (-1 == agent->pid) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    free(argv);
+    free(listen);
+
+    return agent->pid;
+}
+
+// Polls the agent until it answers a GETNEXT, and records how long it took since it was spawned.
+int
+probe_agent(options_t * options, agent_t * agent, guint64 spawned)
+{
+    int                     status;
+    oid                     root[] = { 1 };
+    char                   *peer;
+    netsnmp_session         session, *ss;
+    netsnmp_pdu            *pdu, *response;
+    guint64                 deadline;
+
+    if (-1 == asprintf(&peer, "udp:127.0.0.1:%u", agent->port)) {
+        vsa_log_warnln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
+        return -1;
+    }
+
+    snmp_sess_init(&session);
+    session.peername = peer;
+    session.version = SNMP_VERSION_2c;
+    session.community = (u_char *) options->community;
+    session.community_len = strlen(options->community);
+    session.retries = 0;
+    session.timeout = DENSITY_PROBE_MS * 1000;
+
+    ss = snmp_open(&session);
+    free(peer);
+    if (!ss) {
+        snmp_sess_perror(program_invocation_name, &session);
+        return -1;
+    }
+
+    deadline = spawned + DENSITY_STARTUP_TIMEOUT_S * 1000000ULL;
+    status = STAT_ERROR;
+    while (now_us() < deadline) {
+        if (waitpid(agent->pid, NULL, WNOHANG)) {
+            vsa_log_warnln("agent on port %u exited", agent->port);
+            agent->pid = -1;
+            break;
+        }
+
+        pdu = snmp_pdu_create(SNMP_MSG_GETNEXT);
+        snmp_add_null_var(pdu, root, G_N_ELEMENTS(root));
+        response = NULL;
+        status = snmp_synch_response(ss, pdu, &response);
+        if (response) {
+            snmp_free_pdu(response);
+        }
+        if (STAT_SUCCESS == status) {
+            agent->startup_us = now_us() - spawned;
+            break;
+        }
+        if (STAT_TIMEOUT != status) {
+            // Nothing listens on the port yet.
+            usleep(DENSITY_PROBE_MS * 1000);
+        }
+    }
+    snmp_close(ss);
+
+    return STAT_SUCCESS == status ? 0 : -1;
+}
+
+// User and system CPU time used by a process, in clock ticks.
+int
+read_ticks(pid_t pid, unsigned long *ticks)
+{
+    char                    path[64], buf[1024], *p;
+    unsigned long           utime, stime;
+    FILE                   *fp;
+
+    snprintf(path, sizeof (path), "/proc/%d/stat", (int) pid);
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    p = fgets(buf, sizeof (buf), fp);
+    fclose(fp);
+
+    // The command name may contain spaces, the fields after it don't.
+    if (!p || !(p = strrchr(buf, ')'))) {
+        return -1;
+    }
+    if (2 != sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime)) {
+        return -1;
+    }
+    *ticks = utime + stime;
+
+    return 0;
+}
+
+int
+read_mem(pid_t pid, unsigned long *rss_kb, unsigned long *pss_kb)
+{
+    char                    path[64], line[256];
+    FILE                   *fp;
+
+    snprintf(path, sizeof (path), "/proc/%d/smaps_rollup", (int) pid);
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    *rss_kb = *pss_kb = 0;
+    while (fgets(line, sizeof (line), fp)) {
+        sscanf(line, "Rss: %lu kB", rss_kb);
+        sscanf(line, "Pss: %lu kB", pss_kb);
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+long
+read_mem_available(void)
+{
+    char                    line[256];
+    long                    kb;
+    FILE                   *fp;
+
+    fp = fopen("/proc/meminfo", "r");
+    if (!fp) {
+        return 0;
+    }
+
+    kb = 0;
+    while (fgets(line, sizeof (line), fp)) {
+        if (1 == sscanf(line, "MemAvailable: %ld kB", &kb)) {
+            break;
+        }
+    }
+    fclose(fp);
+
+    return kb;
+}
+
+// One JSON object per line.
+void
+print_step(options_t * options, size_t nagents, step_t * step)
+{
+    size_t                  running;
+
+    running = nagents - step->failed;
+
+    printf("{\"version\":\"%s\",\"agents\":%zu,\"failed\":%u,\"walks\":%zu,", PACKAGE_VERSION, nagents, step->failed,
+           options->nwalks);
+    printf("\"startup_ms\":{\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f,\"mean\":%.1f},",
+           vsa_hist_percentile(&step->startup, 50.0) / 1000.0, vsa_hist_percentile(&step->startup, 99.0) / 1000.0,
+           step->startup.max / 1000.0, vsa_hist_mean(&step->startup) / 1000.0);
+    printf("\"rss_kb\":{\"mean\":%.0f,\"max\":%lu,\"total\":%lu},", running ? (double) step->rss_kb / running : 0.0,
+           step->max_rss_kb, step->rss_kb);
+    printf("\"pss_kb\":{\"mean\":%.0f,\"total\":%lu},", running ? (double) step->pss_kb / running : 0.0,
+           step->pss_kb);
+    printf("\"idle_cpu_pct\":{\"mean\":%.3f,\"max\":%.3f,\"total\":%.3f},",
+           running ? step->idle_cpu / running : 0.0, step->max_idle_cpu, step->idle_cpu);
+    printf("\"mem_used_kb\":%ld}\n", step->mem_used_kb);
+    fflush(stdout);
+}
+
+void
+stop_agents(agent_t * agents, size_t nagents)
+{
+    for (size_t i = 0; i < nagents; i++) {
+        if (agents[i].pid > 0) {
+            kill(agents[i].pid, SIGTERM);
+        }
+    }
+    for (size_t i = 0; i < nagents; i++) {
+        if (agents[i].pid > 0) {
+            waitpid(agents[i].pid, NULL, 0);
+        }
+    }
+}
+
+void
+parse_steps(const char *str, options_t * options)
+{
+    char                   *p;
+    unsigned long           n, last;
+
+    options->nsteps = 0;
+    last = 0;
+    while (*str) {
+        errno = 0;
+        n = strtoul(str, &p, 10);
+        if (errno || p == str || n <= last || (*p && ',' != *p)) {
+            vsa_logln(stderr, "invalid steps '%s', expected increasing numbers of agents", str);
+            exit(EXIT_FAILURE);
+        }
+        options->steps = realloc(options->steps, ++options->nsteps * sizeof (unsigned));
+        if (!options->steps) {
+            vsa_log_errorln("%s", strerror(errno));
+        }
+        options->steps[options->nsteps - 1] = last = n;
+        str = *p ? p + 1 : p;
+    }
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
+{
+    char                    c;
+    int                     index, end;
+
+    struct option           long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'v' },
+        { "vsa", required_argument, NULL, 'x' },
+        { "steps", required_argument, NULL, 'n' },
+        { "port-base", required_argument, NULL, 'p' },
+        { "idle", required_argument, NULL, 'i' },
+        { "community", required_argument, NULL, 'c' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, ":hvx:n:p:i:c:", long_options, &index)) != -1) {
+        switch (c) {
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+            vsa_logln(stdout, PACKAGE_VERSION);
+            exit(EXIT_SUCCESS);
+
+        case 'x':
+            options->vsa = optarg;
+            break;
+
+        case 'n':
+            parse_steps(optarg, options);
+            break;
+
+        case 'p':
+            options->port_base = atoi(optarg);
+            break;
+
+        case 'i':
+            options->idle = atoi(optarg);
+            break;
+
+        case 'c':
+            options->community = optarg;
+            break;
+
+        default:
+            vsa_logln(stderr, "invalid option");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Walks come first, then the arguments passed on to vsa after --.
+    for (end = optind; end < argc && strcmp(argv[end], "--"); end++);
+    options->walks = argv + optind;
+    options->nwalks = end - optind;
+    if (end < argc) {
+        options->args = argv + end + 1;
+        options->nargs = argc - end - 1;
+    }
+
+    if (!options->nwalks) {
+        vsa_logln(stderr, "missing file name");
+        usage(EXIT_FAILURE);
+    }
+    if (!options->idle || !options->port_base
+        || options->port_base + options->steps[options->nsteps - 1] > 65536) {
+        vsa_logln(stderr, "invalid idle time or port range");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void
+usage(int status)
+{
+    FILE                   *out;
+
+    out = status ? stderr : stdout;
+
+    /* *INDENT-OFF* */
+    fprintf(out,
+"vsa-density - measure how many " PACKAGE " agents fit on a host\n\n"
+
+"    vsa-density is part of " PACKAGE_FULL_NAME " toolset\n\n\n"
+
+
+"Usage: vsa-density [OPTION].. FILE.. [-- VSA_ARG..]\n\n"
+
+"The vsa-density program starts growing numbers of " PACKAGE " agents, one process each on its own loopback port, serving the\n"
+"given walk files in turn. At each step it reports, as one line of JSON, the time agents took from being started to\n"
+"answering their first request, their RSS and PSS, the CPU they use while idle, and the host memory used by all of them.\n"
+"The agents find " PACKAGE ".conf as usual, e.g. through the SNMPCONFPATH environment variable.\n\n\n"
+
+
+"OPTIONS\n\n"
+
+"        -h, --help             Print this help message.\n"
+"        -v, --version          Print version.\n\n"
+
+"        -x, --vsa=PATH         The " PACKAGE " binary (default " DENSITY_VSA ").\n"
+"        -n, --steps=N,..       Numbers of agents to measure at (default " DENSITY_STEPS ").\n"
+"        -p, --port-base=PORT   First port, agents listen on consecutive ones (default %d).\n"
+"        -i, --idle=SECONDS     How long idle CPU usage is measured at each step (default 10).\n"
+"        -c, --community=NAME   Community the agents answer to (default " DENSITY_COMMUNITY ").\n\n\n"
+
+
+PACKAGE_COPYRIGHT "\n\n",
+            DENSITY_PORT_BASE);
+    /* *INDENT-ON* */
+    exit(status);
+}
+
+void
+run(int argc, char *argv[])
+{
+    long                    ticks_per_s, mem_available;
+    double                  cpu;
+    size_t                  nagents, max;
+    unsigned long           rss_kb, pss_kb, ticks;
+    guint64                 spawned, idle_start, idle_us;
+    agent_t                *agents;
+    step_t                  step;
+    options_t               options = {
+        DENSITY_VSA, DENSITY_COMMUNITY, DENSITY_PORT_BASE, 10, NULL, 0, NULL, 0, NULL, 0
+    };
+
+    parse_steps(DENSITY_STEPS, &options);
+    parse_args(argc, argv, &options);
+
+    max = options.steps[options.nsteps - 1];
+    agents = calloc(max, sizeof (agent_t));
+    if (!agents) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+
+    init_snmp(program_invocation_name);
+    ticks_per_s = sysconf(_SC_CLK_TCK);
+    mem_available = read_mem_available();
+
+    nagents = 0;
+    for (size_t s = 0; s < options.nsteps; s++) {
+        memset(&step, 0, sizeof (step));
+        vsa_hist_init(&step.startup);
+
+        // Agents are started one at a time so that each startup is timed on its own.
+        vsa_logln(stderr, "starting agents %zu to %u", nagents + 1, options.steps[s]);
+        for (; nagents < options.steps[s]; nagents++) {
+            agents[nagents].port = options.port_base + nagents;
+            spawned = now_us();
+            if (-1 == spawn_agent(&options, &agents[nagents], options.walks[nagents % options.nwalks])) {
+                vsa_log_warnln("couldn't start agent %zu", nagents + 1);
+                continue;
+            }
+            if (probe_agent(&options, &agents[nagents], spawned)) {
+                vsa_log_warnln("agent on port %u didn't answer", agents[nagents].port);
+            }
+        }
+
+        for (size_t i = 0; i < nagents; i++) {
+            if (agents[i].pid > 0 && read_ticks(agents[i].pid, &agents[i].ticks)) {
+                agents[i].pid = -1;
+            }
+        }
+
+        vsa_logln(stderr, "measuring %zu idle agents for %us", nagents, options.idle);
+        idle_start = now_us();
+        sleep(options.idle);
+        idle_us = now_us() - idle_start;
+
+        for (size_t i = 0; i < nagents; i++) {
+            if (agents[i].pid <= 0 || !agents[i].startup_us || read_ticks(agents[i].pid, &ticks)
+                || read_mem(agents[i].pid, &rss_kb, &pss_kb)) {
+                step.failed++;
+                continue;
+            }
+            vsa_hist_record(&step.startup, agents[i].startup_us);
+
+            // Percent of one CPU.
+            cpu = 100.0 * (ticks - agents[i].ticks) / ticks_per_s / (idle_us / 1e6);
+            step.idle_cpu += cpu;
+            if (cpu > step.max_idle_cpu) {
+                step.max_idle_cpu = cpu;
+            }
+
+            step.rss_kb += rss_kb;
+            step.pss_kb += pss_kb;
+            if (rss_kb > step.max_rss_kb) {
+                step.max_rss_kb = rss_kb;
+            }
+        }
+        step.mem_used_kb = mem_available - read_mem_available();
+
+        print_step(&options, nagents, &step);
+    }
+
+    vsa_logln(stderr, "stopping %zu agents", nagents);
+    stop_agents(agents, nagents);
+    snmp_shutdown(program_invocation_name);
+
+    free(agents);
+    free(options.steps);
+}
+
+int
+main(int argc, char *argv[])
+{
+    run(argc, argv);
+    return EXIT_SUCCESS;
+}
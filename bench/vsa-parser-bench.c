@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <vsa/index.h>
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/parser.h>
+
+typedef struct options_s options_t;
+
+struct options_s {
+    char                   *mib;
+    unsigned                repeat;
+};
+
+char                   *program_invocation_name = "vsa-parser-bench";
+
+guint64                 now_ns(void);
+void                    print_stage(const char *name, guint64 ns, guint64 total_ns);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+guint64
+now_ns(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+print_stage(const char *name, guint64 ns, guint64 total_ns)
+{
+    printf("  %-8s %10.3fs %6.1f%%\n", name, ns / 1e9, total_ns ? 100.0 * ns / total_ns : 0.0);
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
+{
+    char                    c;
+    int                     index;
+
+    struct option           long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'v' },
+        { "repeat", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, ":hvr:", long_options, &index)) != -1) {
+        switch (c) {
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+            vsa_logln(stdout, PACKAGE_VERSION);
+            exit(EXIT_SUCCESS);
+
+        case 'r':
+            options->repeat = atoi(optarg);
+            if (!options->repeat) {
+                vsa_logln(stderr, "invalid repeat count '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        default:
+            vsa_logln(stderr, "invalid option");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc) {
+        vsa_logln(stderr, "missing file name");
+        usage(EXIT_FAILURE);
+    }
+    options->mib = argv[optind];
+}
+
+void
+usage(int status)
+{
+    FILE                   *out;
+
+    out = status ? stderr : stdout;
+
+    /* *INDENT-OFF* */
+    fprintf(out,
+"vsa-parser-bench - time the loading of an SNMP walk output\n\n"
+
+"    vsa-parser-bench is part of " PACKAGE_FULL_NAME " toolset\n\n\n"
+
+
+"Usage: vsa-parser-bench [OPTION].. FILE\n\n"
+
+"The vsa-parser-bench program loads FILE the way " PACKAGE " does and reports the time spent in each stage of the parser\n"
+"(reading and matching lines, parsing OIDs, building values and the object list) and in indexing, the throughput in\n"
+"objects and bytes per second, and the peak resident set size.\n\n\n"
+
+
+"OPTIONS\n\n"
+
+"        -h, --help         Print this help message.\n"
+"        -v, --version      Print version.\n\n"
+
+"        -r, --repeat=N     Load FILE N times and report the totals (default 1).\n\n\n"
+
+
+PACKAGE_COPYRIGHT "\n\n"
+            );
+    /* *INDENT-ON* */
+    exit(status);
+}
+
+void
+run(int argc, char *argv[])
+{
+    guint64                 start, parse_ns, index_ns, free_ns, total_ns;
+    struct rusage           usage;
+    GList                  *objects;
+    vsa_index_t            *index;
+    vsa_parser_stats_t      stats;
+    options_t               options = { NULL, 1 };
+
+    parse_args(argc, argv, &options);
+
+    memset(&stats, 0, sizeof (stats));
+    vsa_parser_set_stats(&stats);
+
+    parse_ns = index_ns = free_ns = 0;
+    for (unsigned i = 0; i < options.repeat; i++) {
+        start = now_ns();
+        objects = vsa_parser_parse_mib(options.mib);
+        if (!objects) {
+            vsa_log_errorln(VSA_PARSER_PARSE_MIB_ERROR_MSG);
+        }
+        parse_ns += now_ns() - start;
+
+        start = now_ns();
+        index = vsa_index_new(objects);
+        if (!index) {
+            vsa_log_errorln(VSA_INDEX_NEW_ERROR_MSG);
+        }
+        index_ns += now_ns() - start;
+
+        start = now_ns();
+        vsa_index_free(index);
+        free_ns += now_ns() - start;
+    }
+
+    vsa_parser_set_stats(NULL);
+
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+
+    total_ns = parse_ns + index_ns;
+
+    printf("file:     %s\n", options.mib);
+    printf("loads:    %u\n", options.repeat);
+    printf("input:    %" G_GUINT64_FORMAT " objects, %" G_GUINT64_FORMAT " lines, %" G_GUINT64_FORMAT " bytes\n",
+           stats.objects, stats.lines, stats.bytes);
+    printf("load:     %.3fs, %.0f objects/s, %.1f MB/s\n", total_ns / 1e9,
+           total_ns ? stats.objects / (total_ns / 1e9) : 0.0, total_ns ? stats.bytes / (total_ns / 1e9) / 1e6 : 0.0);
+    print_stage("read", stats.read_ns, total_ns);
+    print_stage("match", stats.match_ns, total_ns);
+    print_stage("oid", stats.oid_ns, total_ns);
+    print_stage("value", stats.value_ns, total_ns);
+    print_stage("list", stats.list_ns, total_ns);
+    print_stage("other", parse_ns - MIN(parse_ns, stats.read_ns + stats.match_ns + stats.oid_ns + stats.value_ns
+                                        + stats.list_ns), total_ns);
+    print_stage("index", index_ns, total_ns);
+    printf("free:     %.3fs\n", free_ns / 1e9);
+    printf("peak RSS: %ld KB\n", usage.ru_maxrss);
+}
+
+int
+main(int argc, char *argv[])
+{
+    run(argc, argv);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+
+// Objects are laid out as tables of WALKGEN_COLUMNS columns by WALKGEN_ROWS rows under this enterprise prefix.
+#define WALKGEN_PREFIX ".1.3.6.1.4.1.99999"
+#define WALKGEN_COLUMNS 24
+#define WALKGEN_ROWS 1000
+
+#define WALKGEN_LONG_HEX_MIN 256
+#define WALKGEN_LONG_HEX_MAX 1024
+
+typedef struct options_s options_t;
+
+enum {
+    WALKGEN_INTEGER,
+    WALKGEN_COUNTER_32,
+    WALKGEN_COUNTER_64,
+    WALKGEN_GAUGE_32,
+    WALKGEN_TIMETICKS,
+    WALKGEN_STRING,
+    WALKGEN_MULTILINE_STRING,
+    WALKGEN_HEX_STRING,
+    WALKGEN_LONG_HEX_STRING,
+    WALKGEN_IP_ADDRESS,
+    WALKGEN_OID,
+    WALKGEN_TYPES
+};
+
+struct options_s {
+    unsigned long           objects;
+    guint32                 seed;
+    char                   *output;
+};
+
+/*
+ * Share of columns of each type, in percent, roughly as seen in walks of switches and routers: mostly integers and
+ * counters, some interface names and descriptions, MAC addresses and a few large binary blobs.
+ */
+static const unsigned   weights[WALKGEN_TYPES] = { 24, 22, 10, 10, 4, 12, 3, 8, 1, 4, 2 };
+
+static const char      *words[] = {
+    "GigabitEthernet", "port", "uplink", "core", "access", "vlan", "trunk", "management", "backup", "primary",
+    "Linux", "router", "switch", "rack", "floor", "building", "link", "to", "from", "customer"
+};
+
+char                   *program_invocation_name = "vsa-walkgen";
+
+int                     pick_type(GRand * rand);
+void                    print_words(FILE * out, GRand * rand, int count);
+void                    print_hex(FILE * out, GRand * rand, int len);
+void                    print_value(FILE * out, GRand * rand, int type, unsigned long row);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+int
+pick_type(GRand * rand)
+{
+    int                     pick;
+
+    pick = g_rand_int_range(rand, 0, 100);
+    for (int i = 0; i < WALKGEN_TYPES; i++) {
+        if (pick < (int) weights[i]) {
+            return i;
+        }
+        pick -= weights[i];
+    }
+
+    return WALKGEN_INTEGER;
+}
+
+void
+print_words(FILE * out, GRand * rand, int count)
+{
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%s", i ? " " : "", words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+    }
+}
+
+// snmpwalk prints 16 bytes per line, with a trailing space.
+void
+print_hex(FILE * out, GRand * rand, int len)
+{
+    for (int i = 0; i < len; i++) {
+        fprintf(out, "%02X%s", g_rand_int_range(rand, 0, 256), (i + 1) % 16 && i + 1 < len ? " " : " \n");
+    }
+}
+
+void
+print_value(FILE * out, GRand * rand, int type, unsigned long row)
+{
+    guint64                 counter;
+
+    switch (type) {
+    case WALKGEN_INTEGER:
+        fprintf(out, "INTEGER: %d\n", g_rand_int_range(rand, 0, 7));
+        break;
+
+    case WALKGEN_COUNTER_32:
+        fprintf(out, "Counter32: %u\n", g_rand_int(rand));
+        break;
+
+    case WALKGEN_COUNTER_64:
+        counter = (guint64) g_rand_int(rand) << 20 | g_rand_int(rand);
+        fprintf(out, "Counter64: %" G_GUINT64_FORMAT "\n", counter);
+        break;
+
+    case WALKGEN_GAUGE_32:
+        fprintf(out, "Gauge32: %d\n", g_rand_int_range(rand, 0, 1000000000));
+        break;
+
+    case WALKGEN_TIMETICKS:
+        counter = g_rand_int_range(rand, 0, G_MAXINT32);
+        fprintf(out, "Timeticks: (%" G_GUINT64_FORMAT ") %" G_GUINT64_FORMAT " days, %d:%02d:%02d.%02d\n", counter,
+                counter / 8640000, (int) (counter / 360000 % 24), (int) (counter / 6000 % 60),
+                (int) (counter / 100 % 60), (int) (counter % 100));
+        break;
+
+    case WALKGEN_STRING:
+        fprintf(out, "STRING: \"");
+        print_words(out, rand, g_rand_int_range(rand, 1, 6));
+        fprintf(out, " %lu\"\n", row);
+        break;
+
+    case WALKGEN_MULTILINE_STRING:
+        fprintf(out, "STRING: \"");
+        for (int i = g_rand_int_range(rand, 2, 6); i; i--) {
+            print_words(out, rand, g_rand_int_range(rand, 3, 10));
+            fprintf(out, "%s", i > 1 ? "\n" : "");
+        }
+        fprintf(out, "\"\n");
+        break;
+
+    case WALKGEN_HEX_STRING:
+        fprintf(out, "Hex-STRING: ");
+        print_hex(out, rand, 6);
+        break;
+
+    case WALKGEN_LONG_HEX_STRING:
+        fprintf(out, "Hex-STRING: ");
+        print_hex(out, rand, g_rand_int_range(rand, WALKGEN_LONG_HEX_MIN, WALKGEN_LONG_HEX_MAX + 1));
+        break;
+
+    case WALKGEN_IP_ADDRESS:
+        fprintf(out, "IpAddress: 10.%lu.%lu.%d\n", row >> 8 & 0xff, row & 0xff, g_rand_int_range(rand, 1, 255));
+        break;
+
+    case WALKGEN_OID:
+        fprintf(out, "OID: .1.3.6.1.4.1.%d.%lu\n", g_rand_int_range(rand, 1, 60000), row);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
+{
+    char                    c, *p;
+    int                     index;
+
+    struct option           long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'v' },
+        { "objects", required_argument, NULL, 'n' },
+        { "seed", required_argument, NULL, 'S' },
+        { "output", required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, ":hvn:S:o:", long_options, &index)) != -1) {
+        switch (c) {
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+            vsa_logln(stdout, PACKAGE_VERSION);
+            exit(EXIT_SUCCESS);
+
+        case 'n':
+            errno = 0;
+            options->objects = strtoul(optarg, &p, 10);
+            if (errno || p == optarg || *p || !options->objects) {
+                vsa_logln(stderr, "invalid number of objects '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'S':
+            options->seed = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'o':
+            options->output = optarg;
+            break;
+
+        default:
+            vsa_logln(stderr, "invalid option");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void
+usage(int status)
+{
+    FILE                   *out;
+
+    out = status ? stderr : stdout;
+
+    /* *INDENT-OFF* */
+    fprintf(out,
+"vsa-walkgen - generate synthetic SNMP walk outputs\n\n"
+
+"    vsa-walkgen is part of " PACKAGE_FULL_NAME " toolset\n\n\n"
+
+
+"Usage: vsa-walkgen [OPTION]..\n\n"
+
+"The vsa-walkgen program writes a walk output, as printed by snmpwalk -On, of tables of objects under " WALKGEN_PREFIX ".\n"
+"The mix of types is close to that of real network devices and includes multi-line strings and long hex blobs. The same\n"
+"seed always gives the same walk.\n\n\n"
+
+
+"OPTIONS\n\n"
+
+"        -h, --help           Print this help message.\n"
+"        -v, --version        Print version.\n\n"
+
+"        -n, --objects=N      Number of objects (default 10000).\n"
+"        -S, --seed=N         Random seed (default 1).\n"
+"        -o, --output=FILE    Write to FILE instead of the standard output.\n\n\n"
+
+
+PACKAGE_COPYRIGHT "\n\n"
+            );
+    /* *INDENT-ON* */
+    exit(status);
+}
+
+void
+run(int argc, char *argv[])
+{
+    FILE                   *out;
+    GRand                  *rand;
+    int                     types[WALKGEN_COLUMNS];
+    options_t               options = { 10000, 1, NULL };
+    unsigned long           count, table, column, row, rows;
+
+    parse_args(argc, argv, &options);
+
+    out = stdout;
+    if (options.output) {
+        out = fopen(options.output, "w");
+        if (!out) {
+            vsa_log_errorln("%s: %s", options.output, strerror(errno));
+        }
+    }
+
+    rand = g_rand_new_with_seed(options.seed);
+
+    // Tables are walked column by column, which also keeps the objects in OID order.
+    count = 0;
+    for (table = 1; count < options.objects; table++) {
+        for (column = 0; column < WALKGEN_COLUMNS; column++) {
+            types[column] = pick_type(rand);
+        }
+
+        rows = (options.objects - count + WALKGEN_COLUMNS - 1) / WALKGEN_COLUMNS;
+        if (rows > WALKGEN_ROWS) {
+            rows = WALKGEN_ROWS;
+        }
+
+        for (column = 0; column < WALKGEN_COLUMNS && count < options.objects; column++) {
+            for (row = 1; row <= rows && count < options.objects; row++, count++) {
+                fprintf(out, WALKGEN_PREFIX ".%lu.1.%lu.%lu = ", table, column + 1, row);
+                print_value(out, rand, types[column], row);
+            }
+        }
+    }
+
+    g_rand_free(rand);
+
+    if (ferror(out) || (options.output && fclose(out))) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    run(argc, argv);
+    return EXIT_SUCCESS;
+}
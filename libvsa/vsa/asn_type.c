@@ -18,63 +18,100 @@
  *
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <vsa/log.h>
 #include <vsa/asn_type.h>
+#include <vsa/value.h>
 
-static const struct {
-    vsa_asn_type_t          type;
+#define VSA_ASN_TAG(name, len, first, second, last, type) \
+    [VSA_ASN_TAG_HASH(len, first, second, last)] = { name, len, type }
+
+typedef struct vsa_asn_tag_s vsa_asn_tag_t;
+
+struct vsa_asn_tag_s {
     const char             *name;
     size_t                  len;
-} types[] = {
-    { VSA_ASN_BIT, "BIT", 3 },
-    { VSA_ASN_COUNTER_32, "COUNTER32", 9 },
-    { VSA_ASN_COUNTER_64, "COUNTER64", 9 },
-    { VSA_ASN_GAUGE_32, "GAUGE32", 7 },
-    { VSA_ASN_HEX_STRING, "HEX-STRING", 10 },
-    { VSA_ASN_INTEGER, "INTEGER", 7 },
-    { VSA_ASN_IP_ADDRESS, "IPADDRESS", 9 },
-    { VSA_ASN_NETWORK_ADDRESS, "NETWORK ADDRESS", 15 },
-    { VSA_ASN_OCTET_STRING, "OCTETSTRING", 11 },
-    { VSA_ASN_OID, "OID", 3 },
-    { VSA_ASN_STRING, "STRING", 6 },
-    { VSA_ASN_TIMETICKS, "TIMETICKS", 9 },
-    { VSA_ASN_UNKNOWN, "UNKNOWN", 0 }
+    vsa_asn_type_t          type;
+};
+
+static const vsa_asn_type_info_t infos[VSA_ASN_LEN] = {
+    [VSA_ASN_UNKNOWN] = { "UNKNOWN", ASN_NULL, 0, NULL },
+    [VSA_ASN_BIT] = { "BIT", ASN_BIT_STR, VSA_ASN_WRITABLE, &vsa_value_bytes_ops },
+    [VSA_ASN_COUNTER_32] = { "COUNTER32", ASN_COUNTER, 0, &vsa_value_ulong_ops },
+    [VSA_ASN_COUNTER_64] = { "COUNTER64", ASN_COUNTER64, 0, &vsa_value_counter64_ops },
+    [VSA_ASN_GAUGE_32] = { "GAUGE32", ASN_GAUGE, VSA_ASN_WRITABLE, &vsa_value_ulong_ops },
+    [VSA_ASN_HEX_STRING] = { "HEX-STRING", ASN_OCTET_STR, VSA_ASN_WRITABLE, &vsa_value_bytes_ops },
+    [VSA_ASN_INTEGER] = { "INTEGER", ASN_INTEGER, VSA_ASN_WRITABLE, &vsa_value_int_ops },
+    [VSA_ASN_IP_ADDRESS] = { "IPADDRESS", ASN_IPADDRESS, VSA_ASN_WRITABLE, &vsa_value_ip_ops },
+    [VSA_ASN_NETWORK_ADDRESS] =
+        { "NETWORK ADDRESS", ASN_IPADDRESS, VSA_ASN_WRITABLE | VSA_ASN_FIXED_SIZE, &vsa_value_bytes_ops },
+    [VSA_ASN_OCTET_STRING] = { "OCTETSTRING", ASN_OCTET_STR, VSA_ASN_WRITABLE, &vsa_value_string_ops },
+    [VSA_ASN_OID] = { "OID", ASN_OBJECT_ID, VSA_ASN_WRITABLE, &vsa_value_oid_ops },
+    [VSA_ASN_STRING] = { "STRING", ASN_OCTET_STR, VSA_ASN_WRITABLE, &vsa_value_string_ops },
+    [VSA_ASN_TIMETICKS] = { "TIMETICKS", ASN_TIMETICKS, VSA_ASN_WRITABLE, &vsa_value_ulong_ops },
+    [VSA_ASN_UNSIGNED_32] = { "UNSIGNED32", ASN_UNSIGNED, VSA_ASN_WRITABLE, &vsa_value_ulong_ops },
+    [VSA_ASN_OPAQUE] = { "OPAQUE", ASN_OPAQUE, VSA_ASN_WRITABLE, &vsa_value_bytes_ops }
 };
 
+/*
+ * The type tags of walks, as net-snmp prints them and as dumps write them, in the slot of their hash. Two tags sharing
+ * a slot would override one another, which -Woverride-init turns into a build error.
+ */
+static const vsa_asn_tag_t tags[VSA_ASN_TAG_SLOTS] = {
+    VSA_ASN_TAG("BIT", 3, 'B', 'I', 'T', VSA_ASN_BIT),
+    VSA_ASN_TAG("BITS", 4, 'B', 'I', 'S', VSA_ASN_BIT),
+    VSA_ASN_TAG("COUNTER32", 9, 'C', 'O', '2', VSA_ASN_COUNTER_32),
+    VSA_ASN_TAG("COUNTER64", 9, 'C', 'O', '4', VSA_ASN_COUNTER_64),
+    VSA_ASN_TAG("GAUGE32", 7, 'G', 'A', '2', VSA_ASN_GAUGE_32),
+    VSA_ASN_TAG("HEX-STRING", 10, 'H', 'E', 'G', VSA_ASN_HEX_STRING),
+    VSA_ASN_TAG("INTEGER", 7, 'I', 'N', 'R', VSA_ASN_INTEGER),
+    VSA_ASN_TAG("INTEGER32", 9, 'I', 'N', '2', VSA_ASN_INTEGER),
+    VSA_ASN_TAG("IPADDRESS", 9, 'I', 'P', 'S', VSA_ASN_IP_ADDRESS),
+    VSA_ASN_TAG("NETWORK ADDRESS", 15, 'N', 'E', 'S', VSA_ASN_NETWORK_ADDRESS),
+    VSA_ASN_TAG("OCTET STRING", 12, 'O', 'C', 'G', VSA_ASN_OCTET_STRING),
+    VSA_ASN_TAG("OCTETSTRING", 11, 'O', 'C', 'G', VSA_ASN_OCTET_STRING),
+    VSA_ASN_TAG("OID", 3, 'O', 'I', 'D', VSA_ASN_OID),
+    VSA_ASN_TAG("OPAQUE", 6, 'O', 'P', 'E', VSA_ASN_OPAQUE),
+    VSA_ASN_TAG("STRING", 6, 'S', 'T', 'G', VSA_ASN_STRING),
+    VSA_ASN_TAG("TIMETICKS", 9, 'T', 'I', 'S', VSA_ASN_TIMETICKS),
+    VSA_ASN_TAG("UINTEGER32", 10, 'U', 'I', '2', VSA_ASN_UNSIGNED_32),
+    VSA_ASN_TAG("UNSIGNED32", 10, 'U', 'N', '2', VSA_ASN_UNSIGNED_32)
+};
+
+// The type of a walk type tag, found with a single comparison. Trailing blanks are ignored.
 vsa_asn_type_t
 vsa_asn_type_from_str(const char *str)
 {
-    for (int i = 0; types[i].len; i++) {
-        if (!strncasecmp(str, types[i].name, types[i].len)) {
-            return types[i].type;
-        }
+    size_t                  len;
+    const vsa_asn_tag_t    *tag;
+
+    len = strlen(str);
+    while (len && isspace((unsigned char) str[len - 1])) {
+        len--;
+    }
+    if (len < 2) {
+        return VSA_ASN_UNKNOWN;
     }
 
-    // There may be lines with types like: "Wrong Type (should be Gauge32 or Unsigned32)"
-    if (strcasestr(str, "gauge32")) {
-        return VSA_ASN_GAUGE_32;
+    tag = &tags[VSA_ASN_TAG_HASH(len, str[0], str[1], str[len - 1])];
+    if (tag->len != len || strncasecmp(str, tag->name, len)) {
+        return VSA_ASN_UNKNOWN;
     }
 
-    return VSA_ASN_UNKNOWN;
+    return tag->type;
 }
 
 char                   *
 vsa_asn_type_to_str(vsa_asn_type_t type)
 {
     char                   *str;
-    int                     i;
 
-    for (i = 0; types[i].len; i++) {
-        if (types[i].type == type) {
-            break;
-        }
-    }
-
-    str = strdup(types[i].name);
+    str = strdup(vsa_asn_type_get_name(type));
     if (!str) {
         vsa_log_debugln("%s", strerror(errno));
         return NULL;
@@ -82,3 +119,16 @@ vsa_asn_type_to_str(vsa_asn_type_t type)
 
     return str;
 }
+
+const char             *
+vsa_asn_type_get_name(vsa_asn_type_t type)
+{
+    return vsa_asn_type_get_info(type)->name;
+}
+
+// The descriptor of type, that of VSA_ASN_UNKNOWN for values out of range, such as those read from a corrupt file.
+const vsa_asn_type_info_t *
+vsa_asn_type_get_info(vsa_asn_type_t type)
+{
+    return &infos[(unsigned) type < VSA_ASN_LEN ? type : VSA_ASN_UNKNOWN];
+}
@@ -24,8 +24,24 @@
 #define VSA_ASN_TYPE_FROM_STR_ERROR_MSG "vsa_asn_type_from_str() failed"
 #define VSA_ASN_TYPE_TO_STR_ERROR_MSG "vsa_asn_type_to_str() failed"
 
+// Values of the type may be SET.
+#define VSA_ASN_WRITABLE 0x1
+// SETs must keep the length of the current value.
+#define VSA_ASN_FIXED_SIZE 0x2
+
+// Walk type tags are looked up in a table of this many slots, indexed by a hash that is perfect for the known tags.
+#define VSA_ASN_TAG_SLOTS 64
+#define VSA_ASN_TAG_FOLD(c) (((unsigned char) (c)) | 0x20)
+#define VSA_ASN_TAG_HASH(len, first, second, last) \
+    (((len) + VSA_ASN_TAG_FOLD(first) + 5 * (VSA_ASN_TAG_FOLD(second) + VSA_ASN_TAG_FOLD(last))) \
+     & (VSA_ASN_TAG_SLOTS - 1))
+
 typedef enum vsa_asn_type vsa_asn_type_t;
+typedef struct vsa_asn_type_info_s vsa_asn_type_info_t;
 
+struct vsa_value_ops_s;
+
+// New types go last: snapshots and write-ahead logs store these values.
 enum vsa_asn_type {
     VSA_ASN_UNKNOWN,
     VSA_ASN_BIT,
@@ -39,10 +55,26 @@ enum vsa_asn_type {
     VSA_ASN_OCTET_STRING,
     VSA_ASN_OID,
     VSA_ASN_STRING,
-    VSA_ASN_TIMETICKS
+    VSA_ASN_TIMETICKS,
+    VSA_ASN_UNSIGNED_32,
+    VSA_ASN_OPAQUE,
+    VSA_ASN_LEN
+};
+
+/*
+ * Everything that depends on the type of a value: its name, as dumps write it, its ASN.1 tag on the wire, the
+ * VSA_ASN_* flags and the operations on the member of vsa_value_t that holds it. Unknown types have no operations.
+ */
+struct vsa_asn_type_info_s {
+    const char             *name;
+    unsigned char           asn;
+    int                     flags;
+    const struct vsa_value_ops_s *ops;
 };
 
 vsa_asn_type_t          vsa_asn_type_from_str(const char *str);
 char                   *vsa_asn_type_to_str(vsa_asn_type_t type);
+const char             *vsa_asn_type_get_name(vsa_asn_type_t type);
+const vsa_asn_type_info_t *vsa_asn_type_get_info(vsa_asn_type_t type);
 
 #endif // VSA_ASN_TYPE_H
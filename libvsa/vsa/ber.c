@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vsa/ber.h>
+
+// Reads the type and length of a TLV, returning where its value starts, which end must leave room for.
+const unsigned char    *
+vsa_ber_read_tlv(const unsigned char *p, const unsigned char *end, unsigned char *type, size_t *len)
+{
+    size_t                  nbytes;
+
+    if (end - p < 2) {
+        return NULL;
+    }
+    *type = *p++;
+
+    if (!(*p & 0x80)) {
+        *len = *p++;
+    } else {
+        nbytes = *p++ & 0x7f;
+        if (!nbytes || nbytes > sizeof (size_t) || (size_t) (end - p) < nbytes) {
+            return NULL;
+        }
+        for (*len = 0; nbytes; nbytes--) {
+            *len = *len << 8 | *p++;
+        }
+    }
+
+    if ((size_t) (end - p) < *len) {
+        return NULL;
+    }
+
+    return p;
+}
+
+// The bytes vsa_ber_write_len() writes len in.
+size_t
+vsa_ber_len_size(size_t len)
+{
+    size_t                  nbytes;
+
+    if (len < 0x80) {
+        return 1;
+    }
+
+    for (nbytes = 1; nbytes < sizeof (size_t) && len >> (nbytes * 8); nbytes++);
+
+    return nbytes + 1;
+}
+
+size_t
+vsa_ber_write_len(unsigned char *p, size_t len)
+{
+    size_t                  nbytes;
+
+    if (len < 0x80) {
+        p[0] = len;
+        return 1;
+    }
+
+    nbytes = vsa_ber_len_size(len) - 1;
+    p[0] = 0x80 | nbytes;
+    for (size_t i = 0; i < nbytes; i++) {
+        p[nbytes - i] = len >> (i * 8) & 0xff;
+    }
+
+    return nbytes + 1;
+}
+
+// Writes the type and length of a TLV, returning the bytes written.
+size_t
+vsa_ber_write_header(unsigned char *p, unsigned char type, size_t len)
+{
+    p[0] = type;
+
+    return 1 + vsa_ber_write_len(p + 1, len);
+}
+
+// The bytes of the shortest encoding of a non-negative integer, which a leading zero keeps positive.
+size_t
+vsa_ber_uint_size(uint32_t value)
+{
+    size_t                  n;
+
+    for (n = 1; n < 5 && (uint64_t) value >> (n * 8 - 1); n++);
+
+    return n;
+}
+
+// Writes a whole integer TLV, returning the bytes written.
+size_t
+vsa_ber_write_uint(unsigned char *p, unsigned char type, uint32_t value)
+{
+    size_t                  n;
+
+    n = vsa_ber_uint_size(value);
+    p[0] = type;
+    p[1] = n;
+    for (size_t i = 0; i < n; i++) {
+        p[1 + n - i] = (uint64_t) value >> (i * 8) & 0xff;
+    }
+
+    return 2 + n;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_BER_H
+#define VSA_BER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+const unsigned char    *vsa_ber_read_tlv(const unsigned char *p, const unsigned char *end, unsigned char *type,
+                                         size_t *len);
+size_t                  vsa_ber_len_size(size_t len);
+size_t                  vsa_ber_write_len(unsigned char *p, size_t len);
+size_t                  vsa_ber_write_header(unsigned char *p, unsigned char type, size_t len);
+size_t                  vsa_ber_uint_size(uint32_t value);
+size_t                  vsa_ber_write_uint(unsigned char *p, unsigned char type, uint32_t value);
+
+#endif // VSA_BER_H
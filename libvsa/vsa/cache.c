@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/ber.h>
+#include <vsa/cache.h>
+#include <vsa/log.h>
+#include <vsa/transport.h>
+
+// Requests whose responses were never sent (e.g. dropped by access control) are forgotten past this limit.
+#define VSA_CACHE_MAX_PENDING 1024
+
+#define VSA_CACHE_V3_PRIV_FLAG 0x02
+
+#define VSA_CACHE_SPLIT_ERROR_MSG "vsa_cache_split() failed"
+
+typedef struct vsa_cache_entry_s vsa_cache_entry_t;
+typedef struct vsa_cache_msg_s vsa_cache_msg_t;
+
+struct vsa_cache_entry_s {
+    GBytes                 *key;
+    unsigned char          *head;
+    size_t                  head_len;
+    unsigned char          *tail;
+    size_t                  tail_len;
+    size_t                  size;
+    GList                   link;
+};
+
+// A message split around its request-id: SEQUENCE { head, PDU { reqid, tail } }.
+struct vsa_cache_msg_s {
+    long                    version;
+    const unsigned char    *head;
+    size_t                  head_len;
+    unsigned char           pdu_type;
+    const unsigned char    *reqid;
+    size_t                  reqid_len;
+    const unsigned char    *tail;
+    size_t                  tail_len;
+};
+
+static int              vsa_cache_split(const unsigned char *buf, size_t len, vsa_cache_msg_t * msg);
+static void             vsa_cache_get_source(const void *opaque, int olength, const void **source, size_t *len);
+static GBytes          *vsa_cache_make_key(const void *source, size_t source_len, const unsigned char *a, size_t a_len,
+                                           unsigned char type, const unsigned char *b, size_t b_len);
+static void             vsa_cache_entry_free(vsa_cache_entry_t * entry);
+static void             vsa_cache_entry_free_cb(void *data);
+static void             vsa_cache_bytes_free_cb(void *data);
+static void             vsa_cache_store(vsa_cache_t * cache, GBytes * key, const vsa_cache_msg_t * msg);
+static int              vsa_cache_reply(vsa_cache_t * cache, vsa_cache_entry_t * entry, const vsa_cache_msg_t * msg,
+                                        netsnmp_transport * transport, void **opaque, int *olength);
+static int              vsa_cache_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque,
+                                            int *olength, void *data);
+static int              vsa_cache_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque,
+                                            int *olength, void *data);
+
+static int
+vsa_cache_split(const unsigned char *buf, size_t len, vsa_cache_msg_t * msg)
+{
+    const unsigned char    *p, *q, *end;
+    unsigned char           type, flags;
+    size_t                  l;
+
+    memset(msg, 0, sizeof (*msg));
+
+    end = buf + len;
+    p = vsa_ber_read_tlv(buf, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    end = p + l;
+
+    // version
+    msg->head = p;
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q || ASN_INTEGER != type || l != 1) {
+        return -1;
+    }
+    msg->version = *q;
+    p = q + l;
+
+    if (SNMP_VERSION_3 == msg->version) {
+        // msgGlobalData: msgID, msgMaxSize, msgFlags and msgSecurityModel
+        q = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!q) {
+            return -1;
+        }
+        p = q + l;
+        for (int i = 0; i < 3; i++) {
+            q = vsa_ber_read_tlv(q, p, &type, &l);
+            if (!q) {
+                return -1;
+            }
+            flags = *q;
+            q += l;
+        }
+        if (flags & VSA_CACHE_V3_PRIV_FLAG) {
+            return 0;
+        }
+
+        // msgSecurityParameters
+        q = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!q) {
+            return -1;
+        }
+        p = q + l;
+
+        // ScopedPDU: contextEngineID, contextName and PDU
+        p = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!p) {
+            return -1;
+        }
+        for (int i = 0; i < 2; i++) {
+            q = vsa_ber_read_tlv(p, end, &type, &l);
+            if (!q) {
+                return -1;
+            }
+            p = q + l;
+        }
+    } else {
+        // community
+        q = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!q || ASN_OCTET_STR != type) {
+            return -1;
+        }
+        p = q + l;
+    }
+    msg->head_len = p - msg->head;
+
+    p = vsa_ber_read_tlv(p, end, &msg->pdu_type, &l);
+    if (!p) {
+        return -1;
+    }
+    end = p + l;
+
+    msg->reqid = p;
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q || ASN_INTEGER != type) {
+        return -1;
+    }
+    msg->reqid_len = q + l - p;
+
+    msg->tail = q + l;
+    msg->tail_len = end - msg->tail;
+
+    return 0;
+}
+
+/*
+ * The address a request came from, without its port: the same community may be restricted to some sources by vsa.conf,
+ * but a manager keeps hitting its entries whichever port it sends from. Other domains use their whole transport data.
+ */
+static void
+vsa_cache_get_source(const void *opaque, int olength, const void **source, size_t *len)
+{
+    const struct sockaddr  *addr;
+
+    *source = NULL;
+    *len = 0;
+    if (!opaque || olength <= 0) {
+        return;
+    }
+    *source = opaque;
+    *len = olength;
+
+    // The transport data of IP domains starts with the manager's address.
+    addr = opaque;
+    if (AF_INET == addr->sa_family && olength >= (int) sizeof (struct sockaddr_in)) {
+        *source = &((const struct sockaddr_in *) opaque)->sin_addr;
+        *len = sizeof (struct in_addr);
+    } else if (AF_INET6 == addr->sa_family && olength >= (int) sizeof (struct sockaddr_in6)) {
+        *source = &((const struct sockaddr_in6 *) opaque)->sin6_addr;
+        *len = sizeof (struct in6_addr);
+    }
+}
+
+static GBytes          *
+vsa_cache_make_key(const void *source, size_t source_len, const unsigned char *a, size_t a_len, unsigned char type,
+                   const unsigned char *b, size_t b_len)
+{
+    unsigned char          *key, *p;
+
+    key = malloc(source_len + a_len + 1 + b_len);
+    if (!key) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    p = key;
+    memcpy(p, source, source_len), p += source_len;
+    memcpy(p, a, a_len), p += a_len;
+    *p++ = type;
+    memcpy(p, b, b_len);
+
+    return g_bytes_new_take(key, source_len + a_len + 1 + b_len);
+}
+
+static void
+vsa_cache_entry_free(vsa_cache_entry_t * entry)
+{
+    g_bytes_unref(entry->key);
+    free(entry->head);
+    free(entry->tail);
+    free(entry);
+}
+
+static void
+vsa_cache_entry_free_cb(void *data)
+{
+    vsa_cache_entry_free((vsa_cache_entry_t *) data);
+}
+
+static void
+vsa_cache_bytes_free_cb(void *data)
+{
+    g_bytes_unref((GBytes *) data);
+}
+
+static void
+vsa_cache_store(vsa_cache_t * cache, GBytes * key, const vsa_cache_msg_t * msg)
+{
+    vsa_cache_entry_t      *entry, *victim;
+
+    entry = calloc(1, sizeof (vsa_cache_entry_t));
+    if (!entry) {
+        vsa_log_debugln("%s", strerror(errno));
+        return;
+    }
+    entry->head = malloc(msg->head_len);
+    entry->tail = malloc(msg->tail_len);
+    if (!entry->head || !entry->tail) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(entry->head);
+        free(entry->tail);
+        free(entry);
+        return;
+    }
+    memcpy(entry->head, msg->head, msg->head_len);
+    entry->head_len = msg->head_len;
+    memcpy(entry->tail, msg->tail, msg->tail_len);
+    entry->tail_len = msg->tail_len;
+    entry->key = g_bytes_ref(key);
+    entry->size = sizeof (*entry) + g_bytes_get_size(key) + entry->head_len + entry->tail_len;
+    entry->link.data = entry;
+
+    if (entry->size > cache->budget) {
+        vsa_cache_entry_free(entry);
+        return;
+    }
+
+    while (cache->size + entry->size > cache->budget) {
+        victim = g_queue_peek_tail(&cache->lru);
+        g_queue_unlink(&cache->lru, &victim->link);
+        cache->size -= victim->size;
+        g_hash_table_remove(cache->entries, victim->key);
+    }
+
+    victim = g_hash_table_lookup(cache->entries, key);
+    if (victim) {
+        g_queue_unlink(&cache->lru, &victim->link);
+        cache->size -= victim->size;
+        g_hash_table_remove(cache->entries, key);
+    }
+
+    g_hash_table_insert(cache->entries, entry->key, entry);
+    g_queue_push_head_link(&cache->lru, &entry->link);
+    cache->size += entry->size;
+}
+
+static int
+vsa_cache_reply(vsa_cache_t * cache, vsa_cache_entry_t * entry, const vsa_cache_msg_t * msg,
+                netsnmp_transport * transport, void **opaque, int *olength)
+{
+    unsigned char           pdu_len_buf[sizeof (size_t) + 1], msg_len_buf[sizeof (size_t) + 1];
+    unsigned char          *p;
+    size_t                  pdu_len, pdu_len_len, msg_len, msg_len_len, total;
+
+    pdu_len = msg->reqid_len + entry->tail_len;
+    pdu_len_len = vsa_ber_write_len(pdu_len_buf, pdu_len);
+    msg_len = entry->head_len + 1 + pdu_len_len + pdu_len;
+    msg_len_len = vsa_ber_write_len(msg_len_buf, msg_len);
+    total = 1 + msg_len_len + msg_len;
+
+    if (cache->buf_len < total) {
+        p = realloc(cache->buf, total);
+        if (!p) {
+            vsa_log_debugln("%s", strerror(errno));
+            return -1;
+        }
+        cache->buf = p;
+        cache->buf_len = total;
+    }
+
+    p = cache->buf;
+    *p++ = ASN_SEQUENCE | ASN_CONSTRUCTOR;
+    memcpy(p, msg_len_buf, msg_len_len), p += msg_len_len;
+    memcpy(p, entry->head, entry->head_len), p += entry->head_len;
+    *p++ = SNMP_MSG_RESPONSE;
+    memcpy(p, pdu_len_buf, pdu_len_len), p += pdu_len_len;
+    memcpy(p, msg->reqid, msg->reqid_len), p += msg->reqid_len;
+    memcpy(p, entry->tail, entry->tail_len);
+
+    if (vsa_transport_send(transport, cache->buf, total, opaque, olength) < 0) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_cache_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque, int *olength, void *data)
+{
+    vsa_cache_t            *cache;
+    vsa_cache_msg_t         msg;
+    const void             *source;
+    size_t                  source_len;
+    vsa_cache_entry_t      *entry;
+    GBytes                 *key, *pending_key;
+
+    cache = data;
+
+    if (vsa_cache_split(buf, len, &msg)) {
+        vsa_log_debugln(VSA_CACHE_SPLIT_ERROR_MSG);
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    switch (msg.pdu_type) {
+    case SNMP_MSG_GET:
+        break;
+
+    case SNMP_MSG_GETNEXT:
+    case SNMP_MSG_GETBULK:
+        return VSA_TRANSPORT_CONTINUE;
+
+    default:
+        // SETs and PDUs that can't be inspected (encrypted SNMPv3) may change values.
+        vsa_cache_clear(cache);
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    if (SNMP_VERSION_1 != msg.version && SNMP_VERSION_2c != msg.version) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    vsa_cache_get_source(*opaque, *olength, &source, &source_len);
+    key = vsa_cache_make_key(source, source_len, msg.head, msg.head_len, msg.pdu_type, msg.tail, msg.tail_len);
+    if (!key) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    entry = g_hash_table_lookup(cache->entries, key);
+    if (entry && !vsa_cache_reply(cache, entry, &msg, transport, opaque, olength)) {
+        g_queue_unlink(&cache->lru, &entry->link);
+        g_queue_push_head_link(&cache->lru, &entry->link);
+        cache->hits++;
+        g_bytes_unref(key);
+        return VSA_TRANSPORT_CONSUMED;
+    }
+    cache->misses++;
+
+    pending_key = vsa_cache_make_key(NULL, 0, *olength > 0 ? *opaque : NULL, *olength > 0 ? *olength : 0, 0, msg.reqid,
+                                     msg.reqid_len);
+    if (!pending_key) {
+        g_bytes_unref(key);
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    if (g_hash_table_size(cache->pending) >= VSA_CACHE_MAX_PENDING) {
+        g_hash_table_remove_all(cache->pending);
+    }
+    g_hash_table_replace(cache->pending, pending_key, key);
+
+    return VSA_TRANSPORT_CONTINUE;
+}
+
+static int
+vsa_cache_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque, int *olength, void *data)
+{
+    vsa_cache_t            *cache;
+    vsa_cache_msg_t         msg;
+    GBytes                 *key, *pending_key;
+
+    (void) transport;
+    cache = data;
+
+    if (!g_hash_table_size(cache->pending)) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    if (vsa_cache_split(buf, len, &msg) || SNMP_MSG_RESPONSE != msg.pdu_type) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    pending_key = vsa_cache_make_key(NULL, 0, *olength > 0 ? *opaque : NULL, *olength > 0 ? *olength : 0, 0, msg.reqid,
+                                     msg.reqid_len);
+    if (!pending_key) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    key = g_hash_table_lookup(cache->pending, pending_key);
+    if (key) {
+        vsa_cache_store(cache, key, &msg);
+        g_hash_table_remove(cache->pending, pending_key);
+    }
+    g_bytes_unref(pending_key);
+
+    return VSA_TRANSPORT_CONTINUE;
+}
+
+vsa_cache_t            *
+vsa_cache_new(size_t budget)
+{
+    vsa_cache_t            *cache;
+
+    cache = calloc(1, sizeof (vsa_cache_t));
+    if (!cache) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    cache->budget = budget;
+    cache->entries = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, NULL, vsa_cache_entry_free_cb);
+    cache->pending =
+        g_hash_table_new_full(g_bytes_hash, g_bytes_equal, vsa_cache_bytes_free_cb, vsa_cache_bytes_free_cb);
+    g_queue_init(&cache->lru);
+
+    return cache;
+}
+
+void                   *
+vsa_cache_free(vsa_cache_t * cache)
+{
+    if (!cache) {
+        return NULL;
+    }
+    vsa_cache_clear(cache);
+    g_hash_table_destroy(cache->entries);
+    g_hash_table_destroy(cache->pending);
+    free(cache->buf);
+    free(cache);
+
+    return NULL;
+}
+
+void
+vsa_cache_clear(vsa_cache_t * cache)
+{
+    g_queue_init(&cache->lru);
+    g_hash_table_remove_all(cache->entries);
+    g_hash_table_remove_all(cache->pending);
+    cache->size = 0;
+}
+
+int
+vsa_cache_attach(vsa_cache_t * cache, netsnmp_transport * transport)
+{
+    if (vsa_transport_add_hook(transport, vsa_cache_recv_hook, vsa_cache_send_hook, cache)) {
+        vsa_log_debugln(VSA_TRANSPORT_ADD_HOOK_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_CACHE_H
+#define VSA_CACHE_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#define VSA_CACHE_NEW_ERROR_MSG "vsa_cache_new() failed"
+#define VSA_CACHE_ATTACH_ERROR_MSG "vsa_cache_attach() failed"
+
+typedef struct vsa_cache_s vsa_cache_t;
+
+/*
+ * Whole-response cache for SNMPv1/v2c GET requests. Entries are keyed on the source address and the request as seen on
+ * the wire, without its request-id (version, community, PDU type and varbinds), and hold the encoded response, so a hit
+ * only requires the request-id to be patched in. A response is thus only replayed to the source net-snmp's access
+ * control let it through for. The cache is bounded by a byte budget and evicts the least recently used entries.
+ */
+struct vsa_cache_s {
+    size_t                  budget;
+    size_t                  size;
+    GHashTable             *entries;
+    GHashTable             *pending;
+    GQueue                  lru;
+    unsigned char          *buf;
+    size_t                  buf_len;
+    unsigned long           hits;
+    unsigned long           misses;
+};
+
+vsa_cache_t            *vsa_cache_new(size_t budget);
+void                   *vsa_cache_free(vsa_cache_t * cache);
+void                    vsa_cache_clear(vsa_cache_t * cache);
+int                     vsa_cache_attach(vsa_cache_t * cache, netsnmp_transport * transport);
+
+#endif // VSA_CACHE_H
@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/ber.h>
+#include <vsa/delay.h>
+#include <vsa/log.h>
+#include <vsa/transport.h>
+
+typedef struct vsa_delay_entry_s vsa_delay_entry_t;
+
+// A held response, with the address it goes to (opaque) ahead of the message.
+struct vsa_delay_entry_s {
+    vsa_wheel_entry_t       timer;
+    netsnmp_transport      *transport;
+    int                     len;
+    int                     olength;
+    unsigned char           data[];
+};
+
+static int              vsa_delay_parse_spec(const char *spec, vsa_delay_dist_t * dist, double *a, double *b);
+static vsa_delay_rule_t *vsa_delay_get_rule(vsa_delay_t * delay, const oid * root, size_t len);
+static int              vsa_delay_parse(const unsigned char *buf, size_t len, unsigned char *pdu_type, oid * name,
+                                        size_t *name_len);
+static guint64          vsa_delay_draw(vsa_delay_t * delay, const vsa_delay_rule_t * rule);
+static void             vsa_delay_send_cb(vsa_wheel_entry_t * timer, void *data);
+static void             vsa_delay_free_cb(vsa_wheel_entry_t * timer, void *data);
+static void             vsa_delay_alarm_cb(unsigned int reg, void *data);
+static int              vsa_delay_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque,
+                                            int *olength, void *data);
+
+// MS, MIN-MAX, MEAN~STDDEV or ~MEAN, in milliseconds.
+static int
+vsa_delay_parse_spec(const char *spec, vsa_delay_dist_t * dist, double *a, double *b)
+{
+    char                   *p;
+
+    *dist = VSA_DELAY_FIXED;
+    if ('~' == *spec) {
+        *dist = VSA_DELAY_EXPONENTIAL;
+        spec++;
+    }
+
+    *a = strtod(spec, &p);
+    if (p == spec || !(*a >= 0 && *a <= VSA_WHEEL_MAX_TICKS)) {
+        return -1;
+    }
+
+    *b = 0;
+    if (VSA_DELAY_FIXED == *dist && ('-' == *p || '~' == *p)) {
+        *dist = '-' == *p ? VSA_DELAY_UNIFORM : VSA_DELAY_NORMAL;
+        spec = p + 1;
+        *b = strtod(spec, &p);
+        if (p == spec || !(*b >= 0 && *b <= VSA_WHEEL_MAX_TICKS) || (VSA_DELAY_UNIFORM == *dist && *b < *a)) {
+            return -1;
+        }
+    }
+
+    return *p ? -1 : 0;
+}
+
+static vsa_delay_rule_t *
+vsa_delay_get_rule(vsa_delay_t * delay, const oid * root, size_t len)
+{
+    vsa_delay_rule_t        rule;
+
+    if (len > MAX_OID_LEN) {
+        vsa_log_debugln("OID longer than %d subidentifiers", MAX_OID_LEN);
+        return NULL;
+    }
+
+    for (guint i = 0; i < delay->rules->len; i++) {
+        vsa_delay_rule_t       *r;
+
+        r = &g_array_index(delay->rules, vsa_delay_rule_t, i);
+        if (r->len == len && (!len || !memcmp(r->root, root, len * sizeof (oid)))) {
+            return r;
+        }
+    }
+
+    memset(&rule, 0, sizeof (rule));
+    if (len) {
+        memcpy(rule.root, root, len * sizeof (oid));
+    }
+    rule.len = len;
+    g_array_append_val(delay->rules, rule);
+
+    return &g_array_index(delay->rules, vsa_delay_rule_t, delay->rules->len - 1);
+}
+
+/*
+ * Reads the PDU type of a message and the OID of its first varbind, leaving name_len at 0 when it has none. Fails on
+ * what can't be read, encrypted SNMPv3 messages included.
+ */
+static int
+vsa_delay_parse(const unsigned char *buf, size_t len, unsigned char *pdu_type, oid * name, size_t *name_len)
+{
+    const unsigned char    *p, *end;
+    unsigned char           type;
+    size_t                  l, n, k;
+    oid                     sub;
+    int                     skip;
+
+    end = buf + len;
+    p = vsa_ber_read_tlv(buf, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    end = p + l;
+
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || ASN_INTEGER != type || l != 1) {
+        return -1;
+    }
+
+    // community, or msgGlobalData, msgSecurityParameters and the ScopedPDU up to its contextName
+    skip = SNMP_VERSION_3 == *p ? 2 : 1;
+    p += l;
+    for (int i = 0; i < skip; i++) {
+        p = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!p) {
+            return -1;
+        }
+        p += l;
+    }
+    if (2 == skip) {
+        p = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+            return -1;
+        }
+        for (int i = 0; i < 2; i++) {
+            p = vsa_ber_read_tlv(p, end, &type, &l);
+            if (!p) {
+                return -1;
+            }
+            p += l;
+        }
+    }
+
+    p = vsa_ber_read_tlv(p, end, pdu_type, &l);
+    if (!p) {
+        return -1;
+    }
+    end = p + l;
+
+    // request-id, error-status and error-index
+    for (int i = 0; i < 3; i++) {
+        p = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!p) {
+            return -1;
+        }
+        p += l;
+    }
+
+    *name_len = 0;
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    if (!l) {
+        return 0;
+    }
+    end = p + l;
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    p = vsa_ber_read_tlv(p, p + l, &type, &l);
+    if (!p || ASN_OBJECT_ID != type || !l) {
+        return -1;
+    }
+
+    // Past MAX_OID_LEN subidentifiers, the OID is cut short: no rule is longer.
+    for (k = 0, n = 0; k < l && n < MAX_OID_LEN;) {
+        for (sub = 0; k < l && p[k] & 0x80; k++) {
+            sub = sub << 7 | (p[k] & 0x7f);
+        }
+        if (k == l) {
+            return -1;
+        }
+        sub = sub << 7 | p[k++];
+
+        // The first subidentifier packs the first two arcs.
+        if (!n) {
+            name[n++] = sub < 40 ? 0 : sub < 80 ? 1 : 2;
+            sub -= name[0] * 40;
+        }
+        name[n++] = sub;
+    }
+    *name_len = n;
+
+    return 0;
+}
+
+static guint64
+vsa_delay_draw(vsa_delay_t * delay, const vsa_delay_rule_t * rule)
+{
+    double                  ms;
+
+    switch (rule->dist) {
+    case VSA_DELAY_FIXED:
+        ms = rule->a;
+        break;
+
+    case VSA_DELAY_UNIFORM:
+        ms = g_rand_double_range(delay->rand, rule->a, rule->b);
+        break;
+
+    case VSA_DELAY_NORMAL:
+        // Box-Muller, over (0, 1] so that the logarithm is defined.
+        ms = rule->a + rule->b * sqrt(-2 * log(1 - g_rand_double(delay->rand)))
+            * cos(2 * G_PI * g_rand_double(delay->rand));
+        break;
+
+    case VSA_DELAY_EXPONENTIAL:
+        ms = -rule->a * log(1 - g_rand_double(delay->rand));
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (ms <= 0) {
+        return 0;
+    }
+
+    return ms < VSA_WHEEL_MAX_TICKS ? (guint64) (ms + 0.5) : VSA_WHEEL_MAX_TICKS;
+}
+
+static void
+vsa_delay_send_cb(vsa_wheel_entry_t * timer, void *data)
+{
+    vsa_delay_entry_t      *entry;
+    void                   *opaque;
+    int                     olength;
+
+    (void) data;
+    entry = timer->data;
+
+    opaque = entry->olength ? entry->data : NULL;
+    olength = entry->olength;
+    if (vsa_transport_send(entry->transport, entry->data + entry->olength, entry->len, &opaque, &olength) < 0) {
+        vsa_log_debugln("%s", strerror(errno));
+    }
+
+    free(entry);
+}
+
+static void
+vsa_delay_free_cb(vsa_wheel_entry_t * timer, void *data)
+{
+    (void) data;
+    free(timer->data);
+}
+
+static void
+vsa_delay_alarm_cb(unsigned int reg, void *data)
+{
+    vsa_delay_t            *delay;
+
+    (void) reg;
+    delay = data;
+
+    vsa_wheel_run(&delay->wheel, vsa_wheel_clock(), vsa_delay_send_cb, delay);
+
+    if (!delay->wheel.len) {
+        snmp_alarm_unregister(delay->alarm);
+        delay->alarm = 0;
+    }
+}
+
+static int
+vsa_delay_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque, int *olength, void *data)
+{
+    vsa_delay_t            *delay;
+    vsa_delay_rule_t       *rule, *latency, *loss;
+    vsa_delay_entry_t      *entry;
+    oid                     name[MAX_OID_LEN];
+    size_t                  name_len;
+    unsigned char           pdu_type;
+    guint64                 ticks;
+    int                     olen;
+    struct timeval          interval = { 0, 1000 };
+
+    delay = data;
+
+    // What can't be read is taken for a response, under the device-wide rule.
+    name_len = 0;
+    if (!vsa_delay_parse(buf, len, &pdu_type, name, &name_len) && SNMP_MSG_RESPONSE != pdu_type) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    latency = loss = NULL;
+    for (guint i = 0; i < delay->rules->len; i++) {
+        rule = &g_array_index(delay->rules, vsa_delay_rule_t, i);
+        if (rule->len > name_len || memcmp(rule->root, name, rule->len * sizeof (oid))) {
+            continue;
+        }
+        if (VSA_DELAY_NONE != rule->dist && (!latency || rule->len > latency->len)) {
+            latency = rule;
+        }
+        if (rule->has_loss && (!loss || rule->len > loss->len)) {
+            loss = rule;
+        }
+    }
+
+    if (loss && g_rand_double(delay->rand) < loss->loss) {
+        delay->dropped++;
+        return VSA_TRANSPORT_CONSUMED;
+    }
+
+    ticks = latency ? vsa_delay_draw(delay, latency) : 0;
+    if (!ticks) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+    if (delay->wheel.len >= delay->max_pending) {
+        delay->overflows++;
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    olen = *olength > 0 && *opaque ? *olength : 0;
+    entry = malloc(sizeof (vsa_delay_entry_t) + olen + len);
+    if (!entry) {
+        vsa_log_debugln("%s", strerror(errno));
+        return VSA_TRANSPORT_CONTINUE;
+    }
+    entry->timer.data = entry;
+    entry->transport = transport;
+    entry->len = len;
+    entry->olength = olen;
+    memcpy(entry->data, *opaque, olen);
+    memcpy(entry->data + olen, buf, len);
+
+    if (!delay->alarm) {
+        delay->alarm = snmp_alarm_register_hr(interval, SA_REPEAT, vsa_delay_alarm_cb, delay);
+        if (!delay->alarm) {
+            vsa_log_debugln("snmp_alarm_register_hr() failed");
+            free(entry);
+            return VSA_TRANSPORT_CONTINUE;
+        }
+    }
+
+    vsa_wheel_add(&delay->wheel, &entry->timer, vsa_wheel_clock(), ticks);
+    delay->delayed++;
+
+    return VSA_TRANSPORT_CONSUMED;
+}
+
+vsa_delay_t            *
+vsa_delay_new(size_t max_pending)
+{
+    vsa_delay_t            *delay;
+
+    delay = calloc(1, sizeof (vsa_delay_t));
+    if (!delay) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    delay->rules = g_array_new(FALSE, FALSE, sizeof (vsa_delay_rule_t));
+    delay->rand = g_rand_new();
+    delay->max_pending = max_pending;
+    vsa_wheel_init(&delay->wheel);
+
+    return delay;
+}
+
+// Held responses are dropped, as on a device going down.
+void                   *
+vsa_delay_free(vsa_delay_t * delay)
+{
+    if (!delay) {
+        return NULL;
+    }
+    if (delay->alarm) {
+        snmp_alarm_unregister(delay->alarm);
+    }
+    vsa_wheel_clear(&delay->wheel, vsa_delay_free_cb, NULL);
+    g_array_free(delay->rules, TRUE);
+    g_rand_free(delay->rand);
+    free(delay);
+
+    return NULL;
+}
+
+int
+vsa_delay_set_latency(vsa_delay_t * delay, const oid * root, size_t len, const char *spec)
+{
+    vsa_delay_rule_t       *rule;
+    vsa_delay_dist_t        dist;
+    double                  a, b;
+
+    if (vsa_delay_parse_spec(spec, &dist, &a, &b)) {
+        vsa_log_debugln("invalid latency '%s'", spec);
+        return -1;
+    }
+
+    rule = vsa_delay_get_rule(delay, root, len);
+    if (!rule) {
+        return -1;
+    }
+    rule->dist = dist;
+    rule->a = a;
+    rule->b = b;
+
+    return 0;
+}
+
+int
+vsa_delay_set_loss(vsa_delay_t * delay, const oid * root, size_t len, double loss)
+{
+    vsa_delay_rule_t       *rule;
+
+    if (!(loss >= 0 && loss <= 1)) {
+        vsa_log_debugln("invalid loss %g", loss);
+        return -1;
+    }
+
+    rule = vsa_delay_get_rule(delay, root, len);
+    if (!rule) {
+        return -1;
+    }
+    rule->has_loss = 1;
+    rule->loss = loss;
+
+    return 0;
+}
+
+int
+vsa_delay_attach(vsa_delay_t * delay, netsnmp_transport * transport)
+{
+    if (vsa_transport_add_hook(transport, NULL, vsa_delay_send_hook, delay)) {
+        vsa_log_debugln(VSA_TRANSPORT_ADD_HOOK_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
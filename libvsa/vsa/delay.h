@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_DELAY_H
+#define VSA_DELAY_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/oid.h>
+#include <vsa/wheel.h>
+
+#define VSA_DELAY_NEW_ERROR_MSG "vsa_delay_new() failed"
+#define VSA_DELAY_SET_LATENCY_ERROR_MSG "vsa_delay_set_latency() failed"
+#define VSA_DELAY_SET_LOSS_ERROR_MSG "vsa_delay_set_loss() failed"
+#define VSA_DELAY_ATTACH_ERROR_MSG "vsa_delay_attach() failed"
+
+// Responses held at once past which the next ones are sent right away, bounding memory.
+#define VSA_DELAY_MAX_PENDING 131072
+
+typedef enum vsa_delay_dist_e vsa_delay_dist_t;
+typedef struct vsa_delay_rule_s vsa_delay_rule_t;
+typedef struct vsa_delay_s vsa_delay_t;
+
+enum vsa_delay_dist_e {
+    VSA_DELAY_NONE,
+    VSA_DELAY_FIXED,
+    VSA_DELAY_UNIFORM,
+    VSA_DELAY_NORMAL,
+    VSA_DELAY_EXPONENTIAL
+};
+
+// The latency and loss of the responses under an OID prefix, the empty one applying to the whole device.
+struct vsa_delay_rule_s {
+    oid                     root[MAX_OID_LEN];
+    size_t                  len;
+    vsa_delay_dist_t        dist;
+    double                  a;
+    double                  b;
+    int                     has_loss;
+    double                  loss;
+};
+
+/*
+ * Delays outgoing responses by a random latency and drops a share of them, as set by the rule of the longest prefix of
+ * their first varbind OID. Held responses are kept in a timer wheel advanced by a net-snmp alarm, so that holding one
+ * and sending it take constant time whatever the number held, and the event loop never sleeps on them.
+ */
+struct vsa_delay_s {
+    GArray                 *rules;
+    GRand                  *rand;
+    vsa_wheel_t             wheel;
+    unsigned int            alarm;
+    size_t                  max_pending;
+    unsigned long           delayed;
+    unsigned long           dropped;
+    unsigned long           overflows;
+};
+
+vsa_delay_t            *vsa_delay_new(size_t max_pending);
+void                   *vsa_delay_free(vsa_delay_t * delay);
+int                     vsa_delay_set_latency(vsa_delay_t * delay, const oid * root, size_t len, const char *spec);
+int                     vsa_delay_set_loss(vsa_delay_t * delay, const oid * root, size_t len, double loss);
+int                     vsa_delay_attach(vsa_delay_t * delay, netsnmp_transport * transport);
+
+#endif // VSA_DELAY_H
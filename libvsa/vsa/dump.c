@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/dump.h>
+#include <vsa/log.h>
+#include <vsa/snapshot.h>
+
+// Values are formatted on the stack up to this size, larger ones in a temporary allocation.
+#define VSA_DUMP_VALUE_SIZE 4096
+
+static int              vsa_dump_write_value(FILE * fp, vsa_value_t * value);
+static int              vsa_dump_write_walk(vsa_index_t * index, int fd);
+
+static int
+vsa_dump_write_value(FILE * fp, vsa_value_t * value)
+{
+    char                    buf[VSA_DUMP_VALUE_SIZE], *str;
+    ssize_t                 len;
+
+    len = vsa_value_format_data(value, buf, sizeof (buf));
+    if (-1 == len) {
+        return -1;
+    }
+    if ((size_t) len < sizeof (buf)) {
+        fputs(buf, fp);
+        return 0;
+    }
+
+    str = malloc(len + 1);
+    if (!str) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    vsa_value_format_data(value, str, len + 1);
+    fputs(str, fp);
+    free(str);
+
+    return 0;
+}
+
+static int
+vsa_dump_write_walk(vsa_index_t * index, int fd)
+{
+    int                     dupfd;
+    FILE                   *fp;
+
+    dupfd = dup(fd);
+    if (-1 == dupfd) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    fp = fdopen(dupfd, "w");
+    if (!fp) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(dupfd);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, VSA_DUMP_BUFFER_SIZE);
+
+    for (size_t i = 0; i < index->len; i++) {
+        if (vsa_dump_write_object(fp, index->objects[i])) {
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    if (ferror(fp)) {
+        vsa_log_debugln("%s", strerror(errno));
+        fclose(fp);
+        return -1;
+    }
+
+    if (fclose(fp)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Writes object as a walk line. A SET may replace its value meanwhile, when this runs off the serving thread.
+int
+vsa_dump_write_object(FILE * fp, vsa_object_t * object)
+{
+    char                    name[VSA_OID_STR_SIZE];
+    vsa_value_t            *value;
+
+    value = g_atomic_pointer_get(&object->value);
+
+    vsa_oid_format(object->tree->oids, object->tree->len, name, sizeof (name));
+    fputs(name, fp);
+    fputs(" = ", fp);
+    fputs(vsa_asn_type_get_name(value->type), fp);
+    fputs(": ", fp);
+    if (vsa_dump_write_value(fp, value)) {
+        vsa_log_debugln(VSA_VALUE_TO_STR_ERROR_MSG);
+        return -1;
+    }
+    fputc('\n', fp);
+
+    return 0;
+}
+
+int
+vsa_dump_format_from_str(const char *str, vsa_dump_format_t * format)
+{
+    if (!strcasecmp(str, "walk")) {
+        *format = VSA_DUMP_WALK;
+    } else if (!strcasecmp(str, "snapshot")) {
+        *format = VSA_DUMP_SNAPSHOT;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Streams the objects of index to fd, in OID order. Values may be replaced by SETs while the dump runs on another
+ * thread, as long as that thread stays in an epoch: each object is written with either its old or its new value.
+ */
+int
+vsa_dump_write(vsa_index_t * index, int fd, vsa_dump_format_t format)
+{
+    switch (format) {
+    case VSA_DUMP_WALK:
+        return vsa_dump_write_walk(index, fd);
+
+    case VSA_DUMP_SNAPSHOT:
+        if (vsa_snapshot_write(index, fd)) {
+            vsa_log_debugln(VSA_SNAPSHOT_WRITE_ERROR_MSG);
+            return -1;
+        }
+        return 0;
+
+    default:
+        vsa_log_debugln("unknown dump format %d", format);
+        return -1;
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_DUMP_H
+#define VSA_DUMP_H
+
+#include <stdio.h>
+
+#include <vsa/index.h>
+
+#define VSA_DUMP_WRITE_ERROR_MSG "vsa_dump_write() failed"
+
+// The stdio buffer of a dump, so that it is written out in large blocks.
+#define VSA_DUMP_BUFFER_SIZE (1 << 20)
+
+typedef enum vsa_dump_format vsa_dump_format_t;
+
+enum vsa_dump_format {
+    // Lines of "OID = TYPE: value", as vsa_parser_parse_mib() reads them.
+    VSA_DUMP_WALK,
+    // A binary snapshot, as vsa_snapshot_read() reads it.
+    VSA_DUMP_SNAPSHOT
+};
+
+int                     vsa_dump_write_object(FILE * fp, vsa_object_t * object);
+int                     vsa_dump_format_from_str(const char *str, vsa_dump_format_t * format);
+int                     vsa_dump_write(vsa_index_t * index, int fd, vsa_dump_format_t format);
+
+#endif // VSA_DUMP_H
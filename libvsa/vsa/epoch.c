@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <vsa/epoch.h>
+#include <vsa/log.h>
+
+typedef struct vsa_epoch_deferred_s vsa_epoch_deferred_t;
+
+struct vsa_epoch_deferred_s {
+    void                    (*free_cb)(void *);
+    void                   *data;
+    unsigned long           epoch;
+};
+
+static atomic_ulong     epoch = 1;
+
+// The epoch each reader entered at, 0 for readers outside of a critical section.
+static atomic_ulong     readers[VSA_EPOCH_MAX_READERS];
+static atomic_int       claimed[VSA_EPOCH_MAX_READERS];
+
+static __thread int     reader = -1;
+static __thread unsigned nesting;
+
+static GMutex           deferred_lock;
+static GQueue           deferred = G_QUEUE_INIT;
+
+static unsigned long    vsa_epoch_min_active(void);
+
+// The oldest epoch a reader is still in, or ULONG_MAX when there's none.
+static unsigned long
+vsa_epoch_min_active(void)
+{
+    unsigned long           min;
+
+    min = ULONG_MAX;
+    for (int i = 0; i < VSA_EPOCH_MAX_READERS; i++) {
+        unsigned long           e;
+
+        e = atomic_load(&readers[i]);
+        if (e && e < min) {
+            min = e;
+        }
+    }
+
+    return min;
+}
+
+int
+vsa_epoch_enter(void)
+{
+    if (-1 == reader) {
+        for (int i = 0; i < VSA_EPOCH_MAX_READERS && -1 == reader; i++) {
+            int                     unclaimed = 0;
+
+            if (atomic_compare_exchange_strong(&claimed[i], &unclaimed, 1)) {
+                reader = i;
+            }
+        }
+        if (-1 == reader) {
+            vsa_log_debugln("too many readers");
+            return -1;
+        }
+    }
+
+    if (!nesting++) {
+        atomic_store(&readers[reader], atomic_load(&epoch));
+    }
+
+    return 0;
+}
+
+void
+vsa_epoch_exit(void)
+{
+    if (-1 == reader || !nesting) {
+        return;
+    }
+
+    if (!--nesting) {
+        atomic_store(&readers[reader], 0);
+    }
+}
+
+void
+vsa_epoch_unregister(void)
+{
+    if (-1 == reader) {
+        return;
+    }
+    nesting = 0;
+    atomic_store(&readers[reader], 0);
+    atomic_store(&claimed[reader], 0);
+    reader = -1;
+}
+
+void
+vsa_epoch_synchronize(void)
+{
+    unsigned long           target;
+
+    target = atomic_fetch_add(&epoch, 1) + 1;
+    while (vsa_epoch_min_active() < target) {
+        sched_yield();
+    }
+}
+
+void
+vsa_epoch_defer(void (*free_cb)(void *), void *data)
+{
+    vsa_epoch_deferred_t   *item;
+
+    item = malloc(sizeof (vsa_epoch_deferred_t));
+    if (!item) {
+        // Better wait than leak or free too early.
+        vsa_log_debugln("%s", strerror(errno));
+        vsa_epoch_synchronize();
+        free_cb(data);
+        return;
+    }
+    item->free_cb = free_cb;
+    item->data = data;
+    item->epoch = atomic_fetch_add(&epoch, 1) + 1;
+
+    g_mutex_lock(&deferred_lock);
+    g_queue_push_tail(&deferred, item);
+    g_mutex_unlock(&deferred_lock);
+}
+
+void
+vsa_epoch_reclaim(void)
+{
+    unsigned long           min;
+    GQueue                  ready = G_QUEUE_INIT;
+    vsa_epoch_deferred_t   *item;
+
+    min = vsa_epoch_min_active();
+
+    // Items are queued in epoch order.
+    g_mutex_lock(&deferred_lock);
+    while ((item = g_queue_peek_head(&deferred)) && item->epoch <= min) {
+        g_queue_push_tail(&ready, g_queue_pop_head(&deferred));
+    }
+    g_mutex_unlock(&deferred_lock);
+
+    while ((item = g_queue_pop_head(&ready))) {
+        item->free_cb(item->data);
+        free(item);
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_EPOCH_H
+#define VSA_EPOCH_H
+
+#define VSA_EPOCH_ENTER_ERROR_MSG "vsa_epoch_enter() failed"
+
+// Threads that may read shared objects at the same time.
+#define VSA_EPOCH_MAX_READERS 64
+
+/*
+ * Epoch-based reclamation. Readers bracket their accesses to shared objects with vsa_epoch_enter() and
+ * vsa_epoch_exit(), and threads that won't read them anymore call vsa_epoch_unregister(). A writer that unpublished
+ * an object frees it either after vsa_epoch_synchronize() returns, or through vsa_epoch_defer(), in which case it is
+ * freed by a later vsa_epoch_reclaim() once no reader can still hold it.
+ */
+int                     vsa_epoch_enter(void);
+void                    vsa_epoch_exit(void);
+void                    vsa_epoch_unregister(void);
+void                    vsa_epoch_synchronize(void);
+void                    vsa_epoch_defer(void (*free_cb)(void *), void *data);
+void                    vsa_epoch_reclaim(void);
+
+#endif // VSA_EPOCH_H
@@ -0,0 +1,693 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vsa/expr.h>
+#include <vsa/log.h>
+#include <vsa/parser.h>
+
+#define VSA_EXPR_2_32 4294967296.0
+#define VSA_EXPR_2_64 18446744073709551616.0
+
+typedef struct vsa_expr_parser_s vsa_expr_parser_t;
+typedef struct vsa_expr_func_s vsa_expr_func_t;
+
+// An expression being compiled, with the depth its stack reaches so far.
+struct vsa_expr_parser_s {
+    const char             *p;
+    vsa_index_t            *index;
+    vsa_object_t           *object;
+    GArray                 *ops;
+    size_t                  depth;
+};
+
+struct vsa_expr_func_s {
+    const char             *name;
+    size_t                  nargs;
+    vsa_expr_code_t         code;
+};
+
+static const vsa_expr_func_t funcs[] = {
+    { "rand", 0, VSA_EXPR_RAND },
+    { "sin", 1, VSA_EXPR_SIN },
+    { "cos", 1, VSA_EXPR_COS },
+    { "abs", 1, VSA_EXPR_ABS },
+    { "floor", 1, VSA_EXPR_FLOOR },
+    { "ceil", 1, VSA_EXPR_CEIL },
+    { "round", 1, VSA_EXPR_ROUND },
+    { "sqrt", 1, VSA_EXPR_SQRT },
+    { "exp", 1, VSA_EXPR_EXP },
+    { "log", 1, VSA_EXPR_LOG },
+    { "min", 2, VSA_EXPR_MIN },
+    { "max", 2, VSA_EXPR_MAX },
+    { "pow", 2, VSA_EXPR_POW }
+};
+
+// When the first expressions were loaded, which t counts from across reloads.
+static guint64          start;
+
+static guint64          vsa_expr_clock(clockid_t clock);
+static int              vsa_expr_is_numeric(vsa_asn_type_t type);
+static double           vsa_expr_get_number(vsa_value_t * value);
+static int              vsa_expr_emit(vsa_expr_parser_t * parser, vsa_expr_code_t code, size_t pops, size_t pushes);
+static int              vsa_expr_match(vsa_expr_parser_t * parser, const char *token);
+static int              vsa_expr_parse_object(vsa_expr_parser_t * parser, const char *end);
+static int              vsa_expr_parse_call(vsa_expr_parser_t * parser, const char *name, size_t len);
+static int              vsa_expr_parse_primary(vsa_expr_parser_t * parser);
+static int              vsa_expr_parse_unary(vsa_expr_parser_t * parser);
+static int              vsa_expr_parse_binary(vsa_expr_parser_t * parser, int level);
+static int              vsa_expr_parse_cond(vsa_expr_parser_t * parser);
+static int              vsa_expr_add(vsa_index_t * index, vsa_object_t * object, const char *str);
+
+static guint64
+vsa_expr_clock(clockid_t clock)
+{
+    struct timespec         ts;
+
+    clock_gettime(clock, &ts);
+
+    return ts.tv_sec * G_GUINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static int
+vsa_expr_is_numeric(vsa_asn_type_t type)
+{
+    switch (type) {
+    case VSA_ASN_COUNTER_32:
+    case VSA_ASN_COUNTER_64:
+    case VSA_ASN_GAUGE_32:
+    case VSA_ASN_INTEGER:
+    case VSA_ASN_TIMETICKS:
+    case VSA_ASN_UNSIGNED_32:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static double
+vsa_expr_get_number(vsa_value_t * value)
+{
+    switch (value->type) {
+    case VSA_ASN_INTEGER:
+        return value->value.int_value;
+    case VSA_ASN_COUNTER_64:
+        return ldexp(value->value.counter64_value.high, 32) + value->value.counter64_value.low;
+    default:
+        return value->value.ulong_value;
+    }
+}
+
+static int
+vsa_expr_emit(vsa_expr_parser_t * parser, vsa_expr_code_t code, size_t pops, size_t pushes)
+{
+    vsa_expr_op_t           op;
+
+    parser->depth = parser->depth - pops + pushes;
+    if (parser->depth > VSA_EXPR_STACK) {
+        vsa_log_debugln("expression nested too deep");
+        return -1;
+    }
+
+    op.code = code;
+    op.arg.object = NULL;
+    g_array_append_val(parser->ops, op);
+
+    return 0;
+}
+
+// Skips spaces and token if it comes next.
+static int
+vsa_expr_match(vsa_expr_parser_t * parser, const char *token)
+{
+    while (isspace((unsigned char) *parser->p)) {
+        parser->p++;
+    }
+    if (strncmp(parser->p, token, strlen(token))) {
+        return 0;
+    }
+    parser->p += strlen(token);
+
+    return 1;
+}
+
+static int
+vsa_expr_parse_object(vsa_expr_parser_t * parser, const char *end)
+{
+    char                   *str;
+    oid                    *oids;
+    size_t                  len;
+    vsa_object_t           *object;
+
+    str = g_strndup(parser->p, end - parser->p);
+    oids = vsa_parser_parse_oid(str, &len);
+    object = oids ? vsa_index_get(parser->index, oids, len) : NULL;
+    free(oids);
+    if (!object || !vsa_expr_is_numeric(object->value->type)) {
+        vsa_log_debugln("no numeric object '%s'", str);
+        g_free(str);
+        return -1;
+    }
+    g_free(str);
+
+    if (vsa_expr_emit(parser, VSA_EXPR_OBJECT, 0, 1)) {
+        return -1;
+    }
+    g_array_index(parser->ops, vsa_expr_op_t, parser->ops->len - 1).arg.object = object;
+    parser->p = end;
+
+    return 0;
+}
+
+static int
+vsa_expr_parse_call(vsa_expr_parser_t * parser, const char *name, size_t len)
+{
+    const vsa_expr_func_t  *func;
+
+    func = NULL;
+    for (size_t i = 0; i < G_N_ELEMENTS(funcs); i++) {
+        if (strlen(funcs[i].name) == len && !strncmp(funcs[i].name, name, len)) {
+            func = &funcs[i];
+        }
+    }
+    if (!func) {
+        vsa_log_debugln("unknown function '%.*s'", (int) len, name);
+        return -1;
+    }
+
+    for (size_t i = 0; i < func->nargs; i++) {
+        if ((i && !vsa_expr_match(parser, ",")) || vsa_expr_parse_cond(parser)) {
+            vsa_log_debugln("%s() takes %zu arguments", func->name, func->nargs);
+            return -1;
+        }
+    }
+    if (!vsa_expr_match(parser, ")")) {
+        vsa_log_debugln("%s() takes %zu arguments", func->name, func->nargs);
+        return -1;
+    }
+
+    return vsa_expr_emit(parser, func->code, func->nargs, 1);
+}
+
+/*
+ * A number, an object given by its OID (two dots at least, so that it reads apart from a number), v for the value of
+ * the object computed, t for the seconds since start, now for those since the epoch, a call or a parenthesized
+ * expression.
+ */
+static int
+vsa_expr_parse_primary(vsa_expr_parser_t * parser)
+{
+    const char             *name, *end;
+    size_t                  len, dots;
+    char                   *p;
+    double                  number;
+
+    if (vsa_expr_match(parser, "(")) {
+        if (vsa_expr_parse_cond(parser)) {
+            return -1;
+        }
+        if (!vsa_expr_match(parser, ")")) {
+            vsa_log_debugln("missing ')' at '%s'", parser->p);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (isdigit((unsigned char) *parser->p) || '.' == *parser->p) {
+        dots = 0;
+        for (end = parser->p; isdigit((unsigned char) *end) || '.' == *end; end++) {
+            dots += '.' == *end;
+        }
+        if (dots > 1) {
+            return vsa_expr_parse_object(parser, end);
+        }
+
+        errno = 0;
+        number = strtod(parser->p, &p);
+        if (errno || p == parser->p) {
+            vsa_log_debugln("invalid number at '%s'", parser->p);
+            return -1;
+        }
+        parser->p = p;
+        if (vsa_expr_emit(parser, VSA_EXPR_NUMBER, 0, 1)) {
+            return -1;
+        }
+        g_array_index(parser->ops, vsa_expr_op_t, parser->ops->len - 1).arg.number = number;
+        return 0;
+    }
+
+    name = parser->p;
+    for (len = 0; isalnum((unsigned char) name[len]) || '_' == name[len]; len++);
+    if (!len) {
+        vsa_log_debugln("unexpected '%s'", parser->p);
+        return -1;
+    }
+    parser->p += len;
+
+    if (vsa_expr_match(parser, "(")) {
+        return vsa_expr_parse_call(parser, name, len);
+    }
+    if (1 == len && 'v' == *name) {
+        if (vsa_expr_emit(parser, VSA_EXPR_OBJECT, 0, 1)) {
+            return -1;
+        }
+        g_array_index(parser->ops, vsa_expr_op_t, parser->ops->len - 1).arg.object = parser->object;
+        return 0;
+    }
+    if (1 == len && 't' == *name) {
+        return vsa_expr_emit(parser, VSA_EXPR_TIME, 0, 1);
+    }
+    if (3 == len && !strncmp(name, "now", len)) {
+        return vsa_expr_emit(parser, VSA_EXPR_NOW, 0, 1);
+    }
+
+    vsa_log_debugln("unknown name '%.*s'", (int) len, name);
+    return -1;
+}
+
+static int
+vsa_expr_parse_unary(vsa_expr_parser_t * parser)
+{
+    if (vsa_expr_match(parser, "-")) {
+        return vsa_expr_parse_unary(parser) || vsa_expr_emit(parser, VSA_EXPR_NEG, 1, 1);
+    }
+    if (vsa_expr_match(parser, "!")) {
+        return vsa_expr_parse_unary(parser) || vsa_expr_emit(parser, VSA_EXPR_NOT, 1, 1);
+    }
+
+    return vsa_expr_parse_primary(parser);
+}
+
+/*
+ * The binary operators of a precedence level and those binding tighter, left to right. Longer tokens come first, so
+ * that <= isn't read as <.
+ */
+static int
+vsa_expr_parse_binary(vsa_expr_parser_t * parser, int level)
+{
+    static const struct {
+        const char             *token;
+        vsa_expr_code_t         code;
+    } levels[][6] = {
+        { { "||", VSA_EXPR_OR } },
+        { { "&&", VSA_EXPR_AND } },
+        { { "==", VSA_EXPR_EQ }, { "!=", VSA_EXPR_NE } },
+        { { "<=", VSA_EXPR_LE }, { ">=", VSA_EXPR_GE }, { "<", VSA_EXPR_LT }, { ">", VSA_EXPR_GT } },
+        { { "+", VSA_EXPR_ADD }, { "-", VSA_EXPR_SUB } },
+        { { "*", VSA_EXPR_MUL }, { "/", VSA_EXPR_DIV }, { "%", VSA_EXPR_MOD } }
+    };
+    int                     found;
+
+    if (level == (int) G_N_ELEMENTS(levels)) {
+        return vsa_expr_parse_unary(parser);
+    }
+
+    if (vsa_expr_parse_binary(parser, level + 1)) {
+        return -1;
+    }
+    do {
+        found = 0;
+        for (size_t i = 0; !found && i < G_N_ELEMENTS(levels[level]) && levels[level][i].token; i++) {
+            if (vsa_expr_match(parser, levels[level][i].token)) {
+                found = 1;
+                if (vsa_expr_parse_binary(parser, level + 1)
+                    || vsa_expr_emit(parser, levels[level][i].code, 2, 1)) {
+                    return -1;
+                }
+            }
+        }
+    } while (found);
+
+    return 0;
+}
+
+// Both branches of COND ? A : B are evaluated, there being no side effects to skip.
+static int
+vsa_expr_parse_cond(vsa_expr_parser_t * parser)
+{
+    if (vsa_expr_parse_binary(parser, 0)) {
+        return -1;
+    }
+    if (!vsa_expr_match(parser, "?")) {
+        return 0;
+    }
+
+    if (vsa_expr_parse_cond(parser)) {
+        return -1;
+    }
+    if (!vsa_expr_match(parser, ":")) {
+        vsa_log_debugln("missing ':' at '%s'", parser->p);
+        return -1;
+    }
+    if (vsa_expr_parse_cond(parser)) {
+        return -1;
+    }
+
+    return vsa_expr_emit(parser, VSA_EXPR_SELECT, 3, 1);
+}
+
+static int
+vsa_expr_add(vsa_index_t * index, vsa_object_t * object, const char *str)
+{
+    vsa_expr_t             *expr;
+
+    expr = vsa_expr_compile(str, index, object);
+    if (!expr) {
+        vsa_log_debugln(VSA_EXPR_COMPILE_ERROR_MSG);
+        return -1;
+    }
+
+    if (!index->exprs) {
+        index->exprs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, vsa_expr_free_cb);
+    }
+    g_hash_table_replace(index->exprs, object, expr);
+
+    return 0;
+}
+
+/*
+ * Compiles str into the operations that compute the value of object, whose type must be numeric, as must be that of
+ * the objects str reads from index.
+ */
+vsa_expr_t             *
+vsa_expr_compile(const char *str, vsa_index_t * index, vsa_object_t * object)
+{
+    vsa_expr_parser_t       parser;
+    vsa_expr_t             *expr;
+
+    if (!vsa_expr_is_numeric(object->value->type)) {
+        vsa_log_debugln("%s values can't be computed", vsa_asn_type_get_name(object->value->type));
+        return NULL;
+    }
+
+    parser.p = str;
+    parser.index = index;
+    parser.object = object;
+    parser.ops = g_array_new(FALSE, FALSE, sizeof (vsa_expr_op_t));
+    parser.depth = 0;
+
+    if (vsa_expr_parse_cond(&parser)) {
+        g_array_free(parser.ops, TRUE);
+        return NULL;
+    }
+    if (!vsa_expr_match(&parser, "") || *parser.p) {
+        vsa_log_debugln("unexpected '%s'", parser.p);
+        g_array_free(parser.ops, TRUE);
+        return NULL;
+    }
+
+    expr = malloc(sizeof (vsa_expr_t) + parser.ops->len * sizeof (vsa_expr_op_t));
+    if (!expr) {
+        vsa_log_debugln("%s", strerror(errno));
+        g_array_free(parser.ops, TRUE);
+        return NULL;
+    }
+    expr->object = object;
+    expr->len = parser.ops->len;
+    memcpy(expr->ops, parser.ops->data, parser.ops->len * sizeof (vsa_expr_op_t));
+    g_array_free(parser.ops, TRUE);
+
+    return expr;
+}
+
+void                   *
+vsa_expr_free(vsa_expr_t * expr)
+{
+    free(expr);
+
+    return NULL;
+}
+
+void
+vsa_expr_free_cb(gpointer data)
+{
+    vsa_expr_free(data);
+}
+
+double
+vsa_expr_eval(vsa_expr_t * expr)
+{
+    double                  stack[VSA_EXPR_STACK];
+    size_t                  sp;
+    double                 *top;
+
+    sp = 0;
+    for (size_t i = 0; i < expr->len; i++) {
+        const vsa_expr_op_t    *op;
+
+        op = &expr->ops[i];
+        top = sp ? &stack[sp - 1] : stack;
+        switch (op->code) {
+        case VSA_EXPR_NUMBER:
+            stack[sp++] = op->arg.number;
+            break;
+        case VSA_EXPR_OBJECT:
+            stack[sp++] = vsa_expr_get_number(op->arg.object->value);
+            break;
+        case VSA_EXPR_TIME:
+            // The coarse clocks, a few milliseconds apart, are read several times faster.
+            stack[sp++] = (vsa_expr_clock(CLOCK_MONOTONIC_COARSE) - start) / 1e9;
+            break;
+        case VSA_EXPR_NOW:
+            stack[sp++] = vsa_expr_clock(CLOCK_REALTIME_COARSE) / 1e9;
+            break;
+        case VSA_EXPR_RAND:
+            stack[sp++] = g_random_double();
+            break;
+        case VSA_EXPR_NEG:
+            *top = -*top;
+            break;
+        case VSA_EXPR_NOT:
+            *top = !*top;
+            break;
+        case VSA_EXPR_SIN:
+            *top = sin(*top);
+            break;
+        case VSA_EXPR_COS:
+            *top = cos(*top);
+            break;
+        case VSA_EXPR_ABS:
+            *top = fabs(*top);
+            break;
+        case VSA_EXPR_FLOOR:
+            *top = floor(*top);
+            break;
+        case VSA_EXPR_CEIL:
+            *top = ceil(*top);
+            break;
+        case VSA_EXPR_ROUND:
+            *top = round(*top);
+            break;
+        case VSA_EXPR_SQRT:
+            *top = sqrt(*top);
+            break;
+        case VSA_EXPR_EXP:
+            *top = exp(*top);
+            break;
+        case VSA_EXPR_LOG:
+            *top = log(*top);
+            break;
+        case VSA_EXPR_SELECT:
+            sp -= 2;
+            top = &stack[sp - 1];
+            *top = *top ? top[1] : top[2];
+            break;
+        default:
+            // Binary operators, replacing their two operands.
+            sp--;
+            top = &stack[sp - 1];
+            switch (op->code) {
+            case VSA_EXPR_ADD:
+                *top += top[1];
+                break;
+            case VSA_EXPR_SUB:
+                *top -= top[1];
+                break;
+            case VSA_EXPR_MUL:
+                *top *= top[1];
+                break;
+            case VSA_EXPR_DIV:
+                *top /= top[1];
+                break;
+            case VSA_EXPR_MOD:
+                *top = fmod(*top, top[1]);
+                break;
+            case VSA_EXPR_LT:
+                *top = *top < top[1];
+                break;
+            case VSA_EXPR_LE:
+                *top = *top <= top[1];
+                break;
+            case VSA_EXPR_GT:
+                *top = *top > top[1];
+                break;
+            case VSA_EXPR_GE:
+                *top = *top >= top[1];
+                break;
+            case VSA_EXPR_EQ:
+                *top = *top == top[1];
+                break;
+            case VSA_EXPR_NE:
+                *top = *top != top[1];
+                break;
+            case VSA_EXPR_AND:
+                *top = *top && top[1];
+                break;
+            case VSA_EXPR_OR:
+                *top = *top || top[1];
+                break;
+            case VSA_EXPR_MIN:
+                *top = fmin(*top, top[1]);
+                break;
+            case VSA_EXPR_MAX:
+                *top = fmax(*top, top[1]);
+                break;
+            case VSA_EXPR_POW:
+                *top = pow(*top, top[1]);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return sp ? stack[sp - 1] : 0;
+}
+
+/*
+ * Sets var to the value of expr, as the type of its object: rounded, counters wrapping around and other types
+ * saturating at their bounds. NaN reads as 0.
+ */
+int
+vsa_expr_to_var(vsa_expr_t * expr, netsnmp_variable_list * var)
+{
+    double                  number;
+    guint64                 counter;
+    vsa_value_t             value;
+
+    number = round(vsa_expr_eval(expr));
+    value.type = expr->object->value->type;
+
+    switch (value.type) {
+    case VSA_ASN_INTEGER:
+        value.value.int_value = isnan(number) ? 0 : CLAMP(number, G_MININT32, G_MAXINT32);
+        break;
+    case VSA_ASN_COUNTER_32:
+        number = fmod(number, VSA_EXPR_2_32);
+        value.value.ulong_value = isnan(number) ? 0 : number < 0 ? number + VSA_EXPR_2_32 : number;
+        break;
+    case VSA_ASN_COUNTER_64:
+        number = fmod(number, VSA_EXPR_2_64);
+        counter = isnan(number) ? 0 : number < 0 ? number + VSA_EXPR_2_64 : number;
+        value.value.counter64_value.high = counter >> 32;
+        value.value.counter64_value.low = counter & 0xffffffff;
+        break;
+    default:
+        value.value.ulong_value = isnan(number) ? 0 : CLAMP(number, 0, G_MAXUINT32);
+        break;
+    }
+
+    return vsa_value_to_var(&value, var);
+}
+
+/*
+ * Compiles the expressions of a rules file for the objects of index, whose lines are OID = EXPRESSION. An OID that
+ * isn't an object applies to each object under it. Blank lines and lines starting with # are skipped.
+ */
+int
+vsa_expr_load(vsa_index_t * index, const char *path)
+{
+    FILE                   *fp;
+    char                   *line, *str, *eq;
+    size_t                  size, lineno, len, pos, computed;
+    oid                    *oids;
+    vsa_object_t           *object;
+    vsa_oid_t              *tree;
+    int                     ret;
+
+    if (!start) {
+        start = vsa_expr_clock(CLOCK_MONOTONIC_COARSE);
+    }
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    ret = 0;
+    line = NULL;
+    size = 0;
+    for (lineno = 1; !ret && getline(&line, &size, fp) != -1; lineno++) {
+        str = g_strstrip(line);
+        if (!*str || '#' == *str) {
+            continue;
+        }
+
+        eq = strchr(str, '=');
+        if (!eq) {
+            vsa_log_debugln("%s:%zu: missing '='", path, lineno);
+            ret = -1;
+            break;
+        }
+        *eq = '\0';
+        oids = vsa_parser_parse_oid(g_strstrip(str), &len);
+        if (!oids) {
+            vsa_log_debugln("%s:%zu: invalid OID '%s'", path, lineno, str);
+            ret = -1;
+            break;
+        }
+
+        object = vsa_index_get(index, oids, len);
+        if (object) {
+            ret = vsa_expr_add(index, object, eq + 1);
+            computed = 1;
+        } else {
+            computed = 0;
+            for (pos = vsa_index_next(index, oids, len); !ret && pos < index->len; pos++) {
+                tree = index->objects[pos]->tree;
+                if (tree->len < len || snmp_oid_compare(tree->oids, len, oids, len)) {
+                    break;
+                }
+                ret = vsa_expr_add(index, index->objects[pos], eq + 1);
+                computed++;
+            }
+        }
+        free(oids);
+
+        if (ret) {
+            vsa_log_debugln("%s:%zu: invalid expression", path, lineno);
+        } else if (!computed) {
+            vsa_log_debugln("%s:%zu: no objects under '%s'", path, lineno, str);
+            ret = -1;
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    return ret;
+}
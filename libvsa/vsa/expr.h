@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_EXPR_H
+#define VSA_EXPR_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/index.h>
+#include <vsa/object.h>
+
+#define VSA_EXPR_COMPILE_ERROR_MSG "vsa_expr_compile() failed"
+#define VSA_EXPR_LOAD_ERROR_MSG "vsa_expr_load() failed"
+#define VSA_EXPR_TO_VAR_ERROR_MSG "vsa_expr_to_var() failed"
+
+// Values an expression may have pending at once, bounding its nesting.
+#define VSA_EXPR_STACK 32
+
+typedef enum vsa_expr_code_e vsa_expr_code_t;
+typedef struct vsa_expr_op_s vsa_expr_op_t;
+typedef struct vsa_expr_s vsa_expr_t;
+
+enum vsa_expr_code_e {
+    VSA_EXPR_NUMBER,
+    VSA_EXPR_OBJECT,
+    VSA_EXPR_TIME,
+    VSA_EXPR_NOW,
+    VSA_EXPR_RAND,
+    VSA_EXPR_NEG,
+    VSA_EXPR_NOT,
+    VSA_EXPR_ADD,
+    VSA_EXPR_SUB,
+    VSA_EXPR_MUL,
+    VSA_EXPR_DIV,
+    VSA_EXPR_MOD,
+    VSA_EXPR_LT,
+    VSA_EXPR_LE,
+    VSA_EXPR_GT,
+    VSA_EXPR_GE,
+    VSA_EXPR_EQ,
+    VSA_EXPR_NE,
+    VSA_EXPR_AND,
+    VSA_EXPR_OR,
+    VSA_EXPR_SELECT,
+    VSA_EXPR_SIN,
+    VSA_EXPR_COS,
+    VSA_EXPR_ABS,
+    VSA_EXPR_FLOOR,
+    VSA_EXPR_CEIL,
+    VSA_EXPR_ROUND,
+    VSA_EXPR_SQRT,
+    VSA_EXPR_EXP,
+    VSA_EXPR_LOG,
+    VSA_EXPR_MIN,
+    VSA_EXPR_MAX,
+    VSA_EXPR_POW
+};
+
+// Pushes its number or the value of its object, or replaces the values on top of the stack with its result.
+struct vsa_expr_op_s {
+    vsa_expr_code_t         code;
+    union {
+        double                  number;
+        vsa_object_t           *object;
+    } arg;
+};
+
+/*
+ * An expression compiled for the object it computes the value of, as postfix operations on a stack of doubles. The
+ * objects it reads are resolved once, when compiled.
+ */
+struct vsa_expr_s {
+    vsa_object_t           *object;
+    size_t                  len;
+    vsa_expr_op_t           ops[];
+};
+
+vsa_expr_t             *vsa_expr_compile(const char *str, vsa_index_t * index, vsa_object_t * object);
+void                   *vsa_expr_free(vsa_expr_t * expr);
+void                    vsa_expr_free_cb(gpointer data);
+double                  vsa_expr_eval(vsa_expr_t * expr);
+int                     vsa_expr_to_var(vsa_expr_t * expr, netsnmp_variable_list * var);
+int                     vsa_expr_load(vsa_index_t * index, const char *path);
+
+#endif // VSA_EXPR_H
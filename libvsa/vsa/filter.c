@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include <vsa/filter.h>
+#include <vsa/log.h>
+
+#define VSA_FILTER_GROW_ERROR_MSG "vsa_filter_grow() failed"
+#define VSA_FILTER_MERGE_NODE_ERROR_MSG "vsa_filter_merge_node() failed"
+
+static vsa_filter_edge_t *vsa_filter_find(const vsa_filter_node_t * node, oid arc, size_t *pos);
+static ssize_t          vsa_filter_grow(vsa_filter_t * filter, size_t parent, size_t pos, oid arc);
+static int              vsa_filter_merge_node(vsa_filter_t * filter, const vsa_filter_t * other, size_t node,
+                                              oid * oids, size_t len);
+static vsa_filter_rule_t vsa_filter_default(const vsa_filter_t * filter);
+
+// The edge of node labeled arc, or NULL with *pos, if given, set to where it would be inserted.
+static vsa_filter_edge_t *
+vsa_filter_find(const vsa_filter_node_t * node, oid arc, size_t *pos)
+{
+    size_t                  lo, hi, mid;
+
+    lo = 0;
+    hi = node->nedges;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (node->edges[mid].arc < arc) {
+            lo = mid + 1;
+        } else if (node->edges[mid].arc > arc) {
+            hi = mid;
+        } else {
+            return &node->edges[mid];
+        }
+    }
+    if (pos) {
+        *pos = lo;
+    }
+
+    return NULL;
+}
+
+// Adds a child labeled arc to parent, at position pos among its edges, and returns its index.
+static ssize_t
+vsa_filter_grow(vsa_filter_t * filter, size_t parent, size_t pos, oid arc)
+{
+    vsa_filter_node_t      *nodes, *node;
+    vsa_filter_edge_t      *edges;
+
+    nodes = realloc(filter->nodes, (filter->nnodes + 1) * sizeof (*nodes));
+    if (!nodes) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    filter->nodes = nodes;
+
+    node = &nodes[parent];
+    edges = realloc(node->edges, (node->nedges + 1) * sizeof (*edges));
+    if (!edges) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    memmove(&edges[pos + 1], &edges[pos], (node->nedges - pos) * sizeof (*edges));
+    edges[pos].arc = arc;
+    edges[pos].node = filter->nnodes;
+    node->edges = edges;
+    node->nedges++;
+
+    memset(&nodes[filter->nnodes], 0, sizeof (*nodes));
+
+    return filter->nnodes++;
+}
+
+// Adds the rules found at and below node of other, whose prefix is the len subidentifiers in oids.
+static int
+vsa_filter_merge_node(vsa_filter_t * filter, const vsa_filter_t * other, size_t node, oid * oids, size_t len)
+{
+    const vsa_filter_node_t *from;
+
+    from = &other->nodes[node];
+    if (VSA_FILTER_NONE != from->rule && vsa_filter_add(filter, from->rule, oids, len)) {
+        vsa_log_debugln(VSA_FILTER_ADD_ERROR_MSG);
+        return -1;
+    }
+
+    for (size_t i = 0; i < from->nedges; i++) {
+        oids[len] = from->edges[i].arc;
+        if (vsa_filter_merge_node(filter, other, from->edges[i].node, oids, len + 1)) {
+            vsa_log_debugln(VSA_FILTER_MERGE_NODE_ERROR_MSG);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static vsa_filter_rule_t
+vsa_filter_default(const vsa_filter_t * filter)
+{
+    return filter->nincludes ? VSA_FILTER_EXCLUDE : VSA_FILTER_INCLUDE;
+}
+
+vsa_filter_t           *
+vsa_filter_new(void)
+{
+    vsa_filter_t           *filter;
+
+    filter = calloc(1, sizeof (*filter));
+    if (!filter) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    // The root, for the empty prefix.
+    filter->nodes = calloc(1, sizeof (*filter->nodes));
+    if (!filter->nodes) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(filter);
+        return NULL;
+    }
+    filter->nnodes = 1;
+
+    return filter;
+}
+
+void                   *
+vsa_filter_free(vsa_filter_t * filter)
+{
+    if (filter) {
+        for (size_t i = 0; i < filter->nnodes; i++) {
+            free(filter->nodes[i].edges);
+        }
+        free(filter->nodes);
+        free(filter);
+    }
+
+    return NULL;
+}
+
+// Sets rule on the prefix of len subidentifiers in oids, replacing the one it had. VSA_FILTER_NONE removes it.
+int
+vsa_filter_add(vsa_filter_t * filter, vsa_filter_rule_t rule, const oid * oids, size_t len)
+{
+    size_t                  node, pos;
+    ssize_t                 child;
+    vsa_filter_edge_t      *edge;
+
+    if (len > MAX_OID_LEN) {
+        vsa_log_debugln("prefix longer than %d subidentifiers", MAX_OID_LEN);
+        return -1;
+    }
+
+    node = 0;
+    for (size_t i = 0; i < len; i++) {
+        edge = vsa_filter_find(&filter->nodes[node], oids[i], &pos);
+        if (edge) {
+            node = edge->node;
+            continue;
+        }
+        child = vsa_filter_grow(filter, node, pos, oids[i]);
+        if (-1 == child) {
+            vsa_log_debugln(VSA_FILTER_GROW_ERROR_MSG);
+            return -1;
+        }
+        node = child;
+    }
+
+    if (VSA_FILTER_INCLUDE == filter->nodes[node].rule) {
+        filter->nincludes--;
+    }
+    if (VSA_FILTER_INCLUDE == rule) {
+        filter->nincludes++;
+    }
+    filter->nodes[node].rule = rule;
+
+    return 0;
+}
+
+// Adds the rules of other to filter, replacing those filter has on the same prefixes.
+int
+vsa_filter_merge(vsa_filter_t * filter, const vsa_filter_t * other)
+{
+    oid                     oids[MAX_OID_LEN];
+
+    if (vsa_filter_merge_node(filter, other, 0, oids, 0)) {
+        vsa_log_debugln(VSA_FILTER_MERGE_NODE_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Whether filter has no rules, and so includes every OID.
+int
+vsa_filter_is_empty(const vsa_filter_t * filter)
+{
+    return !filter->nodes[0].nedges && VSA_FILTER_NONE == filter->nodes[0].rule;
+}
+
+// Whether the OID of len subidentifiers in oids is included. The walk stops at the first subidentifier without an edge.
+int
+vsa_filter_match(const vsa_filter_t * filter, const oid * oids, size_t len)
+{
+    vsa_filter_rule_t       rule;
+    const vsa_filter_node_t *node;
+    const vsa_filter_edge_t *edge;
+
+    rule = vsa_filter_default(filter);
+    node = filter->nodes;
+    for (size_t i = 0;; i++) {
+        if (VSA_FILTER_NONE != node->rule) {
+            rule = node->rule;
+        }
+        if (i == len || !(edge = vsa_filter_find(node, oids[i], NULL))) {
+            break;
+        }
+        node = &filter->nodes[edge->node];
+    }
+
+    return VSA_FILTER_INCLUDE == rule;
+}
+
+/*
+ * Like vsa_filter_match(), for an OID of len chars in the dotted form of a walk, such as .1.3.6.1 or iso.3.6.1. Only
+ * the subidentifiers needed to decide are read and nothing is allocated, so lines can be filtered as they are read.
+ */
+int
+vsa_filter_match_str(const vsa_filter_t * filter, const char *str, size_t len)
+{
+    oid                     arc;
+    const char             *p, *end;
+    vsa_filter_rule_t       rule;
+    const vsa_filter_node_t *node;
+    const vsa_filter_edge_t *edge;
+
+    p = str;
+    end = str + len;
+    if (p < end && '.' == *p) {
+        p++;
+    }
+
+    rule = vsa_filter_default(filter);
+    node = filter->nodes;
+    while (1) {
+        if (VSA_FILTER_NONE != node->rule) {
+            rule = node->rule;
+        }
+        if (p == end || !node->nedges) {
+            break;
+        }
+
+        if (end - p >= 3 && !strncasecmp(p, "iso", 3)) {
+            arc = 1;
+            p += 3;
+        } else if (isdigit((unsigned char) *p)) {
+            for (arc = 0; p < end && isdigit((unsigned char) *p); p++) {
+                arc = arc * 10 + (*p - '0');
+            }
+        } else {
+            break;
+        }
+        if (p < end && '.' == *p) {
+            p++;
+        }
+
+        edge = vsa_filter_find(node, arc, NULL);
+        if (!edge) {
+            break;
+        }
+        node = &filter->nodes[edge->node];
+    }
+
+    return VSA_FILTER_INCLUDE == rule;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_FILTER_H
+#define VSA_FILTER_H
+
+#include <vsa/oid.h>
+
+#define VSA_FILTER_NEW_ERROR_MSG "vsa_filter_new() failed"
+#define VSA_FILTER_ADD_ERROR_MSG "vsa_filter_add() failed"
+#define VSA_FILTER_MERGE_ERROR_MSG "vsa_filter_merge() failed"
+
+typedef enum vsa_filter_rule_e vsa_filter_rule_t;
+typedef struct vsa_filter_edge_s vsa_filter_edge_t;
+typedef struct vsa_filter_node_s vsa_filter_node_t;
+typedef struct vsa_filter_s vsa_filter_t;
+
+enum vsa_filter_rule_e {
+    VSA_FILTER_NONE,
+    VSA_FILTER_INCLUDE,
+    VSA_FILTER_EXCLUDE
+};
+
+struct vsa_filter_edge_s {
+    oid                     arc;
+    size_t                  node;
+};
+
+// The rule set on the prefix ending at the node, if any, and the edges to its children, sorted by arc.
+struct vsa_filter_node_s {
+    vsa_filter_rule_t       rule;
+    vsa_filter_edge_t      *edges;
+    size_t                  nedges;
+};
+
+/*
+ * Include and exclude rules on OID prefixes, compiled into a trie walked one subidentifier at a time. An OID takes the
+ * rule of its longest matching prefix. OIDs matching none are included, unless there are include rules.
+ */
+struct vsa_filter_s {
+    vsa_filter_node_t      *nodes;
+    size_t                  nnodes;
+    size_t                  nincludes;
+};
+
+vsa_filter_t           *vsa_filter_new(void);
+void                   *vsa_filter_free(vsa_filter_t * filter);
+int                     vsa_filter_add(vsa_filter_t * filter, vsa_filter_rule_t rule, const oid * oids, size_t len);
+int                     vsa_filter_merge(vsa_filter_t * filter, const vsa_filter_t * other);
+int                     vsa_filter_is_empty(const vsa_filter_t * filter);
+int                     vsa_filter_match(const vsa_filter_t * filter, const oid * oids, size_t len);
+int                     vsa_filter_match_str(const vsa_filter_t * filter, const char *str, size_t len);
+
+#endif // VSA_FILTER_H
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <vsa/handover.h>
+#include <vsa/log.h>
+
+static int              vsa_handover_set_addr(struct sockaddr_un *addr, const char *path);
+
+static int
+vsa_handover_set_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof (*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof (addr->sun_path)) {
+        vsa_log_debugln("path too long: '%s'", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+
+    return 0;
+}
+
+int
+vsa_handover_listen(const char *path)
+{
+    int                     sock;
+    char                   *tmp;
+    struct sockaddr_un      addr;
+
+    if (-1 == asprintf(&tmp, "%s.%ld", path, (long) getpid())) {
+        vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
+        return -1;
+    }
+
+    if (vsa_handover_set_addr(&addr, tmp)) {
+        free(tmp);
+        return -1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (-1 == sock) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(tmp);
+        return -1;
+    }
+
+    // Bound under a temporary name first, then renamed over the previous socket so that path is never missing.
+    unlink(tmp);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof (addr)) || listen(sock, 1) || rename(tmp, path)) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        unlink(tmp);
+        close(sock);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+
+    return sock;
+}
+
+int
+vsa_handover_connect(const char *path)
+{
+    int                     sock, errnum;
+    struct sockaddr_un      addr;
+
+    if (vsa_handover_set_addr(&addr, path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (-1 == sock) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof (addr))) {
+        errnum = errno;
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        close(sock);
+        errno = errnum;
+        return -1;
+    }
+
+    return sock;
+}
+
+int
+vsa_handover_send(int sock, const int *fds, size_t nfds)
+{
+    char                    byte;
+    struct iovec            iov;
+    struct msghdr           msg;
+    struct cmsghdr         *cmsg;
+    union {
+        char                    buf[CMSG_SPACE(sizeof (int) * VSA_HANDOVER_MAX_FDS)];
+        struct cmsghdr          align;
+    } control;
+
+    if (!nfds || nfds > VSA_HANDOVER_MAX_FDS) {
+        vsa_log_debugln("invalid number of descriptors: %zu", nfds);
+        return -1;
+    }
+
+    // At least one byte of data must go along with the descriptors.
+    byte = (char) nfds;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    memset(&msg, 0, sizeof (msg));
+    memset(&control, 0, sizeof (control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof (int) * nfds);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof (int) * nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof (int) * nfds);
+
+    if (1 != sendmsg(sock, &msg, MSG_NOSIGNAL)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+vsa_handover_receive(int sock, int *fds, size_t *nfds)
+{
+    char                    byte;
+    ssize_t                 len;
+    struct iovec            iov;
+    struct msghdr           msg;
+    struct cmsghdr         *cmsg;
+    union {
+        char                    buf[CMSG_SPACE(sizeof (int) * VSA_HANDOVER_MAX_FDS)];
+        struct cmsghdr          align;
+    } control;
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    memset(&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (1 != len) {
+        vsa_log_debugln("%s", len ? strerror(errno) : "connection closed");
+        return -1;
+    }
+
+    *nfds = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+            *nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+            memcpy(fds, CMSG_DATA(cmsg), sizeof (int) * *nfds);
+        }
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC || *nfds != (size_t) byte) {
+        vsa_log_debugln("expected %d descriptors, got %zu", byte, *nfds);
+        for (size_t i = 0; i < *nfds; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+
+    return 0;
+}
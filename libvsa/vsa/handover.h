@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_HANDOVER_H
+#define VSA_HANDOVER_H
+
+#include <stddef.h>
+
+#define VSA_HANDOVER_LISTEN_ERROR_MSG "vsa_handover_listen() failed"
+#define VSA_HANDOVER_CONNECT_ERROR_MSG "vsa_handover_connect() failed"
+#define VSA_HANDOVER_SEND_ERROR_MSG "vsa_handover_send() failed"
+#define VSA_HANDOVER_RECEIVE_ERROR_MSG "vsa_handover_receive() failed"
+
+// File descriptors passed at once.
+#define VSA_HANDOVER_MAX_FDS 16
+
+/*
+ * Passing of open file descriptors between processes over a Unix socket, used to hand the bound agent sockets and a
+ * snapshot of the objects over to a new vsa process.
+ *
+ * vsa_handover_listen() atomically replaces whatever is at path, so a new process can take it over while the previous
+ * one is still running. vsa_handover_connect() fails with errno set to ENOENT or ECONNREFUSED when there's no process
+ * to take over from.
+ */
+int                     vsa_handover_listen(const char *path);
+int                     vsa_handover_connect(const char *path);
+int                     vsa_handover_send(int sock, const int *fds, size_t nfds);
+int                     vsa_handover_receive(int sock, int *fds, size_t *nfds);
+
+#endif // VSA_HANDOVER_H
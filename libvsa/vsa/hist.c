@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <vsa/hist.h>
+
+static unsigned         vsa_hist_get_bucket(uint64_t value);
+static uint64_t         vsa_hist_get_value(unsigned bucket);
+
+static unsigned
+vsa_hist_get_bucket(uint64_t value)
+{
+    unsigned                shift;
+
+    if (value < VSA_HIST_SUB_COUNT) {
+        return value;
+    }
+
+    shift = 63 - __builtin_clzll(value) - (VSA_HIST_SUB_BITS - 1);
+
+    return VSA_HIST_SUB_COUNT + (shift - 1) * VSA_HIST_HALF_COUNT + (value >> shift) - VSA_HIST_HALF_COUNT;
+}
+
+// The highest value counted in a bucket.
+static uint64_t
+vsa_hist_get_value(unsigned bucket)
+{
+    unsigned                shift;
+    uint64_t                sub;
+
+    if (bucket < VSA_HIST_SUB_COUNT) {
+        return bucket;
+    }
+
+    shift = (bucket - VSA_HIST_SUB_COUNT) / VSA_HIST_HALF_COUNT + 1;
+    sub = (bucket - VSA_HIST_SUB_COUNT) % VSA_HIST_HALF_COUNT + VSA_HIST_HALF_COUNT;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+void
+vsa_hist_init(vsa_hist_t * hist)
+{
+    memset(hist, 0, sizeof (*hist));
+}
+
+void
+vsa_hist_record(vsa_hist_t * hist, uint64_t value)
+{
+    hist->counts[vsa_hist_get_bucket(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void
+vsa_hist_merge(vsa_hist_t * hist, const vsa_hist_t * other)
+{
+    for (unsigned i = 0; i < VSA_HIST_LEN; i++) {
+        hist->counts[i] += other->counts[i];
+    }
+    hist->total += other->total;
+    hist->sum += other->sum;
+    if (other->max > hist->max) {
+        hist->max = other->max;
+    }
+}
+
+uint64_t
+vsa_hist_percentile(const vsa_hist_t * hist, double percentile)
+{
+    uint64_t                rank, seen;
+
+    if (!hist->total) {
+        return 0;
+    }
+
+    rank = (uint64_t) (percentile / 100.0 * hist->total + 0.5);
+    if (!rank) {
+        rank = 1;
+    }
+
+    seen = 0;
+    for (unsigned i = 0; i < VSA_HIST_LEN; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            return vsa_hist_get_value(i) < hist->max ? vsa_hist_get_value(i) : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+double
+vsa_hist_mean(const vsa_hist_t * hist)
+{
+    return hist->total ? hist->sum / hist->total : 0.0;
+}
+
+void
+vsa_hist_print(const vsa_hist_t * hist, FILE * out, const char *unit)
+{
+    fprintf(out, "p50 %" PRIu64 "%s, p99 %" PRIu64 "%s, p99.9 %" PRIu64 "%s, max %" PRIu64 "%s, mean %.1f%s\n",
+            vsa_hist_percentile(hist, 50.0), unit, vsa_hist_percentile(hist, 99.0), unit,
+            vsa_hist_percentile(hist, 99.9), unit, hist->max, unit, vsa_hist_mean(hist), unit);
+}
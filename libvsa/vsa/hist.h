@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_HIST_H
+#define VSA_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Values below 2^VSA_HIST_SUB_BITS are counted exactly, larger ones with VSA_HIST_SUB_BITS - 1 significant bits, which
+ * keeps the relative error under 1 / 2^(VSA_HIST_SUB_BITS - 1): 0.8% with 8.
+ */
+#define VSA_HIST_SUB_BITS 8
+#define VSA_HIST_SUB_COUNT (1 << VSA_HIST_SUB_BITS)
+#define VSA_HIST_HALF_COUNT (VSA_HIST_SUB_COUNT / 2)
+#define VSA_HIST_LEN (VSA_HIST_SUB_COUNT + (64 - VSA_HIST_SUB_BITS) * VSA_HIST_HALF_COUNT)
+
+typedef struct vsa_hist_s vsa_hist_t;
+
+/*
+ * A log-linear latency histogram in the spirit of HdrHistogram: a fixed amount of memory, constant time recording and
+ * percentiles with a bounded relative error.
+ */
+struct vsa_hist_s {
+    uint64_t                counts[VSA_HIST_LEN];
+    uint64_t                total;
+    uint64_t                max;
+    double                  sum;
+};
+
+void                    vsa_hist_init(vsa_hist_t * hist);
+void                    vsa_hist_record(vsa_hist_t * hist, uint64_t value);
+void                    vsa_hist_merge(vsa_hist_t * hist, const vsa_hist_t * other);
+uint64_t                vsa_hist_percentile(const vsa_hist_t * hist, double percentile);
+double                  vsa_hist_mean(const vsa_hist_t * hist);
+void                    vsa_hist_print(const vsa_hist_t * hist, FILE * out, const char *unit);
+
+#endif // VSA_HIST_H
@@ -0,0 +1,723 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#include <vsa/epoch.h>
+#include <vsa/expr.h>
+#include <vsa/index.h>
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/oid.h>
+#include <vsa/trace.h>
+#include <vsa/value.h>
+
+#define VSA_INDEX_HANDLER_NAME "vsa"
+#define VSA_INDEX_SET_DATA "vsa_index_set"
+
+#define VSA_INDEX_FNV_OFFSET 14695981039346656037ULL
+#define VSA_INDEX_FNV_PRIME 1099511628211ULL
+
+#define VSA_INDEX_DUPLICATE_WARN_MSG "duplicate object ignored"
+
+typedef struct vsa_index_set_s vsa_index_set_t;
+
+// A pending SET: the value not currently held by the object (the new one until ACTION, the old one after it).
+struct vsa_index_set_s {
+    vsa_object_t           *object;
+    vsa_value_t            *value;
+    int                     done;
+};
+
+static gint             vsa_index_compare_cb(gconstpointer a, gconstpointer b, gpointer user_data);
+static size_t           vsa_index_lower_bound(vsa_index_t * index, const oid * oids, size_t len);
+static guint64          vsa_index_hash(guint64 hash, const void *data, size_t len);
+static vsa_index_cursor_t *vsa_index_get_cursor(vsa_index_t * index, netsnmp_pdu * pdu);
+static size_t           vsa_index_cursor_next(vsa_index_t * index, vsa_index_cursor_t * cursor, const oid * oids,
+                                              size_t len);
+static void             vsa_index_value_free_cb(void *data);
+static void             vsa_index_set_free_cb(void *data);
+static void             vsa_index_set_swap(vsa_index_set_t * set);
+static int              vsa_index_handle_get(vsa_index_t * index, netsnmp_agent_request_info * reqinfo,
+                                             netsnmp_request_info * requests);
+static int              vsa_index_handle_getnext(vsa_index_t * index, netsnmp_agent_request_info * reqinfo,
+                                                 netsnmp_request_info * requests);
+static int              vsa_index_handle_set(vsa_index_t * index, netsnmp_agent_request_info * reqinfo,
+                                             netsnmp_request_info * requests);
+static int              vsa_index_handler(netsnmp_mib_handler * handler, netsnmp_handler_registration * reginfo,
+                                          netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests);
+static void             vsa_index_reset_cursors(vsa_index_t * index);
+static size_t           vsa_index_get_root_len(vsa_index_t * index);
+static int              vsa_index_register_handler(vsa_index_t * index);
+
+static gint
+vsa_index_compare_cb(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const vsa_object_t     *object_a, *object_b;
+
+    (void) user_data;
+
+    object_a = *(vsa_object_t * const *) a;
+    object_b = *(vsa_object_t * const *) b;
+
+    return snmp_oid_compare(object_a->tree->oids, object_a->tree->len, object_b->tree->oids, object_b->tree->len);
+}
+
+static size_t
+vsa_index_lower_bound(vsa_index_t * index, const oid * oids, size_t len)
+{
+    size_t                  low, high, mid;
+
+    low = 0;
+    high = index->len;
+    while (low < high) {
+        vsa_oid_t              *tree;
+
+        mid = low + (high - low) / 2;
+        tree = index->objects[mid]->tree;
+        if (snmp_oid_compare(tree->oids, tree->len, oids, len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static guint64
+vsa_index_hash(guint64 hash, const void *data, size_t len)
+{
+    const unsigned char    *p;
+
+    p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * VSA_INDEX_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static vsa_index_cursor_t *
+vsa_index_get_cursor(vsa_index_t * index, netsnmp_pdu * pdu)
+{
+    guint64                 manager;
+    const struct sockaddr  *addr;
+    vsa_index_cursor_t     *cursor;
+
+    if (!pdu || !pdu->transport_data || pdu->transport_data_length < (int) sizeof (struct sockaddr_in)) {
+        return NULL;
+    }
+
+    // The transport data of IP domains starts with the manager's address.
+    addr = pdu->transport_data;
+    manager = vsa_index_hash(VSA_INDEX_FNV_OFFSET, &addr->sa_family, sizeof (addr->sa_family));
+    switch (addr->sa_family) {
+    case AF_INET:{
+            const struct sockaddr_in *in = pdu->transport_data;
+
+            manager = vsa_index_hash(manager, &in->sin_port, sizeof (in->sin_port));
+            manager = vsa_index_hash(manager, &in->sin_addr, sizeof (in->sin_addr));
+        }
+        break;
+
+    case AF_INET6:{
+            const struct sockaddr_in6 *in6 = pdu->transport_data;
+
+            if (pdu->transport_data_length < (int) sizeof (struct sockaddr_in6)) {
+                return NULL;
+            }
+            manager = vsa_index_hash(manager, &in6->sin6_port, sizeof (in6->sin6_port));
+            manager = vsa_index_hash(manager, &in6->sin6_addr, sizeof (in6->sin6_addr));
+        }
+        break;
+
+    default:
+        return NULL;
+    }
+
+    cursor = &index->cursors[manager % VSA_INDEX_CURSORS];
+    if (cursor->manager != manager) {
+        cursor->manager = manager;
+        cursor->next = 0;
+        for (int i = 0; i < VSA_INDEX_CURSOR_WAYS; i++) {
+            cursor->positions[i] = SIZE_MAX;
+        }
+    }
+
+    return cursor;
+}
+
+static size_t
+vsa_index_cursor_next(vsa_index_t * index, vsa_index_cursor_t * cursor, const oid * oids, size_t len)
+{
+    size_t                  pos;
+
+    if (cursor) {
+        for (int i = 0; i < VSA_INDEX_CURSOR_WAYS; i++) {
+            vsa_oid_t              *tree;
+
+            pos = cursor->positions[i];
+            if (pos >= index->len) {
+                continue;
+            }
+
+            tree = index->objects[pos]->tree;
+            if (!snmp_oid_compare(tree->oids, tree->len, oids, len)) {
+                index->cursor_hits++;
+                cursor->positions[i] = ++pos;
+                return pos;
+            }
+        }
+    }
+    index->cursor_misses++;
+
+    pos = vsa_index_next(index, oids, len);
+    if (cursor && pos < index->len) {
+        cursor->positions[cursor->next] = pos;
+        cursor->next = (cursor->next + 1) % VSA_INDEX_CURSOR_WAYS;
+    }
+
+    return pos;
+}
+
+static void
+vsa_index_value_free_cb(void *data)
+{
+    vsa_value_free((vsa_value_t *) data);
+}
+
+static void
+vsa_index_set_free_cb(void *data)
+{
+    vsa_index_set_t        *set;
+
+    set = data;
+    // A reload may be comparing against the replaced value.
+    vsa_epoch_defer(vsa_index_value_free_cb, set->value);
+    free(set);
+}
+
+static void
+vsa_index_set_swap(vsa_index_set_t * set)
+{
+    vsa_value_t            *value;
+
+    value = set->object->value;
+    g_atomic_pointer_set(&set->object->value, set->value);
+    set->value = value;
+}
+
+static int
+vsa_index_handle_get(vsa_index_t * index, netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests)
+{
+    for (netsnmp_request_info * request = requests; request; request = request->next) {
+        netsnmp_variable_list  *var;
+        vsa_object_t           *object;
+        unsigned long long      start;
+
+        if (request->processed) {
+            continue;
+        }
+
+        var = request->requestvb;
+        start = VSA_TRACE_NOW();
+        object = vsa_index_get(index, var->name, var->name_length);
+        VSA_TRACE(lookup, var->name, var->name_length, object ? object->value->type : VSA_ASN_UNKNOWN,
+                  VSA_TRACE_NOW() - start, MODE_GET);
+        if (!object) {
+            index->nosuch++;
+            netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHOBJECT);
+            continue;
+        }
+
+        if (vsa_index_object_to_var(index, object, var)) {
+            vsa_log_debugln(VSA_VALUE_TO_VAR_ERROR_MSG);
+            netsnmp_set_request_error(reqinfo, request, SNMP_ERR_GENERR);
+        }
+    }
+
+    return SNMP_ERR_NOERROR;
+}
+
+static int
+vsa_index_handle_getnext(vsa_index_t * index, netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests)
+{
+    vsa_index_cursor_t     *cursor;
+
+    cursor = vsa_index_get_cursor(index, reqinfo->asp ? reqinfo->asp->pdu : NULL);
+
+    for (netsnmp_request_info * request = requests; request; request = request->next) {
+        size_t                  pos;
+        netsnmp_variable_list  *var;
+        vsa_object_t           *object;
+        unsigned long long      start;
+
+        if (request->processed) {
+            continue;
+        }
+
+        var = request->requestvb;
+        start = VSA_TRACE_NOW();
+        pos = vsa_index_cursor_next(index, cursor, var->name, var->name_length);
+        VSA_TRACE(lookup, var->name, var->name_length,
+                  pos < index->len ? index->objects[pos]->value->type : VSA_ASN_UNKNOWN, VSA_TRACE_NOW() - start,
+                  MODE_GETNEXT);
+        if (pos >= index->len) {
+            // Left unanswered, so the agent moves on to the next registration.
+            continue;
+        }
+
+        object = index->objects[pos];
+        snmp_set_var_objid(var, object->tree->oids, object->tree->len);
+        if (vsa_index_object_to_var(index, object, var)) {
+            vsa_log_debugln(VSA_VALUE_TO_VAR_ERROR_MSG);
+            netsnmp_set_request_error(reqinfo, request, SNMP_ERR_GENERR);
+        }
+    }
+
+    return SNMP_ERR_NOERROR;
+}
+
+static int
+vsa_index_handle_set(vsa_index_t * index, netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests)
+{
+    for (netsnmp_request_info * request = requests; request; request = request->next) {
+        int                     err;
+        netsnmp_variable_list  *var;
+        vsa_object_t           *object;
+        vsa_index_set_t        *set;
+
+        if (request->processed) {
+            continue;
+        }
+
+        var = request->requestvb;
+
+        switch (reqinfo->mode) {
+        case MODE_SET_RESERVE1:
+            if (index->readonly) {
+                netsnmp_set_request_error(reqinfo, request, SNMP_ERR_RESOURCEUNAVAILABLE);
+                break;
+            }
+            object = vsa_index_get(index, var->name, var->name_length);
+            if (!object) {
+                netsnmp_set_request_error(reqinfo, request, SNMP_ERR_NOCREATION);
+                break;
+            }
+            err = vsa_value_check_var(object->value, var);
+            if (SNMP_ERR_NOERROR != err) {
+                netsnmp_set_request_error(reqinfo, request, err);
+            }
+            break;
+
+        case MODE_SET_RESERVE2:
+            object = vsa_index_get(index, var->name, var->name_length);
+            set = calloc(1, sizeof (vsa_index_set_t));
+            if (!set) {
+                vsa_log_debugln("%s", strerror(errno));
+                netsnmp_set_request_error(reqinfo, request, SNMP_ERR_RESOURCEUNAVAILABLE);
+                break;
+            }
+            set->object = object;
+            set->value = vsa_value_from_var(object->value->type, var);
+            if (!set->value) {
+                vsa_log_debugln(VSA_VALUE_FROM_VAR_ERROR_MSG);
+                free(set);
+                netsnmp_set_request_error(reqinfo, request, SNMP_ERR_RESOURCEUNAVAILABLE);
+                break;
+            }
+            netsnmp_request_add_list_data(request,
+                                          netsnmp_create_data_list(VSA_INDEX_SET_DATA, set, vsa_index_set_free_cb));
+            break;
+
+        case MODE_SET_ACTION:
+            set = netsnmp_request_get_list_data(request, VSA_INDEX_SET_DATA);
+            if (set && !set->done) {
+                vsa_index_set_swap(set);
+                set->done = 1;
+            }
+            break;
+
+        case MODE_SET_UNDO:
+            set = netsnmp_request_get_list_data(request, VSA_INDEX_SET_DATA);
+            if (set && set->done) {
+                vsa_index_set_swap(set);
+                set->done = 0;
+            }
+            break;
+
+        case MODE_SET_COMMIT:
+            set = netsnmp_request_get_list_data(request, VSA_INDEX_SET_DATA);
+            if (set && set->done && index->set_cb) {
+                index->set_cb(set->object, index->set_data);
+            }
+            break;
+
+        default:
+            // FREE, and after COMMIT: whatever value the pending SET still holds is released along with the request.
+            break;
+        }
+    }
+
+    return SNMP_ERR_NOERROR;
+}
+
+static int
+vsa_index_handler(netsnmp_mib_handler * handler, netsnmp_handler_registration * reginfo,
+                  netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests)
+{
+    int                     ret, varbinds;
+    vsa_index_t            *index;
+    unsigned long long      start;
+
+    (void) reginfo;
+
+    start = VSA_TRACE_NOW();
+    if (vsa_epoch_enter()) {
+        vsa_log_debugln(VSA_EPOCH_ENTER_ERROR_MSG);
+        return SNMP_ERR_GENERR;
+    }
+    index = g_atomic_pointer_get(&handler->myvoid);
+
+    switch (reqinfo->mode) {
+    case MODE_GET:
+        ret = vsa_index_handle_get(index, reqinfo, requests);
+        break;
+
+    case MODE_GETNEXT:
+        ret = vsa_index_handle_getnext(index, reqinfo, requests);
+        break;
+
+    case MODE_SET_RESERVE1:
+    case MODE_SET_RESERVE2:
+    case MODE_SET_ACTION:
+    case MODE_SET_COMMIT:
+    case MODE_SET_FREE:
+    case MODE_SET_UNDO:
+        ret = vsa_index_handle_set(index, reqinfo, requests);
+        break;
+
+    default:
+        ret = SNMP_ERR_NOERROR;
+        break;
+    }
+    vsa_epoch_exit();
+
+    varbinds = 0;
+#ifdef VSA_USDT
+    for (netsnmp_request_info * request = requests; request; request = request->next) {
+        varbinds++;
+    }
+#endif
+    VSA_TRACE(request, reqinfo->mode, varbinds, VSA_TRACE_NOW() - start);
+
+    return ret;
+}
+
+static void
+vsa_index_reset_cursors(vsa_index_t * index)
+{
+    for (int i = 0; i < VSA_INDEX_CURSORS; i++) {
+        index->cursors[i].manager = 0;
+        index->cursors[i].next = 0;
+        for (int j = 0; j < VSA_INDEX_CURSOR_WAYS; j++) {
+            index->cursors[i].positions[j] = SIZE_MAX;
+        }
+    }
+}
+
+// Objects are sorted, so the prefix shared by the first and the last one is shared by all of them.
+static size_t
+vsa_index_get_root_len(vsa_index_t * index)
+{
+    size_t                  len;
+    vsa_oid_t              *first, *last;
+
+    first = index->objects[0]->tree;
+    last = index->objects[index->len - 1]->tree;
+    for (len = 0; len < first->len && len < last->len && first->oids[len] == last->oids[len]; len++);
+
+    return len;
+}
+
+static int
+vsa_index_register_handler(vsa_index_t * index)
+{
+    index->reginfo =
+        netsnmp_create_handler_registration(VSA_INDEX_HANDLER_NAME, vsa_index_handler, index->objects[0]->tree->oids,
+                                            vsa_index_get_root_len(index), HANDLER_CAN_RWRITE);
+    if (!index->reginfo) {
+        vsa_log_debugln("netsnmp_create_handler_registration() failed");
+        return -1;
+    }
+    index->reginfo->handler->myvoid = index;
+
+    if (MIB_REGISTERED_OK != netsnmp_register_handler(index->reginfo)) {
+        vsa_log_debugln("netsnmp_register_handler() failed");
+        index->reginfo = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+vsa_index_t            *
+vsa_index_new(GList * objects)
+{
+    int                     sorted;
+    size_t                  len;
+    vsa_index_t            *index;
+
+    index = calloc(1, sizeof (vsa_index_t));
+    if (!index) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    len = g_list_length(objects);
+    index->objects = calloc(len ? len : 1, sizeof (vsa_object_t *));
+    if (!index->objects) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(index);
+        return NULL;
+    }
+
+    for (GList * l = objects; l; l = l->next) {
+        index->objects[index->len++] = l->data;
+    }
+    g_list_free(objects);
+
+    // Walks normalized by vsa-sort are in order already.
+    sorted = 1;
+    for (size_t i = 1; sorted && i < index->len; i++) {
+        sorted = vsa_index_compare_cb(&index->objects[i - 1], &index->objects[i], NULL) <= 0;
+    }
+
+    // Stable, so the first of duplicated objects is kept, as the first registered used to be.
+    if (!sorted) {
+        g_qsort_with_data(index->objects, index->len, sizeof (vsa_object_t *), vsa_index_compare_cb, NULL);
+    }
+
+    len = 0;
+    for (size_t i = 0; i < index->len; i++) {
+        vsa_object_t           *object;
+
+        object = index->objects[i];
+        if (len && !vsa_index_compare_cb(&index->objects[len - 1], &object, NULL)) {
+            char                    object_str[VSA_LOG_MESSAGE_SIZE];
+
+            if (-1 == vsa_object_format(object, object_str, sizeof (object_str))) {
+                strcpy(object_str, "(?)");
+            }
+            vsa_log_warnln(VSA_INDEX_DUPLICATE_WARN_MSG " '%s'", object_str);
+            vsa_object_free(object);
+            index->nduplicates++;
+            continue;
+        }
+        index->objects[len++] = object;
+    }
+    index->len = len;
+
+    vsa_index_reset_cursors(index);
+
+    return index;
+}
+
+void                   *
+vsa_index_free(vsa_index_t * index)
+{
+    if (!index) {
+        return NULL;
+    }
+    if (index->reginfo) {
+        netsnmp_unregister_handler(index->reginfo);
+    }
+    for (size_t i = 0; i < index->len; i++) {
+        vsa_object_free(index->objects[i]);
+    }
+    if (index->exprs) {
+        g_hash_table_destroy(index->exprs);
+    }
+    free(index->objects);
+    free(index);
+
+    return NULL;
+}
+
+vsa_object_t           *
+vsa_index_get(vsa_index_t * index, const oid * oids, size_t len)
+{
+    size_t                  pos;
+    vsa_oid_t              *tree;
+
+    pos = vsa_index_lower_bound(index, oids, len);
+    if (pos >= index->len) {
+        return NULL;
+    }
+
+    tree = index->objects[pos]->tree;
+    if (snmp_oid_compare(tree->oids, tree->len, oids, len)) {
+        return NULL;
+    }
+
+    return index->objects[pos];
+}
+
+size_t
+vsa_index_next(vsa_index_t * index, const oid * oids, size_t len)
+{
+    size_t                  pos;
+    vsa_oid_t              *tree;
+
+    pos = vsa_index_lower_bound(index, oids, len);
+    if (pos < index->len) {
+        tree = index->objects[pos]->tree;
+        if (!snmp_oid_compare(tree->oids, tree->len, oids, len)) {
+            pos++;
+        }
+    }
+
+    return pos;
+}
+
+// The value served for object, that of its expression if it has one.
+int
+vsa_index_object_to_var(vsa_index_t * index, vsa_object_t * object, netsnmp_variable_list * var)
+{
+    vsa_expr_t             *expr;
+
+    if (index->exprs && (expr = g_hash_table_lookup(index->exprs, object))) {
+        return vsa_expr_to_var(expr, var);
+    }
+
+    return vsa_value_to_var(object->value, var);
+}
+
+int
+vsa_index_register(vsa_index_t * index)
+{
+    int                     ret;
+    unsigned long long      start;
+
+    if (!index->len) {
+        vsa_log_debugln("no objects to register");
+        return -1;
+    }
+
+    start = VSA_TRACE_NOW();
+    ret = vsa_index_register_handler(index);
+    VSA_TRACE(index_register, index->objects[0]->tree->oids, vsa_index_get_root_len(index), index->len,
+              VSA_TRACE_NOW() - start, ret);
+
+    return ret;
+}
+
+/*
+ * Counts the objects a newly built index adds, removes and changes compared to an index, without modifying either, so
+ * it may run off the serving thread as long as it is called between vsa_epoch_enter() and vsa_epoch_exit().
+ */
+void
+vsa_index_diff(vsa_index_t * index, vsa_index_t * update, vsa_index_diff_t * diff)
+{
+    size_t                  i, j;
+
+    memset(diff, 0, sizeof (*diff));
+
+    i = j = 0;
+    while (i < index->len || j < update->len) {
+        int                     cmp;
+
+        if (i == index->len) {
+            cmp = 1;
+        } else if (j == update->len) {
+            cmp = -1;
+        } else {
+            cmp = vsa_index_compare_cb(&index->objects[i], &update->objects[j], NULL);
+        }
+
+        if (cmp < 0) {
+            diff->removed++;
+            i++;
+        } else if (cmp > 0) {
+            diff->added++;
+            j++;
+        } else {
+            if (vsa_value_equal(g_atomic_pointer_get(&index->objects[i]->value), update->objects[j]->value)) {
+                diff->unchanged++;
+            } else {
+                diff->changed++;
+            }
+            i++;
+            j++;
+        }
+    }
+}
+
+/*
+ * Makes the registered index serve a new one instead, atomically, and returns it unregistered. Requests already being
+ * handled may still be reading it: it may only be freed after vsa_epoch_synchronize(). Returns NULL, index still
+ * being served, if the update has no objects or can't be registered at its root. The new handler is registered before
+ * the old one goes, so there is always one.
+ */
+vsa_index_t            *
+vsa_index_swap(vsa_index_t * index, vsa_index_t * update)
+{
+    netsnmp_handler_registration *reginfo;
+
+    if (!update->len) {
+        vsa_log_debugln("no objects to register");
+        return NULL;
+    }
+
+    reginfo = index->reginfo;
+    if (reginfo && reginfo->rootoid_len == vsa_index_get_root_len(update)
+        && !snmp_oid_compare(reginfo->rootoid, reginfo->rootoid_len, update->objects[0]->tree->oids,
+                             reginfo->rootoid_len)) {
+        update->reginfo = reginfo;
+        g_atomic_pointer_set(&reginfo->handler->myvoid, update);
+    } else if (reginfo) {
+        if (vsa_index_register(update)) {
+            vsa_log_debugln(VSA_INDEX_REGISTER_ERROR_MSG);
+            return NULL;
+        }
+        netsnmp_unregister_handler(reginfo);
+    }
+    index->reginfo = NULL;
+
+    update->cursor_hits += index->cursor_hits;
+    update->cursor_misses += index->cursor_misses;
+    update->nosuch += index->nosuch;
+    update->set_cb = index->set_cb;
+    update->set_data = index->set_data;
+    update->readonly = index->readonly;
+
+    return index;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_INDEX_H
+#define VSA_INDEX_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#include <vsa/object.h>
+
+#define VSA_INDEX_NEW_ERROR_MSG "vsa_index_new() failed"
+#define VSA_INDEX_REGISTER_ERROR_MSG "vsa_index_register() failed"
+
+// Managers remembered at once, and positions remembered per manager (one per column of a table poll).
+#define VSA_INDEX_CURSORS 256
+#define VSA_INDEX_CURSOR_WAYS 4
+
+typedef struct vsa_index_s vsa_index_t;
+typedef struct vsa_index_cursor_s vsa_index_cursor_t;
+typedef struct vsa_index_diff_s vsa_index_diff_t;
+
+// Called with each object whose value a SET has committed.
+typedef void            (*vsa_index_set_cb_t) (vsa_object_t * object, void *data);
+
+/*
+ * The last positions returned to a manager. A GETNEXT starting at one of them continues at the following position
+ * without searching the index.
+ */
+struct vsa_index_cursor_s {
+    guint64                 manager;
+    size_t                  positions[VSA_INDEX_CURSOR_WAYS];
+    unsigned                next;
+};
+
+// How an index built from a reloaded walk differs from the one it replaces, for the log: the update is swapped in whole.
+struct vsa_index_diff_s {
+    size_t                  added;
+    size_t                  removed;
+    size_t                  changed;
+    size_t                  unchanged;
+};
+
+/*
+ * Objects sorted by OID and served by a single handler registered at their longest common prefix. The objects exprs
+ * maps to an expression are served its value rather than their own. SETs are refused while readonly is set.
+ */
+struct vsa_index_s {
+    vsa_object_t          **objects;
+    size_t                  len;
+    size_t                  nduplicates;
+    netsnmp_handler_registration *reginfo;
+    vsa_index_cursor_t      cursors[VSA_INDEX_CURSORS];
+    unsigned long           cursor_hits;
+    unsigned long           cursor_misses;
+    unsigned long           nosuch;
+    vsa_index_set_cb_t      set_cb;
+    void                   *set_data;
+    int                     readonly;
+    GHashTable             *exprs;
+};
+
+vsa_index_t            *vsa_index_new(GList * objects);
+void                   *vsa_index_free(vsa_index_t * index);
+vsa_object_t           *vsa_index_get(vsa_index_t * index, const oid * oids, size_t len);
+size_t                  vsa_index_next(vsa_index_t * index, const oid * oids, size_t len);
+int                     vsa_index_object_to_var(vsa_index_t * index, vsa_object_t * object,
+                                                netsnmp_variable_list * var);
+int                     vsa_index_register(vsa_index_t * index);
+void                    vsa_index_diff(vsa_index_t * index, vsa_index_t * update, vsa_index_diff_t * diff);
+vsa_index_t            *vsa_index_swap(vsa_index_t * index, vsa_index_t * update);
+
+#endif // VSA_INDEX_H
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+
+typedef struct vsa_log_slot_s vsa_log_slot_t;
+
+/*
+ * A slot of the ring. seq tells who owns it: the producer reserving position pos when equal to pos, the writer thread
+ * once a producer has filled it and set it to pos + 1.
+ */
+struct vsa_log_slot_s {
+    guint64                 seq;
+    FILE                   *stream;
+    char                    message[VSA_LOG_MESSAGE_SIZE];
+};
+
+vsa_log_level_t         vsa_log_level = VSA_LOG_LEVEL_DEBUG;
+
+static const char      *levels[] = { "error", "warn", "info", "debug" };
+
+static vsa_log_slot_t  *ring;
+static guint64          head;
+static guint64          tail;
+static guint64          dropped;
+static guint64          last_progress;
+static int              sleeping;
+static int              stopping;
+static int              efd = -1;
+static GThread         *writer;
+static GMutex           drain_lock;
+
+static void             vsa_log_wake(void);
+static int              vsa_log_drain(void);
+static gpointer         vsa_log_writer_thread(gpointer data);
+
+static void
+vsa_log_wake(void)
+{
+    guint64                 one;
+
+    one = 1;
+    if (-1 == write(efd, &one, sizeof (one))) {
+        // The counter can only overflow after 2^64 - 1 unread wakeups, so the writer is awake already.
+    }
+}
+
+// Writes out every filled slot and returns how many there were. The writer thread and vsa_log_flush() take turns.
+static int
+vsa_log_drain(void)
+{
+    int                     n;
+    guint64                 lost;
+    static guint64          reported;
+
+    g_mutex_lock(&drain_lock);
+
+    n = 0;
+    for (;;) {
+        vsa_log_slot_t         *slot;
+
+        slot = &ring[tail % VSA_LOG_SLOTS];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+            break;
+        }
+        fputs(slot->message, slot->stream);
+        __atomic_store_n(&slot->seq, tail + VSA_LOG_SLOTS, __ATOMIC_RELEASE);
+        tail++;
+        n++;
+    }
+
+    lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (lost != reported) {
+        vsa_logln(stderr, "warn: %" G_GUINT64_FORMAT " log messages dropped", lost - reported);
+        reported = lost;
+    }
+
+    if (n) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    g_mutex_unlock(&drain_lock);
+
+    return n;
+}
+
+static gpointer
+vsa_log_writer_thread(gpointer data)
+{
+    guint64                 count;
+
+    (void) data;
+
+    for (;;) {
+        vsa_log_drain();
+        if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+            vsa_log_drain();
+            break;
+        }
+
+        // Producers only signal a sleeping writer, so check again for messages published before it was marked so.
+        __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+        if (vsa_log_drain() || __atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        if (-1 == read(efd, &count, sizeof (count)) && EINTR != errno) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+void
+vsa_log_set_level(vsa_log_level_t level)
+{
+    __atomic_store_n(&vsa_log_level, level, __ATOMIC_RELAXED);
+}
+
+int
+vsa_log_level_from_str(const char *str, vsa_log_level_t * level)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(levels); i++) {
+        if (!strcasecmp(str, levels[i])) {
+            *level = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Moves logging to a background thread: messages are formatted into a lock-free ring by the logging threads and
+ * written, with a flush per batch, by the writer thread. When the ring is full, messages are dropped and counted.
+ * Until this is called, and after vsa_log_stop(), messages are written synchronously.
+ */
+int
+vsa_log_start(void)
+{
+    GError                 *gerror;
+
+    if (writer) {
+        return 0;
+    }
+
+    ring = calloc(VSA_LOG_SLOTS, sizeof (vsa_log_slot_t));
+    if (!ring) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    for (guint64 i = 0; i < VSA_LOG_SLOTS; i++) {
+        ring[i].seq = i;
+    }
+    head = tail = 0;
+
+    efd = eventfd(0, EFD_CLOEXEC);
+    if (-1 == efd) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(ring), ring = NULL;
+        return -1;
+    }
+
+    gerror = NULL;
+    stopping = 0;
+    writer = g_thread_try_new("log", vsa_log_writer_thread, NULL, &gerror);
+    if (!writer) {
+        vsa_log_debugln("%s", gerror->message);
+        g_error_free(gerror);
+        close(efd), efd = -1;
+        free(ring), ring = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Writes out the pending messages and stops the writer thread. It must not be called by concurrent logging threads.
+void
+vsa_log_stop(void)
+{
+    GThread                *thread;
+
+    thread = writer;
+    if (!thread || g_thread_self() == thread) {
+        return;
+    }
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+    vsa_log_wake();
+    g_thread_join(thread);
+    writer = NULL;
+
+    close(efd), efd = -1;
+    free(ring), ring = NULL;
+}
+
+/*
+ * Writes out the pending messages from the calling thread, leaving the ring and the writer thread to vsa_log_stop().
+ * Unlike it, this may be called while other threads are logging, as on fatal errors, which go on to exit().
+ */
+void
+vsa_log_flush(void)
+{
+    if (__atomic_load_n(&writer, __ATOMIC_ACQUIRE)) {
+        vsa_log_drain();
+    }
+}
+
+void
+vsa_log_write(FILE * stream, const char *fmt, ...)
+{
+    va_list                 ap;
+    guint64                 pos;
+    vsa_log_slot_t         *slot;
+
+    va_start(ap, fmt);
+
+    if (!__atomic_load_n(&writer, __ATOMIC_ACQUIRE)) {
+        vfprintf(stream, fmt, ap);
+        va_end(ap);
+        if (stdout == stream) {
+            fflush(stdout);
+        }
+        return;
+    }
+
+    // Reserve a slot, as in Dmitry Vyukov's bounded queue.
+    pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    for (;;) {
+        gint64                  diff;
+
+        slot = &ring[pos % VSA_LOG_SLOTS];
+        diff = (gint64) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            va_end(ap);
+            return;
+        } else {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->stream = stream;
+    vsnprintf(slot->message, sizeof (slot->message), fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&sleeping, 0, __ATOMIC_SEQ_CST)) {
+        vsa_log_wake();
+    }
+}
+
+// Whether a progress message may be logged now, claiming the slot for the next VSA_LOG_PROGRESS_INTERVAL if so.
+int
+vsa_log_progress_due(void)
+{
+    guint64                 now, last;
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (guint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    last = __atomic_load_n(&last_progress, __ATOMIC_RELAXED);
+    if (last && now - last < VSA_LOG_PROGRESS_INTERVAL) {
+        return 0;
+    }
+
+    return __atomic_compare_exchange_n(&last_progress, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
@@ -28,6 +28,33 @@ extern char            *program_invocation_name;
 // The asprintf documentation doesn't make it clear whether or not it uses errno.
 #define VSA_LOG_AS_PRINTF_ERROR_MSG (errno ? strerror(errno) : "asprintf() error")
 #define VSA_LOG_INTERNAL_ERROR_MSG "internal error"
+#define VSA_LOG_START_ERROR_MSG "vsa_log_start() failed"
+
+// Messages longer than this are truncated once vsa_log_start() has been called.
+#define VSA_LOG_MESSAGE_SIZE 512
+#define VSA_LOG_SLOTS 1024
+// The minimum interval, in milliseconds, between two progress messages.
+#define VSA_LOG_PROGRESS_INTERVAL 1000
+
+typedef enum vsa_log_level vsa_log_level_t;
+
+enum vsa_log_level {
+    VSA_LOG_LEVEL_ERROR,
+    VSA_LOG_LEVEL_WARN,
+    VSA_LOG_LEVEL_INFO,
+    VSA_LOG_LEVEL_DEBUG
+};
+
+// Messages above this level are skipped without being formatted. Set with vsa_log_set_level().
+extern vsa_log_level_t  vsa_log_level;
+
+void                    vsa_log_set_level(vsa_log_level_t level);
+int                     vsa_log_level_from_str(const char *str, vsa_log_level_t * level);
+int                     vsa_log_start(void);
+void                    vsa_log_stop(void);
+void                    vsa_log_flush(void);
+void                    vsa_log_write(FILE * stream, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int                     vsa_log_progress_due(void);
 
 // VSA_LOG
 #define vsa_log(stream, fmt, ...)\
@@ -38,8 +65,12 @@ extern char            *program_invocation_name;
 
 // VSA_LOG_DEBUG
 #define vsa_log_debug(fmt, ...)\
-        vsa_log(stderr, "debug: %s: %s: %d: " fmt,\
-                __FILE__, __func__, __LINE__, ##__VA_ARGS__)
+        do {\
+            if (vsa_log_level >= VSA_LOG_LEVEL_DEBUG) {\
+                vsa_log_write(stderr, "%s: debug: %s: %s: %d: " fmt, program_invocation_name,\
+                              __FILE__, __func__, __LINE__, ##__VA_ARGS__);\
+            }\
+        } while (0)
 
 #define vsa_log_debugln(fmt, ...)\
         vsa_log_debug(fmt "\n", ##__VA_ARGS__)
@@ -51,7 +82,11 @@ extern char            *program_invocation_name;
 
 // VSA_LOG_WARN
 #define vsa_log_warn(fmt, ...)\
-        vsa_log(stderr, "warn: " fmt, ##__VA_ARGS__)
+        do {\
+            if (vsa_log_level >= VSA_LOG_LEVEL_WARN) {\
+                vsa_log_write(stderr, "%s: warn: " fmt, program_invocation_name, ##__VA_ARGS__);\
+            }\
+        } while (0)
 
 #define vsa_log_warnln(fmt, ...)\
         vsa_log_warn(fmt "\n", ##__VA_ARGS__)
@@ -64,6 +99,7 @@ extern char            *program_invocation_name;
 // VSA_LOG_ERROR
 #define vsa_log_error(fmt, ...)\
         do {\
+            vsa_log_flush();\
             vsa_log(stderr, "error: " fmt, ##__VA_ARGS__);\
             exit(EXIT_FAILURE);\
         }while(0)
@@ -74,11 +110,23 @@ extern char            *program_invocation_name;
 // VSA_LOG_INFO
 #define vsa_log_info(fmt, ...)\
         do {\
-            vsa_log(stdout, fmt, ##__VA_ARGS__);\
-            fflush(stdout);\
-        } while(0)
+            if (vsa_log_level >= VSA_LOG_LEVEL_INFO) {\
+                vsa_log_write(stdout, "%s: " fmt, program_invocation_name, ##__VA_ARGS__);\
+            }\
+        } while (0)
 
 #define vsa_log_infoln(fmt, ...)\
         vsa_log_info(fmt "\n", ##__VA_ARGS__)
 
+// VSA_LOG_PROGRESS: info messages logged at most once per VSA_LOG_PROGRESS_INTERVAL, the others are skipped.
+#define vsa_log_progress(fmt, ...)\
+        do {\
+            if (vsa_log_level >= VSA_LOG_LEVEL_INFO && vsa_log_progress_due()) {\
+                vsa_log_write(stdout, "%s: " fmt, program_invocation_name, ##__VA_ARGS__);\
+            }\
+        } while (0)
+
+#define vsa_log_progressln(fmt, ...)\
+        vsa_log_progress(fmt "\n", ##__VA_ARGS__)
+
 #endif // VSA_LOG_H
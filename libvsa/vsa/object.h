@@ -26,7 +26,6 @@
 
 #define VSA_OBJECT_NEW_ERROR_MSG "vsa_object_new() failed"
 #define VSA_OBJECT_TO_STR_ERROR_MSG "vsa_object_to_str() failed"
-#define VSA_OBJECT_REGISTER_ERROR_MSG "vsa_object_register() failed"
 
 typedef struct vsa_object_s vsa_object_t;
 
@@ -37,7 +36,8 @@ struct vsa_object_s {
 
 vsa_object_t           *vsa_object_new(vsa_oid_t * tree, vsa_value_t * value);
 void                   *vsa_object_free(vsa_object_t * object);
+void                    vsa_object_free_cb(void *data);
 char                   *vsa_object_to_str(vsa_object_t * object);
-int                     vsa_object_register(vsa_object_t * object);
+ssize_t                 vsa_object_format(vsa_object_t * object, char *buf, size_t size);
 
 #endif // VSA_OBJECT_H
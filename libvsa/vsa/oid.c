@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
@@ -50,7 +51,9 @@ vsa_oid_free(vsa_oid_t * tree)
     if (!tree) {
         return NULL;
     }
-    free(tree->oids);
+    if (!tree->shared) {
+        free(tree->oids);
+    }
     free(tree);
 
     return NULL;
@@ -60,19 +63,53 @@ char                   *
 vsa_oid_to_str(vsa_oid_t * tree)
 {
     char                   *str;
+    size_t                  len;
+
+    len = vsa_oid_format(tree->oids, tree->len, NULL, 0);
+    str = malloc(len + 1);
+    if (!str) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    vsa_oid_format(tree->oids, tree->len, str, len + 1);
+
+    return str;
+}
 
-    str = NULL;
-    for (size_t i = 0; i < tree->len; i++) {
-        char                   *tmp;
+/*
+ * Writes the dotted form of an OID into buf, as snprintf() does: the output is truncated to size - 1 characters and
+ * terminated if size isn't 0, and the length of the whole string is returned.
+ */
+size_t
+vsa_oid_format(const oid * oids, size_t len, char *buf, size_t size)
+{
+    char                    digits[24], *p;
+    size_t                  pos;
+
+    pos = 0;
+    for (size_t i = 0; i < len; i++) {
+        oid                     arc;
+        size_t                  n;
 
-        tmp = str;
-        if (-1 == asprintf(&str, "%s.%lu", str ? str : "", tree->oids[i])) {
-            vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-            free(tmp);
-            return NULL;
+        // Digits are produced backwards, right after the dot.
+        p = digits + sizeof (digits);
+        arc = oids[i];
+        do {
+            *--p = '0' + arc % 10;
+            arc /= 10;
+        } while (arc);
+        *--p = '.';
+
+        n = digits + sizeof (digits) - p;
+        if (pos < size) {
+            memcpy(buf + pos, p, n < size - pos ? n : size - pos);
         }
-        free(tmp);
+        pos += n;
     }
 
-    return str;
+    if (size) {
+        buf[pos < size ? pos : size - 1] = '\0';
+    }
+
+    return pos;
 }
@@ -27,15 +27,21 @@
 #define VSA_OID_NEW_ERROR_MSG "vsa_oid_new() failed"
 #define VSA_OID_TO_STR_ERROR_MSG "vsa_oid_to_str() failed"
 
+// Large enough for any OID net-snmp accepts, with up to 10 digits and a dot per subidentifier.
+#define VSA_OID_STR_SIZE (MAX_OID_LEN * 11 + 1)
+
 typedef struct vsa_oid_s vsa_oid_t;
 
+// The sub-identifiers of a shared OID belong to someone else, such as a store mapping, and aren't freed with it.
 struct vsa_oid_s {
     oid                    *oids;
     size_t                  len;
+    int                     shared;
 };
 
 vsa_oid_t              *vsa_oid_new(oid * oids, size_t len);
 void                   *vsa_oid_free(vsa_oid_t * tree);
 char                   *vsa_oid_to_str(vsa_oid_t * tree);
+size_t                  vsa_oid_format(const oid * oids, size_t len, char *buf, size_t size);
 
 #endif // VSA_OID_H
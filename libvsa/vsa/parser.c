@@ -22,13 +22,17 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <glib.h>
 
+#include <vsa/filter.h>
 #include <vsa/log.h>
 #include <vsa/object.h>
 #include <vsa/oid.h>
 #include <vsa/parser.h>
+#include <vsa/stream.h>
+#include <vsa/trace.h>
 
 #define VSA_PARSER_PARSE_OID_GET_IDX_ERROR_MSG "vsa_parser_parse_oid_get_idx() failed"
 #define VSA_PARSER_MAKE_OBJECT_ERROR_MSG "vsa_parser_make_object() failed"
@@ -38,6 +42,9 @@
 
 #define VSA_PARSER_CANNOT_PARSE_LINE_ERROR_MSG "%s: %u: can't parse line"
 
+// How net-snmp tags values of another type than the MIB declares, e.g. "Wrong Type (should be Gauge32): Counter32: 5".
+#define VSA_PARSER_WRONG_TYPE "Wrong Type"
+
 #define VSA_PARSER_LINE_PATTERN\
     "((?<!\\d)\\.?(?:1|iso)(?:\\.\\d+)+)"\
     "[ =:-]*"\
@@ -51,15 +58,40 @@ struct vsa_parser_s {
     char                   *oid;
     char                   *type;
     char                   *value;
+    int                     skipping;
 };
 
+// Stats of the calling thread, and when its current stage started.
+static __thread vsa_parser_stats_t *thread_stats;
+static __thread guint64 lap;
+
+// The filter that selects the objects to load, for all threads. All of them are loaded without one.
+static const vsa_filter_t *filter;
+
+static void             vsa_parser_lap(guint64 * ns);
 static int              vsa_parser_parse_oid_get_idx(const char *index, oid * poid);
+static int              vsa_parser_selects(const char *line, GMatchInfo * match_info);
 static vsa_object_t    *vsa_parser_make_object(vsa_parser_t * parser);
 static char            *vsa_parser_rstrip(const char *str);
 static vsa_parser_t    *vsa_parser_cleanup(vsa_parser_t * parser);
 static vsa_parser_t    *vsa_parser_feed(vsa_parser_t * parser, const char *oid, const char *type, const char *value);
 static vsa_parser_t    *vsa_parser_append(vsa_parser_t * parser, const char *value);
-static void             vsa_object_free_cb(void *data);
+static int              vsa_parser_prepend_cb(vsa_object_t * object, void *data);
+
+// Adds the time elapsed since the previous lap to *ns, if given.
+static void
+vsa_parser_lap(guint64 * ns)
+{
+    struct timespec         ts;
+    guint64                 now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (ns) {
+        *ns += now - lap;
+    }
+    lap = now;
+}
 
 unsigned char          *
 vsa_parser_parse_hex_values(const char *str, size_t *len)
@@ -186,23 +218,41 @@ vsa_parser_parse_oid(const char *str, size_t *len)
     return oids;
 }
 
+// Whether the object whose line matched is loaded, decided on the text of its OID before anything is copied.
+static int
+vsa_parser_selects(const char *line, GMatchInfo * match_info)
+{
+    gint                    start, end;
+
+    if (!filter || !g_match_info_fetch_pos(match_info, 1, &start, &end)) {
+        return 1;
+    }
+
+    return vsa_filter_match_str(filter, line + start, end - start);
+}
+
 static vsa_object_t    *
 vsa_parser_make_object(vsa_parser_t * parser)
 {
-    char                   *rvalue;
+    char                   *rvalue, *str, *p;
     size_t                  len;
     oid                    *oids;
     vsa_asn_type_t          type;
     vsa_oid_t              *tree;
     vsa_object_t           *object;
     vsa_value_t            *value;
+    unsigned long long      start;
+
+    start = VSA_TRACE_NOW();
 
     oids = vsa_parser_parse_oid(parser->oid, &len);
     if (!oids) {
         vsa_log_debugln(VSA_PARSER_PARSE_OID_ERROR_MSG);
         return NULL;
     }
-
+    if (thread_stats) {
+        vsa_parser_lap(&thread_stats->oid_ns);
+    }
     tree = vsa_oid_new(oids, len);
     if (!tree) {
         vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
@@ -210,14 +260,22 @@ vsa_parser_make_object(vsa_parser_t * parser)
         return NULL;
     }
 
+    str = parser->value;
     type = vsa_asn_type_from_str(parser->type);
+    // The value carries the type it was sent with.
+    if (VSA_ASN_UNKNOWN == type && !strncasecmp(parser->type, VSA_PARSER_WRONG_TYPE, strlen(VSA_PARSER_WRONG_TYPE))
+        && (p = strchr(str, ':'))) {
+        *p++ = '\0';
+        type = vsa_asn_type_from_str(str);
+        str = p + strspn(p, " ");
+    }
     if (VSA_ASN_UNKNOWN == type) {
         vsa_log_debugln(VSA_ASN_TYPE_FROM_STR_ERROR_MSG);
         vsa_oid_free(tree);
         return NULL;
     }
 
-    rvalue = vsa_parser_rstrip(parser->value);
+    rvalue = vsa_parser_rstrip(str);
     if (!rvalue) {
         vsa_log_debugln(VSA_PARSER_RSTRIP_ERROR_MSG);
         vsa_oid_free(tree);
@@ -241,6 +299,10 @@ vsa_parser_make_object(vsa_parser_t * parser)
         return NULL;
     }
     free(rvalue);
+    if (thread_stats) {
+        vsa_parser_lap(&thread_stats->value_ns);
+    }
+    VSA_TRACE(object_parsed, tree->oids, tree->len, type, VSA_TRACE_NOW() - start);
 
     return object;
 }
@@ -272,6 +334,7 @@ vsa_parser_cleanup(vsa_parser_t * parser)
     free(parser->oid), parser->oid = NULL;
     free(parser->type), parser->type = NULL;
     free(parser->value), parser->value = NULL;
+    parser->skipping = 0;
 
     return parser;
 }
@@ -308,31 +371,39 @@ vsa_parser_append(vsa_parser_t * parser, const char *value)
     return parser;
 }
 
-static void
-vsa_object_free_cb(void *data)
+static int
+vsa_parser_prepend_cb(vsa_object_t * object, void *data)
 {
-    vsa_object_free((vsa_object_t *) data);
+    GList                 **objects;
+
+    objects = data;
+    *objects = g_list_prepend(*objects, object);
+
+    return 0;
 }
 
-GList                  *
-vsa_parser_parse_mib(const char *mib_name)
+/*
+ * Parses the walk in mib_name and calls cb with each object, in file order. cb takes ownership of the object, and
+ * parsing stops with an error if it returns nonzero.
+ */
+int
+vsa_parser_parse_mib_foreach(const char *mib_name, vsa_parser_object_cb_t cb, void *data)
 {
     char                   *line;
     unsigned                lineno;
     size_t                  len;
+    ssize_t                 nread;
     FILE                   *mib;
     gchar                 **matches;
     GError                 *gerror;
-    GList                  *objects;
     GMatchInfo             *match_info;
     static GRegex          *gregex;
     vsa_object_t           *object;
-    vsa_parser_t            parser = { NULL, NULL, NULL };
+    vsa_parser_t            parser = { NULL, NULL, NULL, 0 };
 
     line = NULL;
     mib = NULL;
     matches = NULL;
-    objects = NULL;
     match_info = NULL;
     object = NULL;
 
@@ -346,43 +417,71 @@ vsa_parser_parse_mib(const char *mib_name)
         }
     }
 
-    mib = fopen(mib_name, "r");
+    mib = vsa_stream_open(mib_name);
     if (!mib) {
-        vsa_log_debugln("%s", strerror(errno));
+        vsa_log_debugln(VSA_STREAM_OPEN_ERROR_MSG);
         goto cleanup_and_exit_error;
     }
 
+    if (thread_stats) {
+        vsa_parser_lap(NULL);
+    }
+
     len = 0;
     lineno = 1;
-    while (-1 != getline(&line, &len, mib)) {
+    while (-1 != (nread = getline(&line, &len, mib))) {
+        if (thread_stats) {
+            vsa_parser_lap(&thread_stats->read_ns);
+            thread_stats->lines++;
+            thread_stats->bytes += nread;
+        }
 
         if (g_regex_match(gregex, line, 0, &match_info)) {
-            matches = g_match_info_fetch_all(match_info);
             if (parser.oid) {
+                if (thread_stats) {
+                    vsa_parser_lap(&thread_stats->match_ns);
+                }
                 object = vsa_parser_make_object(&parser);
                 if (!object) {
                     vsa_log_warnln("%s: %u: " VSA_PARSER_MAKE_OBJECT_ERROR_MSG, mib_name, lineno);
-                } else {
-                    objects = g_list_prepend(objects, object);
                 }
                 vsa_parser_cleanup(&parser);
+                if (thread_stats) {
+                    thread_stats->objects += object ? 1 : 0;
+                }
+                if (object && cb(g_steal_pointer(&object), data)) {
+                    goto cleanup_and_exit_error;
+                }
+                if (thread_stats) {
+                    vsa_parser_lap(&thread_stats->list_ns);
+                }
             }
-            if (!vsa_parser_feed(&parser, matches[1], matches[2], matches[3])) {
-                vsa_log_debugln(VSA_PARSER_FEED_ERROR_MSG);
-                goto cleanup_and_exit_error;
+            // Filtered out objects are dropped here, along with the continuation lines of their values.
+            if (!vsa_parser_selects(line, match_info)) {
+                parser.skipping = 1;
+            } else {
+                matches = g_match_info_fetch_all(match_info);
+                if (!vsa_parser_feed(&parser, matches[1], matches[2], matches[3])) {
+                    vsa_log_debugln(VSA_PARSER_FEED_ERROR_MSG);
+                    goto cleanup_and_exit_error;
+                }
+                g_strfreev(matches), matches = NULL;
             }
-            g_strfreev(matches), matches = NULL;
         } else if (parser.oid) {
 
             if (!vsa_parser_append(&parser, line)) {
                 vsa_log_debugln(VSA_PARSER_APPEND_ERROR_MSG);
                 goto cleanup_and_exit_error;
             }
-        } else {
+        } else if (!parser.skipping) {
             vsa_log_warnln(VSA_PARSER_CANNOT_PARSE_LINE_ERROR_MSG, mib_name, lineno);
         }
         g_match_info_free(match_info), match_info = NULL;
+        vsa_log_progressln("%s: %u lines read", mib_name, lineno);
         lineno++;
+        if (thread_stats) {
+            vsa_parser_lap(&thread_stats->match_ns);
+        }
     }
     if (errno) {
         vsa_log_debugln("%s", strerror(errno));
@@ -394,15 +493,23 @@ vsa_parser_parse_mib(const char *mib_name)
         object = vsa_parser_make_object(&parser);
         if (!object) {
             vsa_log_warnln("%s: %u: " VSA_PARSER_MAKE_OBJECT_ERROR_MSG, mib_name, lineno);
-        } else {
-            objects = g_list_prepend(objects, object);
         }
         vsa_parser_cleanup(&parser);
+        if (thread_stats) {
+            thread_stats->objects += object ? 1 : 0;
+        }
+        if (object && cb(g_steal_pointer(&object), data)) {
+            goto cleanup_and_exit_error;
+        }
     }
 
     fclose(mib), mib = NULL;
 
-    return g_list_reverse(objects);
+    if (thread_stats) {
+        vsa_parser_lap(&thread_stats->list_ns);
+    }
+
+    return 0;
 
   cleanup_and_exit_error:
     free(line);
@@ -412,14 +519,40 @@ vsa_parser_parse_mib(const char *mib_name)
     if (matches) {
         g_strfreev(matches);
     }
-    if (objects) {
-        g_list_free_full(g_steal_pointer(&objects), vsa_object_free_cb);
-    }
     if (match_info) {
         g_match_info_free(match_info);
     }
-    if (object) {
-        vsa_object_free(object);
+    vsa_parser_cleanup(&parser);
+    return -1;
+}
+
+// The objects of the walk in mib_name, in file order.
+GList                  *
+vsa_parser_parse_mib(const char *mib_name)
+{
+    GList                  *objects;
+
+    objects = NULL;
+    if (vsa_parser_parse_mib_foreach(mib_name, vsa_parser_prepend_cb, &objects)) {
+        g_list_free_full(objects, vsa_object_free_cb);
+        return NULL;
     }
-    return NULL;
+
+    return g_list_reverse(objects);
+}
+
+void
+vsa_parser_set_stats(vsa_parser_stats_t * stats)
+{
+    thread_stats = stats;
+}
+
+/*
+ * Makes vsa_parser_parse_mib() load only the objects that filter includes, or all of them again if NULL. It applies to
+ * every thread, so it must be set before parsing starts, and filter must not change while in use.
+ */
+void
+vsa_parser_set_filter(const vsa_filter_t * new_filter)
+{
+    filter = new_filter;
 }
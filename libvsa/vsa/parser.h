@@ -23,14 +23,42 @@
 
 #include <glib.h>
 
+#include <vsa/filter.h>
+#include <vsa/object.h>
+#include <vsa/oid.h>
+
 #define VSA_PARSER_PARSE_HEX_VALUES_ERROR_MSG "vsa_parser_parse_hex_values() failed"
 #define VSA_PARSER_PARSE_NUMBER_ERROR_MSG "vsa_parser_parse_number() failed"
 #define VSA_PARSER_PARSE_OID_ERROR_MSG "vsa_parser_parse_oid() failed"
 #define VSA_PARSER_PARSE_MIB_ERROR_MSG "vsa_parser_parse_mib() failed"
 
+typedef struct vsa_parser_stats_s vsa_parser_stats_t;
+
+// Called with each parsed object, which it takes ownership of. Nonzero stops parsing.
+typedef int             (*vsa_parser_object_cb_t) (vsa_object_t * object, void *data);
+
+/*
+ * Where vsa_parser_parse_mib() spends its time, in nanoseconds: reading lines, matching them and gathering multi-line
+ * values, parsing OIDs, building values and objects, and building the list. Accumulated over the calls made by the
+ * thread that set it with vsa_parser_set_stats().
+ */
+struct vsa_parser_stats_s {
+    guint64                 read_ns;
+    guint64                 match_ns;
+    guint64                 oid_ns;
+    guint64                 value_ns;
+    guint64                 list_ns;
+    guint64                 lines;
+    guint64                 bytes;
+    guint64                 objects;
+};
+
 unsigned char          *vsa_parser_parse_hex_values(const char *str, size_t *len);
 int                     vsa_parser_parse_number(const char *str, unsigned long *pvalue);
 oid                    *vsa_parser_parse_oid(const char *str, size_t *len);
+int                     vsa_parser_parse_mib_foreach(const char *mib_name, vsa_parser_object_cb_t cb, void *data);
 GList                  *vsa_parser_parse_mib(const char *mib_name);
+void                    vsa_parser_set_stats(vsa_parser_stats_t * stats);
+void                    vsa_parser_set_filter(const vsa_filter_t * filter);
 
 #endif // VSA_PARSER_H
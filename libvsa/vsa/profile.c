@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#ifdef VSA_MALLINFO2
+#include <malloc.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/profile.h>
+
+static guint64          vsa_profile_clock(clockid_t clock);
+static gint64           vsa_profile_get_rss(void);
+static gint64           vsa_profile_get_heap(void);
+
+static guint64
+vsa_profile_clock(clockid_t clock)
+{
+    struct timespec         ts;
+
+    clock_gettime(clock, &ts);
+
+    return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static gint64
+vsa_profile_get_rss(void)
+{
+    long                    size, resident;
+    FILE                   *fp;
+
+    fp = fopen("/proc/self/statm", "r");
+    if (!fp) {
+        return 0;
+    }
+    if (2 != fscanf(fp, "%ld %ld", &size, &resident)) {
+        resident = 0;
+    }
+    fclose(fp);
+
+    return (gint64) resident * sysconf(_SC_PAGESIZE);
+}
+
+// The bytes malloc() has handed out and not had back, by every thread, or 0 without mallinfo2().
+static gint64
+vsa_profile_get_heap(void)
+{
+#ifdef VSA_MALLINFO2
+    struct mallinfo2        info;
+
+    info = mallinfo2();
+
+    return (gint64) (info.uordblks + info.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+vsa_profile_t          *
+vsa_profile_new(void)
+{
+    vsa_profile_t          *profile;
+
+    profile = calloc(1, sizeof (vsa_profile_t));
+    if (!profile) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    return profile;
+}
+
+void                   *
+vsa_profile_free(vsa_profile_t * profile)
+{
+    if (profile) {
+        free(profile);
+    }
+
+    return NULL;
+}
+
+// Starts a phase. Phases beyond VSA_PROFILE_MAX_PHASES are ignored, as are all of them when profile is NULL.
+void
+vsa_profile_begin(vsa_profile_t * profile, const char *name)
+{
+    if (!profile || profile->nphases >= VSA_PROFILE_MAX_PHASES) {
+        return;
+    }
+    profile->phases[profile->nphases].name = name;
+
+    profile->rss_start = vsa_profile_get_rss();
+    profile->heap_start = vsa_profile_get_heap();
+    profile->cpu_start = vsa_profile_clock(CLOCK_PROCESS_CPUTIME_ID);
+    profile->wall_start = vsa_profile_clock(CLOCK_MONOTONIC);
+}
+
+void
+vsa_profile_end(vsa_profile_t * profile)
+{
+    vsa_profile_phase_t    *phase;
+
+    if (!profile || profile->nphases >= VSA_PROFILE_MAX_PHASES) {
+        return;
+    }
+    phase = &profile->phases[profile->nphases++];
+
+    phase->wall_ns = vsa_profile_clock(CLOCK_MONOTONIC) - profile->wall_start;
+    phase->cpu_ns = vsa_profile_clock(CLOCK_PROCESS_CPUTIME_ID) - profile->cpu_start;
+    phase->heap_delta = vsa_profile_get_heap() - profile->heap_start;
+    phase->rss_delta = vsa_profile_get_rss() - profile->rss_start;
+}
+
+void
+vsa_profile_count_objects(vsa_profile_t * profile, GList * objects)
+{
+    for (GList * l = objects; l; l = l->next) {
+        vsa_object_t           *object;
+
+        object = l->data;
+        profile->types[object->value->type]++;
+        profile->objects++;
+    }
+}
+
+void
+vsa_profile_print(vsa_profile_t * profile, FILE * out)
+{
+    guint64                 wall, cpu;
+    gint64                  heap, rss;
+
+    fprintf(out, "%-20s %12s %12s %15s %14s\n", "phase", "wall ms", "cpu ms", "heap delta KiB", "rss delta KiB");
+
+    wall = cpu = 0;
+    heap = rss = 0;
+    for (size_t i = 0; i < profile->nphases; i++) {
+        vsa_profile_phase_t    *phase;
+
+        phase = &profile->phases[i];
+        fprintf(out, "%-20s %12.3f %12.3f %15" G_GINT64_FORMAT " %14" G_GINT64_FORMAT "\n", phase->name,
+                phase->wall_ns / 1e6, phase->cpu_ns / 1e6, phase->heap_delta / 1024, phase->rss_delta / 1024);
+        wall += phase->wall_ns;
+        cpu += phase->cpu_ns;
+        heap += phase->heap_delta;
+        rss += phase->rss_delta;
+    }
+    fprintf(out, "%-20s %12.3f %12.3f %15" G_GINT64_FORMAT " %14" G_GINT64_FORMAT "\n\n", "total", wall / 1e6,
+            cpu / 1e6, heap / 1024, rss / 1024);
+
+    fprintf(out, "%" G_GUINT64_FORMAT " objects, %" G_GUINT64_FORMAT " not registered as duplicates\n",
+            profile->objects, profile->duplicates);
+    for (int type = 0; type < VSA_ASN_LEN; type++) {
+        if (profile->types[type]) {
+            fprintf(out, "%-20s %12" G_GUINT64_FORMAT "\n", vsa_asn_type_get_name(type), profile->types[type]);
+        }
+    }
+}
+
+char                   *
+vsa_profile_to_json(vsa_profile_t * profile)
+{
+    GString                *json;
+
+    json = g_string_new("{\"phases\":[");
+    for (size_t i = 0; i < profile->nphases; i++) {
+        vsa_profile_phase_t    *phase;
+
+        phase = &profile->phases[i];
+        g_string_append_printf(json,
+                               "%s{\"name\":\"%s\",\"wall_ns\":%" G_GUINT64_FORMAT ",\"cpu_ns\":%" G_GUINT64_FORMAT
+                               ",\"heap_delta\":%" G_GINT64_FORMAT ",\"rss_delta\":%" G_GINT64_FORMAT "}", i ? "," : "",
+                               phase->name, phase->wall_ns, phase->cpu_ns, phase->heap_delta, phase->rss_delta);
+    }
+
+    g_string_append_printf(json,
+                           "],\"heap\":%" G_GINT64_FORMAT ",\"rss\":%" G_GINT64_FORMAT ",\"objects\":%"
+                           G_GUINT64_FORMAT ",\"duplicates\":%" G_GUINT64_FORMAT ",\"types\":{", vsa_profile_get_heap(),
+                           vsa_profile_get_rss(), profile->objects, profile->duplicates);
+    for (int type = 0, n = 0; type < VSA_ASN_LEN; type++) {
+        if (profile->types[type]) {
+            g_string_append_printf(json, "%s\"%s\":%" G_GUINT64_FORMAT, n++ ? "," : "",
+                                   vsa_asn_type_get_name(type), profile->types[type]);
+        }
+    }
+    g_string_append(json, "}}\n");
+
+    return g_string_free(json, FALSE);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_PROFILE_H
+#define VSA_PROFILE_H
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include <vsa/asn_type.h>
+
+#define VSA_PROFILE_NEW_ERROR_MSG "vsa_profile_new() failed"
+#define VSA_PROFILE_MAX_PHASES 16
+
+typedef struct vsa_profile_phase_s vsa_profile_phase_t;
+typedef struct vsa_profile_s vsa_profile_t;
+
+/*
+ * What a phase cost: wall and process CPU time in nanoseconds, and the change in heap in use, by any thread, and in
+ * resident memory, in bytes.
+ */
+struct vsa_profile_phase_s {
+    const char             *name;
+    guint64                 wall_ns;
+    guint64                 cpu_ns;
+    gint64                  heap_delta;
+    gint64                  rss_delta;
+};
+
+/*
+ * A startup profile: consecutive phases delimited by vsa_profile_begin() and vsa_profile_end(), plus the count of
+ * loaded objects per type and of those left unregistered as duplicates, which the caller fills in. The heap in use is
+ * read from mallinfo2(), where the C library has it; elsewhere it reads as 0.
+ */
+struct vsa_profile_s {
+    vsa_profile_phase_t     phases[VSA_PROFILE_MAX_PHASES];
+    size_t                  nphases;
+    guint64                 wall_start;
+    guint64                 cpu_start;
+    gint64                  heap_start;
+    gint64                  rss_start;
+    guint64                 types[VSA_ASN_LEN];
+    guint64                 objects;
+    guint64                 duplicates;
+};
+
+vsa_profile_t          *vsa_profile_new(void);
+void                   *vsa_profile_free(vsa_profile_t * profile);
+void                    vsa_profile_begin(vsa_profile_t * profile, const char *name);
+void                    vsa_profile_end(vsa_profile_t * profile);
+void                    vsa_profile_count_objects(vsa_profile_t * profile, GList * objects);
+void                    vsa_profile_print(vsa_profile_t * profile, FILE * out);
+char                   *vsa_profile_to_json(vsa_profile_t * profile);
+
+#endif // VSA_PROFILE_H
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/snapshot.h>
+
+// The stdio buffer of a snapshot being written, so that it is written out in large blocks.
+#define VSA_SNAPSHOT_BUFFER_SIZE (1 << 20)
+
+static const unsigned char *vsa_snapshot_take(const unsigned char **p, const unsigned char *end, size_t len);
+
+// Advances *p over len bytes, or returns NULL if the snapshot is shorter than that.
+static const unsigned char *
+vsa_snapshot_take(const unsigned char **p, const unsigned char *end, size_t len)
+{
+    const unsigned char    *start;
+
+    if ((size_t) (end - *p) < len) {
+        return NULL;
+    }
+    start = *p;
+    *p += len;
+
+    return start;
+}
+
+// Writes the header of a snapshot of len objects.
+int
+vsa_snapshot_write_header(FILE * fp, guint64 len)
+{
+    vsa_snapshot_header_t   header;
+
+    memset(&header, 0, sizeof (header));
+    memcpy(header.magic, VSA_SNAPSHOT_MAGIC, sizeof (VSA_SNAPSHOT_MAGIC));
+    header.version = VSA_SNAPSHOT_VERSION;
+    header.oid_size = sizeof (oid);
+    header.len = len;
+
+    return 1 == fwrite(&header, sizeof (header), 1, fp) ? 0 : -1;
+}
+
+// Writes object as a snapshot stores it. A SET may replace its value meanwhile, when this runs off the serving thread.
+int
+vsa_snapshot_write_object(FILE * fp, vsa_object_t * object)
+{
+    const void             *payload;
+    guint32                 type;
+    guint64                 len;
+    size_t                  payload_len;
+    vsa_value_t            *value;
+
+    value = g_atomic_pointer_get(&object->value);
+
+    len = object->tree->len;
+    fwrite(&len, sizeof (len), 1, fp);
+    fwrite(object->tree->oids, sizeof (oid), object->tree->len, fp);
+
+    if (vsa_value_get_payload(value, &payload, &payload_len)) {
+        return -1;
+    }
+    type = value->type;
+    len = payload_len;
+    fwrite(&type, sizeof (type), 1, fp);
+    fwrite(&len, sizeof (len), 1, fp);
+    fwrite(payload, 1, payload_len, fp);
+
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * Reads an object written by vsa_snapshot_write_object() from fp into *object. Returns 1 at the end of fp, and -1 if
+ * the object is truncated or can't be read.
+ */
+int
+vsa_snapshot_read_object(FILE * fp, vsa_object_t ** object)
+{
+    guint32                 type;
+    guint64                 len;
+    oid                    *oids;
+    unsigned char          *payload;
+    vsa_oid_t              *tree;
+    vsa_value_t            *value;
+
+    if (1 != fread(&len, sizeof (len), 1, fp)) {
+        if (ferror(fp)) {
+            vsa_log_debugln("%s", strerror(errno));
+            return -1;
+        }
+        return 1;
+    }
+    if (!len || len > MAX_OID_LEN) {
+        vsa_log_debugln("invalid OID length %" G_GUINT64_FORMAT, len);
+        return -1;
+    }
+
+    oids = malloc(len * sizeof (oid));
+    if (!oids) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    if (len != fread(oids, sizeof (oid), len, fp)) {
+        vsa_log_debugln("truncated object");
+        free(oids);
+        return -1;
+    }
+    tree = vsa_oid_new(oids, len);
+    if (!tree) {
+        vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+        free(oids);
+        return -1;
+    }
+
+    if (1 != fread(&type, sizeof (type), 1, fp) || 1 != fread(&len, sizeof (len), 1, fp)) {
+        vsa_log_debugln("truncated object");
+        vsa_oid_free(tree);
+        return -1;
+    }
+    payload = malloc(len ? len : 1);
+    if (!payload) {
+        vsa_log_debugln("%s", strerror(errno));
+        vsa_oid_free(tree);
+        return -1;
+    }
+    if (len != fread(payload, 1, len, fp)) {
+        vsa_log_debugln("truncated object");
+        free(payload);
+        vsa_oid_free(tree);
+        return -1;
+    }
+    value = vsa_value_new_payload(type, payload, len);
+    free(payload);
+    if (!value) {
+        vsa_oid_free(tree);
+        return -1;
+    }
+
+    *object = vsa_object_new(tree, value);
+    if (!*object) {
+        vsa_log_debugln(VSA_OBJECT_NEW_ERROR_MSG);
+        vsa_oid_free(tree);
+        vsa_value_free(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+vsa_snapshot_write(vsa_index_t * index, int fd)
+{
+    int                     dupfd;
+    FILE                   *fp;
+
+    dupfd = dup(fd);
+    if (-1 == dupfd) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    fp = fdopen(dupfd, "w");
+    if (!fp) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(dupfd);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, VSA_SNAPSHOT_BUFFER_SIZE);
+
+    vsa_snapshot_write_header(fp, index->len);
+    for (size_t i = 0; i < index->len; i++) {
+        if (vsa_snapshot_write_object(fp, index->objects[i])) {
+            vsa_log_debugln("%s", ferror(fp) ? strerror(errno) : "invalid value");
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    if (ferror(fp)) {
+        vsa_log_debugln("%s", strerror(errno));
+        fclose(fp);
+        return -1;
+    }
+
+    if (fclose(fp)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+GList                  *
+vsa_snapshot_read(int fd)
+{
+    struct stat             st;
+    const unsigned char    *map, *p, *end, *field;
+    vsa_snapshot_header_t   header;
+    GList                  *objects;
+
+    if (fstat(fd, &st)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof (header)) {
+        vsa_log_debugln("snapshot too short");
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == map) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    p = map;
+    end = map + st.st_size;
+
+    memcpy(&header, vsa_snapshot_take(&p, end, sizeof (header)), sizeof (header));
+    if (memcmp(header.magic, VSA_SNAPSHOT_MAGIC, sizeof (VSA_SNAPSHOT_MAGIC))
+        || VSA_SNAPSHOT_VERSION != header.version || sizeof (oid) != header.oid_size) {
+        vsa_log_debugln("not a snapshot of this vsa version");
+        munmap((void *) map, st.st_size);
+        return NULL;
+    }
+
+    objects = NULL;
+    for (guint64 i = 0; i < header.len; i++) {
+        guint32                 type;
+        guint64                 len;
+        oid                    *oids;
+        vsa_oid_t              *tree;
+        vsa_value_t            *value;
+        vsa_object_t           *object;
+
+        field = vsa_snapshot_take(&p, end, sizeof (len));
+        if (!field) {
+            goto truncated;
+        }
+        memcpy(&len, field, sizeof (len));
+        if (!len || len > MAX_OID_LEN) {
+            goto truncated;
+        }
+
+        field = vsa_snapshot_take(&p, end, len * sizeof (oid));
+        if (!field) {
+            goto truncated;
+        }
+        oids = malloc(len * sizeof (oid));
+        if (!oids) {
+            vsa_log_debugln("%s", strerror(errno));
+            goto failed;
+        }
+        memcpy(oids, field, len * sizeof (oid));
+
+        tree = vsa_oid_new(oids, len);
+        if (!tree) {
+            vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+            free(oids);
+            goto failed;
+        }
+
+        field = vsa_snapshot_take(&p, end, sizeof (type));
+        if (field) {
+            memcpy(&type, field, sizeof (type));
+            field = vsa_snapshot_take(&p, end, sizeof (len));
+        }
+        if (field) {
+            memcpy(&len, field, sizeof (len));
+            field = vsa_snapshot_take(&p, end, len);
+        }
+        if (!field) {
+            vsa_oid_free(tree);
+            goto truncated;
+        }
+
+        value = vsa_value_new_payload(type, field, len);
+        if (!value) {
+            vsa_oid_free(tree);
+            goto failed;
+        }
+
+        object = vsa_object_new(tree, value);
+        if (!object) {
+            vsa_log_debugln(VSA_OBJECT_NEW_ERROR_MSG);
+            vsa_oid_free(tree);
+            vsa_value_free(value);
+            goto failed;
+        }
+        objects = g_list_prepend(objects, object);
+    }
+
+    munmap((void *) map, st.st_size);
+
+    return g_list_reverse(objects);
+
+  truncated:
+    vsa_log_debugln("truncated snapshot");
+  failed:
+    munmap((void *) map, st.st_size);
+    g_list_free_full(objects, vsa_object_free_cb);
+
+    return NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_SNAPSHOT_H
+#define VSA_SNAPSHOT_H
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include <vsa/index.h>
+
+#define VSA_SNAPSHOT_WRITE_ERROR_MSG "vsa_snapshot_write() failed"
+#define VSA_SNAPSHOT_READ_ERROR_MSG "vsa_snapshot_read() failed"
+
+#define VSA_SNAPSHOT_MAGIC "VSASNAP"
+#define VSA_SNAPSHOT_VERSION 1
+
+typedef struct vsa_snapshot_header_s vsa_snapshot_header_t;
+
+/*
+ * A snapshot is this header followed by the indexed objects in OID order. Each object is stored as its OID length and
+ * sub-identifiers, then its value type, payload length and payload, all in host byte order: snapshots are only meant
+ * to be read by another vsa process on the same host.
+ */
+struct vsa_snapshot_header_s {
+    char                    magic[8];
+    guint32                 version;
+    guint32                 oid_size;
+    guint64                 len;
+};
+
+int                     vsa_snapshot_write_header(FILE * fp, guint64 len);
+int                     vsa_snapshot_write_object(FILE * fp, vsa_object_t * object);
+int                     vsa_snapshot_read_object(FILE * fp, vsa_object_t ** object);
+int                     vsa_snapshot_write(vsa_index_t * index, int fd);
+GList                  *vsa_snapshot_read(int fd);
+
+#endif // VSA_SNAPSHOT_H
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+#include <vsa/snapshot.h>
+#include <vsa/sort.h>
+
+typedef struct vsa_sort_source_s vsa_sort_source_t;
+
+// A sorted run being merged: a spilled one read back from its file, or the last one, still in memory.
+struct vsa_sort_source_s {
+    size_t                  run;
+    FILE                   *fp;
+    size_t                  pos;
+    vsa_object_t           *object;
+};
+
+static gint             vsa_sort_compare(const vsa_object_t * a, const vsa_object_t * b);
+static gint             vsa_sort_compare_cb(gconstpointer a, gconstpointer b);
+static size_t           vsa_sort_get_size(vsa_object_t * object);
+static void             vsa_sort_run(vsa_sort_t * sort);
+static int              vsa_sort_spill(vsa_sort_t * sort);
+static int              vsa_sort_next(vsa_sort_t * sort, vsa_sort_source_t * source);
+static void             vsa_sort_sift_down(vsa_sort_source_t ** heap, size_t len, size_t i);
+static int              vsa_sort_pop(vsa_sort_t * sort, vsa_sort_source_t ** heap, size_t *len,
+                                     vsa_object_t ** object, size_t *run);
+
+static gint
+vsa_sort_compare(const vsa_object_t * a, const vsa_object_t * b)
+{
+    return snmp_oid_compare(a->tree->oids, a->tree->len, b->tree->oids, b->tree->len);
+}
+
+static gint
+vsa_sort_compare_cb(gconstpointer a, gconstpointer b)
+{
+    return vsa_sort_compare(*(vsa_object_t * const *) a, *(vsa_object_t * const *) b);
+}
+
+// Roughly what object takes in memory.
+static size_t
+vsa_sort_get_size(vsa_object_t * object)
+{
+    const void             *payload;
+    size_t                  len;
+
+    if (vsa_value_get_payload(object->value, &payload, &len)) {
+        len = 0;
+    }
+
+    return sizeof (vsa_object_t) + sizeof (vsa_oid_t) + object->tree->len * sizeof (oid) + sizeof (vsa_value_t) + len
+        + VSA_SORT_OBJECT_OVERHEAD;
+}
+
+// Sorts the current run and keeps only the last of duplicated objects.
+static void
+vsa_sort_run(vsa_sort_t * sort)
+{
+    size_t                  len;
+
+    // Stable, so the last of equal objects is the one added last.
+    g_ptr_array_sort(sort->run, vsa_sort_compare_cb);
+
+    len = 0;
+    for (size_t i = 0; i < sort->run->len; i++) {
+        vsa_object_t           *object;
+
+        object = g_ptr_array_index(sort->run, i);
+        if (i + 1 < sort->run->len && !vsa_sort_compare(object, g_ptr_array_index(sort->run, i + 1))) {
+            vsa_object_free(object);
+            sort->nduplicates++;
+            continue;
+        }
+        g_ptr_array_index(sort->run, len++) = object;
+    }
+    g_ptr_array_set_size(sort->run, len);
+}
+
+static int
+vsa_sort_spill(vsa_sort_t * sort)
+{
+    int                     fd;
+    char                   *path;
+    FILE                   *fp;
+
+    vsa_sort_run(sort);
+
+    path = g_build_filename(sort->tmpdir, "vsa-sort-XXXXXX", NULL);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        g_free(path);
+        return -1;
+    }
+    // Gone once closed, even if the process dies before.
+    unlink(path);
+    g_free(path);
+
+    fp = fdopen(fd, "w+");
+    if (!fp) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IOFBF, VSA_SORT_BUFFER_SIZE);
+    g_ptr_array_add(sort->runs, fp);
+
+    for (size_t i = 0; i < sort->run->len; i++) {
+        if (vsa_snapshot_write_object(fp, g_ptr_array_index(sort->run, i))) {
+            vsa_log_debugln("%s", ferror(fp) ? strerror(errno) : "invalid value");
+            return -1;
+        }
+    }
+    if (fflush(fp)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    for (size_t i = 0; i < sort->run->len; i++) {
+        vsa_object_free(g_ptr_array_index(sort->run, i));
+    }
+    g_ptr_array_set_size(sort->run, 0);
+    sort->used = 0;
+
+    return 0;
+}
+
+// Loads the next object of the run of source, or NULL at its end.
+static int
+vsa_sort_next(vsa_sort_t * sort, vsa_sort_source_t * source)
+{
+    source->object = NULL;
+
+    if (!source->fp) {
+        if (source->pos < sort->run->len) {
+            // Taken out of the run, so that it only holds what is left to merge.
+            source->object = g_ptr_array_index(sort->run, source->pos);
+            g_ptr_array_index(sort->run, source->pos++) = NULL;
+        }
+        return 0;
+    }
+
+    if (-1 == vsa_snapshot_read_object(source->fp, &source->object)) {
+        vsa_log_debugln("couldn't read run %zu", source->run);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+vsa_sort_sift_down(vsa_sort_source_t ** heap, size_t len, size_t i)
+{
+    for (;;) {
+        size_t                  min, child;
+        vsa_sort_source_t      *source;
+
+        min = i;
+        for (child = 2 * i + 1; child <= 2 * i + 2 && child < len; child++) {
+            if (vsa_sort_compare(heap[child]->object, heap[min]->object) < 0) {
+                min = child;
+            }
+        }
+        if (min == i) {
+            return;
+        }
+
+        source = heap[i];
+        heap[i] = heap[min];
+        heap[min] = source;
+        i = min;
+    }
+}
+
+// Takes the smallest object out of the heap, along with its run, and moves on to the next object of that run.
+static int
+vsa_sort_pop(vsa_sort_t * sort, vsa_sort_source_t ** heap, size_t *len, vsa_object_t ** object, size_t *run)
+{
+    *object = heap[0]->object;
+    *run = heap[0]->run;
+
+    if (vsa_sort_next(sort, heap[0])) {
+        return -1;
+    }
+    if (!heap[0]->object) {
+        heap[0] = heap[--*len];
+    }
+    vsa_sort_sift_down(heap, *len, 0);
+
+    return 0;
+}
+
+// Spills runs to files in tmpdir, or the default temporary directory if NULL, once they take memory bytes.
+vsa_sort_t             *
+vsa_sort_new(const char *tmpdir, size_t memory)
+{
+    vsa_sort_t             *sort;
+
+    sort = calloc(1, sizeof (vsa_sort_t));
+    if (!sort) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    sort->tmpdir = strdup(tmpdir ? tmpdir : g_get_tmp_dir());
+    if (!sort->tmpdir) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(sort);
+        return NULL;
+    }
+    sort->memory = memory ? memory : VSA_SORT_MEMORY;
+    sort->run = g_ptr_array_new();
+    sort->runs = g_ptr_array_new();
+
+    return sort;
+}
+
+void                   *
+vsa_sort_free(vsa_sort_t * sort)
+{
+    if (!sort) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sort->runs->len; i++) {
+        fclose(g_ptr_array_index(sort->runs, i));
+    }
+    g_ptr_array_free(sort->runs, TRUE);
+    for (size_t i = 0; i < sort->run->len; i++) {
+        vsa_object_free(g_ptr_array_index(sort->run, i));
+    }
+    g_ptr_array_free(sort->run, TRUE);
+    free(sort->tmpdir);
+    free(sort);
+
+    return NULL;
+}
+
+// Adds object, which sort takes ownership of even on failure.
+int
+vsa_sort_add(vsa_sort_t * sort, vsa_object_t * object)
+{
+    g_ptr_array_add(sort->run, object);
+    sort->used += vsa_sort_get_size(object);
+    sort->nobjects++;
+
+    if (sort->used >= sort->memory && vsa_sort_spill(sort)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// A vsa_parser_object_cb_t adding each parsed object to the sort passed as data.
+int
+vsa_sort_add_cb(vsa_object_t * object, void *data)
+{
+    if (vsa_sort_add(data, object)) {
+        vsa_log_debugln(VSA_SORT_ADD_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Merges the runs and calls cb with each distinct object, in OID order. It may only be called once, after the last
+ * object has been added.
+ */
+int
+vsa_sort_finish(vsa_sort_t * sort, vsa_sort_cb_t cb, void *data)
+{
+    int                     ret;
+    size_t                  nsources, len, run, other_run;
+    vsa_object_t           *object, *other;
+    vsa_sort_source_t      *sources, **heap;
+
+    vsa_sort_run(sort);
+
+    nsources = sort->runs->len + 1;
+    sources = calloc(nsources, sizeof (vsa_sort_source_t));
+    heap = calloc(nsources, sizeof (vsa_sort_source_t *));
+    if (!sources || !heap) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(sources);
+        free(heap);
+        return -1;
+    }
+
+    ret = -1;
+    len = 0;
+    for (size_t i = 0; i < nsources; i++) {
+        sources[i].run = i;
+        // The run still in memory is the last one.
+        if (i < sort->runs->len) {
+            sources[i].fp = g_ptr_array_index(sort->runs, i);
+            rewind(sources[i].fp);
+        }
+        if (vsa_sort_next(sort, &sources[i])) {
+            goto exit;
+        }
+        if (sources[i].object) {
+            heap[len++] = &sources[i];
+        }
+    }
+    for (size_t i = len / 2; i-- > 0;) {
+        vsa_sort_sift_down(heap, len, i);
+    }
+
+    while (len) {
+        if (vsa_sort_pop(sort, heap, &len, &object, &run)) {
+            vsa_object_free(object);
+            goto exit;
+        }
+
+        // Duplicates, each from another run, come out right after: the latest run wins.
+        while (len && !vsa_sort_compare(heap[0]->object, object)) {
+            if (vsa_sort_pop(sort, heap, &len, &other, &other_run)) {
+                vsa_object_free(other);
+                vsa_object_free(object);
+                goto exit;
+            }
+            if (other_run > run) {
+                vsa_object_free(object);
+                object = other;
+                run = other_run;
+            } else {
+                vsa_object_free(other);
+            }
+            sort->nduplicates++;
+        }
+
+        if (cb(object, data)) {
+            goto exit;
+        }
+    }
+    ret = 0;
+
+  exit:
+    for (size_t i = 0; i < nsources; i++) {
+        vsa_object_free(sources[i].object);
+    }
+    free(sources);
+    free(heap);
+
+    return ret;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_SORT_H
+#define VSA_SORT_H
+
+#include <glib.h>
+
+#include <vsa/object.h>
+
+#define VSA_SORT_NEW_ERROR_MSG "vsa_sort_new() failed"
+#define VSA_SORT_ADD_ERROR_MSG "vsa_sort_add() failed"
+#define VSA_SORT_FINISH_ERROR_MSG "vsa_sort_finish() failed"
+
+// How much memory the objects of a run may take by default before being spilled to a temporary file.
+#define VSA_SORT_MEMORY (256 << 20)
+
+// The stdio buffer of each run file, so that runs are written and merged in large blocks.
+#define VSA_SORT_BUFFER_SIZE (1 << 20)
+
+// Allocator overhead counted per object on top of its own size.
+#define VSA_SORT_OBJECT_OVERHEAD 64
+
+typedef struct vsa_sort_s vsa_sort_t;
+
+// Called with each object in OID order, which it takes ownership of. Nonzero stops the merge.
+typedef int             (*vsa_sort_cb_t) (vsa_object_t * object, void *data);
+
+/*
+ * Sorts objects by OID in bounded memory. Objects are gathered into runs of up to memory bytes, each sorted in memory
+ * and spilled to an unlinked temporary file, and the runs are then merged. When several objects share an OID, the
+ * last one added wins: a run keeps the last of its duplicates, and the merge the one from the latest run.
+ */
+struct vsa_sort_s {
+    char                   *tmpdir;
+    size_t                  memory;
+    size_t                  used;
+    GPtrArray              *run;
+    GPtrArray              *runs;
+    size_t                  nobjects;
+    size_t                  nduplicates;
+};
+
+vsa_sort_t             *vsa_sort_new(const char *tmpdir, size_t memory);
+void                   *vsa_sort_free(vsa_sort_t * sort);
+int                     vsa_sort_add(vsa_sort_t * sort, vsa_object_t * object);
+int                     vsa_sort_add_cb(vsa_object_t * object, void *data);
+int                     vsa_sort_finish(vsa_sort_t * sort, vsa_sort_cb_t cb, void *data);
+
+#endif // VSA_SORT_H
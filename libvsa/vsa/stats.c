@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+#include <vsa/stats.h>
+#include <vsa/transport.h>
+
+#define VSA_STATS_HANDLER_NAME "vsa_stats"
+
+static const struct {
+    const char             *name;
+    u_char                  type;
+} fields[VSA_STATS_FIELDS] = {
+    { "get_requests", ASN_COUNTER64 },
+    { "getnext_requests", ASN_COUNTER64 },
+    { "getbulk_requests", ASN_COUNTER64 },
+    { "set_requests", ASN_COUNTER64 },
+    { "other_pdus", ASN_COUNTER64 },
+    { "varbinds", ASN_COUNTER64 },
+    { "nosuch", ASN_COUNTER64 },
+    { "packets_in", ASN_COUNTER64 },
+    { "bytes_in", ASN_COUNTER64 },
+    { "packets_out", ASN_COUNTER64 },
+    { "bytes_out", ASN_COUNTER64 },
+    { "receive_drops", ASN_COUNTER64 },
+    { "latency_p50_ns", ASN_GAUGE },
+    { "latency_p99_ns", ASN_GAUGE },
+    { "latency_p999_ns", ASN_GAUGE },
+    { "latency_max_ns", ASN_GAUGE },
+    { "cache_hits", ASN_COUNTER64 },
+    { "cache_misses", ASN_COUNTER64 },
+    { "cursor_hits", ASN_COUNTER64 },
+    { "cursor_misses", ASN_COUNTER64 }
+};
+
+// Statistics whose session callback is wrapped. There's a single agent session to instrument.
+static vsa_stats_t     *attached;
+
+static guint64          vsa_stats_now(void);
+static int              vsa_stats_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque,
+                                            int *olength, void *data);
+static int              vsa_stats_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque,
+                                            int *olength, void *data);
+static int              vsa_stats_callback(int op, netsnmp_session * session, int reqid, netsnmp_pdu * pdu,
+                                           void *magic);
+static guint64          vsa_stats_get_drops(vsa_stats_t * stats);
+static int              vsa_stats_handler(netsnmp_mib_handler * handler, netsnmp_handler_registration * reginfo,
+                                          netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests);
+static void             vsa_stats_accept_cb(int fd, void *data);
+
+static guint64
+vsa_stats_now(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+vsa_stats_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque, int *olength, void *data)
+{
+    vsa_stats_t            *stats;
+
+    (void) transport;
+    (void) buf;
+    (void) opaque;
+    (void) olength;
+
+    stats = data;
+    stats->counters[VSA_STATS_PACKETS_IN]++;
+    stats->counters[VSA_STATS_BYTES_IN] += len;
+    stats->received = vsa_stats_now();
+
+    return VSA_TRANSPORT_CONTINUE;
+}
+
+// Requests are handled as soon as they are read, so a response answers the last packet received.
+static int
+vsa_stats_send_hook(netsnmp_transport * transport, const void *buf, int len, void **opaque, int *olength,
+                    void *data)
+{
+    vsa_stats_t            *stats;
+
+    (void) transport;
+    (void) buf;
+    (void) opaque;
+    (void) olength;
+
+    stats = data;
+    stats->counters[VSA_STATS_PACKETS_OUT]++;
+    stats->counters[VSA_STATS_BYTES_OUT] += len;
+    if (stats->received) {
+        vsa_hist_record(&stats->latency, vsa_stats_now() - stats->received);
+        stats->received = 0;
+    }
+
+    return VSA_TRANSPORT_CONTINUE;
+}
+
+// Counts decoded PDUs, SNMPv3 ones included, before the agent handles them.
+static int
+vsa_stats_callback(int op, netsnmp_session * session, int reqid, netsnmp_pdu * pdu, void *magic)
+{
+    vsa_stats_t            *stats;
+
+    stats = attached;
+
+    // A magic value means a request being resumed, which was already counted.
+    if (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE == op && pdu && !magic) {
+        switch (pdu->command) {
+        case SNMP_MSG_GET:
+            stats->counters[VSA_STATS_GET_REQUESTS]++;
+            break;
+
+        case SNMP_MSG_GETNEXT:
+            stats->counters[VSA_STATS_GETNEXT_REQUESTS]++;
+            break;
+
+        case SNMP_MSG_GETBULK:
+            stats->counters[VSA_STATS_GETBULK_REQUESTS]++;
+            break;
+
+        case SNMP_MSG_SET:
+            stats->counters[VSA_STATS_SET_REQUESTS]++;
+            break;
+
+        default:
+            stats->counters[VSA_STATS_OTHER_PDUS]++;
+            break;
+        }
+
+        for (netsnmp_variable_list * var = pdu->variables; var; var = var->next_variable) {
+            stats->counters[VSA_STATS_VARBINDS]++;
+        }
+    }
+
+    return stats->callback(op, session, reqid, pdu, magic);
+}
+
+// Datagrams the kernel dropped because the agent's receive buffer was full, as reported in /proc/net/udp{,6}.
+static guint64
+vsa_stats_get_drops(vsa_stats_t * stats)
+{
+    char                    line[512];
+    const char             *paths[] = { "/proc/net/udp", "/proc/net/udp6" };
+    unsigned long           inode, drops;
+    struct stat             st;
+    FILE                   *fp;
+
+    if (!stats->transport || fstat(stats->transport->sock, &st)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < G_N_ELEMENTS(paths); i++) {
+        fp = fopen(paths[i], "r");
+        if (!fp) {
+            continue;
+        }
+        while (fgets(line, sizeof (line), fp)) {
+            if (2 == sscanf(line, "%*s %*s %*s %*s %*s %*s %*s %*s %*s %lu %*s %*s %lu", &inode, &drops)
+                && inode == st.st_ino) {
+                fclose(fp);
+                return drops;
+            }
+        }
+        fclose(fp);
+    }
+
+    return 0;
+}
+
+static int
+vsa_stats_handler(netsnmp_mib_handler * handler, netsnmp_handler_registration * reginfo,
+                  netsnmp_agent_request_info * reqinfo, netsnmp_request_info * requests)
+{
+    oid                     name[MAX_OID_LEN];
+    size_t                  len;
+    guint64                 values[VSA_STATS_FIELDS];
+    vsa_stats_t            *stats;
+
+    stats = handler->myvoid;
+
+    if (MODE_GET != reqinfo->mode && MODE_GETNEXT != reqinfo->mode) {
+        return SNMP_ERR_NOERROR;
+    }
+
+    vsa_stats_read(stats, values);
+
+    // Fields are served as <root>.<field + 1>.0.
+    len = reginfo->rootoid_len;
+    memcpy(name, reginfo->rootoid, len * sizeof (oid));
+    name[len + 1] = 0;
+
+    for (netsnmp_request_info * request = requests; request; request = request->next) {
+        int                     field;
+        struct counter64        counter;
+        u_long                  gauge;
+        netsnmp_variable_list  *var;
+
+        if (request->processed) {
+            continue;
+        }
+        var = request->requestvb;
+
+        for (field = 0; field < VSA_STATS_FIELDS; field++) {
+            int                     cmp;
+
+            name[len] = field + 1;
+            cmp = snmp_oid_compare(name, len + 2, var->name, var->name_length);
+            if (MODE_GET == reqinfo->mode ? !cmp : cmp > 0) {
+                break;
+            }
+        }
+
+        if (VSA_STATS_FIELDS == field) {
+            if (MODE_GET == reqinfo->mode) {
+                netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHOBJECT);
+            }
+            continue;
+        }
+
+        if (MODE_GETNEXT == reqinfo->mode) {
+            snmp_set_var_objid(var, name, len + 2);
+        }
+
+        if (ASN_COUNTER64 == fields[field].type) {
+            counter.high = values[field] >> 32;
+            counter.low = values[field] & 0xffffffff;
+            snmp_set_var_typed_value(var, ASN_COUNTER64, &counter, sizeof (counter));
+        } else {
+            gauge = values[field] > 0xffffffff ? 0xffffffff : values[field];
+            snmp_set_var_typed_value(var, ASN_GAUGE, &gauge, sizeof (gauge));
+        }
+    }
+
+    return SNMP_ERR_NOERROR;
+}
+
+static void
+vsa_stats_accept_cb(int fd, void *data)
+{
+    int                     conn;
+    char                   *json;
+    size_t                  len;
+    ssize_t                 sent;
+
+    conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (-1 == conn) {
+        vsa_log_debugln("%s", strerror(errno));
+        return;
+    }
+
+    json = vsa_stats_to_json(data);
+    if (json) {
+        // The document is small enough for the socket buffer, a client that doesn't read it just gets it cut short.
+        len = strlen(json);
+        sent = send(conn, json, len, MSG_NOSIGNAL);
+        if (-1 == sent || (size_t) sent != len) {
+            vsa_log_debugln("short write to a stats client");
+        }
+        free(json);
+    }
+    close(conn);
+}
+
+vsa_stats_t            *
+vsa_stats_new(void)
+{
+    vsa_stats_t            *stats;
+
+    stats = calloc(1, sizeof (vsa_stats_t));
+    if (!stats) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    vsa_hist_init(&stats->latency);
+    stats->sock = -1;
+
+    return stats;
+}
+
+void                   *
+vsa_stats_free(vsa_stats_t * stats)
+{
+    if (!stats) {
+        return NULL;
+    }
+    if (attached == stats) {
+        stats->session->callback = stats->callback;
+        attached = NULL;
+    }
+    if (stats->reginfo) {
+        netsnmp_unregister_handler(stats->reginfo);
+    }
+    if (-1 != stats->sock) {
+        unregister_readfd(stats->sock);
+        close(stats->sock);
+        unlink(stats->path);
+    }
+    free(stats->path);
+    free(stats);
+
+    return NULL;
+}
+
+/*
+ * Starts counting the PDUs received by session and the packets going through transport, which should be the
+ * session's.
+ */
+int
+vsa_stats_attach(vsa_stats_t * stats, netsnmp_session * session, netsnmp_transport * transport)
+{
+    if (attached) {
+        vsa_log_debugln("statistics already attached");
+        return -1;
+    }
+
+    if (vsa_transport_add_hook(transport, vsa_stats_recv_hook, vsa_stats_send_hook, stats)) {
+        vsa_log_debugln(VSA_TRANSPORT_ADD_HOOK_ERROR_MSG);
+        return -1;
+    }
+    stats->transport = transport;
+
+    stats->session = session;
+    stats->callback = session->callback;
+    session->callback = vsa_stats_callback;
+    attached = stats;
+
+    return 0;
+}
+
+const char             *
+vsa_stats_get_name(vsa_stats_field_t field)
+{
+    return fields[field].name;
+}
+
+void
+vsa_stats_read(vsa_stats_t * stats, guint64 * values)
+{
+    vsa_index_t            *index;
+
+    memcpy(values, stats->counters, sizeof (stats->counters));
+
+    values[VSA_STATS_RECEIVE_DROPS] = vsa_stats_get_drops(stats);
+    values[VSA_STATS_LATENCY_P50] = vsa_hist_percentile(&stats->latency, 50.0);
+    values[VSA_STATS_LATENCY_P99] = vsa_hist_percentile(&stats->latency, 99.0);
+    values[VSA_STATS_LATENCY_P999] = vsa_hist_percentile(&stats->latency, 99.9);
+    values[VSA_STATS_LATENCY_MAX] = stats->latency.max;
+
+    if (stats->cache) {
+        values[VSA_STATS_CACHE_HITS] = stats->cache->hits;
+        values[VSA_STATS_CACHE_MISSES] = stats->cache->misses;
+    }
+
+    index = stats->index ? *stats->index : NULL;
+    if (index) {
+        values[VSA_STATS_NOSUCH] = index->nosuch;
+        values[VSA_STATS_CURSOR_HITS] = index->cursor_hits;
+        values[VSA_STATS_CURSOR_MISSES] = index->cursor_misses;
+    }
+}
+
+char                   *
+vsa_stats_to_json(vsa_stats_t * stats)
+{
+    guint64                 values[VSA_STATS_FIELDS];
+    GString                *json;
+
+    vsa_stats_read(stats, values);
+
+    json = g_string_new("{");
+    for (int i = 0; i < VSA_STATS_FIELDS; i++) {
+        g_string_append_printf(json, "%s\"%s\":%" G_GUINT64_FORMAT, i ? "," : "", fields[i].name, values[i]);
+    }
+    g_string_append(json, "}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+int
+vsa_stats_register(vsa_stats_t * stats, const oid * root, size_t len)
+{
+    stats->reginfo =
+        netsnmp_create_handler_registration(VSA_STATS_HANDLER_NAME, vsa_stats_handler, root, len, HANDLER_CAN_RONLY);
+    if (!stats->reginfo) {
+        vsa_log_debugln("netsnmp_create_handler_registration() failed");
+        return -1;
+    }
+    stats->reginfo->handler->myvoid = stats;
+
+    if (MIB_REGISTERED_OK != netsnmp_register_handler(stats->reginfo)) {
+        vsa_log_debugln("netsnmp_register_handler() failed");
+        stats->reginfo = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Serves the statistics as a JSON document to every client connecting to the Unix socket path.
+int
+vsa_stats_listen(vsa_stats_t * stats, const char *path)
+{
+    struct sockaddr_un      addr;
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof (addr.sun_path)) {
+        vsa_log_debugln("path too long: '%s'", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    stats->path = strdup(path);
+    if (!stats->path) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    stats->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == stats->sock) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(stats->path), stats->path = NULL;
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(stats->sock, (struct sockaddr *) &addr, sizeof (addr)) || listen(stats->sock, 16)) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        close(stats->sock), stats->sock = -1;
+        free(stats->path), stats->path = NULL;
+        return -1;
+    }
+    register_readfd(stats->sock, vsa_stats_accept_cb, stats);
+
+    return 0;
+}
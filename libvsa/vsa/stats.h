@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_STATS_H
+#define VSA_STATS_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#include <vsa/cache.h>
+#include <vsa/hist.h>
+#include <vsa/index.h>
+
+#define VSA_STATS_NEW_ERROR_MSG "vsa_stats_new() failed"
+#define VSA_STATS_ATTACH_ERROR_MSG "vsa_stats_attach() failed"
+#define VSA_STATS_REGISTER_ERROR_MSG "vsa_stats_register() failed"
+#define VSA_STATS_LISTEN_ERROR_MSG "vsa_stats_listen() failed"
+
+// Under NET-SNMP-MIB::netSnmpPlaypen, the arc net-snmp sets aside for local extensions.
+#define VSA_STATS_ROOT ".1.3.6.1.4.1.8072.9999.9999.161"
+
+typedef enum vsa_stats_field vsa_stats_field_t;
+typedef struct vsa_stats_s vsa_stats_t;
+
+/*
+ * The exported statistics, in order. Each one is served as the scalar <root>.<field + 1>.0 and named in the JSON
+ * output as in vsa_stats_get_name(). Latencies are in nanoseconds, from the moment a request is read to the moment its
+ * response is sent.
+ */
+enum vsa_stats_field {
+    VSA_STATS_GET_REQUESTS,
+    VSA_STATS_GETNEXT_REQUESTS,
+    VSA_STATS_GETBULK_REQUESTS,
+    VSA_STATS_SET_REQUESTS,
+    VSA_STATS_OTHER_PDUS,
+    VSA_STATS_VARBINDS,
+    VSA_STATS_NOSUCH,
+    VSA_STATS_PACKETS_IN,
+    VSA_STATS_BYTES_IN,
+    VSA_STATS_PACKETS_OUT,
+    VSA_STATS_BYTES_OUT,
+    VSA_STATS_RECEIVE_DROPS,
+    VSA_STATS_LATENCY_P50,
+    VSA_STATS_LATENCY_P99,
+    VSA_STATS_LATENCY_P999,
+    VSA_STATS_LATENCY_MAX,
+    VSA_STATS_CACHE_HITS,
+    VSA_STATS_CACHE_MISSES,
+    VSA_STATS_CURSOR_HITS,
+    VSA_STATS_CURSOR_MISSES,
+    VSA_STATS_FIELDS
+};
+
+/*
+ * Runtime statistics of an agent. Counters are only written and read by the thread serving requests, so they need
+ * neither locks nor atomics: the hot path costs a few increments and two clock readings per request.
+ *
+ * Responses answered by a cache or the SNMPv3 fast path attached after the statistics bypass the agent and the send
+ * hooks: they're counted as packets in, and cache hits, only.
+ *
+ * index and cache are optional and may be set by the caller to export their own counters. index points to the
+ * caller's pointer so that swapped indexes are followed.
+ */
+struct vsa_stats_s {
+    guint64                 counters[VSA_STATS_FIELDS];
+    vsa_hist_t              latency;
+    guint64                 received;
+    vsa_index_t           **index;
+    vsa_cache_t            *cache;
+    netsnmp_session        *session;
+    netsnmp_transport      *transport;
+    netsnmp_callback        callback;
+    netsnmp_handler_registration *reginfo;
+    int                     sock;
+    char                   *path;
+};
+
+vsa_stats_t            *vsa_stats_new(void);
+void                   *vsa_stats_free(vsa_stats_t * stats);
+int                     vsa_stats_attach(vsa_stats_t * stats, netsnmp_session * session, netsnmp_transport * transport);
+const char             *vsa_stats_get_name(vsa_stats_field_t field);
+void                    vsa_stats_read(vsa_stats_t * stats, guint64 * values);
+char                   *vsa_stats_to_json(vsa_stats_t * stats);
+int                     vsa_stats_register(vsa_stats_t * stats, const oid * root, size_t len);
+int                     vsa_stats_listen(vsa_stats_t * stats, const char *path);
+
+#endif // VSA_STATS_H
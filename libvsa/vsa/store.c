@@ -0,0 +1,553 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+#include <vsa/object.h>
+#include <vsa/parser.h>
+#include <vsa/store.h>
+
+// The read size while hashing a walk file, and the stdio buffer of a store file being written.
+#define VSA_STORE_HASH_SIZE (1 << 16)
+#define VSA_STORE_BUFFER_SIZE (1 << 20)
+
+typedef struct vsa_store_writer_s vsa_store_writer_t;
+
+struct vsa_store_writer_s {
+    FILE                   *fp;
+    guint64                 len;
+    guint64                 size;
+};
+
+static char            *vsa_store_hash(const char *mib_name);
+static int              vsa_store_write_cb(vsa_object_t * object, void *data);
+static int              vsa_store_lock(const char *path);
+static int              vsa_store_build(const char *path, const char *mib_name);
+static vsa_store_map_t *vsa_store_map(const char *path);
+static void             vsa_store_unmap_cb(gpointer data);
+static void             vsa_store_remove(vsa_store_map_t * map);
+static GList           *vsa_store_objects(const vsa_store_map_t * map, const vsa_filter_t * filter);
+
+// The SHA-256 of the walk file, as a hex string.
+static char            *
+vsa_store_hash(const char *mib_name)
+{
+    int                     fd;
+    char                   *hash;
+    ssize_t                 n;
+    unsigned char          *buf;
+    GChecksum              *checksum;
+
+    fd = open(mib_name, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", mib_name, strerror(errno));
+        return NULL;
+    }
+
+    buf = malloc(VSA_STORE_HASH_SIZE);
+    if (!buf) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    while (0 < (n = read(fd, buf, VSA_STORE_HASH_SIZE)) || (-1 == n && EINTR == errno)) {
+        if (n > 0) {
+            g_checksum_update(checksum, buf, n);
+        }
+    }
+    hash = -1 == n ? NULL : g_strdup(g_checksum_get_string(checksum));
+    if (!hash) {
+        vsa_log_debugln("%s: %s", mib_name, strerror(errno));
+    }
+
+    g_checksum_free(checksum);
+    free(buf);
+    close(fd);
+
+    return hash;
+}
+
+// Appends object to the store file being written, and frees it.
+static int
+vsa_store_write_cb(vsa_object_t * object, void *data)
+{
+    static const char       zeros[VSA_STORE_ALIGN + 1];
+    const void             *payload;
+    size_t                  len, padding;
+    vsa_store_record_t      record;
+    vsa_store_writer_t     *writer;
+
+    writer = data;
+
+    if (vsa_value_get_payload(object->value, &payload, &len)) {
+        vsa_object_free(object);
+        return -1;
+    }
+    record.type = object->value->type;
+    record.oid_len = object->tree->len;
+    record.payload_len = len;
+
+    len = sizeof (record) + record.oid_len * sizeof (oid) + record.payload_len;
+    // The NUL ending the payload, then as many more as the next record needs to be aligned.
+    padding = VSA_STORE_ALIGN - len % VSA_STORE_ALIGN;
+
+    fwrite(&record, sizeof (record), 1, writer->fp);
+    fwrite(object->tree->oids, sizeof (oid), record.oid_len, writer->fp);
+    fwrite(payload, 1, record.payload_len, writer->fp);
+    fwrite(zeros, 1, padding, writer->fp);
+    vsa_object_free(object);
+
+    writer->len++;
+    writer->size += len + padding;
+
+    return ferror(writer->fp) ? -1 : 0;
+}
+
+/*
+ * Takes an exclusive lock on the lock file of the store file at path, and returns its descriptor, which closing
+ * releases it. The lock file is removed along with the store file, so the one locked must still be the one at its path.
+ */
+static int
+vsa_store_lock(const char *path)
+{
+    int                     fd;
+    char                   *lock;
+    struct stat             st, locked;
+
+    lock = g_strdup_printf("%s.lock", path);
+    for (;;) {
+        fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (-1 == fd) {
+            break;
+        }
+        if (-1 == flock(fd, LOCK_EX)) {
+            if (EINTR == errno) {
+                close(fd);
+                continue;
+            }
+            close(fd), fd = -1;
+            break;
+        }
+        if (!fstat(fd, &locked) && !stat(lock, &st) && st.st_dev == locked.st_dev && st.st_ino == locked.st_ino) {
+            break;
+        }
+        close(fd);
+    }
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", lock, strerror(errno));
+    }
+    g_free(lock);
+
+    return fd;
+}
+
+/*
+ * Parses the walk in mib_name into a temporary file renamed to path, so that path never holds a partial store file.
+ * The caller holds the lock of path, so other processes loading the same walk wait for it rather than build it too.
+ */
+static int
+vsa_store_build(const char *path, const char *mib_name)
+{
+    int                     fd;
+    char                   *tmp;
+    vsa_store_header_t      header;
+    vsa_store_writer_t      writer;
+
+    tmp = g_strdup_printf("%s.XXXXXX", path);
+    fd = g_mkstemp_full(tmp, O_RDWR | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", tmp, strerror(errno));
+        g_free(tmp);
+        return -1;
+    }
+
+    writer.fp = fdopen(fd, "w");
+    if (!writer.fp) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        unlink(tmp);
+        g_free(tmp);
+        return -1;
+    }
+    setvbuf(writer.fp, NULL, _IOFBF, VSA_STORE_BUFFER_SIZE);
+
+    // Written again once len and size are known.
+    memset(&header, 0, sizeof (header));
+    fwrite(&header, sizeof (header), 1, writer.fp);
+    writer.len = 0;
+    writer.size = sizeof (header);
+
+    if (vsa_parser_parse_mib_foreach(mib_name, vsa_store_write_cb, &writer)) {
+        vsa_log_debugln(VSA_PARSER_PARSE_MIB_ERROR_MSG);
+        goto cleanup_and_exit_error;
+    }
+
+    memcpy(header.magic, VSA_STORE_MAGIC, sizeof (VSA_STORE_MAGIC));
+    header.version = VSA_STORE_VERSION;
+    header.oid_size = sizeof (oid);
+    header.len = writer.len;
+    header.size = writer.size;
+    rewind(writer.fp);
+    fwrite(&header, sizeof (header), 1, writer.fp);
+
+    if (ferror(writer.fp)) {
+        vsa_log_debugln("%s: %s", tmp, strerror(errno));
+        goto cleanup_and_exit_error;
+    }
+    if (fclose(writer.fp)) {
+        writer.fp = NULL;
+        vsa_log_debugln("%s: %s", tmp, strerror(errno));
+        goto cleanup_and_exit_error;
+    }
+    writer.fp = NULL;
+
+    if (rename(tmp, path)) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        goto cleanup_and_exit_error;
+    }
+    g_free(tmp);
+
+    vsa_log_infoln("stored %" G_GUINT64_FORMAT " objects of %s in %s", header.len, mib_name, path);
+
+    return 0;
+
+  cleanup_and_exit_error:
+    if (writer.fp) {
+        fclose(writer.fp);
+    }
+    unlink(tmp);
+    g_free(tmp);
+
+    return -1;
+}
+
+// Maps the store file at path, or returns NULL if it is missing or isn't a whole store file of this vsa version.
+static vsa_store_map_t *
+vsa_store_map(const char *path)
+{
+    int                     fd;
+    struct stat             st;
+    void                   *addr;
+    vsa_store_header_t      header;
+    vsa_store_map_t        *map;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        if (ENOENT != errno) {
+            vsa_log_debugln("%s: %s", path, strerror(errno));
+        }
+        return NULL;
+    }
+    if (flock(fd, LOCK_SH) || fstat(fd, &st)) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof (header)) {
+        vsa_log_debugln("%s: not a store file", path);
+        close(fd);
+        return NULL;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == addr) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    memcpy(&header, addr, sizeof (header));
+    if (memcmp(header.magic, VSA_STORE_MAGIC, sizeof (VSA_STORE_MAGIC)) || VSA_STORE_VERSION != header.version
+        || sizeof (oid) != header.oid_size || (guint64) st.st_size != header.size) {
+        vsa_log_debugln("%s: not a store file of this vsa version", path);
+        munmap(addr, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    map = malloc(sizeof (vsa_store_map_t));
+    if (!map) {
+        vsa_log_debugln("%s", strerror(errno));
+        munmap(addr, st.st_size);
+        close(fd);
+        return NULL;
+    }
+    map->path = g_strdup(path);
+    map->fd = fd;
+    map->addr = addr;
+    map->size = st.st_size;
+    map->refs = 0;
+
+    return map;
+}
+
+static void
+vsa_store_unmap_cb(gpointer data)
+{
+    vsa_store_map_t        *map;
+
+    map = data;
+    munmap(map->addr, map->size);
+    close(map->fd);
+    g_free(map->path);
+    free(map);
+}
+
+/*
+ * Removes the file of a map that is no longer used, with its lock file, unless another process maps it. Being the only
+ * one to hold a lock on it, it can trade its shared lock for an exclusive one.
+ */
+static void
+vsa_store_remove(vsa_store_map_t * map)
+{
+    int                     fd;
+    char                   *lock;
+
+    fd = vsa_store_lock(map->path);
+    if (-1 == fd) {
+        return;
+    }
+
+    if (!flock(map->fd, LOCK_EX | LOCK_NB)) {
+        lock = g_strdup_printf("%s.lock", map->path);
+        if (unlink(map->path) || unlink(lock)) {
+            vsa_log_debugln("%s: %s", map->path, strerror(errno));
+        } else {
+            vsa_log_infoln("removed %s, no longer used", map->path);
+        }
+        g_free(lock);
+    } else if (EWOULDBLOCK != errno) {
+        vsa_log_debugln("%s: %s", map->path, strerror(errno));
+    }
+    close(fd);
+}
+
+// The objects of map that filter includes, or all of them without one, sharing their OIDs and payloads with it.
+static GList           *
+vsa_store_objects(const vsa_store_map_t * map, const vsa_filter_t * filter)
+{
+    const unsigned char    *p, *end, *payload;
+    size_t                  len, avail;
+    oid                    *oids;
+    GList                  *objects;
+    vsa_oid_t              *tree;
+    vsa_value_t            *value;
+    vsa_object_t           *object;
+    const vsa_store_header_t *header;
+    const vsa_store_record_t *record;
+
+    header = map->addr;
+    p = (const unsigned char *) map->addr + sizeof (vsa_store_header_t);
+    end = (const unsigned char *) map->addr + map->size;
+
+    objects = NULL;
+    for (guint64 i = 0; i < header->len; i++) {
+        if ((size_t) (end - p) < sizeof (vsa_store_record_t)) {
+            goto truncated;
+        }
+        record = (const vsa_store_record_t *) p;
+        avail = end - p - sizeof (*record);
+        if (!record->oid_len || record->oid_len > MAX_OID_LEN || avail < record->oid_len * sizeof (oid)
+            || record->payload_len >= avail - record->oid_len * sizeof (oid)) {
+            goto truncated;
+        }
+        len = sizeof (*record) + record->oid_len * sizeof (oid) + record->payload_len;
+        len += VSA_STORE_ALIGN - len % VSA_STORE_ALIGN;
+        if ((size_t) (end - p) < len) {
+            goto truncated;
+        }
+
+        oids = (oid *) (p + sizeof (*record));
+        payload = (const unsigned char *) (oids + record->oid_len);
+        if (payload[record->payload_len]) {
+            goto truncated;
+        }
+        p += len;
+
+        if (filter && !vsa_filter_match(filter, oids, record->oid_len)) {
+            continue;
+        }
+
+        tree = vsa_oid_new(oids, record->oid_len);
+        if (!tree) {
+            vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+            goto failed;
+        }
+        tree->shared = 1;
+
+        value = vsa_value_new_shared(record->type, payload, record->payload_len);
+        if (!value) {
+            vsa_oid_free(tree);
+            goto failed;
+        }
+
+        object = vsa_object_new(tree, value);
+        if (!object) {
+            vsa_log_debugln(VSA_OBJECT_NEW_ERROR_MSG);
+            vsa_oid_free(tree);
+            vsa_value_free(value);
+            goto failed;
+        }
+        objects = g_list_prepend(objects, object);
+    }
+
+    return g_list_reverse(objects);
+
+  truncated:
+    vsa_log_debugln("truncated store file");
+  failed:
+    g_list_free_full(objects, vsa_object_free_cb);
+
+    return NULL;
+}
+
+vsa_store_t            *
+vsa_store_new(const char *dir)
+{
+    vsa_store_t            *store;
+
+    if (g_mkdir_with_parents(dir, 0755)) {
+        vsa_log_debugln("%s: %s", dir, strerror(errno));
+        return NULL;
+    }
+
+    store = calloc(1, sizeof (vsa_store_t));
+    if (!store) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    store->dir = strdup(dir);
+    if (!store->dir) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(store);
+        return NULL;
+    }
+    store->maps = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, vsa_store_unmap_cb);
+    g_mutex_init(&store->lock);
+
+    return store;
+}
+
+// Unmaps the store files, which no object loaded from them may still be using, keeping them for the next agents.
+void                   *
+vsa_store_free(vsa_store_t * store)
+{
+    if (!store) {
+        return NULL;
+    }
+    g_hash_table_destroy(store->maps);
+    g_mutex_clear(&store->lock);
+    free(store->dir);
+    free(store);
+
+    return NULL;
+}
+
+/*
+ * Loads the objects of the walk in mib_name that filter includes, or all of them if NULL, from its store file, and
+ * sets *map to the mapping they use, to be released once they are freed. The file is parsed into the store first if
+ * it isn't there yet, or was written by another vsa version. It holds every object of the walk, whatever the filter,
+ * so the parser must not be filtering. Loading a walk again, as a reload of an unchanged file does, reuses the mapping
+ * it was first loaded from.
+ */
+GList                  *
+vsa_store_load(vsa_store_t * store, const char *mib_name, const vsa_filter_t * filter, vsa_store_map_t ** map)
+{
+    int                     fd;
+    char                   *hash, *path;
+    GList                  *objects;
+
+    *map = NULL;
+
+    hash = vsa_store_hash(mib_name);
+    if (!hash) {
+        return NULL;
+    }
+    path = g_strdup_printf("%s/%s", store->dir, hash);
+    g_free(hash);
+
+    g_mutex_lock(&store->lock);
+    *map = g_hash_table_lookup(store->maps, path);
+    if (!*map) {
+        // Without the lock, as in a read-only directory, the file can only be mapped if it is there already.
+        fd = vsa_store_lock(path);
+        *map = vsa_store_map(path);
+        if (!*map && -1 != fd && !vsa_store_build(path, mib_name)) {
+            *map = vsa_store_map(path);
+        }
+        if (-1 != fd) {
+            close(fd);
+        }
+        if (*map) {
+            g_hash_table_insert(store->maps, (*map)->path, *map);
+        }
+    }
+    if (*map) {
+        (*map)->refs++;
+    }
+    g_mutex_unlock(&store->lock);
+    g_free(path);
+
+    if (!*map) {
+        vsa_log_debugln("%s: can't be stored", mib_name);
+        return NULL;
+    }
+
+    objects = vsa_store_objects(*map, filter);
+    if (!objects) {
+        vsa_store_release(store, *map);
+        *map = NULL;
+    }
+
+    return objects;
+}
+
+// Releases a load of map, whose objects must have been freed. Releasing the last one unmaps the file.
+void
+vsa_store_release(vsa_store_t * store, vsa_store_map_t * map)
+{
+    if (!map) {
+        return;
+    }
+
+    g_mutex_lock(&store->lock);
+    if (--map->refs) {
+        g_mutex_unlock(&store->lock);
+        return;
+    }
+    g_hash_table_steal(store->maps, map->path);
+    g_mutex_unlock(&store->lock);
+
+    vsa_store_remove(map);
+    vsa_store_unmap_cb(map);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_STORE_H
+#define VSA_STORE_H
+
+#include <glib.h>
+
+#include <vsa/filter.h>
+
+#define VSA_STORE_NEW_ERROR_MSG "vsa_store_new() failed"
+#define VSA_STORE_LOAD_ERROR_MSG "vsa_store_load() failed"
+
+#define VSA_STORE_MAGIC "VSASTOR"
+#define VSA_STORE_VERSION 1
+
+// Where walks are stored by default: a tmpfs, so that the processes mapping a file share its pages in memory.
+#define VSA_STORE_DIR "/dev/shm/vsa"
+
+// What records are padded to, so that the sub-identifiers and payloads of a mapping can be used in place.
+#define VSA_STORE_ALIGN sizeof (guint64)
+
+typedef struct vsa_store_header_s vsa_store_header_t;
+typedef struct vsa_store_record_s vsa_store_record_t;
+typedef struct vsa_store_map_s vsa_store_map_t;
+typedef struct vsa_store_s vsa_store_t;
+
+/*
+ * A store file holds every object of a walk, and is named after the SHA-256 of the walk file. It is this header
+ * followed by len records, each a vsa_store_record_t followed by oid_len sub-identifiers, payload_len bytes of payload
+ * and a NUL, then padded to VSA_STORE_ALIGN bytes. size is that of the whole file. Everything is in host byte order:
+ * store files are only meant to be mapped by vsa processes on the same host.
+ */
+struct vsa_store_header_s {
+    char                    magic[8];
+    guint32                 version;
+    guint32                 oid_size;
+    guint64                 len;
+    guint64                 size;
+};
+
+struct vsa_store_record_s {
+    guint32                 type;
+    guint32                 oid_len;
+    guint64                 payload_len;
+};
+
+/*
+ * A mapped store file, and the loads whose objects use it. fd stays open to hold a shared lock on the file, which tells
+ * other processes it is mapped.
+ */
+struct vsa_store_map_s {
+    char                   *path;
+    int                     fd;
+    void                   *addr;
+    size_t                  size;
+    guint                   refs;
+};
+
+/*
+ * Walks parsed once into read-only files of a directory that every agent loading them maps, containers included when
+ * it is mounted into them. The objects loaded from a file are private, as is any value a SET gives them, but their
+ * OIDs and payloads point into the mapping, which the page cache shares between all the processes mapping it: memory
+ * grows with the number of distinct walks rather than with the number of agents. maps holds the mappings by file name.
+ *
+ * A file is built by one process at a time: the others loading the same walk wait for it, then map the file. Once the
+ * objects of every load from a file are freed and the load released, the file is unmapped and, if no other process
+ * maps it, removed, so that reloading a changed walk doesn't leave its previous file behind. Files are otherwise kept
+ * for the next agents to map; those of walks changed while their agents stopped stay until removed by hand, which is
+ * safe at any time.
+ */
+struct vsa_store_s {
+    char                   *dir;
+    GHashTable             *maps;
+    GMutex                  lock;
+};
+
+vsa_store_t            *vsa_store_new(const char *dir);
+void                   *vsa_store_free(vsa_store_t * store);
+GList                  *vsa_store_load(vsa_store_t * store, const char *mib_name, const vsa_filter_t * filter,
+                                        vsa_store_map_t ** map);
+void                    vsa_store_release(vsa_store_t * store, vsa_store_map_t * map);
+
+#endif // VSA_STORE_H
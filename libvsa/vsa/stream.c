@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#ifdef VSA_ZLIB
+#include <zlib.h>
+#endif
+#ifdef VSA_ZSTD
+#include <zstd.h>
+#endif
+
+#include <vsa/log.h>
+#include <vsa/stream.h>
+
+typedef struct vsa_stream_s vsa_stream_t;
+typedef struct vsa_stream_buffer_s vsa_stream_buffer_t;
+
+// Decompressed bytes. The buffer with last set ends the stream, with error set if it couldn't be decompressed whole.
+struct vsa_stream_buffer_s {
+    size_t                  len;
+    size_t                  pos;
+    int                     last;
+    int                     error;
+    unsigned char           data[VSA_STREAM_BUFFER_SIZE];
+};
+
+/*
+ * A compressed file being decompressed by a thread of its own. Buffers go round between the two queues: the thread
+ * fills the empty ones and the reader empties the full ones, so that decompression runs ahead of parsing by up to
+ * VSA_STREAM_BUFFERS buffers and then waits.
+ */
+struct vsa_stream_s {
+    int                     fd;
+    vsa_stream_format_t     format;
+    int                     stopping;
+    vsa_stream_buffer_t    *buffers;
+    vsa_stream_buffer_t    *current;
+    GAsyncQueue            *empty;
+    GAsyncQueue            *full;
+    GThread                *thread;
+};
+
+#if defined(VSA_ZLIB) || defined(VSA_ZSTD)
+static ssize_t          vsa_stream_input(vsa_stream_t * stream, unsigned char *in);
+#endif
+#ifdef VSA_ZLIB
+static int              vsa_stream_inflate(vsa_stream_t * stream, vsa_stream_buffer_t ** out, unsigned char *in);
+#endif
+#ifdef VSA_ZSTD
+static int              vsa_stream_decompress_zstd(vsa_stream_t * stream, vsa_stream_buffer_t ** out,
+                                                   unsigned char *in);
+#endif
+static vsa_stream_buffer_t *vsa_stream_get_buffer(vsa_stream_t * stream);
+static int              vsa_stream_put_buffer(vsa_stream_t * stream, vsa_stream_buffer_t ** out);
+static gpointer         vsa_stream_thread(gpointer data);
+static ssize_t          vsa_stream_read(void *cookie, char *buf, size_t size);
+static int              vsa_stream_close(void *cookie);
+static vsa_stream_t    *vsa_stream_free(vsa_stream_t * stream);
+
+#if defined(VSA_ZLIB) || defined(VSA_ZSTD)
+static ssize_t
+vsa_stream_input(vsa_stream_t * stream, unsigned char *in)
+{
+    ssize_t                 n;
+
+    do {
+        n = read(stream->fd, in, VSA_STREAM_INPUT_SIZE);
+    } while (-1 == n && EINTR == errno);
+    if (-1 == n) {
+        vsa_log_debugln("%s", strerror(errno));
+    }
+
+    return n;
+}
+#endif
+
+#ifdef VSA_ZLIB
+static int
+vsa_stream_inflate(vsa_stream_t * stream, vsa_stream_buffer_t ** out, unsigned char *in)
+{
+    int                     ret, flushed;
+    ssize_t                 n;
+    z_stream                zs;
+
+    memset(&zs, 0, sizeof (zs));
+    // Accepts both gzip and zlib headers.
+    if (Z_OK != inflateInit2(&zs, 15 + 32)) {
+        vsa_log_debugln("inflateInit2() failed");
+        return -1;
+    }
+
+    ret = Z_OK;
+    flushed = 1;
+    for (;;) {
+        // Only once inflate() has room left over has it output all it could from the input it has.
+        if (!zs.avail_in && flushed) {
+            n = vsa_stream_input(stream, in);
+            if (n <= 0) {
+                break;
+            }
+            zs.next_in = in;
+            zs.avail_in = n;
+        }
+
+        zs.next_out = (*out)->data + (*out)->len;
+        zs.avail_out = VSA_STREAM_BUFFER_SIZE - (*out)->len;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (Z_OK != ret && Z_STREAM_END != ret && Z_BUF_ERROR != ret) {
+            vsa_log_debugln("%s", zs.msg ? zs.msg : "inflate() failed");
+            n = -1;
+            break;
+        }
+        flushed = zs.avail_out > 0;
+        (*out)->len = VSA_STREAM_BUFFER_SIZE - zs.avail_out;
+
+        // Members of concatenated gzip files follow one another.
+        if (Z_STREAM_END == ret && zs.avail_in && Z_OK != inflateReset(&zs)) {
+            vsa_log_debugln("inflateReset() failed");
+            n = -1;
+            break;
+        }
+
+        if (!flushed && vsa_stream_put_buffer(stream, out)) {
+            inflateEnd(&zs);
+            return 0;
+        }
+    }
+    inflateEnd(&zs);
+
+    if (-1 == n) {
+        return -1;
+    }
+    if (Z_STREAM_END != ret) {
+        vsa_log_debugln("truncated gzip stream");
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+#ifdef VSA_ZSTD
+static int
+vsa_stream_decompress_zstd(vsa_stream_t * stream, vsa_stream_buffer_t ** out, unsigned char *in)
+{
+    int                     flushed;
+    size_t                  ret;
+    ssize_t                 n;
+    ZSTD_DCtx              *dctx;
+    ZSTD_inBuffer           input;
+    ZSTD_outBuffer          output;
+
+    dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        vsa_log_debugln("ZSTD_createDCtx() failed");
+        return -1;
+    }
+
+    input.src = in;
+    input.size = input.pos = 0;
+    ret = 0;
+    flushed = 1;
+    for (;;) {
+        if (input.pos == input.size && flushed) {
+            n = vsa_stream_input(stream, in);
+            if (n <= 0) {
+                break;
+            }
+            input.size = n;
+            input.pos = 0;
+        }
+
+        output.dst = (*out)->data;
+        output.size = VSA_STREAM_BUFFER_SIZE;
+        output.pos = (*out)->len;
+        // Frames of concatenated files follow one another.
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret)) {
+            vsa_log_debugln("%s", ZSTD_getErrorName(ret));
+            n = -1;
+            break;
+        }
+        flushed = output.pos < output.size;
+        (*out)->len = output.pos;
+
+        if (!flushed && vsa_stream_put_buffer(stream, out)) {
+            ZSTD_freeDCtx(dctx);
+            return 0;
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+
+    if (-1 == n) {
+        return -1;
+    }
+    // Not at the end of a frame.
+    if (ret) {
+        vsa_log_debugln("truncated zstd stream");
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+static vsa_stream_buffer_t *
+vsa_stream_get_buffer(vsa_stream_t * stream)
+{
+    vsa_stream_buffer_t    *buffer;
+
+    buffer = g_async_queue_pop(stream->empty);
+    buffer->len = buffer->pos = 0;
+    buffer->last = buffer->error = 0;
+
+    return buffer;
+}
+
+// Hands *out to the reader and replaces it with an empty buffer. Returns nonzero if the reader is gone.
+static int
+vsa_stream_put_buffer(vsa_stream_t * stream, vsa_stream_buffer_t ** out)
+{
+    g_async_queue_push(stream->full, *out);
+    *out = vsa_stream_get_buffer(stream);
+
+    return g_atomic_int_get(&stream->stopping);
+}
+
+static gpointer
+vsa_stream_thread(gpointer data)
+{
+    int                     ret;
+    unsigned char          *in;
+    vsa_stream_t           *stream;
+    vsa_stream_buffer_t    *out;
+
+    stream = data;
+
+    out = vsa_stream_get_buffer(stream);
+    ret = -1;
+    in = malloc(VSA_STREAM_INPUT_SIZE);
+    if (!in) {
+        vsa_log_debugln("%s", strerror(errno));
+    } else {
+        switch (stream->format) {
+#ifdef VSA_ZLIB
+        case VSA_STREAM_GZIP:
+            ret = vsa_stream_inflate(stream, &out, in);
+            break;
+#endif
+#ifdef VSA_ZSTD
+        case VSA_STREAM_ZSTD:
+            ret = vsa_stream_decompress_zstd(stream, &out, in);
+            break;
+#endif
+        default:
+            break;
+        }
+        free(in);
+    }
+
+    out->last = 1;
+    out->error = ret ? 1 : 0;
+    g_async_queue_push(stream->full, out);
+
+    return NULL;
+}
+
+static ssize_t
+vsa_stream_read(void *cookie, char *buf, size_t size)
+{
+    size_t                  n;
+    vsa_stream_t           *stream;
+    vsa_stream_buffer_t    *buffer;
+
+    stream = cookie;
+
+    buffer = stream->current;
+    while (!buffer || (buffer->pos == buffer->len && !buffer->last)) {
+        if (buffer) {
+            g_async_queue_push(stream->empty, buffer);
+        }
+        buffer = stream->current = g_async_queue_pop(stream->full);
+    }
+
+    if (buffer->pos == buffer->len) {
+        if (buffer->error) {
+            errno = EIO;
+            return -1;
+        }
+        return 0;
+    }
+
+    n = buffer->len - buffer->pos < size ? buffer->len - buffer->pos : size;
+    memcpy(buf, buffer->data + buffer->pos, n);
+    buffer->pos += n;
+
+    return n;
+}
+
+// Stops the thread, which may be waiting for an empty buffer, by handing it buffers until it is done.
+static int
+vsa_stream_close(void *cookie)
+{
+    vsa_stream_t           *stream;
+    vsa_stream_buffer_t    *buffer;
+
+    stream = cookie;
+
+    g_atomic_int_set(&stream->stopping, 1);
+    buffer = stream->current;
+    while (!buffer || !buffer->last) {
+        if (buffer) {
+            g_async_queue_push(stream->empty, buffer);
+        }
+        buffer = g_async_queue_pop(stream->full);
+    }
+    g_thread_join(stream->thread);
+
+    vsa_stream_free(stream);
+
+    return 0;
+}
+
+static vsa_stream_t    *
+vsa_stream_free(vsa_stream_t * stream)
+{
+    // The buffers are owned by the array, not by the queues.
+    if (stream->empty) {
+        g_async_queue_unref(stream->empty);
+    }
+    if (stream->full) {
+        g_async_queue_unref(stream->full);
+    }
+    free(stream->buffers);
+    close(stream->fd);
+    free(stream);
+
+    return NULL;
+}
+
+vsa_stream_format_t
+vsa_stream_get_format(const unsigned char *magic, size_t len)
+{
+    if (len >= 2 && 0x1f == magic[0] && 0x8b == magic[1]) {
+        return VSA_STREAM_GZIP;
+    }
+    if (len >= 4 && 0x28 == magic[0] && 0xb5 == magic[1] && 0x2f == magic[2] && 0xfd == magic[3]) {
+        return VSA_STREAM_ZSTD;
+    }
+
+    return VSA_STREAM_PLAIN;
+}
+
+const char             *
+vsa_stream_get_format_name(vsa_stream_format_t format)
+{
+    switch (format) {
+    case VSA_STREAM_GZIP:
+        return "gzip";
+
+    case VSA_STREAM_ZSTD:
+        return "zstd";
+
+    default:
+        break;
+    }
+
+    return "plain";
+}
+
+/*
+ * Opens path for reading. Files compressed with gzip or zstd, as told by their first bytes, are decompressed on a
+ * thread of their own while the caller reads them, and others are read as they are. Either way, fclose() releases
+ * everything.
+ */
+FILE                   *
+vsa_stream_open(const char *path)
+{
+    int                     fd;
+    ssize_t                 n;
+    unsigned char           magic[4];
+    FILE                   *fp;
+    GError                 *gerror;
+    vsa_stream_t           *stream;
+    cookie_io_functions_t   functions = { vsa_stream_read, NULL, NULL, vsa_stream_close };
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    n = pread(fd, magic, sizeof (magic), 0);
+    if (-1 == n) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    stream = calloc(1, sizeof (vsa_stream_t));
+    if (!stream) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    stream->fd = fd;
+    stream->format = vsa_stream_get_format(magic, n);
+
+    switch (stream->format) {
+    case VSA_STREAM_PLAIN:
+        free(stream);
+        fp = fdopen(fd, "r");
+        if (!fp) {
+            vsa_log_debugln("%s", strerror(errno));
+            close(fd);
+        }
+        return fp;
+
+#ifdef VSA_ZLIB
+    case VSA_STREAM_GZIP:
+#endif
+#ifdef VSA_ZSTD
+    case VSA_STREAM_ZSTD:
+#endif
+        break;
+
+    default:
+        vsa_log_debugln("%s: compressed with %s, which vsa was built without", path,
+                        vsa_stream_get_format_name(stream->format));
+        vsa_stream_free(stream);
+        return NULL;
+    }
+
+    stream->buffers = malloc(VSA_STREAM_BUFFERS * sizeof (vsa_stream_buffer_t));
+    if (!stream->buffers) {
+        vsa_log_debugln("%s", strerror(errno));
+        vsa_stream_free(stream);
+        return NULL;
+    }
+    stream->empty = g_async_queue_new();
+    stream->full = g_async_queue_new();
+    for (size_t i = 0; i < VSA_STREAM_BUFFERS; i++) {
+        g_async_queue_push(stream->empty, &stream->buffers[i]);
+    }
+
+    gerror = NULL;
+    stream->thread = g_thread_try_new("stream", vsa_stream_thread, stream, &gerror);
+    if (!stream->thread) {
+        vsa_log_debugln("%s", gerror->message);
+        g_error_free(gerror);
+        vsa_stream_free(stream);
+        return NULL;
+    }
+
+    fp = fopencookie(stream, "r", functions);
+    if (!fp) {
+        vsa_log_debugln("%s", strerror(errno));
+        vsa_stream_close(stream);
+        return NULL;
+    }
+    setvbuf(fp, NULL, _IOFBF, VSA_STREAM_BUFFER_SIZE);
+
+    return fp;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_STREAM_H
+#define VSA_STREAM_H
+
+#include <stdio.h>
+
+#define VSA_STREAM_OPEN_ERROR_MSG "vsa_stream_open() failed"
+
+// Decompressed bytes handed to the reader at once, and how many such buffers may be in flight.
+#define VSA_STREAM_BUFFER_SIZE (1 << 18)
+#define VSA_STREAM_BUFFERS 8
+
+// Compressed bytes read at once.
+#define VSA_STREAM_INPUT_SIZE (1 << 17)
+
+typedef enum vsa_stream_format vsa_stream_format_t;
+
+enum vsa_stream_format {
+    VSA_STREAM_PLAIN,
+    VSA_STREAM_GZIP,
+    VSA_STREAM_ZSTD
+};
+
+vsa_stream_format_t     vsa_stream_get_format(const unsigned char *magic, size_t len);
+const char             *vsa_stream_get_format_name(vsa_stream_format_t format);
+FILE                   *vsa_stream_open(const char *path);
+
+#endif // VSA_STREAM_H
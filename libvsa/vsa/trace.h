@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_TRACE_H
+#define VSA_TRACE_H
+
+/*
+ * Static tracepoints for bpftrace, perf and SystemTap, compiled in with ./configure --enable-usdt. Every probe belongs
+ * to the vsa provider. OIDs are passed as a pointer to their subidentifiers and a length, types as vsa_asn_type_t and
+ * durations in nanoseconds:
+ *
+ *     object_parsed(oids, len, type, ns)           an object was built from a walk line
+ *     index_register(oids, len, objects, ns, ret)  an index was registered under oids
+ *     packet_receive(buf, len)                     a datagram was read from a hooked transport
+ *     packet_send(buf, len, ns)                    a response was sent, ns after the last datagram was read
+ *     lookup(oids, len, type, ns, mode)            a varbind was looked up, type is 0 when nothing matched
+ *     request(mode, varbinds, ns)                  the index handled a request
+ *
+ * Without --enable-usdt, the probes compile to nothing and VSA_TRACE_NOW() to 0, so no clock is read either.
+ */
+#ifdef VSA_USDT
+#include <time.h>
+#include <sys/sdt.h>
+
+#define VSA_TRACE(probe, ...) STAP_PROBEV(vsa, probe, ##__VA_ARGS__)
+#define VSA_TRACE_NOW() vsa_trace_now()
+
+static inline unsigned long long
+vsa_trace_now(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#else
+// The arguments stay referenced, in dead code, so that values computed only for the probes don't trigger warnings.
+#define VSA_TRACE(probe, ...)\
+        do {\
+            if (0) {\
+                vsa_trace_discard(0, ##__VA_ARGS__);\
+            }\
+        } while (0)
+#define VSA_TRACE_NOW() 0ULL
+
+static inline void
+vsa_trace_discard(int unused, ...)
+{
+    (void) unused;
+}
+#endif
+
+#endif // VSA_TRACE_H
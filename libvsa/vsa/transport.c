@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#include <vsa/log.h>
+#include <vsa/trace.h>
+#include <vsa/transport.h>
+
+typedef struct vsa_transport_s vsa_transport_t;
+typedef struct vsa_transport_hook_s vsa_transport_hook_t;
+
+struct vsa_transport_s {
+    int                     (*recv)(netsnmp_transport *, void *, int, void **, int *);
+    int                     (*send)(netsnmp_transport *, const void *, int, void **, int *);
+    GList                  *hooks;
+};
+
+struct vsa_transport_hook_s {
+    vsa_transport_recv_hook_t recv;
+    vsa_transport_send_hook_t send;
+    void                   *data;
+};
+
+extern netsnmp_session *main_session;
+extern struct session_list *Sessions;
+
+static GHashTable      *transports;
+
+// When the last datagram was read, for the packet_send probe.
+static unsigned long long received;
+
+static int              vsa_transport_recv_cb(netsnmp_transport * transport, void *buf, int size, void **opaque,
+                                              int *olength);
+static int              vsa_transport_send_cb(netsnmp_transport * transport, const void *buf, int len,
+                                              void **opaque, int *olength);
+static vsa_transport_t *vsa_transport_get_wrapper(netsnmp_transport * transport);
+
+static int
+vsa_transport_recv_cb(netsnmp_transport * transport, void *buf, int size, void **opaque, int *olength)
+{
+    int                     len;
+    vsa_transport_t        *wrapper;
+
+    wrapper = g_hash_table_lookup(transports, transport);
+
+    len = wrapper->recv(transport, buf, size, opaque, olength);
+    if (len <= 0) {
+        return len;
+    }
+    received = VSA_TRACE_NOW();
+    VSA_TRACE(packet_receive, buf, len);
+
+    for (GList * l = wrapper->hooks; l; l = l->next) {
+        vsa_transport_hook_t   *hook;
+
+        hook = l->data;
+        if (hook->recv && VSA_TRANSPORT_CONSUMED == hook->recv(transport, buf, len, opaque, olength, hook->data)) {
+            // net-snmp silently discards datagrams whose reception "failed".
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+static int
+vsa_transport_send_cb(netsnmp_transport * transport, const void *buf, int len, void **opaque, int *olength)
+{
+    vsa_transport_t        *wrapper;
+
+    wrapper = g_hash_table_lookup(transports, transport);
+    VSA_TRACE(packet_send, buf, len, VSA_TRACE_NOW() - received);
+
+    for (GList * l = wrapper->hooks; l; l = l->next) {
+        vsa_transport_hook_t   *hook;
+
+        hook = l->data;
+        if (hook->send && VSA_TRANSPORT_CONSUMED == hook->send(transport, buf, len, opaque, olength, hook->data)) {
+            return len;
+        }
+    }
+
+    return wrapper->send(transport, buf, len, opaque, olength);
+}
+
+static vsa_transport_t *
+vsa_transport_get_wrapper(netsnmp_transport * transport)
+{
+    vsa_transport_t        *wrapper;
+
+    if (!transports) {
+        transports = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    wrapper = g_hash_table_lookup(transports, transport);
+    if (!wrapper) {
+        wrapper = calloc(1, sizeof (vsa_transport_t));
+        if (!wrapper) {
+            vsa_log_debugln("%s", strerror(errno));
+            return NULL;
+        }
+        wrapper->recv = transport->f_recv;
+        wrapper->send = transport->f_send;
+        transport->f_recv = vsa_transport_recv_cb;
+        transport->f_send = vsa_transport_send_cb;
+        g_hash_table_insert(transports, transport, wrapper);
+    }
+
+    return wrapper;
+}
+
+netsnmp_transport      *
+vsa_transport_get_main(void)
+{
+    void                   *sessp;
+
+    if (!main_session) {
+        vsa_log_debugln("no agent session");
+        return NULL;
+    }
+
+    sessp = snmp_sess_pointer(main_session);
+    if (!sessp) {
+        vsa_log_debugln("no agent session pointer");
+        return NULL;
+    }
+
+    return snmp_sess_transport(sessp);
+}
+
+/*
+ * Fills transports with up to size of the datagram transports the agent receives requests on, the main one first, and
+ * returns how many there are.
+ */
+size_t
+vsa_transport_get_agent(netsnmp_transport ** transports, size_t size)
+{
+    size_t                  n;
+    netsnmp_transport      *transport;
+
+    n = 0;
+    transport = vsa_transport_get_main();
+    if (transport && !(transport->flags & NETSNMP_TRANSPORT_FLAG_STREAM)) {
+        if (n < size) {
+            transports[n] = transport;
+        }
+        n++;
+    }
+
+    for (struct session_list * slp = Sessions; slp; slp = slp->next) {
+        if (!slp->transport || slp->transport == transport || handle_snmp_packet != slp->session->callback
+            || slp->transport->flags & NETSNMP_TRANSPORT_FLAG_STREAM) {
+            continue;
+        }
+        if (n < size) {
+            transports[n] = slp->transport;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+int
+vsa_transport_add_hook(netsnmp_transport * transport, vsa_transport_recv_hook_t recv_hook,
+                       vsa_transport_send_hook_t send_hook, void *data)
+{
+    vsa_transport_t        *wrapper;
+    vsa_transport_hook_t   *hook;
+
+    hook = calloc(1, sizeof (vsa_transport_hook_t));
+    if (!hook) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    hook->recv = recv_hook;
+    hook->send = send_hook;
+    hook->data = data;
+
+    wrapper = vsa_transport_get_wrapper(transport);
+    if (!wrapper) {
+        free(hook);
+        return -1;
+    }
+    wrapper->hooks = g_list_append(wrapper->hooks, hook);
+
+    return 0;
+}
+
+int
+vsa_transport_send(netsnmp_transport * transport, const void *buf, int len, void **opaque, int *olength)
+{
+    vsa_transport_t        *wrapper;
+
+    VSA_TRACE(packet_send, buf, len, VSA_TRACE_NOW() - received);
+
+    wrapper = transports ? g_hash_table_lookup(transports, transport) : NULL;
+    if (!wrapper) {
+        return transport->f_send(transport, buf, len, opaque, olength);
+    }
+
+    return wrapper->send(transport, buf, len, opaque, olength);
+}
+
+// Routes the packets of transport through the wrappers even without hooks, so that they hit the packet probes.
+int
+vsa_transport_trace(netsnmp_transport * transport)
+{
+    return vsa_transport_get_wrapper(transport) ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_TRANSPORT_H
+#define VSA_TRANSPORT_H
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#define VSA_TRANSPORT_ADD_HOOK_ERROR_MSG "vsa_transport_add_hook() failed"
+#define VSA_TRANSPORT_GET_MAIN_ERROR_MSG "vsa_transport_get_main() failed"
+#define VSA_TRANSPORT_TRACE_ERROR_MSG "vsa_transport_trace() failed"
+
+// Values returned by the hooks. A consumed packet is not seen by the next hooks nor by net-snmp.
+#define VSA_TRANSPORT_CONTINUE 0
+#define VSA_TRANSPORT_CONSUMED 1
+
+typedef int             (*vsa_transport_recv_hook_t) (netsnmp_transport * transport, void *buf, int len,
+                                                      void **opaque, int *olength, void *data);
+typedef int             (*vsa_transport_send_hook_t) (netsnmp_transport * transport, const void *buf, int len,
+                                                      void **opaque, int *olength, void *data);
+
+netsnmp_transport      *vsa_transport_get_main(void);
+size_t                  vsa_transport_get_agent(netsnmp_transport ** transports, size_t size);
+int                     vsa_transport_add_hook(netsnmp_transport * transport, vsa_transport_recv_hook_t recv_hook,
+                                               vsa_transport_send_hook_t send_hook, void *data);
+int                     vsa_transport_send(netsnmp_transport * transport, const void *buf, int len, void **opaque,
+                                           int *olength);
+int                     vsa_transport_trace(netsnmp_transport * transport);
+
+#endif // VSA_TRANSPORT_H
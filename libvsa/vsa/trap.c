@@ -0,0 +1,1012 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#include <vsa/ber.h>
+#include <vsa/log.h>
+#include <vsa/parser.h>
+#include <vsa/trap.h>
+#include <vsa/value.h>
+
+#define VSA_TRAP_PORT "162"
+
+// net-snmp's defaults, for sinks that don't set theirs.
+#define VSA_TRAP_TIMEOUT 1000
+#define VSA_TRAP_RETRIES 5
+
+// Notifications sent in a row before reading responses again.
+#define VSA_TRAP_BURST (VSA_TRAP_BATCH * 16)
+
+// Milliseconds between checks for the SNMPv3 informs to send again.
+#define VSA_TRAP_V3_INTERVAL 10
+
+// Room for what a message takes besides the community and the varbinds of its template.
+#define VSA_TRAP_OVERHEAD 64
+
+#define VSA_TRAP_RECV_SIZE 65536
+
+// Varbinds that don't fit this could never be sent in a datagram: encoding gives up there.
+#define VSA_TRAP_MAX_VARBINDS 65536
+
+static const oid        vsa_trap_uptime_oid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static const oid        vsa_trap_oid_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static const oid        vsa_trap_link_down_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 3 };
+static const oid        vsa_trap_link_up_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 4 };
+
+// ifEntry, whose ifIndex, ifAdminStatus and ifOperStatus columns are the varbinds of linkDown and linkUp.
+static const oid        vsa_trap_if_entry_oid[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1 };
+static const oid        vsa_trap_link_columns[] = { 1, 7, 8 };
+
+// The encoded sysUpTime.0 name, the same in every message.
+static const unsigned char vsa_trap_uptime_name[] = { ASN_OBJECT_ID, 8, 0x2b, 6, 1, 2, 1, 1, 3, 0 };
+
+// Whether the sink being parsed was given -Ci, as net-snmp's trapsess takes it.
+static int              vsa_trap_inform_opt;
+
+static void             vsa_trap_opt_cb(int argc, char *const *argv, int opt);
+static int              vsa_trap_connect(const char *peer);
+static vsa_trap_template_t *vsa_trap_template_new(const oid * notification, size_t len);
+static void             vsa_trap_template_free_cb(gpointer data);
+static int              vsa_trap_template_add(vsa_trap_template_t * template, vsa_index_t * index, const oid * oids,
+                                              size_t len);
+static int              vsa_trap_template_encode(vsa_trap_template_t * template);
+static void             vsa_trap_sink_free_cb(gpointer data);
+static gint             vsa_trap_event_cmp(gconstpointer a, gconstpointer b);
+static size_t           vsa_trap_encode(vsa_trap_sink_t * sink, vsa_trap_template_t * template, guint32 reqid,
+                                        guint32 uptime, unsigned char *buf);
+static int              vsa_trap_get_reqid(const unsigned char *buf, size_t len, guint32 * reqid);
+static int              vsa_trap_response_cb(int operation, netsnmp_session * session, int reqid, netsnmp_pdu * pdu,
+                                             void *data);
+static void             vsa_trap_send_v3(vsa_trap_t * trap, vsa_trap_sink_t * sink, vsa_trap_template_t * template,
+                                         guint32 uptime);
+static void             vsa_trap_flush(vsa_trap_t * trap, vsa_trap_sink_t * sink);
+static void             vsa_trap_queue(vsa_trap_t * trap, vsa_trap_template_t * template, guint32 uptime);
+static size_t           vsa_trap_send_due(vsa_trap_t * trap, guint64 elapsed, size_t next);
+static void             vsa_trap_retransmit_cb(vsa_wheel_entry_t * timer, void *data);
+static void             vsa_trap_read(vsa_trap_t * trap, vsa_trap_sink_t * sink);
+static int              vsa_trap_get_timeout(vsa_trap_t * trap, guint64 elapsed, size_t next);
+static gpointer         vsa_trap_thread(gpointer data);
+
+static void
+vsa_trap_opt_cb(int argc, char *const *argv, int opt)
+{
+    (void) argc;
+    (void) argv;
+
+    if ('C' == opt && strchr(optarg, 'i')) {
+        vsa_trap_inform_opt = 1;
+    }
+}
+
+// Opens a UDP socket connected to peer, [udp:|udp6:]HOST[:PORT] as net-snmp writes it.
+static int
+vsa_trap_connect(const char *peer)
+{
+    int                     sock, ret;
+    char                   *host, *port, *p;
+    struct addrinfo         hints, *res;
+
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (g_str_has_prefix(peer, "udp:")) {
+        hints.ai_family = AF_INET;
+        peer += strlen("udp:");
+    } else if (g_str_has_prefix(peer, "udp6:")) {
+        hints.ai_family = AF_INET6;
+        peer += strlen("udp6:");
+    }
+
+    host = g_strdup(peer);
+    port = NULL;
+    if ('[' == *host) {
+        p = strchr(host, ']');
+        if (!p || (p[1] && ':' != p[1])) {
+            vsa_log_debugln("invalid address '%s'", peer);
+            g_free(host);
+            return -1;
+        }
+        *p = '\0';
+        port = p[1] ? p + 2 : NULL;
+        memmove(host, host + 1, strlen(host));
+    } else {
+        // A bare IPv6 address has more than one colon.
+        p = strrchr(host, ':');
+        if (p && strchr(host, ':') == p) {
+            *p = '\0';
+            port = p + 1;
+        }
+    }
+
+    ret = getaddrinfo(host, port && *port ? port : VSA_TRAP_PORT, &hints, &res);
+    g_free(host);
+    if (ret) {
+        vsa_log_debugln("%s: %s", peer, gai_strerror(ret));
+        return -1;
+    }
+
+    sock = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (-1 == sock || connect(sock, res->ai_addr, res->ai_addrlen)) {
+        vsa_log_debugln("%s", strerror(errno));
+        if (-1 != sock) {
+            close(sock);
+        }
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+
+    return sock;
+}
+
+static vsa_trap_template_t *
+vsa_trap_template_new(const oid * notification, size_t len)
+{
+    vsa_trap_template_t    *template;
+
+    template = calloc(1, sizeof (vsa_trap_template_t));
+    if (!template) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    if (!snmp_varlist_add_variable(&template->vars, vsa_trap_oid_oid, G_N_ELEMENTS(vsa_trap_oid_oid), ASN_OBJECT_ID,
+                                   notification, len * sizeof (oid))) {
+        vsa_log_debugln("snmp_varlist_add_variable() failed");
+        free(template);
+        return NULL;
+    }
+
+    return template;
+}
+
+static void
+vsa_trap_template_free_cb(gpointer data)
+{
+    vsa_trap_template_t    *template;
+
+    template = data;
+    snmp_free_varbind(template->vars);
+    free(template->varbinds);
+    free(template);
+}
+
+// Adds the object with the value it has now.
+static int
+vsa_trap_template_add(vsa_trap_template_t * template, vsa_index_t * index, const oid * oids, size_t len)
+{
+    vsa_object_t           *object;
+    const void             *payload;
+    size_t                  payload_len;
+
+    object = vsa_index_get(index, oids, len);
+    if (!object) {
+        vsa_log_debugln("no such object");
+        return -1;
+    }
+
+    if (vsa_value_get_payload(object->value, &payload, &payload_len)) {
+        vsa_log_debugln(VSA_VALUE_GET_PAYLOAD_ERROR_MSG);
+        return -1;
+    }
+
+    if (!snmp_varlist_add_variable(&template->vars, oids, len, vsa_asn_type_get_info(object->value->type)->asn,
+                                   payload, payload_len)) {
+        vsa_log_debugln("snmp_varlist_add_variable() failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_trap_template_encode(vsa_trap_template_t * template)
+{
+    unsigned char          *buf, *p;
+    size_t                  size, left;
+
+    for (size = 1024; size <= VSA_TRAP_MAX_VARBINDS; size *= 2) {
+        buf = realloc(template->varbinds, size);
+        if (!buf) {
+            vsa_log_debugln("%s", strerror(errno));
+            return -1;
+        }
+        template->varbinds = buf;
+
+        p = buf;
+        left = size;
+        for (netsnmp_variable_list * var = template->vars; var && p; var = var->next_variable) {
+            p = snmp_build_var_op(p, var->name, &var->name_length, var->type, var->val_len, var->val.string, &left);
+        }
+        if (p) {
+            template->len = p - buf;
+            return 0;
+        }
+    }
+    vsa_log_debugln("varbinds don't fit in %d bytes", VSA_TRAP_MAX_VARBINDS);
+
+    return -1;
+}
+
+static void
+vsa_trap_sink_free_cb(gpointer data)
+{
+    vsa_trap_sink_t        *sink;
+
+    sink = data;
+    if (-1 != sink->sock) {
+        close(sink->sock);
+    }
+    if (sink->sessp) {
+        snmp_sess_close(sink->sessp);
+    }
+    free(sink->head);
+    free(sink->bufs);
+    free(sink);
+}
+
+static gint
+vsa_trap_event_cmp(gconstpointer a, gconstpointer b)
+{
+    const vsa_trap_event_t *event_a, *event_b;
+
+    event_a = a;
+    event_b = b;
+    if (event_a->offset != event_b->offset) {
+        return event_a->offset < event_b->offset ? -1 : 1;
+    }
+
+    // Notifications due at once keep the order of the schedule.
+    return event_a->template < event_b->template ? -1 : event_a->template > event_b->template;
+}
+
+/*
+ * Assembles an SNMPv2c notification: SEQUENCE { head, PDU { reqid, 0, 0, SEQUENCE { sysUpTime.0, varbinds } } }, the
+ * lengths depending on those of reqid and uptime.
+ */
+static size_t
+vsa_trap_encode(vsa_trap_sink_t * sink, vsa_trap_template_t * template, guint32 reqid, guint32 uptime,
+                unsigned char *buf)
+{
+    size_t                  uptime_len, list_len, pdu_len, msg_len;
+    unsigned char          *p;
+
+    uptime_len = sizeof (vsa_trap_uptime_name) + 2 + vsa_ber_uint_size(uptime);
+    list_len = 2 + uptime_len + template->len;
+    pdu_len = 2 + vsa_ber_uint_size(reqid) + 6 + 1 + vsa_ber_len_size(list_len) + list_len;
+    msg_len = sink->head_len + 1 + vsa_ber_len_size(pdu_len) + pdu_len;
+
+    p = buf;
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, msg_len);
+    memcpy(p, sink->head, sink->head_len), p += sink->head_len;
+    p += vsa_ber_write_header(p, sink->inform ? SNMP_MSG_INFORM : SNMP_MSG_TRAP2, pdu_len);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, reqid);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, 0);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, 0);
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, list_len);
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, uptime_len);
+    memcpy(p, vsa_trap_uptime_name, sizeof (vsa_trap_uptime_name)), p += sizeof (vsa_trap_uptime_name);
+    p += vsa_ber_write_uint(p, ASN_TIMETICKS, uptime);
+    memcpy(p, template->varbinds, template->len), p += template->len;
+
+    return p - buf;
+}
+
+// Reads the request-id of an SNMPv2c response.
+static int
+vsa_trap_get_reqid(const unsigned char *buf, size_t len, guint32 * reqid)
+{
+    const unsigned char    *p, *end;
+    unsigned char           type;
+    size_t                  l;
+
+    end = buf + len;
+    p = vsa_ber_read_tlv(buf, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    end = p + l;
+
+    // version and community
+    for (int i = 0; i < 2; i++) {
+        p = vsa_ber_read_tlv(p, end, &type, &l);
+        if (!p) {
+            return -1;
+        }
+        p += l;
+    }
+
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || SNMP_MSG_RESPONSE != type) {
+        return -1;
+    }
+    p = vsa_ber_read_tlv(p, p + l, &type, &l);
+    if (!p || ASN_INTEGER != type || !l || l > 5 || *p & 0x80) {
+        return -1;
+    }
+    for (*reqid = 0; l; l--) {
+        *reqid = *reqid << 8 | *p++;
+    }
+
+    return 0;
+}
+
+static int
+vsa_trap_response_cb(int operation, netsnmp_session * session, int reqid, netsnmp_pdu * pdu, void *data)
+{
+    vsa_trap_t             *trap;
+
+    (void) session;
+    (void) reqid;
+    (void) pdu;
+    trap = data;
+
+    if (NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE == operation) {
+        trap->acked++;
+    } else if (NETSNMP_CALLBACK_OP_TIMED_OUT == operation) {
+        trap->timeouts++;
+    }
+
+    return 1;
+}
+
+static void
+vsa_trap_send_v3(vsa_trap_t * trap, vsa_trap_sink_t * sink, vsa_trap_template_t * template, guint32 uptime)
+{
+    netsnmp_pdu            *pdu;
+    u_long                  ticks;
+    int                     ret;
+
+    pdu = snmp_pdu_create(sink->inform ? SNMP_MSG_INFORM : SNMP_MSG_TRAP2);
+    if (!pdu) {
+        trap->errors++;
+        return;
+    }
+
+    ticks = uptime;
+    if (!snmp_varlist_add_variable(&pdu->variables, vsa_trap_uptime_oid, G_N_ELEMENTS(vsa_trap_uptime_oid),
+                                   ASN_TIMETICKS, &ticks, sizeof (ticks))) {
+        snmp_free_pdu(pdu);
+        trap->errors++;
+        return;
+    }
+    pdu->variables->next_variable = snmp_clone_varbind(template->vars);
+
+    if (sink->inform) {
+        ret = snmp_sess_async_send(sink->sessp, pdu, vsa_trap_response_cb, trap);
+    } else {
+        ret = snmp_sess_send(sink->sessp, pdu);
+    }
+    if (!ret) {
+        snmp_free_pdu(pdu);
+        trap->errors++;
+        return;
+    }
+    trap->sent++;
+}
+
+static void
+vsa_trap_flush(vsa_trap_t * trap, vsa_trap_sink_t * sink)
+{
+    int                     ret;
+
+    for (unsigned i = 0; i < sink->nmsgs; i += ret) {
+        ret = sendmmsg(sink->sock, sink->msgs + i, sink->nmsgs - i, 0);
+        if (ret < 0 && EINTR == errno) {
+            ret = 0;
+        } else if (ret <= 0) {
+            // The message at i was refused (e.g. by an ICMP error of a previous one): it is lost, as over the wire.
+            trap->errors++;
+            ret = 1;
+        }
+    }
+    sink->nmsgs = 0;
+}
+
+// Builds the notification for every sink, flushing full batches.
+static void
+vsa_trap_queue(vsa_trap_t * trap, vsa_trap_template_t * template, guint32 uptime)
+{
+    vsa_trap_sink_t        *sink;
+    vsa_trap_inform_t      *inform;
+    unsigned char          *buf;
+    size_t                  len;
+
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        if (sink->sessp) {
+            vsa_trap_send_v3(trap, sink, template, uptime);
+            continue;
+        }
+
+        trap->reqid = trap->reqid % G_MAXINT32 + 1;
+        buf = sink->bufs + sink->nmsgs * trap->max_len;
+        len = vsa_trap_encode(sink, template, trap->reqid, uptime, buf);
+        sink->iovs[sink->nmsgs].iov_base = buf;
+        sink->iovs[sink->nmsgs].iov_len = len;
+
+        if (sink->inform) {
+            inform = malloc(sizeof (vsa_trap_inform_t) + len);
+            if (!inform) {
+                vsa_log_debugln("%s", strerror(errno));
+            } else {
+                inform->timer.data = inform;
+                inform->sink = sink;
+                inform->reqid = trap->reqid;
+                inform->retries = sink->retries;
+                inform->len = len;
+                memcpy(inform->msg, buf, len);
+                vsa_wheel_add(&trap->wheel, &inform->timer, vsa_wheel_clock(), sink->timeout);
+                g_hash_table_insert(trap->informs, GUINT_TO_POINTER(inform->reqid), inform);
+            }
+        }
+
+        trap->sent++;
+        if (++sink->nmsgs == VSA_TRAP_BATCH) {
+            vsa_trap_flush(trap, sink);
+        }
+    }
+}
+
+/*
+ * Sends the notifications due elapsed milliseconds after the start, from the next-th one on, and returns where it
+ * stopped: at a burst at most, and while informs can still be tracked.
+ */
+static size_t
+vsa_trap_send_due(vsa_trap_t * trap, guint64 elapsed, size_t next)
+{
+    size_t                  due, limit;
+    guint32                 uptime;
+    vsa_trap_sink_t        *sink;
+    vsa_trap_event_t       *event;
+    vsa_trap_template_t    *template;
+
+    due = trap->rate > 0 ? (size_t) (elapsed * trap->rate / 1000) : trap->schedule->len;
+    uptime = netsnmp_get_agent_uptime();
+
+    for (limit = next + VSA_TRAP_BURST; next < due && next < limit; next++) {
+        if (trap->rate > 0) {
+            template = g_ptr_array_index(trap->templates, next % trap->templates->len);
+        } else {
+            event = &g_array_index(trap->schedule, vsa_trap_event_t, next);
+            if (event->offset > elapsed) {
+                break;
+            }
+            template = g_ptr_array_index(trap->templates, event->template);
+        }
+        if (g_hash_table_size(trap->informs) >= VSA_TRAP_MAX_INFORMS) {
+            break;
+        }
+        vsa_trap_queue(trap, template, uptime);
+    }
+
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        if (sink->nmsgs) {
+            vsa_trap_flush(trap, sink);
+        }
+    }
+
+    return next;
+}
+
+static void
+vsa_trap_retransmit_cb(vsa_wheel_entry_t * timer, void *data)
+{
+    vsa_trap_t             *trap;
+    vsa_trap_inform_t      *inform;
+
+    trap = data;
+    inform = timer->data;
+
+    if (!inform->retries--) {
+        trap->timeouts++;
+        g_hash_table_remove(trap->informs, GUINT_TO_POINTER(inform->reqid));
+        return;
+    }
+
+    if (send(inform->sink->sock, inform->msg, inform->len, 0) < 0) {
+        trap->errors++;
+    }
+    trap->retransmitted++;
+    vsa_wheel_add(&trap->wheel, timer, vsa_wheel_clock(), inform->sink->timeout);
+}
+
+static void
+vsa_trap_read(vsa_trap_t * trap, vsa_trap_sink_t * sink)
+{
+    unsigned char           buf[VSA_TRAP_RECV_SIZE];
+    ssize_t                 len;
+    guint32                 reqid;
+    vsa_trap_inform_t      *inform;
+    fd_set                  fdset;
+
+    if (sink->sessp) {
+        FD_ZERO(&fdset);
+        FD_SET(snmp_sess_transport(sink->sessp)->sock, &fdset);
+        snmp_sess_read(sink->sessp, &fdset);
+        return;
+    }
+
+    while ((len = recv(sink->sock, buf, sizeof (buf), MSG_DONTWAIT)) > 0) {
+        if (vsa_trap_get_reqid(buf, len, &reqid)) {
+            continue;
+        }
+        inform = g_hash_table_lookup(trap->informs, GUINT_TO_POINTER(reqid));
+        if (!inform || inform->sink != sink) {
+            continue;
+        }
+        vsa_wheel_remove(&trap->wheel, &inform->timer);
+        g_hash_table_remove(trap->informs, GUINT_TO_POINTER(reqid));
+        trap->acked++;
+    }
+}
+
+// Milliseconds until there is something to do, -1 for none.
+static int
+vsa_trap_get_timeout(vsa_trap_t * trap, guint64 elapsed, size_t next)
+{
+    int                     timeout;
+    guint64                 offset;
+    vsa_trap_sink_t        *sink;
+
+    timeout = -1;
+    if (trap->rate > 0 || trap->wheel.len) {
+        timeout = 1;
+    } else if (next < trap->schedule->len) {
+        offset = g_array_index(trap->schedule, vsa_trap_event_t, next).offset;
+        timeout = offset > elapsed ? MIN(offset - elapsed, G_MAXINT) : 0;
+    }
+
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        if (sink->sessp && sink->inform && (-1 == timeout || timeout > VSA_TRAP_V3_INTERVAL)) {
+            timeout = VSA_TRAP_V3_INTERVAL;
+        }
+    }
+
+    return timeout;
+}
+
+static gpointer
+vsa_trap_thread(gpointer data)
+{
+    vsa_trap_t             *trap;
+    vsa_trap_sink_t        *sink;
+    struct pollfd          *fds;
+    guint                   nfds;
+    guint64                 start, now, checked;
+    size_t                  next;
+
+    trap = data;
+
+    nfds = trap->sinks->len + 1;
+    fds = calloc(nfds, sizeof (struct pollfd));
+    if (!fds) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    fds[0].fd = trap->fds[0];
+    fds[0].events = POLLIN;
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        fds[i + 1].fd = sink->sessp ? snmp_sess_transport(sink->sessp)->sock : sink->sock;
+        fds[i + 1].events = POLLIN;
+    }
+
+    next = 0;
+    start = checked = vsa_wheel_clock();
+    for (;;) {
+        now = vsa_wheel_clock();
+        next = vsa_trap_send_due(trap, now - start, next);
+        vsa_wheel_run(&trap->wheel, now, vsa_trap_retransmit_cb, trap);
+
+        if (now - checked >= VSA_TRAP_V3_INTERVAL) {
+            for (guint i = 0; i < trap->sinks->len; i++) {
+                sink = g_ptr_array_index(trap->sinks, i);
+                if (sink->sessp) {
+                    snmp_sess_timeout(sink->sessp);
+                }
+            }
+            checked = now;
+        }
+
+        if (poll(fds, nfds, vsa_trap_get_timeout(trap, now - start, next)) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            vsa_log_debugln("%s", strerror(errno));
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        for (guint i = 0; i < trap->sinks->len; i++) {
+            if (fds[i + 1].revents) {
+                vsa_trap_read(trap, g_ptr_array_index(trap->sinks, i));
+            }
+        }
+    }
+
+    free(fds);
+
+    return NULL;
+}
+
+vsa_trap_t             *
+vsa_trap_new(void)
+{
+    vsa_trap_t             *trap;
+
+    trap = calloc(1, sizeof (vsa_trap_t));
+    if (!trap) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    trap->templates = g_ptr_array_new_with_free_func(vsa_trap_template_free_cb);
+    trap->schedule = g_array_new(FALSE, FALSE, sizeof (vsa_trap_event_t));
+    trap->sinks = g_ptr_array_new_with_free_func(vsa_trap_sink_free_cb);
+    trap->informs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+    trap->fds[0] = trap->fds[1] = -1;
+    vsa_wheel_init(&trap->wheel);
+
+    return trap;
+}
+
+void                   *
+vsa_trap_free(vsa_trap_t * trap)
+{
+    if (!trap) {
+        return NULL;
+    }
+    vsa_trap_stop(trap);
+    g_hash_table_destroy(trap->informs);
+    g_ptr_array_free(trap->sinks, TRUE);
+    g_ptr_array_free(trap->templates, TRUE);
+    g_array_free(trap->schedule, TRUE);
+    free(trap);
+
+    return NULL;
+}
+
+/*
+ * Adds a sink given as to net-snmp's trapsess: [-Ci] [SNMP options] ADDRESS, e.g. "-v 2c -c public 10.0.0.1:162". -Ci
+ * sends informs instead of traps.
+ */
+int
+vsa_trap_add_sink(vsa_trap_t * trap, const char *args)
+{
+    gint                    argc;
+    gchar                 **argv, *line;
+    GError                 *gerror;
+    netsnmp_session         session;
+    vsa_trap_sink_t        *sink;
+    u_char                  engine_id[SNMP_MAXBUF_SMALL];
+    size_t                  community_len;
+    unsigned char          *p;
+
+    gerror = NULL;
+    line = g_strconcat("trap ", args, NULL);
+    if (!g_shell_parse_argv(line, &argc, &argv, &gerror)) {
+        vsa_log_debugln("%s", gerror->message);
+        g_error_free(gerror);
+        g_free(line);
+        return -1;
+    }
+    g_free(line);
+
+    snmp_sess_init(&session);
+    vsa_trap_inform_opt = 0;
+    optind = 0;
+    if (netsnmp_parse_args(argc, argv, &session, "C:", vsa_trap_opt_cb,
+                           NETSNMP_PARSE_ARGS_NOLOGGING | NETSNMP_PARSE_ARGS_NOZERO) < 0 || !session.peername) {
+        vsa_log_debugln("invalid sink '%s'", args);
+        g_strfreev(argv);
+        return -1;
+    }
+#ifndef NETSNMP_REENTRANT
+    // SNMPv3 sinks are served by the trap thread, which only a reentrant net-snmp lets share its state with the agent.
+    if (SNMP_VERSION_3 == session.version) {
+        vsa_log_debugln("SNMPv3 sinks need a net-snmp built with --enable-reentrant");
+        g_strfreev(argv);
+        return -1;
+    }
+#endif
+
+    sink = calloc(1, sizeof (vsa_trap_sink_t));
+    if (!sink) {
+        vsa_log_debugln("%s", strerror(errno));
+        g_strfreev(argv);
+        return -1;
+    }
+    sink->sock = -1;
+    sink->inform = vsa_trap_inform_opt;
+    sink->version = session.version;
+    sink->timeout = session.timeout > 0 ? (guint64) session.timeout / 1000 : VSA_TRAP_TIMEOUT;
+    sink->retries = session.retries >= 0 ? session.retries : VSA_TRAP_RETRIES;
+
+    switch (session.version) {
+    case SNMP_VERSION_2c:
+        community_len = session.community_len;
+        sink->head_len = 3 + 1 + vsa_ber_len_size(community_len) + community_len;
+        sink->head = malloc(sink->head_len);
+        if (!sink->head) {
+            vsa_log_debugln("%s", strerror(errno));
+            break;
+        }
+        p = sink->head;
+        p += vsa_ber_write_uint(p, ASN_INTEGER, SNMP_VERSION_2c);
+        p += vsa_ber_write_header(p, ASN_OCTET_STR, community_len);
+        memcpy(p, session.community, community_len);
+
+        sink->sock = vsa_trap_connect(session.peername);
+        break;
+
+    case SNMP_VERSION_3:
+        // Traps are sent by the local engine, which the keys are localized to. Informs go to the sink's, discovered.
+        if (!sink->inform && !session.securityEngineIDLen) {
+            session.securityEngineIDLen = snmpv3_get_engineID(engine_id, sizeof (engine_id));
+            session.securityEngineID = engine_id;
+        }
+        sink->sessp = snmp_sess_open(&session);
+        if (!sink->sessp) {
+            vsa_log_debugln("snmp_sess_open() failed");
+        }
+        break;
+
+    default:
+        vsa_log_debugln("SNMPv1 traps aren't supported");
+        break;
+    }
+    g_strfreev(argv);
+
+    if (-1 == sink->sock && !sink->sessp) {
+        vsa_trap_sink_free_cb(sink);
+        return -1;
+    }
+    g_ptr_array_add(trap->sinks, sink);
+
+    return 0;
+}
+
+/*
+ * Loads the notifications of a schedule file, whose lines are OFFSET NOTIFICATION [OBJECT]..., OFFSET being in
+ * milliseconds from the start and the values of the OBJECT varbinds those the objects have now. Blank lines and lines
+ * starting with # are skipped.
+ */
+int
+vsa_trap_load_schedule(vsa_trap_t * trap, vsa_index_t * index, const char *path)
+{
+    FILE                   *fp;
+    char                   *line, *token, *saveptr, *p;
+    size_t                  size, lineno, len;
+    ssize_t                 nread;
+    oid                    *oids;
+    vsa_trap_event_t        event;
+    vsa_trap_template_t    *template;
+    int                     ret;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    ret = 0;
+    line = NULL;
+    size = 0;
+    for (lineno = 1; !ret && (nread = getline(&line, &size, fp)) != -1; lineno++) {
+        token = strtok_r(line, " \t\r\n", &saveptr);
+        if (!token || '#' == *token) {
+            continue;
+        }
+
+        ret = -1;
+        errno = 0;
+        event.offset = strtoull(token, &p, 10);
+        if (errno || p == token || *p) {
+            vsa_log_debugln("%s:%zu: invalid offset '%s'", path, lineno, token);
+            break;
+        }
+
+        token = strtok_r(NULL, " \t\r\n", &saveptr);
+        oids = token ? vsa_parser_parse_oid(token, &len) : NULL;
+        if (!oids) {
+            vsa_log_debugln("%s:%zu: invalid notification", path, lineno);
+            break;
+        }
+        template = vsa_trap_template_new(oids, len);
+        free(oids);
+        if (!template) {
+            break;
+        }
+        g_ptr_array_add(trap->templates, template);
+
+        while ((token = strtok_r(NULL, " \t\r\n", &saveptr))) {
+            oids = vsa_parser_parse_oid(token, &len);
+            if (!oids || vsa_trap_template_add(template, index, oids, len)) {
+                vsa_log_debugln("%s:%zu: invalid object '%s'", path, lineno, token);
+                free(oids);
+                break;
+            }
+            free(oids);
+        }
+        if (token || vsa_trap_template_encode(template)) {
+            break;
+        }
+
+        event.template = trap->templates->len - 1;
+        g_array_append_val(trap->schedule, event);
+        ret = 0;
+    }
+    free(line);
+    fclose(fp);
+
+    g_array_sort(trap->schedule, vsa_trap_event_cmp);
+
+    return ret;
+}
+
+// Adds a linkDown and a linkUp notification for each interface of the ifTable.
+int
+vsa_trap_add_links(vsa_trap_t * trap, vsa_index_t * index)
+{
+    oid                     oids[MAX_OID_LEN];
+    size_t                  pos, len;
+    vsa_oid_t              *tree;
+    vsa_trap_template_t    *template;
+    const oid              *notifications[] = { vsa_trap_link_down_oid, vsa_trap_link_up_oid };
+    size_t                  added;
+
+    len = G_N_ELEMENTS(vsa_trap_if_entry_oid);
+    memcpy(oids, vsa_trap_if_entry_oid, sizeof (vsa_trap_if_entry_oid));
+    oids[len] = vsa_trap_link_columns[0];
+
+    added = 0;
+    for (pos = vsa_index_next(index, oids, len + 1); pos < index->len; pos++) {
+        tree = index->objects[pos]->tree;
+        if (tree->len != len + 2 || memcmp(tree->oids, oids, (len + 1) * sizeof (oid))) {
+            break;
+        }
+        oids[len + 1] = tree->oids[len + 1];
+
+        for (size_t i = 0; i < G_N_ELEMENTS(notifications); i++) {
+            template = vsa_trap_template_new(notifications[i], G_N_ELEMENTS(vsa_trap_link_down_oid));
+            if (!template) {
+                return -1;
+            }
+            g_ptr_array_add(trap->templates, template);
+
+            for (size_t j = 0; j < G_N_ELEMENTS(vsa_trap_link_columns); j++) {
+                oids[len] = vsa_trap_link_columns[j];
+                if (vsa_trap_template_add(template, index, oids, len + 2)) {
+                    return -1;
+                }
+            }
+            oids[len] = vsa_trap_link_columns[0];
+
+            if (vsa_trap_template_encode(template)) {
+                return -1;
+            }
+        }
+        added++;
+    }
+
+    if (!added) {
+        vsa_log_debugln("no ifIndex objects");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Starts sending, rate notifications per second or, with a rate of 0, as scheduled.
+int
+vsa_trap_start(vsa_trap_t * trap, double rate)
+{
+    size_t                  head_len;
+    vsa_trap_sink_t        *sink;
+    vsa_trap_template_t    *template;
+    GError                 *gerror;
+
+    if (!trap->sinks->len || !trap->templates->len) {
+        vsa_log_debugln("no sinks or no notifications");
+        return -1;
+    }
+    trap->rate = rate;
+
+    head_len = 0;
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        head_len = MAX(head_len, sink->head_len);
+    }
+    for (guint i = 0; i < trap->templates->len; i++) {
+        template = g_ptr_array_index(trap->templates, i);
+        trap->max_len = MAX(trap->max_len, head_len + template->len + VSA_TRAP_OVERHEAD);
+    }
+
+    for (guint i = 0; i < trap->sinks->len; i++) {
+        sink = g_ptr_array_index(trap->sinks, i);
+        if (sink->sessp) {
+            continue;
+        }
+        sink->bufs = malloc(VSA_TRAP_BATCH * trap->max_len);
+        if (!sink->bufs) {
+            vsa_log_debugln("%s", strerror(errno));
+            return -1;
+        }
+        for (int j = 0; j < VSA_TRAP_BATCH; j++) {
+            memset(&sink->msgs[j], 0, sizeof (sink->msgs[j]));
+            sink->msgs[j].msg_hdr.msg_iov = &sink->iovs[j];
+            sink->msgs[j].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    if (pipe2(trap->fds, O_CLOEXEC)) {
+        vsa_log_debugln("%s", strerror(errno));
+        trap->fds[0] = trap->fds[1] = -1;
+        return -1;
+    }
+
+    gerror = NULL;
+    trap->thread = g_thread_try_new("trap", vsa_trap_thread, trap, &gerror);
+    if (!trap->thread) {
+        vsa_log_debugln("%s", gerror->message);
+        g_error_free(gerror);
+        close(trap->fds[0]);
+        close(trap->fds[1]);
+        trap->fds[0] = trap->fds[1] = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+vsa_trap_stop(vsa_trap_t * trap)
+{
+    if (!trap->thread) {
+        return;
+    }
+
+    if (write(trap->fds[1], "", 1) < 0) {
+        vsa_log_debugln("%s", strerror(errno));
+    }
+    g_thread_join(trap->thread);
+    trap->thread = NULL;
+    close(trap->fds[0]);
+    close(trap->fds[1]);
+    trap->fds[0] = trap->fds[1] = -1;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_TRAP_H
+#define VSA_TRAP_H
+
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/index.h>
+#include <vsa/wheel.h>
+
+#define VSA_TRAP_NEW_ERROR_MSG "vsa_trap_new() failed"
+#define VSA_TRAP_ADD_SINK_ERROR_MSG "vsa_trap_add_sink() failed"
+#define VSA_TRAP_LOAD_SCHEDULE_ERROR_MSG "vsa_trap_load_schedule() failed"
+#define VSA_TRAP_ADD_LINKS_ERROR_MSG "vsa_trap_add_links() failed"
+#define VSA_TRAP_START_ERROR_MSG "vsa_trap_start() failed"
+
+// Messages handed to the kernel per sendmmsg() call.
+#define VSA_TRAP_BATCH 64
+
+// Informs awaiting a response at once. Past that, sending waits for responses or timeouts.
+#define VSA_TRAP_MAX_INFORMS 65536
+
+typedef struct vsa_trap_template_s vsa_trap_template_t;
+typedef struct vsa_trap_event_s vsa_trap_event_t;
+typedef struct vsa_trap_sink_s vsa_trap_sink_t;
+typedef struct vsa_trap_inform_s vsa_trap_inform_t;
+typedef struct vsa_trap_s vsa_trap_t;
+
+/*
+ * A notification, its varbinds following sysUpTime.0 encoded once and for all with the values the objects had then.
+ * vars holds the same varbinds for the sinks whose messages net-snmp encodes.
+ */
+struct vsa_trap_template_s {
+    unsigned char          *varbinds;
+    size_t                  len;
+    netsnmp_variable_list  *vars;
+};
+
+// A notification of the schedule, sent offset milliseconds after the start.
+struct vsa_trap_event_s {
+    guint64                 offset;
+    size_t                  template;
+};
+
+/*
+ * Where notifications go. SNMPv2c messages are assembled from the templates around a header encoded beforehand, and
+ * sent in batches over a socket of their own. SNMPv3 ones are encoded and secured by a net-snmp session.
+ */
+struct vsa_trap_sink_s {
+    int                     inform;
+    long                    version;
+    int                     sock;
+    unsigned char          *head;
+    size_t                  head_len;
+    void                   *sessp;
+    guint64                 timeout;
+    int                     retries;
+    unsigned char          *bufs;
+    struct mmsghdr          msgs[VSA_TRAP_BATCH];
+    struct iovec            iovs[VSA_TRAP_BATCH];
+    unsigned                nmsgs;
+};
+
+// An SNMPv2c inform awaiting its response, kept encoded to be sent again.
+struct vsa_trap_inform_s {
+    vsa_wheel_entry_t       timer;
+    vsa_trap_sink_t        *sink;
+    guint32                 reqid;
+    int                     retries;
+    size_t                  len;
+    unsigned char           msg[];
+};
+
+/*
+ * Sends notifications to the sinks, either at a fixed rate, cycling through the templates, or as the schedule says.
+ * A thread of its own does the sending, so that queries are served meanwhile, and tracks the informs in a timer wheel
+ * to send them again until they are answered. The counters are only read once the thread has stopped.
+ *
+ * SNMPv3 sinks have the thread encode, send and read through net-snmp while the agent does the same, which takes a
+ * net-snmp built with --enable-reentrant to lock its request IDs and sessions. The USM users and engine boots and time
+ * they also read are only written by init_snmp(), before the thread starts.
+ */
+struct vsa_trap_s {
+    GPtrArray              *templates;
+    GArray                 *schedule;
+    GPtrArray              *sinks;
+    size_t                  max_len;
+    double                  rate;
+    GHashTable             *informs;
+    vsa_wheel_t             wheel;
+    guint32                 reqid;
+    GThread                *thread;
+    int                     fds[2];
+    unsigned long           sent;
+    unsigned long           acked;
+    unsigned long           retransmitted;
+    unsigned long           timeouts;
+    unsigned long           errors;
+};
+
+vsa_trap_t             *vsa_trap_new(void);
+void                   *vsa_trap_free(vsa_trap_t * trap);
+int                     vsa_trap_add_sink(vsa_trap_t * trap, const char *args);
+int                     vsa_trap_load_schedule(vsa_trap_t * trap, vsa_index_t * index, const char *path);
+int                     vsa_trap_add_links(vsa_trap_t * trap, vsa_index_t * index);
+int                     vsa_trap_start(vsa_trap_t * trap, double rate);
+void                    vsa_trap_stop(vsa_trap_t * trap);
+
+#endif // VSA_TRAP_H
@@ -0,0 +1,1026 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+
+#ifdef VSA_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#endif
+
+#include <vsa/ber.h>
+#include <vsa/epoch.h>
+#include <vsa/log.h>
+#include <vsa/transport.h>
+#include <vsa/usm.h>
+
+#ifdef VSA_OPENSSL
+
+// The largest message over UDP, which the buffers are sized for.
+#define VSA_USM_MAX_MSG 65507
+
+// Seconds a message's engine time may be off ours (RFC 3414, 3.2.7).
+#define VSA_USM_TIME_WINDOW 150
+
+#define VSA_USM_AUTH_FLAG 0x01
+#define VSA_USM_PRIV_FLAG 0x02
+
+#define VSA_USM_MAX_USER 32
+#define VSA_USM_MAX_MAC 48
+#define VSA_USM_SALT_LEN 8
+#define VSA_USM_AES_KEY_LEN 16
+
+// The most repeaters of a GETBULK answered here, and the bytes of a response besides its varbinds and identifiers.
+#define VSA_USM_MAX_REPEATERS 128
+#define VSA_USM_OVERHEAD 128
+
+#define VSA_USM_USER_NEW_ERROR_MSG "vsa_usm_user_new() failed"
+
+typedef struct vsa_usm_auth_s vsa_usm_auth_t;
+typedef struct vsa_usm_user_s vsa_usm_user_t;
+typedef struct vsa_usm_msg_s vsa_usm_msg_t;
+typedef struct vsa_usm_repeater_s vsa_usm_repeater_t;
+
+struct vsa_usm_auth_s {
+    oid                     protocol[10];
+    size_t                  mac_len;
+    const EVP_MD           *(*md)(void);
+};
+
+/*
+ * The contexts of a user: the digests of its key padded with ipad and opad, which HMACs start from, and AES ciphers
+ * keyed with its privacy key, whose IV is all a message changes. Users that can't be served here have no contexts.
+ */
+struct vsa_usm_user_s {
+    char                   *sec_name;
+    size_t                  mac_len;
+    EVP_MD_CTX             *inner;
+    EVP_MD_CTX             *outer;
+    EVP_MD_CTX             *work;
+    EVP_CIPHER_CTX         *encrypt;
+    EVP_CIPHER_CTX         *decrypt;
+};
+
+// A message as read from the wire, its scoped PDU decrypted if it was private.
+struct vsa_usm_msg_s {
+    const unsigned char    *msg_id;
+    size_t                  msg_id_len;
+    uint32_t                max_size;
+    unsigned char           flags;
+    const unsigned char    *engine_id;
+    size_t                  engine_id_len;
+    uint32_t                boots;
+    uint32_t                time;
+    const unsigned char    *user;
+    size_t                  user_len;
+    size_t                  auth_pos;
+    size_t                  auth_len;
+    const unsigned char    *salt;
+    size_t                  salt_len;
+    const unsigned char    *data;
+    size_t                  data_len;
+    unsigned char           pdu_type;
+    const unsigned char    *reqid;
+    size_t                  reqid_len;
+    uint32_t                non_repeaters;
+    uint32_t                max_repetitions;
+    const unsigned char    *vars;
+    const unsigned char    *vars_end;
+};
+
+// A GETBULK repeater: its varbind in the request, the next object it returns and whether it has returned any.
+struct vsa_usm_repeater_s {
+    const unsigned char    *var;
+    size_t                  pos;
+    int                     advanced;
+};
+
+// usmHMACMD5AuthProtocol, usmHMACSHAAuthProtocol and the usmHMAC*SHA*AuthProtocol of RFC 7860.
+static const vsa_usm_auth_t vsa_usm_auths[] = {
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 2 }, 12, EVP_md5 },
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 3 }, 12, EVP_sha1 },
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 4 }, 16, EVP_sha224 },
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 5 }, 24, EVP_sha256 },
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 6 }, 32, EVP_sha384 },
+    { { 1, 3, 6, 1, 6, 3, 10, 1, 1, 7 }, 48, EVP_sha512 },
+};
+
+static const oid        vsa_usm_no_priv[] = { 1, 3, 6, 1, 6, 3, 10, 1, 2, 1 };
+static const oid        vsa_usm_aes[] = { 1, 3, 6, 1, 6, 3, 10, 1, 2, 4 };
+
+static const unsigned char *vsa_usm_read_uint(const unsigned char *p, const unsigned char *end, uint32_t * value);
+static const unsigned char *vsa_usm_read_str(const unsigned char *p, const unsigned char *end,
+                                             const unsigned char **str, size_t *len);
+static const unsigned char *vsa_usm_read_oid(const unsigned char *p, const unsigned char *end, oid * oids,
+                                             size_t *len);
+static int              vsa_usm_split(const unsigned char *buf, size_t len, vsa_usm_msg_t * msg);
+static int              vsa_usm_split_scoped(vsa_usm_t * usm, const unsigned char *buf, size_t len,
+                                             vsa_usm_msg_t * msg);
+static void             vsa_usm_user_free(vsa_usm_user_t * user);
+static void             vsa_usm_user_free_cb(void *data);
+static EVP_MD_CTX      *vsa_usm_pad_key(const EVP_MD * md, const unsigned char *key, size_t len, unsigned char pad);
+static vsa_usm_user_t  *vsa_usm_user_new(struct usmUser *usm_user);
+static vsa_usm_user_t  *vsa_usm_get_user(vsa_usm_t * usm, const vsa_usm_msg_t * msg);
+static int              vsa_usm_hmac(vsa_usm_user_t * user, const unsigned char *buf, size_t len, size_t auth_pos,
+                                     unsigned char *mac);
+static int              vsa_usm_crypt(EVP_CIPHER_CTX * ctx, uint32_t boots, uint32_t time, const unsigned char *salt,
+                                      const unsigned char *in, size_t len, unsigned char *out);
+static int              vsa_usm_put_var(vsa_index_t * index, vsa_object_t * object, oid * oids, size_t len,
+                                        unsigned char type, netsnmp_pdu * pdu, unsigned char **p, size_t *left);
+static int              vsa_usm_put_next(vsa_index_t * index, size_t pos, oid * oids, size_t len, netsnmp_pdu * pdu,
+                                         unsigned char **p, size_t *left);
+static int              vsa_usm_put_vars(vsa_index_t * index, const vsa_usm_msg_t * msg, netsnmp_pdu * pdu,
+                                         unsigned char *buf, size_t *len);
+static size_t           vsa_usm_tlv_size(size_t len);
+static int              vsa_usm_reply(vsa_usm_t * usm, vsa_usm_user_t * user, const vsa_usm_msg_t * msg,
+                                      const unsigned char *vars, size_t vars_len, netsnmp_transport * transport,
+                                      void **opaque, int *olength);
+static int              vsa_usm_answer(vsa_usm_t * usm, const unsigned char *buf, size_t len, vsa_usm_msg_t * msg,
+                                       netsnmp_transport * transport, void **opaque, int *olength);
+static int              vsa_usm_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque,
+                                          int *olength, void *data);
+
+// Reads a non-negative INTEGER of up to 32 bits.
+static const unsigned char *
+vsa_usm_read_uint(const unsigned char *p, const unsigned char *end, uint32_t * value)
+{
+    unsigned char           type;
+    size_t                  len;
+
+    p = vsa_ber_read_tlv(p, end, &type, &len);
+    if (!p || ASN_INTEGER != type || !len || len > 5 || *p & 0x80 || (5 == len && *p)) {
+        return NULL;
+    }
+
+    for (*value = 0; len; len--) {
+        *value = *value << 8 | *p++;
+    }
+
+    return p;
+}
+
+static const unsigned char *
+vsa_usm_read_str(const unsigned char *p, const unsigned char *end, const unsigned char **str, size_t *len)
+{
+    unsigned char           type;
+
+    p = vsa_ber_read_tlv(p, end, &type, len);
+    if (!p || ASN_OCTET_STR != type) {
+        return NULL;
+    }
+    *str = p;
+
+    return p + *len;
+}
+
+// Reads an OBJECT IDENTIFIER into oids, which has room for MAX_OID_LEN sub-identifiers of up to 32 bits.
+static const unsigned char *
+vsa_usm_read_oid(const unsigned char *p, const unsigned char *end, oid * oids, size_t *len)
+{
+    unsigned char           type;
+    size_t                  l;
+    uint32_t                value;
+
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || ASN_OBJECT_ID != type || !l || p[l - 1] & 0x80) {
+        return NULL;
+    }
+    end = p + l;
+
+    *len = 0;
+    for (value = 0; p < end; p++) {
+        if (value > 0x1ffffff) {
+            return NULL;
+        }
+        value = value << 7 | (*p & 0x7f);
+        if (*p & 0x80) {
+            continue;
+        }
+
+        if (!*len) {
+            oids[0] = value < 80 ? value / 40 : 2;
+            oids[1] = value - oids[0] * 40;
+            *len = 2;
+        } else if (*len < MAX_OID_LEN) {
+            oids[(*len)++] = value;
+        } else {
+            return NULL;
+        }
+        value = 0;
+    }
+
+    return end;
+}
+
+/*
+ * Splits an SNMPv3 message: SEQUENCE { version, msgGlobalData, msgSecurityParameters, msgData }, the USM security
+ * parameters being SEQUENCE { engineID, boots, time, userName, authParameters, privParameters }.
+ */
+static int
+vsa_usm_split(const unsigned char *buf, size_t len, vsa_usm_msg_t * msg)
+{
+    const unsigned char    *p, *q, *end, *flags;
+    unsigned char           type;
+    size_t                  l, flags_len;
+    uint32_t                version, model;
+
+    memset(msg, 0, sizeof (*msg));
+
+    end = buf + len;
+    p = vsa_ber_read_tlv(buf, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    end = p + l;
+
+    p = vsa_usm_read_uint(p, end, &version);
+    if (!p || SNMP_VERSION_3 != version) {
+        return -1;
+    }
+
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    p = q + l;
+    msg->msg_id = q;
+    q = vsa_usm_read_uint(q, p, &version);
+    if (!q) {
+        return -1;
+    }
+    msg->msg_id_len = q - msg->msg_id;
+    q = vsa_usm_read_uint(q, p, &msg->max_size);
+    if (!q) {
+        return -1;
+    }
+    q = vsa_usm_read_str(q, p, &flags, &flags_len);
+    if (!q || 1 != flags_len) {
+        return -1;
+    }
+    msg->flags = *flags;
+    q = vsa_usm_read_uint(q, p, &model);
+    if (!q || SNMP_SEC_MODEL_USM != model) {
+        return -1;
+    }
+
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q || ASN_OCTET_STR != type) {
+        return -1;
+    }
+    p = q + l;
+    q = vsa_ber_read_tlv(q, p, &type, &l);
+    if (!q || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    q = vsa_usm_read_str(q, p, &msg->engine_id, &msg->engine_id_len);
+    if (!q) {
+        return -1;
+    }
+    q = vsa_usm_read_uint(q, p, &msg->boots);
+    if (!q) {
+        return -1;
+    }
+    q = vsa_usm_read_uint(q, p, &msg->time);
+    if (!q) {
+        return -1;
+    }
+    q = vsa_usm_read_str(q, p, &msg->user, &msg->user_len);
+    if (!q) {
+        return -1;
+    }
+    q = vsa_usm_read_str(q, p, &flags, &msg->auth_len);
+    if (!q) {
+        return -1;
+    }
+    msg->auth_pos = flags - buf;
+    q = vsa_usm_read_str(q, p, &msg->salt, &msg->salt_len);
+    if (!q) {
+        return -1;
+    }
+
+    // The scoped PDU, whole, or the encrypted one's octets.
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q) {
+        return -1;
+    }
+    if (ASN_OCTET_STR == type) {
+        msg->data = q;
+        msg->data_len = l;
+    } else {
+        msg->data = p;
+        msg->data_len = q + l - p;
+    }
+
+    return 0;
+}
+
+// Splits a scoped PDU: SEQUENCE { contextEngineID, contextName, PDU { request-id, ..., varbinds } }.
+static int
+vsa_usm_split_scoped(vsa_usm_t * usm, const unsigned char *buf, size_t len, vsa_usm_msg_t * msg)
+{
+    const unsigned char    *p, *q, *end, *str;
+    unsigned char           type;
+    size_t                  l, str_len;
+    uint32_t                value;
+
+    end = buf + len;
+    p = vsa_ber_read_tlv(buf, end, &type, &l);
+    if (!p || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    end = p + l;
+
+    p = vsa_usm_read_str(p, end, &str, &str_len);
+    if (!p || str_len != usm->engine_id_len || memcmp(str, usm->engine_id, str_len)) {
+        return -1;
+    }
+    p = vsa_usm_read_str(p, end, &str, &str_len);
+    if (!p || str_len) {
+        return -1;
+    }
+
+    p = vsa_ber_read_tlv(p, end, &msg->pdu_type, &l);
+    if (!p) {
+        return -1;
+    }
+    end = p + l;
+
+    msg->reqid = p;
+    p = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!p || ASN_INTEGER != type) {
+        return -1;
+    }
+    p += l;
+    msg->reqid_len = p - msg->reqid;
+
+    p = vsa_usm_read_uint(p, end, &value);
+    if (!p) {
+        return -1;
+    }
+    msg->non_repeaters = value;
+    p = vsa_usm_read_uint(p, end, &value);
+    if (!p) {
+        return -1;
+    }
+    msg->max_repetitions = value;
+
+    q = vsa_ber_read_tlv(p, end, &type, &l);
+    if (!q || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type) {
+        return -1;
+    }
+    msg->vars = q;
+    msg->vars_end = q + l;
+
+    return 0;
+}
+
+static void
+vsa_usm_user_free(vsa_usm_user_t * user)
+{
+    if (user) {
+        g_free(user->sec_name);
+        EVP_MD_CTX_free(user->inner);
+        EVP_MD_CTX_free(user->outer);
+        EVP_MD_CTX_free(user->work);
+        EVP_CIPHER_CTX_free(user->encrypt);
+        EVP_CIPHER_CTX_free(user->decrypt);
+        free(user);
+    }
+}
+
+static void
+vsa_usm_user_free_cb(void *data)
+{
+    vsa_usm_user_free((vsa_usm_user_t *) data);
+}
+
+// A digest context having hashed key XORed with pad over a whole block, as HMAC's inner and outer hashes start.
+static EVP_MD_CTX      *
+vsa_usm_pad_key(const EVP_MD * md, const unsigned char *key, size_t len, unsigned char pad)
+{
+    unsigned char           block[EVP_MAX_MD_SIZE * 2];
+    size_t                  block_len;
+    unsigned int            digest_len;
+    EVP_MD_CTX             *ctx;
+
+    block_len = EVP_MD_block_size(md);
+    if (block_len > sizeof (block)) {
+        return NULL;
+    }
+
+    ctx = EVP_MD_CTX_new();
+    if (!ctx) {
+        return NULL;
+    }
+
+    memset(block, 0, sizeof (block));
+    if (len > block_len) {
+        if (!EVP_Digest(key, len, block, &digest_len, md, NULL)) {
+            EVP_MD_CTX_free(ctx);
+            return NULL;
+        }
+    } else {
+        memcpy(block, key, len);
+    }
+    for (size_t i = 0; i < block_len; i++) {
+        block[i] ^= pad;
+    }
+
+    if (!EVP_DigestInit_ex(ctx, md, NULL) || !EVP_DigestUpdate(ctx, block, block_len)) {
+        EVP_MD_CTX_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+// Returns NULL if the user's protocols aren't supported here, or on error.
+static vsa_usm_user_t  *
+vsa_usm_user_new(struct usmUser *usm_user)
+{
+    const vsa_usm_auth_t   *auth;
+    vsa_usm_user_t         *user;
+
+    if (RS_ACTIVE != usm_user->userStatus) {
+        return NULL;
+    }
+
+    auth = NULL;
+    for (size_t i = 0; i < G_N_ELEMENTS(vsa_usm_auths) && !auth; i++) {
+        if (!snmp_oid_compare(usm_user->authProtocol, usm_user->authProtocolLen, vsa_usm_auths[i].protocol,
+                              G_N_ELEMENTS(vsa_usm_auths[i].protocol))) {
+            auth = &vsa_usm_auths[i];
+        }
+    }
+    if (!auth || !usm_user->authKey) {
+        return NULL;
+    }
+
+    user = calloc(1, sizeof (vsa_usm_user_t));
+    if (!user) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    user->sec_name = g_strdup(usm_user->secName);
+    user->mac_len = auth->mac_len;
+
+    user->inner = vsa_usm_pad_key(auth->md(), usm_user->authKey, usm_user->authKeyLen, 0x36);
+    user->outer = vsa_usm_pad_key(auth->md(), usm_user->authKey, usm_user->authKeyLen, 0x5c);
+    user->work = EVP_MD_CTX_new();
+    if (!user->inner || !user->outer || !user->work) {
+        vsa_log_debugln("couldn't set up the HMAC of user '%s'", user->sec_name);
+        vsa_usm_user_free(user);
+        return NULL;
+    }
+
+    // Users without privacy, or whose privacy protocol isn't supported, are only served authNoPriv requests.
+    if (snmp_oid_compare(usm_user->privProtocol, usm_user->privProtocolLen, vsa_usm_aes, G_N_ELEMENTS(vsa_usm_aes))
+        || !usm_user->privKey || usm_user->privKeyLen < VSA_USM_AES_KEY_LEN) {
+        if (snmp_oid_compare(usm_user->privProtocol, usm_user->privProtocolLen, vsa_usm_no_priv,
+                             G_N_ELEMENTS(vsa_usm_no_priv))) {
+            vsa_log_debugln("privacy protocol of user '%s' not supported, leaving its private requests to net-snmp",
+                            user->sec_name);
+        }
+        return user;
+    }
+
+    user->encrypt = EVP_CIPHER_CTX_new();
+    user->decrypt = EVP_CIPHER_CTX_new();
+    if (!user->encrypt || !user->decrypt
+        || !EVP_CipherInit_ex(user->encrypt, EVP_aes_128_cfb128(), NULL, usm_user->privKey, NULL, 1)
+        || !EVP_CipherInit_ex(user->decrypt, EVP_aes_128_cfb128(), NULL, usm_user->privKey, NULL, 0)) {
+        vsa_log_debugln("couldn't set up the cipher of user '%s'", user->sec_name);
+        vsa_usm_user_free(user);
+        return NULL;
+    }
+
+    return user;
+}
+
+/*
+ * Only the users served here are kept, so that the table is bounded by those of vsa.conf whatever names unauthenticated
+ * messages carry. Unknown users and those that can't be served here are looked up in net-snmp's list again each time.
+ */
+static vsa_usm_user_t  *
+vsa_usm_get_user(vsa_usm_t * usm, const vsa_usm_msg_t * msg)
+{
+    char                    name[VSA_USM_MAX_USER + 1];
+    struct usmUser         *usm_user;
+    vsa_usm_user_t         *user;
+
+    if (!msg->user_len || msg->user_len > VSA_USM_MAX_USER || memchr(msg->user, 0, msg->user_len)) {
+        return NULL;
+    }
+    memcpy(name, msg->user, msg->user_len);
+    name[msg->user_len] = 0;
+
+    user = g_hash_table_lookup(usm->users, name);
+    if (user) {
+        return user;
+    }
+
+    usm_user = usm_get_user(usm->engine_id, usm->engine_id_len, name);
+    user = usm_user ? vsa_usm_user_new(usm_user) : NULL;
+    if (user) {
+        g_hash_table_insert(usm->users, g_strdup(name), user);
+    }
+
+    return user;
+}
+
+// Computes the HMAC of a message with its authentication parameters, at auth_pos, zeroed.
+static int
+vsa_usm_hmac(vsa_usm_user_t * user, const unsigned char *buf, size_t len, size_t auth_pos, unsigned char *mac)
+{
+    static const unsigned char zeros[VSA_USM_MAX_MAC];
+    unsigned char           digest[EVP_MAX_MD_SIZE];
+    unsigned int            digest_len;
+    size_t                  tail;
+
+    tail = auth_pos + user->mac_len;
+    if (!EVP_MD_CTX_copy_ex(user->work, user->inner)
+        || !EVP_DigestUpdate(user->work, buf, auth_pos)
+        || !EVP_DigestUpdate(user->work, zeros, user->mac_len)
+        || !EVP_DigestUpdate(user->work, buf + tail, len - tail)
+        || !EVP_DigestFinal_ex(user->work, digest, &digest_len)
+        || !EVP_MD_CTX_copy_ex(user->work, user->outer)
+        || !EVP_DigestUpdate(user->work, digest, digest_len)
+        || !EVP_DigestFinal_ex(user->work, digest, &digest_len)) {
+        return -1;
+    }
+    memcpy(mac, digest, user->mac_len);
+
+    return 0;
+}
+
+// AES-CFB with the IV of RFC 3826: the engine boots and time, then the salt.
+static int
+vsa_usm_crypt(EVP_CIPHER_CTX * ctx, uint32_t boots, uint32_t time, const unsigned char *salt,
+              const unsigned char *in, size_t len, unsigned char *out)
+{
+    unsigned char           iv[VSA_USM_AES_KEY_LEN];
+    int                     out_len;
+
+    for (int i = 0; i < 4; i++) {
+        iv[i] = boots >> (24 - i * 8);
+        iv[4 + i] = time >> (24 - i * 8);
+    }
+    memcpy(iv + 8, salt, VSA_USM_SALT_LEN);
+
+    if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, -1) || !EVP_CipherUpdate(ctx, out, &out_len, in, len)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Encodes a varbind: object's value, or the exception type if there's no object. Returns 1 if it doesn't fit and -1
+ * if the request must be left to net-snmp, as when access control doesn't let the user see the OID.
+ */
+static int
+vsa_usm_put_var(vsa_index_t * index, vsa_object_t * object, oid * oids, size_t len, unsigned char type,
+                netsnmp_pdu * pdu, unsigned char **p, size_t *left)
+{
+    unsigned char          *q;
+    netsnmp_variable_list   var;
+
+    memset(&var, 0, sizeof (var));
+    if (object) {
+        if (vsa_index_object_to_var(index, object, &var)) {
+            vsa_log_debugln(VSA_VALUE_TO_VAR_ERROR_MSG);
+            return -1;
+        }
+        type = var.type;
+    }
+
+    if (VACM_SUCCESS != in_a_view(oids, &len, pdu, type)) {
+        snmp_free_var_internals(&var);
+        return -1;
+    }
+
+    q = snmp_build_var_op(*p, oids, &len, type, var.val_len, var.val.string, left);
+    snmp_free_var_internals(&var);
+    if (!q) {
+        return 1;
+    }
+    *p = q;
+
+    return 0;
+}
+
+// Encodes the object at pos, or endOfMibView at the OID asked for if the index is past its end.
+static int
+vsa_usm_put_next(vsa_index_t * index, size_t pos, oid * oids, size_t len, netsnmp_pdu * pdu, unsigned char **p,
+                 size_t *left)
+{
+    vsa_object_t           *object;
+
+    if (pos >= index->len) {
+        return vsa_usm_put_var(index, NULL, oids, len, SNMP_ENDOFMIBVIEW, pdu, p, left);
+    }
+    object = index->objects[pos];
+
+    return vsa_usm_put_var(index, object, object->tree->oids, object->tree->len, 0, pdu, p, left);
+}
+
+/*
+ * Encodes the varbinds answering a request into buf, which has room for *len bytes, and sets *len to those written.
+ * GETBULK repetitions stop once they no longer fit or once all repeaters are past the end of the index.
+ */
+static int
+vsa_usm_put_vars(vsa_index_t * index, const vsa_usm_msg_t * msg, netsnmp_pdu * pdu, unsigned char *buf, size_t *len)
+{
+    const unsigned char    *v;
+    unsigned char          *p, type;
+    oid                     oids[MAX_OID_LEN];
+    size_t                  l, oids_len, left, nrepeaters;
+    uint32_t                i;
+    int                     ret;
+    vsa_usm_repeater_t      repeaters[VSA_USM_MAX_REPEATERS];
+
+    p = buf;
+    left = *len;
+    nrepeaters = 0;
+    for (i = 0, v = msg->vars; v < msg->vars_end; i++) {
+        const unsigned char    *var;
+
+        var = v;
+        v = vsa_ber_read_tlv(v, msg->vars_end, &type, &l);
+        if (!v || (ASN_SEQUENCE | ASN_CONSTRUCTOR) != type || !vsa_usm_read_oid(v, v + l, oids, &oids_len)) {
+            return -1;
+        }
+        v += l;
+
+        if (SNMP_MSG_GET == msg->pdu_type) {
+            vsa_object_t           *object;
+
+            object = vsa_index_get(index, oids, oids_len);
+            if (!object) {
+                index->nosuch++;
+            }
+            ret = vsa_usm_put_var(index, object, oids, oids_len, SNMP_NOSUCHOBJECT, pdu, &p, &left);
+        } else if (SNMP_MSG_GETBULK == msg->pdu_type && i >= msg->non_repeaters) {
+            if (VSA_USM_MAX_REPEATERS == nrepeaters) {
+                return -1;
+            }
+            repeaters[nrepeaters].var = var;
+            repeaters[nrepeaters].pos = vsa_index_next(index, oids, oids_len);
+            repeaters[nrepeaters].advanced = 0;
+            nrepeaters++;
+            ret = 0;
+        } else {
+            ret = vsa_usm_put_next(index, vsa_index_next(index, oids, oids_len), oids, oids_len, pdu, &p, &left);
+        }
+
+        // Only repetitions may be cut short, a response missing other varbinds being tooBig.
+        if (ret) {
+            return -1;
+        }
+    }
+
+    for (uint32_t r = 0; r < msg->max_repetitions && nrepeaters; r++) {
+        int                     ended;
+
+        ended = 1;
+        for (i = 0; i < nrepeaters; i++) {
+            vsa_usm_repeater_t     *repeater;
+            vsa_object_t           *last;
+
+            repeater = &repeaters[i];
+            if (repeater->pos < index->len) {
+                ended = 0;
+                ret = vsa_usm_put_next(index, repeater->pos, NULL, 0, pdu, &p, &left);
+                repeater->pos++;
+                repeater->advanced = 1;
+            } else if (repeater->advanced) {
+                // endOfMibView is reported at the OID last returned in the column, or else at the one asked for.
+                last = index->objects[index->len - 1];
+                ret = vsa_usm_put_next(index, index->len, last->tree->oids, last->tree->len, pdu, &p, &left);
+            } else {
+                v = vsa_ber_read_tlv(repeater->var, msg->vars_end, &type, &l);
+                vsa_usm_read_oid(v, v + l, oids, &oids_len);
+                ret = vsa_usm_put_next(index, index->len, oids, oids_len, pdu, &p, &left);
+            }
+
+            if (ret < 0) {
+                return -1;
+            } else if (ret) {
+                break;
+            }
+        }
+
+        if (ret || ended) {
+            break;
+        }
+    }
+
+    *len = p - buf;
+
+    return 0;
+}
+
+static size_t
+vsa_usm_tlv_size(size_t len)
+{
+    return 1 + vsa_ber_len_size(len) + len;
+}
+
+/*
+ * Sends the response to a request: its scoped PDU in usm->buf, encrypted or copied past it into the message, whose
+ * HMAC is then written over the zeroed authentication parameters.
+ */
+static int
+vsa_usm_reply(vsa_usm_t * usm, vsa_usm_user_t * user, const vsa_usm_msg_t * msg, const unsigned char *vars,
+              size_t vars_len, netsnmp_transport * transport, void **opaque, int *olength)
+{
+    unsigned char          *scoped, *out, *p, salt[VSA_USM_SALT_LEN];
+    unsigned char           flags;
+    size_t                  pdu_len, scoped_len, global_len, params_len, data_len, msg_len, total, auth_pos;
+    uint32_t                boots, time;
+
+    flags = msg->flags & (VSA_USM_AUTH_FLAG | VSA_USM_PRIV_FLAG);
+    boots = snmpv3_local_snmpEngineBoots();
+    time = snmpv3_local_snmpEngineTime();
+
+    pdu_len = msg->reqid_len + 3 + 3 + vsa_usm_tlv_size(vars_len);
+    scoped_len = vsa_usm_tlv_size(usm->engine_id_len) + vsa_usm_tlv_size(0) + vsa_usm_tlv_size(pdu_len);
+    global_len = msg->msg_id_len + 2 + vsa_ber_uint_size(VSA_USM_MAX_MSG) + 3 + 3;
+    params_len = vsa_usm_tlv_size(usm->engine_id_len) + 2 + vsa_ber_uint_size(boots) + 2 + vsa_ber_uint_size(time)
+        + vsa_usm_tlv_size(msg->user_len) + vsa_usm_tlv_size(user->mac_len)
+        + vsa_usm_tlv_size(flags & VSA_USM_PRIV_FLAG ? VSA_USM_SALT_LEN : 0);
+    data_len = vsa_usm_tlv_size(scoped_len);
+    if (flags & VSA_USM_PRIV_FLAG) {
+        data_len = vsa_usm_tlv_size(data_len);
+    }
+    msg_len = 3 + vsa_usm_tlv_size(global_len) + vsa_usm_tlv_size(vsa_usm_tlv_size(params_len)) + data_len;
+    total = vsa_usm_tlv_size(msg_len);
+    if (total > msg->max_size || total > VSA_USM_MAX_MSG) {
+        return -1;
+    }
+
+    scoped = usm->buf + VSA_USM_MAX_MSG;
+    p = scoped;
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, scoped_len);
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, usm->engine_id_len);
+    memcpy(p, usm->engine_id, usm->engine_id_len), p += usm->engine_id_len;
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, 0);
+    p += vsa_ber_write_header(p, SNMP_MSG_RESPONSE, pdu_len);
+    memcpy(p, msg->reqid, msg->reqid_len), p += msg->reqid_len;
+    p += vsa_ber_write_uint(p, ASN_INTEGER, SNMP_ERR_NOERROR);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, 0);
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, vars_len);
+    memcpy(p, vars, vars_len);
+
+    out = scoped + VSA_USM_MAX_MSG;
+    p = out;
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, msg_len);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, SNMP_VERSION_3);
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, global_len);
+    memcpy(p, msg->msg_id, msg->msg_id_len), p += msg->msg_id_len;
+    p += vsa_ber_write_uint(p, ASN_INTEGER, VSA_USM_MAX_MSG);
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, 1);
+    *p++ = flags;
+    p += vsa_ber_write_uint(p, ASN_INTEGER, SNMP_SEC_MODEL_USM);
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, vsa_usm_tlv_size(params_len));
+    p += vsa_ber_write_header(p, ASN_SEQUENCE | ASN_CONSTRUCTOR, params_len);
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, usm->engine_id_len);
+    memcpy(p, usm->engine_id, usm->engine_id_len), p += usm->engine_id_len;
+    p += vsa_ber_write_uint(p, ASN_INTEGER, boots);
+    p += vsa_ber_write_uint(p, ASN_INTEGER, time);
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, msg->user_len);
+    memcpy(p, msg->user, msg->user_len), p += msg->user_len;
+    p += vsa_ber_write_header(p, ASN_OCTET_STR, user->mac_len);
+    auth_pos = p - out;
+    memset(p, 0, user->mac_len), p += user->mac_len;
+
+    if (flags & VSA_USM_PRIV_FLAG) {
+        // Salts are unique for the life of the key as long as the counter doesn't wrap (RFC 3826, 3.1.2.1).
+        for (int i = 0; i < VSA_USM_SALT_LEN; i++) {
+            salt[i] = usm->salt >> (56 - i * 8);
+        }
+        usm->salt++;
+        p += vsa_ber_write_header(p, ASN_OCTET_STR, VSA_USM_SALT_LEN);
+        memcpy(p, salt, VSA_USM_SALT_LEN), p += VSA_USM_SALT_LEN;
+        p += vsa_ber_write_header(p, ASN_OCTET_STR, vsa_usm_tlv_size(scoped_len));
+        if (vsa_usm_crypt(user->encrypt, boots, time, salt, scoped, vsa_usm_tlv_size(scoped_len), p)) {
+            vsa_log_debugln("couldn't encrypt the response to user '%s'", user->sec_name);
+            return -1;
+        }
+    } else {
+        p += vsa_ber_write_header(p, ASN_OCTET_STR, 0);
+        memcpy(p, scoped, vsa_usm_tlv_size(scoped_len));
+    }
+
+    if (vsa_usm_hmac(user, out, total, auth_pos, out + auth_pos)) {
+        vsa_log_debugln("couldn't authenticate the response to user '%s'", user->sec_name);
+        return -1;
+    }
+
+    if (vsa_transport_send(transport, out, total, opaque, olength) < 0) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Answers a request, making the checks net-snmp would make before, or returns -1 to leave it to net-snmp: it then
+ * reports whatever failed, or answers what isn't served here.
+ */
+static int
+vsa_usm_answer(vsa_usm_t * usm, const unsigned char *buf, size_t len, vsa_usm_msg_t * msg,
+               netsnmp_transport * transport, void **opaque, int *olength)
+{
+    unsigned char           mac[VSA_USM_MAX_MAC], *plain, *vars;
+    size_t                  vars_len, overhead;
+    uint32_t                time;
+    int                     ret;
+    vsa_usm_user_t         *user;
+    vsa_index_t            *index;
+    netsnmp_pdu             pdu;
+
+    if (!(msg->flags & VSA_USM_AUTH_FLAG) || msg->engine_id_len != usm->engine_id_len
+        || memcmp(msg->engine_id, usm->engine_id, usm->engine_id_len)) {
+        return -1;
+    }
+
+    time = snmpv3_local_snmpEngineTime();
+    if (msg->boots != snmpv3_local_snmpEngineBoots() || (uint64_t) msg->time + VSA_USM_TIME_WINDOW < time
+        || (uint64_t) time + VSA_USM_TIME_WINDOW < msg->time) {
+        return -1;
+    }
+
+    user = vsa_usm_get_user(usm, msg);
+    if (!user || msg->auth_len != user->mac_len || (msg->flags & VSA_USM_PRIV_FLAG && !user->decrypt)) {
+        return -1;
+    }
+
+    if (vsa_usm_hmac(user, buf, len, msg->auth_pos, mac) || CRYPTO_memcmp(mac, buf + msg->auth_pos, user->mac_len)) {
+        return -1;
+    }
+
+    if (msg->flags & VSA_USM_PRIV_FLAG) {
+        if (VSA_USM_SALT_LEN != msg->salt_len || msg->data_len > VSA_USM_MAX_MSG) {
+            return -1;
+        }
+        plain = usm->buf;
+        if (vsa_usm_crypt(user->decrypt, msg->boots, msg->time, msg->salt, msg->data, msg->data_len, plain)) {
+            vsa_log_debugln("couldn't decrypt the request of user '%s'", user->sec_name);
+            return -1;
+        }
+        ret = vsa_usm_split_scoped(usm, plain, msg->data_len, msg);
+    } else {
+        ret = vsa_usm_split_scoped(usm, msg->data, msg->data_len, msg);
+    }
+    if (ret) {
+        return -1;
+    }
+
+    if (SNMP_MSG_GET != msg->pdu_type && SNMP_MSG_GETNEXT != msg->pdu_type && SNMP_MSG_GETBULK != msg->pdu_type) {
+        return -1;
+    }
+
+    memset(&pdu, 0, sizeof (pdu));
+    pdu.version = SNMP_VERSION_3;
+    pdu.command = msg->pdu_type;
+    pdu.securityModel = SNMP_SEC_MODEL_USM;
+    pdu.securityLevel = msg->flags & VSA_USM_PRIV_FLAG ? SNMP_SEC_LEVEL_AUTHPRIV : SNMP_SEC_LEVEL_AUTHNOPRIV;
+    pdu.securityName = user->sec_name;
+    pdu.securityNameLen = strlen(user->sec_name);
+    pdu.contextName = "";
+    pdu.contextNameLen = 0;
+    if (check_access(&pdu)) {
+        return -1;
+    }
+
+    overhead = VSA_USM_OVERHEAD + 2 * usm->engine_id_len + msg->user_len + user->mac_len + msg->reqid_len;
+    if (MIN(msg->max_size, VSA_USM_MAX_MSG) <= overhead) {
+        return -1;
+    }
+    vars = usm->buf + 3 * VSA_USM_MAX_MSG;
+    vars_len = MIN(msg->max_size, VSA_USM_MAX_MSG) - overhead;
+
+    if (vsa_epoch_enter()) {
+        vsa_log_debugln(VSA_EPOCH_ENTER_ERROR_MSG);
+        return -1;
+    }
+    index = *usm->index;
+    ret = vsa_usm_put_vars(index, msg, &pdu, vars, &vars_len);
+    vsa_epoch_exit();
+    if (ret) {
+        return -1;
+    }
+
+    return vsa_usm_reply(usm, user, msg, vars, vars_len, transport, opaque, olength);
+}
+
+static int
+vsa_usm_recv_hook(netsnmp_transport * transport, void *buf, int len, void **opaque, int *olength, void *data)
+{
+    vsa_usm_t              *usm;
+    vsa_usm_msg_t           msg;
+
+    usm = data;
+
+    if (vsa_usm_split(buf, len, &msg)) {
+        return VSA_TRANSPORT_CONTINUE;
+    }
+
+    if (vsa_usm_answer(usm, buf, len, &msg, transport, opaque, olength)) {
+        usm->passed++;
+        return VSA_TRANSPORT_CONTINUE;
+    }
+    usm->answered++;
+
+    return VSA_TRANSPORT_CONSUMED;
+}
+
+#endif // VSA_OPENSSL
+
+vsa_usm_t              *
+vsa_usm_new(void)
+{
+#ifdef VSA_OPENSSL
+    vsa_usm_t              *usm;
+
+    usm = calloc(1, sizeof (vsa_usm_t));
+    if (!usm) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+
+    // The decrypted request, the response's scoped PDU, the response and its varbinds.
+    usm->buf = malloc(4 * VSA_USM_MAX_MSG);
+    if (!usm->buf) {
+        vsa_log_debugln("%s", strerror(errno));
+        free(usm);
+        return NULL;
+    }
+    usm->users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, vsa_usm_user_free_cb);
+    usm->salt = (guint64) g_random_int() << 32 | g_random_int();
+
+    return usm;
+#else
+    vsa_log_debugln("vsa was built without OpenSSL");
+    return NULL;
+#endif
+}
+
+void                   *
+vsa_usm_free(vsa_usm_t * usm)
+{
+    if (usm) {
+        g_hash_table_destroy(usm->users);
+        free(usm->buf);
+        free(usm);
+    }
+
+    return NULL;
+}
+
+int
+vsa_usm_attach(vsa_usm_t * usm, netsnmp_transport * transport)
+{
+#ifdef VSA_OPENSSL
+    usm->engine_id_len = snmpv3_get_engineID(usm->engine_id, sizeof (usm->engine_id));
+    if (!usm->engine_id_len) {
+        vsa_log_debugln("no local engine ID");
+        return -1;
+    }
+
+    return vsa_transport_add_hook(transport, vsa_usm_recv_hook, NULL, usm);
+#else
+    (void) usm;
+    (void) transport;
+
+    return -1;
+#endif
+}
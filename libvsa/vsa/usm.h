@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_USM_H
+#define VSA_USM_H
+
+#include <glib.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <vsa/index.h>
+
+#define VSA_USM_NEW_ERROR_MSG "vsa_usm_new() failed"
+#define VSA_USM_ATTACH_ERROR_MSG "vsa_usm_attach() failed"
+
+#define VSA_USM_MAX_ENGINE_ID 32
+
+typedef struct vsa_usm_s vsa_usm_t;
+
+/*
+ * SNMPv3 fast path. GET, GETNEXT and GETBULK requests of the USM users authenticated with HMAC-MD5, SHA or SHA-2, and
+ * encrypted with AES-128 if private, are answered straight from the index as they're read; anything else is left to
+ * net-snmp, which also answers whatever doesn't pass the checks it would make (engine, time window, user, digest and
+ * access control). The HMAC and cipher contexts of a user are built from its localized keys the first time it's
+ * seen and reused for every later message: a request costs two digest context copies and an IV reset rather than
+ * setting them up from the keys again.
+ *
+ * index points to the caller's pointer so that swapped indexes are followed. Users are read once from net-snmp, which
+ * has them all by the time the agent serves requests.
+ */
+struct vsa_usm_s {
+    vsa_index_t           **index;
+    GHashTable             *users;
+    unsigned char           engine_id[VSA_USM_MAX_ENGINE_ID];
+    size_t                  engine_id_len;
+    guint64                 salt;
+    unsigned char          *buf;
+    unsigned long           answered;
+    unsigned long           passed;
+};
+
+vsa_usm_t              *vsa_usm_new(void);
+void                   *vsa_usm_free(vsa_usm_t * usm);
+int                     vsa_usm_attach(vsa_usm_t * usm, netsnmp_transport * transport);
+
+#endif // VSA_USM_H
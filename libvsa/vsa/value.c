@@ -20,6 +20,8 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,102 +31,507 @@
 #include <vsa/parser.h>
 #include <vsa/value.h>
 
-#define VSA_VALUE_ULONG_SIZE (sizeof(unsigned long))
-
 #define VSA_VALUE_UNKNOWN_TYPE_ERROR_MSG "unknown type value '%d'"
 
-vsa_value_t            *
-vsa_value_new(vsa_asn_type_t type, const char *str)
+static void             vsa_value_put(char *buf, size_t size, size_t *pos, char c);
+static void             vsa_value_append(char *buf, size_t size, size_t *pos, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+static const vsa_value_ops_t *vsa_value_get_ops(vsa_asn_type_t type);
+static int              vsa_value_bytes_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_bytes_load(vsa_value_t * value, const void *payload, size_t len);
+static int              vsa_value_bytes_share(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_bytes_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_bytes_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static void             vsa_value_bytes_free(vsa_value_t * value);
+static int              vsa_value_ulong_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_ulong_load(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_ulong_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_ulong_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static int              vsa_value_counter64_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_counter64_load(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_counter64_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_counter64_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static int              vsa_value_int_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_int_load(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_int_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_int_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static int              vsa_value_ip_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_ip_load(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_ip_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_ip_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static int              vsa_value_string_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_string_load(vsa_value_t * value, const void *payload, size_t len);
+static int              vsa_value_string_share(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_string_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_string_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static void             vsa_value_string_free(vsa_value_t * value);
+static int              vsa_value_oid_parse(vsa_value_t * value, const char *str);
+static int              vsa_value_oid_load(vsa_value_t * value, const void *payload, size_t len);
+static int              vsa_value_oid_share(vsa_value_t * value, const void *payload, size_t len);
+static void             vsa_value_oid_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+static int              vsa_value_oid_format(vsa_value_t * value, char *buf, size_t size, size_t *pos);
+static void             vsa_value_oid_free(vsa_value_t * value);
+
+// Bit strings, hex strings, network addresses and opaque values.
+const vsa_value_ops_t   vsa_value_bytes_ops = {
+    0, 1, vsa_value_bytes_parse, vsa_value_bytes_load, vsa_value_bytes_share, vsa_value_bytes_get_payload,
+    vsa_value_bytes_format, vsa_value_bytes_free
+};
+
+// Counter32, Gauge32, TimeTicks and Unsigned32.
+const vsa_value_ops_t   vsa_value_ulong_ops = {
+    sizeof (unsigned long), 1, vsa_value_ulong_parse, vsa_value_ulong_load, NULL, vsa_value_ulong_get_payload,
+    vsa_value_ulong_format, NULL
+};
+
+const vsa_value_ops_t   vsa_value_counter64_ops = {
+    sizeof (struct counter64), 1, vsa_value_counter64_parse, vsa_value_counter64_load, NULL,
+    vsa_value_counter64_get_payload, vsa_value_counter64_format, NULL
+};
+
+const vsa_value_ops_t   vsa_value_int_ops = {
+    sizeof (((vsa_value_t *) NULL)->value.int_value), 1, vsa_value_int_parse, vsa_value_int_load, NULL,
+    vsa_value_int_get_payload, vsa_value_int_format, NULL
+};
+
+const vsa_value_ops_t   vsa_value_ip_ops = {
+    sizeof (struct in_addr), 1, vsa_value_ip_parse, vsa_value_ip_load, NULL, vsa_value_ip_get_payload,
+    vsa_value_ip_format, NULL
+};
+
+const vsa_value_ops_t   vsa_value_string_ops = {
+    0, 1, vsa_value_string_parse, vsa_value_string_load, vsa_value_string_share, vsa_value_string_get_payload,
+    vsa_value_string_format, vsa_value_string_free
+};
+
+const vsa_value_ops_t   vsa_value_oid_ops = {
+    0, sizeof (oid), vsa_value_oid_parse, vsa_value_oid_load, vsa_value_oid_share, vsa_value_oid_get_payload,
+    vsa_value_oid_format, vsa_value_oid_free
+};
+
+static void
+vsa_value_put(char *buf, size_t size, size_t *pos, char c)
+{
+    if (*pos < size) {
+        buf[*pos] = c;
+    }
+    (*pos)++;
+}
+
+static void
+vsa_value_append(char *buf, size_t size, size_t *pos, const char *fmt, ...)
+{
+    int                     n;
+    va_list                 ap;
+
+    va_start(ap, fmt);
+    n = vsnprintf(*pos < size ? buf + *pos : NULL, *pos < size ? size - *pos : 0, fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        *pos += n;
+    }
+}
+
+static const vsa_value_ops_t *
+vsa_value_get_ops(vsa_asn_type_t type)
+{
+    const vsa_value_ops_t  *ops;
+
+    ops = vsa_asn_type_get_info(type)->ops;
+    if (!ops) {
+        vsa_log_debugln(VSA_VALUE_UNKNOWN_TYPE_ERROR_MSG, type);
+    }
+
+    return ops;
+}
+
+static int
+vsa_value_bytes_parse(vsa_value_t * value, const char *str)
+{
+    value->value.hex_value.values = vsa_parser_parse_hex_values(str, &value->value.hex_value.len);
+    if (!value->value.hex_value.values) {
+        vsa_log_debugln(VSA_PARSER_PARSE_HEX_VALUES_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_value_bytes_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    value->value.hex_value.values = malloc(len ? len : 1);
+    if (!value->value.hex_value.values) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    memcpy(value->value.hex_value.values, payload, len);
+    value->value.hex_value.len = len;
+
+    return 0;
+}
+
+static int
+vsa_value_bytes_share(vsa_value_t * value, const void *payload, size_t len)
+{
+    value->value.hex_value.values = (unsigned char *) payload;
+    value->value.hex_value.len = len;
+
+    return 0;
+}
+
+static void
+vsa_value_bytes_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = value->value.hex_value.values;
+    *len = value->value.hex_value.len;
+}
+
+static int
+vsa_value_bytes_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    static const char       hex[] = "0123456789ABCDEF";
+    unsigned char          *values;
+
+    values = value->value.hex_value.values;
+    for (size_t i = 0; i < value->value.hex_value.len; i++) {
+        if (i) {
+            vsa_value_put(buf, size, pos, ' ');
+        }
+        vsa_value_put(buf, size, pos, hex[values[i] >> 4]);
+        vsa_value_put(buf, size, pos, hex[values[i] & 0xf]);
+    }
+
+    return 0;
+}
+
+static void
+vsa_value_bytes_free(vsa_value_t * value)
+{
+    if (!value->shared) {
+        free(value->value.hex_value.values);
+    }
+}
+
+static int
+vsa_value_ulong_parse(vsa_value_t * value, const char *str)
+{
+    if (-1 == vsa_parser_parse_number(str, &value->value.ulong_value)) {
+        vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_value_ulong_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    memcpy(&value->value.ulong_value, payload, len);
+
+    return 0;
+}
+
+static void
+vsa_value_ulong_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = &value->value.ulong_value;
+    *len = sizeof (value->value.ulong_value);
+}
+
+static int
+vsa_value_ulong_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    vsa_value_append(buf, size, pos, "%lu", value->value.ulong_value);
+
+    return 0;
+}
+
+static int
+vsa_value_counter64_parse(vsa_value_t * value, const char *str)
 {
-    char                   *string_value;
-    unsigned char          *hex_values;
     unsigned long           ulong_value;
+
+    if (-1 == vsa_parser_parse_number(str, &ulong_value)) {
+        vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
+        return -1;
+    }
+    value->value.counter64_value.low = ulong_value & 0xffffffff;
+    value->value.counter64_value.high = (unsigned long long) ulong_value >> 32;
+
+    return 0;
+}
+
+static int
+vsa_value_counter64_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    memcpy(&value->value.counter64_value, payload, len);
+
+    return 0;
+}
+
+static void
+vsa_value_counter64_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = &value->value.counter64_value;
+    *len = sizeof (value->value.counter64_value);
+}
+
+static int
+vsa_value_counter64_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    vsa_value_append(buf, size, pos, "%llu",
+                     ((unsigned long long) value->value.counter64_value.high << 32) |
+                     (value->value.counter64_value.low & 0xffffffff));
+
+    return 0;
+}
+
+static int
+vsa_value_int_parse(vsa_value_t * value, const char *str)
+{
+    unsigned long           ulong_value;
+
+    if (-1 == vsa_parser_parse_number(str, &ulong_value)) {
+        vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
+        return -1;
+    }
+    value->value.int_value = ulong_value;
+
+    return 0;
+}
+
+static int
+vsa_value_int_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    memcpy(&value->value.int_value, payload, len);
+
+    return 0;
+}
+
+static void
+vsa_value_int_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = &value->value.int_value;
+    *len = sizeof (value->value.int_value);
+}
+
+static int
+vsa_value_int_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    vsa_value_append(buf, size, pos, "%ld", (long) value->value.int_value);
+
+    return 0;
+}
+
+static int
+vsa_value_ip_parse(vsa_value_t * value, const char *str)
+{
+    if (inet_pton(AF_INET, str, &value->value.ip_value) <= 0) {
+
+        if (errno) {
+            vsa_log_debugln("%s", strerror(errno));
+        } else {
+            vsa_log_debugln("invalid address: '%s'", str);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_value_ip_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    memcpy(&value->value.ip_value, payload, len);
+
+    return 0;
+}
+
+static void
+vsa_value_ip_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = &value->value.ip_value;
+    *len = sizeof (value->value.ip_value);
+}
+
+static int
+vsa_value_ip_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    char                    address_str[INET_ADDRSTRLEN];
+
+    if (!inet_ntop(AF_INET, &value->value.ip_value.s_addr, address_str, sizeof (address_str))) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    vsa_value_append(buf, size, pos, "%s", address_str);
+
+    return 0;
+}
+
+static int
+vsa_value_string_parse(vsa_value_t * value, const char *str)
+{
+    value->value.string_value.values = strdup(str);
+    if (!value->value.string_value.values) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    value->value.string_value.len = strlen(str);
+
+    return 0;
+}
+
+// OCTET STRINGs may hold any byte, NULs included, so they keep their length. They are NUL-terminated all the same.
+static int
+vsa_value_string_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    value->value.string_value.values = malloc(len + 1);
+    if (!value->value.string_value.values) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    memcpy(value->value.string_value.values, payload, len);
+    value->value.string_value.values[len] = '\0';
+    value->value.string_value.len = len;
+
+    return 0;
+}
+
+static int
+vsa_value_string_share(vsa_value_t * value, const void *payload, size_t len)
+{
+    value->value.string_value.values = (char *) payload;
+    value->value.string_value.len = len;
+
+    return 0;
+}
+
+static void
+vsa_value_string_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = value->value.string_value.values;
+    *len = value->value.string_value.len;
+}
+
+static int
+vsa_value_string_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    for (size_t i = 0; i < value->value.string_value.len; i++) {
+        vsa_value_put(buf, size, pos, value->value.string_value.values[i]);
+    }
+
+    return 0;
+}
+
+static void
+vsa_value_string_free(vsa_value_t * value)
+{
+    if (!value->shared) {
+        free(value->value.string_value.values);
+    }
+}
+
+static int
+vsa_value_oid_parse(vsa_value_t * value, const char *str)
+{
     size_t                  len;
     oid                    *oids;
+
+    oids = vsa_parser_parse_oid(str, &len);
+    if (!oids) {
+        vsa_log_debugln(VSA_PARSER_PARSE_OID_ERROR_MSG);
+        return -1;
+    }
+    value->value.oid_value = vsa_oid_new(oids, len);
+    if (!value->value.oid_value) {
+        vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+        free(oids);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vsa_value_oid_load(vsa_value_t * value, const void *payload, size_t len)
+{
+    oid                    *oids;
+
+    oids = malloc(len ? len : 1);
+    if (!oids) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    memcpy(oids, payload, len);
+    value->value.oid_value = vsa_oid_new(oids, len / sizeof (oid));
+    if (!value->value.oid_value) {
+        vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+        free(oids);
+        return -1;
+    }
+
+    return 0;
+}
+
+// The payload must be aligned for oid.
+static int
+vsa_value_oid_share(vsa_value_t * value, const void *payload, size_t len)
+{
+    value->value.oid_value = vsa_oid_new((oid *) payload, len / sizeof (oid));
+    if (!value->value.oid_value) {
+        vsa_log_debugln(VSA_OID_NEW_ERROR_MSG);
+        return -1;
+    }
+    value->value.oid_value->shared = 1;
+
+    return 0;
+}
+
+static void
+vsa_value_oid_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    *payload = value->value.oid_value->oids;
+    *len = value->value.oid_value->len * sizeof (oid);
+}
+
+static int
+vsa_value_oid_format(vsa_value_t * value, char *buf, size_t size, size_t *pos)
+{
+    *pos += vsa_oid_format(value->value.oid_value->oids, value->value.oid_value->len,
+                           *pos < size ? buf + *pos : NULL, *pos < size ? size - *pos : 0);
+
+    return 0;
+}
+
+static void
+vsa_value_oid_free(vsa_value_t * value)
+{
+    vsa_oid_free(value->value.oid_value);
+}
+
+vsa_value_t            *
+vsa_value_new(vsa_asn_type_t type, const char *str)
+{
+    const vsa_value_ops_t  *ops;
     vsa_value_t            *value;
 
+    ops = vsa_value_get_ops(type);
+    if (!ops) {
+        return NULL;
+    }
+
     value = calloc(1, sizeof (vsa_value_t));
     if (!value) {
         vsa_log_debugln("%s", strerror(errno));
         return NULL;
     }
-
     value->type = type;
 
-    switch (type) {
-    case VSA_ASN_BIT:
-    case VSA_ASN_HEX_STRING:
-    case VSA_ASN_NETWORK_ADDRESS:
-        hex_values = vsa_parser_parse_hex_values(str, &len);
-        if (!hex_values) {
-            vsa_log_debugln(VSA_PARSER_PARSE_HEX_VALUES_ERROR_MSG);
-            return vsa_value_free(value);
-        }
-        value->value.hex_value.values = hex_values;
-        value->value.hex_value.len = len;
-        break;
-
-    case VSA_ASN_COUNTER_32:
-    case VSA_ASN_GAUGE_32:
-    case VSA_ASN_TIMETICKS:
-        if (-1 == vsa_parser_parse_number(str, &value->value.ulong_value)) {
-            vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
-            return vsa_value_free(value);
-        }
-        break;
-
-    case VSA_ASN_COUNTER_64:
-        if (-1 == vsa_parser_parse_number(str, &ulong_value)) {
-            vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
-            return vsa_value_free(value);
-        }
-        value->value.counter64_value.low = ulong_value & ~0;
-        value->value.counter64_value.high = ulong_value >> 32 & ~0;
-        break;
-
-    case VSA_ASN_INTEGER:
-        if (-1 == vsa_parser_parse_number(str, &ulong_value)) {
-            vsa_log_debugln(VSA_PARSER_PARSE_NUMBER_ERROR_MSG);
-            return vsa_value_free(value);
-        }
-        value->value.int_value = ulong_value;
-        break;
-
-    case VSA_ASN_IP_ADDRESS:
-        if (inet_pton(AF_INET, str, &value->value.ip_value) <= 0) {
-
-            if (errno) {
-                vsa_log_debugln("%s", strerror(errno));
-            } else {
-                vsa_log_debugln("invalid address: '%s'", str);
-            }
-            return vsa_value_free(value);
-        }
-        break;
-
-    case VSA_ASN_OCTET_STRING:
-    case VSA_ASN_STRING:
-        string_value = strdup(str);
-        if (!string_value) {
-            vsa_log_debugln("%s", strerror(errno));
-            return vsa_value_free(value);
-        }
-        value->value.string_value = string_value;
-        break;
-
-    case VSA_ASN_OID:
-        oids = vsa_parser_parse_oid(str, &len);
-        if (!oids) {
-            vsa_log_debugln(VSA_PARSER_PARSE_OID_ERROR_MSG);
-            return vsa_value_free(value);
-        }
-        value->value.oid_value = vsa_oid_new(oids, len);
-        break;
-
-    default:
-        vsa_log_debugln(VSA_VALUE_UNKNOWN_TYPE_ERROR_MSG, type);
-        return vsa_value_free(value);
-        break;
+    if (ops->parse(value, str)) {
+        free(value);
+        return NULL;
     }
 
     return value;
@@ -133,29 +540,16 @@ vsa_value_new(vsa_asn_type_t type, const char *str)
 void                   *
 vsa_value_free(vsa_value_t * value)
 {
+    const vsa_value_ops_t  *ops;
+
     if (!value) {
         return NULL;
     }
 
-    switch (value->type) {
-    case VSA_ASN_BIT:
-    case VSA_ASN_HEX_STRING:
-    case VSA_ASN_NETWORK_ADDRESS:
-        free(value->value.hex_value.values);
-        break;
-
-    case VSA_ASN_OCTET_STRING:
-    case VSA_ASN_STRING:
-        free(value->value.string_value);
-        break;
-
-    case VSA_ASN_OID:
-        vsa_oid_free(value->value.oid_value);
-        break;
-    default:
-        break;
+    ops = vsa_asn_type_get_info(value->type)->ops;
+    if (ops && ops->free) {
+        ops->free(value);
     }
-
     free(value);
 
     return NULL;
@@ -164,107 +558,217 @@ vsa_value_free(vsa_value_t * value)
 char                   *
 vsa_value_to_str(vsa_value_t * value)
 {
-    char                   *str, *type, *tmp;
-    char                    address_str[INET_ADDRSTRLEN];
-    unsigned char          *values;
+    char                   *str;
+    ssize_t                 len;
+
+    len = vsa_value_format(value, NULL, 0);
+    if (-1 == len) {
+        return NULL;
+    }
+
+    str = malloc(len + 1);
+    if (!str) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    vsa_value_format(value, str, len + 1);
+
+    return str;
+}
+
+/*
+ * Writes value as "TYPE -> value" into buf, as snprintf() does: the output is truncated to size - 1 characters and
+ * terminated if size isn't 0, and the length of the whole string is returned. It returns -1 for unknown types.
+ */
+ssize_t
+vsa_value_format(vsa_value_t * value, char *buf, size_t size)
+{
+    size_t                  pos;
+    ssize_t                 len;
+
+    pos = 0;
+    vsa_value_append(buf, size, &pos, "%s -> ", vsa_asn_type_get_name(value->type));
+
+    len = vsa_value_format_data(value, pos < size ? buf + pos : NULL, pos < size ? size - pos : 0);
+    if (-1 == len) {
+        return -1;
+    }
+
+    return pos + len;
+}
+
+// Writes value alone, in the form vsa_value_new() parses, as vsa_value_format() does.
+ssize_t
+vsa_value_format_data(vsa_value_t * value, char *buf, size_t size)
+{
+    size_t                  pos;
+    const vsa_value_ops_t  *ops;
+
+    ops = vsa_value_get_ops(value->type);
+    if (!ops) {
+        return -1;
+    }
+
+    pos = 0;
+    if (ops->format(value, buf, size, &pos)) {
+        return -1;
+    }
+
+    if (size) {
+        buf[pos < size ? pos : size - 1] = '\0';
+    }
+
+    return pos;
+}
+
+int
+vsa_value_to_var(vsa_value_t * value, netsnmp_variable_list * var)
+{
+    const void             *payload;
     size_t                  len;
 
-    str = NULL;
-
-    switch (value->type) {
-    case VSA_ASN_BIT:
-    case VSA_ASN_HEX_STRING:
-    case VSA_ASN_NETWORK_ADDRESS:
-        values = value->value.hex_value.values;
-        len = value->value.hex_value.len;
-        for (size_t i = 0; i < len; i++) {
-            tmp = str;
-            if (-1 == asprintf(&str, "%s%s%02X", (str ? str : ""), (str ? " " : ""), values[i])) {
-                vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-                free(tmp);
-                return NULL;
-            }
-            free(tmp);
-        }
-        break;
+    if (vsa_value_get_payload(value, &payload, &len)) {
+        vsa_log_debugln(VSA_VALUE_GET_PAYLOAD_ERROR_MSG);
+        return -1;
+    }
 
-    case VSA_ASN_OCTET_STRING:
-    case VSA_ASN_STRING:
-        str = strdup(value->value.string_value);
-        if (!str) {
-            vsa_log_debugln("%s", strerror(errno));
-            return NULL;
-        }
-        break;
-
-    case VSA_ASN_COUNTER_32:
-    case VSA_ASN_GAUGE_32:
-    case VSA_ASN_TIMETICKS:
-        if (-1 == asprintf(&str, "%lu", value->value.ulong_value)) {
-            vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-            return NULL;
-        }
-        break;
-
-    case VSA_ASN_COUNTER_64:
-        if (-1 ==
-            asprintf(&str, "%lu",
-                     value->value.counter64_value.low | (((unsigned long) value->value.counter64_value.high) <<
-                                                         (VSA_VALUE_ULONG_SIZE / 2)))) {
-            vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-            return NULL;
-        }
-        break;
+    return snmp_set_var_typed_value(var, vsa_asn_type_get_info(value->type)->asn, payload, len);
+}
 
-    case VSA_ASN_INTEGER:
-        if (-1 == asprintf(&str, "%ld", value->value.int_value)) {
-            vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-            return NULL;
-        }
-        break;
+int
+vsa_value_check_var(vsa_value_t * value, netsnmp_variable_list * var)
+{
+    const void             *payload;
+    size_t                  len, size;
+    const vsa_asn_type_info_t *info;
 
-    case VSA_ASN_IP_ADDRESS:
-        if (!inet_ntop(AF_INET, &value->value.ip_value.s_addr, address_str, sizeof (address_str))) {
-            vsa_log_debugln("%s", strerror(errno));
-            return NULL;
-        }
-        str = strdup(address_str);
-        if (!str) {
-            vsa_log_debugln("%s", strerror(errno));
-            return NULL;
-        }
-        break;
+    info = vsa_asn_type_get_info(value->type);
+    if (!info->ops || !(info->flags & VSA_ASN_WRITABLE)) {
+        return SNMP_ERR_NOTWRITABLE;
+    }
 
-    case VSA_ASN_OID:
-        str = vsa_oid_to_str(value->value.oid_value);
-        if (!str) {
-            vsa_log_debugln(VSA_OID_TO_STR_ERROR_MSG);
-            return NULL;
-        }
-        break;
+    if (var->type != info->asn) {
+        return SNMP_ERR_WRONGTYPE;
+    }
+
+    // net-snmp holds an INTEGER in a long, which int_value may be narrower than.
+    size = info->ops == &vsa_value_int_ops ? sizeof (long) : info->ops->size;
+    info->ops->get_payload(value, &payload, &len);
+    if ((size && var->val_len != size) || var->val_len % info->ops->unit
+        || (info->flags & VSA_ASN_FIXED_SIZE && var->val_len != len)) {
+        return SNMP_ERR_WRONGLENGTH;
+    }
+
+    return SNMP_ERR_NOERROR;
+}
+
+vsa_value_t            *
+vsa_value_from_var(vsa_asn_type_t type, netsnmp_variable_list * var)
+{
+    vsa_value_t             integer;
+
+    if (vsa_value_get_ops(type) == &vsa_value_int_ops) {
+        integer.value.int_value = *var->val.integer;
+        return vsa_value_new_payload(type, &integer.value.int_value, sizeof (integer.value.int_value));
+    }
+
+    return vsa_value_new_payload(type, var->val.string, var->val_len);
+}
+
+int
+vsa_value_equal(vsa_value_t * a, vsa_value_t * b)
+{
+    const void             *a_payload, *b_payload;
+    size_t                  a_len, b_len;
+
+    if (a->type != b->type || vsa_value_get_payload(a, &a_payload, &a_len)
+        || vsa_value_get_payload(b, &b_payload, &b_len)) {
+        return 0;
+    }
+
+    return a_len == b_len && !memcmp(a_payload, b_payload, a_len);
+}
+
+// The bytes value is sent, stored and watched as. They are only valid as long as the value is.
+int
+vsa_value_get_payload(vsa_value_t * value, const void **payload, size_t *len)
+{
+    const vsa_value_ops_t  *ops;
+
+    ops = vsa_value_get_ops(value->type);
+    if (!ops) {
+        return -1;
+    }
+    ops->get_payload(value, payload, len);
 
-    default:
-        vsa_log_debugln(VSA_VALUE_UNKNOWN_TYPE_ERROR_MSG, value->type);
+    return 0;
+}
+
+// A value of the given type read back from its payload.
+vsa_value_t            *
+vsa_value_new_payload(vsa_asn_type_t type, const void *payload, size_t len)
+{
+    const vsa_value_ops_t  *ops;
+    vsa_value_t            *value;
+
+    ops = vsa_value_get_ops(type);
+    if (!ops) {
+        return NULL;
+    }
+    if ((ops->size && len != ops->size) || len % ops->unit) {
+        vsa_log_debugln("invalid value of type %d and length %zu", type, len);
         return NULL;
-        break;
     }
 
-    type = vsa_asn_type_to_str(value->type);
-    if (!type) {
-        vsa_log_debugln(VSA_ASN_TYPE_TO_STR_ERROR_MSG);
-        free(str);
+    value = calloc(1, sizeof (vsa_value_t));
+    if (!value) {
+        vsa_log_debugln("%s", strerror(errno));
         return NULL;
     }
+    value->type = type;
 
-    tmp = str;
-    if (-1 == asprintf(&str, "%s -> %s", type, str)) {
-        vsa_log_debugln("%s", VSA_LOG_AS_PRINTF_ERROR_MSG);
-        free(tmp);
-        free(type);
+    if (ops->load(value, payload, len)) {
+        free(value);
         return NULL;
     }
-    free(tmp);
-    free(type);
 
-    return str;
+    return value;
+}
+
+/*
+ * A value of the given type pointing to its payload rather than copying it, as a shared value, for the types that hold
+ * it out of the value. The payload must outlive the value and be aligned for oid.
+ */
+vsa_value_t            *
+vsa_value_new_shared(vsa_asn_type_t type, const void *payload, size_t len)
+{
+    const vsa_value_ops_t  *ops;
+    vsa_value_t            *value;
+
+    ops = vsa_value_get_ops(type);
+    if (!ops) {
+        return NULL;
+    }
+    if (!ops->share) {
+        return vsa_value_new_payload(type, payload, len);
+    }
+    if (len % ops->unit) {
+        vsa_log_debugln("invalid value of type %d and length %zu", type, len);
+        return NULL;
+    }
+
+    value = calloc(1, sizeof (vsa_value_t));
+    if (!value) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    value->type = type;
+    value->shared = 1;
+
+    if (ops->share(value, payload, len)) {
+        free(value);
+        return NULL;
+    }
+
+    return value;
 }
@@ -29,16 +29,30 @@
 #include <net-snmp/agent/mib_modules.h>
 
 #include <vsa/asn_type.h>
+#include <vsa/oid.h>
 
 #define VSA_VALUE_NEW_ERROR_MSG "vsa_value_new() failed"
 #define VSA_VALUE_TO_STR_ERROR_MSG "vsa_value_to_str() failed"
+#define VSA_VALUE_TO_VAR_ERROR_MSG "vsa_value_to_var() failed"
+#define VSA_VALUE_FROM_VAR_ERROR_MSG "vsa_value_from_var() failed"
+#define VSA_VALUE_GET_PAYLOAD_ERROR_MSG "vsa_value_get_payload() failed"
+#define VSA_VALUE_NEW_PAYLOAD_ERROR_MSG "vsa_value_new_payload() failed"
 
 typedef struct vsa_value_s vsa_value_t;
+typedef struct vsa_value_ops_s vsa_value_ops_t;
 
+/*
+ * A shared value points into memory it doesn't own, such as a store mapping, instead of holding its own copy of its
+ * payload. Freeing it only frees the value itself.
+ */
 struct vsa_value_s {
     vsa_asn_type_t          type;
+    int                     shared;
     union {
-        char                   *string_value;
+        struct {
+            char                   *values;
+            size_t                  len;
+        } string_value;
 #if defined __x86_64
         long                     int_value;
 #else
@@ -55,8 +69,42 @@ struct vsa_value_s {
     } value;
 };
 
+/*
+ * The operations on one member of the value union, shared by the types held in it: parsing walk text, loading and
+ * getting the payload, that is the bytes a value is sent, stored and watched as, formatting and freeing. Payloads are
+ * size bytes long, or any multiple of unit bytes when size is 0. The members held out of the union also share a
+ * payload, pointing to it rather than copying it.
+ */
+struct vsa_value_ops_s {
+    size_t                  size;
+    size_t                  unit;
+    int                     (*parse) (vsa_value_t * value, const char *str);
+    int                     (*load) (vsa_value_t * value, const void *payload, size_t len);
+    int                     (*share) (vsa_value_t * value, const void *payload, size_t len);
+    void                    (*get_payload) (vsa_value_t * value, const void **payload, size_t *len);
+    int                     (*format) (vsa_value_t * value, char *buf, size_t size, size_t *pos);
+    void                    (*free) (vsa_value_t * value);
+};
+
+extern const vsa_value_ops_t vsa_value_bytes_ops;
+extern const vsa_value_ops_t vsa_value_ulong_ops;
+extern const vsa_value_ops_t vsa_value_counter64_ops;
+extern const vsa_value_ops_t vsa_value_int_ops;
+extern const vsa_value_ops_t vsa_value_ip_ops;
+extern const vsa_value_ops_t vsa_value_string_ops;
+extern const vsa_value_ops_t vsa_value_oid_ops;
+
 vsa_value_t            *vsa_value_new(vsa_asn_type_t type, const char *str);
 void                   *vsa_value_free(vsa_value_t * value);
 char                   *vsa_value_to_str(vsa_value_t * value);
+ssize_t                 vsa_value_format(vsa_value_t * value, char *buf, size_t size);
+ssize_t                 vsa_value_format_data(vsa_value_t * value, char *buf, size_t size);
+int                     vsa_value_to_var(vsa_value_t * value, netsnmp_variable_list * var);
+int                     vsa_value_check_var(vsa_value_t * value, netsnmp_variable_list * var);
+vsa_value_t            *vsa_value_from_var(vsa_asn_type_t type, netsnmp_variable_list * var);
+int                     vsa_value_equal(vsa_value_t * a, vsa_value_t * b);
+int                     vsa_value_get_payload(vsa_value_t * value, const void **payload, size_t *len);
+vsa_value_t            *vsa_value_new_payload(vsa_asn_type_t type, const void *payload, size_t len);
+vsa_value_t            *vsa_value_new_shared(vsa_asn_type_t type, const void *payload, size_t len);
 
 #endif // VSA_VALUE_H
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <vsa/log.h>
+#include <vsa/snapshot.h>
+#include <vsa/wal.h>
+
+#define VSA_WAL_FNV_OFFSET 2166136261U
+#define VSA_WAL_FNV_PRIME 16777619U
+
+static guint32          vsa_wal_hash(const unsigned char *data, size_t len);
+static const unsigned char *vsa_wal_next(const unsigned char **p, const unsigned char *end, size_t *len);
+static int              vsa_wal_decode(const unsigned char *body, size_t len, oid * oids, size_t *oids_len,
+                                       guint32 * type, const unsigned char **payload, size_t *payload_len);
+static int              vsa_wal_write(int fd, const void *buf, size_t len);
+static int              vsa_wal_sync_dir(const char *path);
+static int              vsa_wal_flush(vsa_wal_t * wal, GByteArray * batch);
+static int              vsa_wal_truncate(vsa_wal_t * wal);
+static int              vsa_wal_compact(vsa_wal_t * wal);
+static gpointer         vsa_wal_thread(gpointer data);
+
+static guint32
+vsa_wal_hash(const unsigned char *data, size_t len)
+{
+    guint32                 hash;
+
+    hash = VSA_WAL_FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= VSA_WAL_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// Advances *p over the next record and returns its bytes, or returns NULL where the log ends or a record is torn.
+static const unsigned char *
+vsa_wal_next(const unsigned char **p, const unsigned char *end, size_t *len)
+{
+    const unsigned char    *body;
+    vsa_wal_record_t        record;
+
+    if ((size_t) (end - *p) < sizeof (record)) {
+        return NULL;
+    }
+    memcpy(&record, *p, sizeof (record));
+    body = *p + sizeof (record);
+
+    if ((size_t) (end - body) < record.len || record.check != vsa_wal_hash(body, record.len)) {
+        return NULL;
+    }
+    *p = body + record.len;
+    *len = record.len;
+
+    return body;
+}
+
+// Records aren't aligned, so the OID is copied out to oids, which must hold MAX_OID_LEN sub-identifiers.
+static int
+vsa_wal_decode(const unsigned char *body, size_t len, oid * oids, size_t *oids_len, guint32 * type,
+               const unsigned char **payload, size_t *payload_len)
+{
+    guint64                 n;
+    const unsigned char    *end;
+
+    end = body + len;
+
+    if (len < sizeof (n)) {
+        return -1;
+    }
+    memcpy(&n, body, sizeof (n));
+    body += sizeof (n);
+    if (!n || n > MAX_OID_LEN || (size_t) (end - body) < n * sizeof (oid) + sizeof (*type) + sizeof (n)) {
+        return -1;
+    }
+    memcpy(oids, body, n * sizeof (oid));
+    body += n * sizeof (oid);
+    *oids_len = n;
+
+    memcpy(type, body, sizeof (*type));
+    body += sizeof (*type);
+    memcpy(&n, body, sizeof (n));
+    body += sizeof (n);
+    if ((size_t) (end - body) != n) {
+        return -1;
+    }
+    *payload = body;
+    *payload_len = n;
+
+    return 0;
+}
+
+static int
+vsa_wal_write(int fd, const void *buf, size_t len)
+{
+    ssize_t                 n;
+
+    while (len) {
+        n = write(fd, buf, len);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+// Makes a rename in the directory of path durable.
+static int
+vsa_wal_sync_dir(const char *path)
+{
+    int                     fd, ret;
+    char                   *dir;
+
+    dir = g_path_get_dirname(path);
+    fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    g_free(dir);
+    if (-1 == fd) {
+        return -1;
+    }
+    ret = fsync(fd);
+    close(fd);
+
+    return ret;
+}
+
+static int
+vsa_wal_flush(vsa_wal_t * wal, GByteArray * batch)
+{
+    if (vsa_wal_write(wal->fd, batch->data, batch->len) || fdatasync(wal->fd)) {
+        vsa_log_debugln("%s", strerror(errno));
+        // Whatever part of the batch made it is dropped, so that the next batch doesn't follow a torn record.
+        if (ftruncate(wal->fd, wal->size)) {
+            vsa_log_debugln("%s", strerror(errno));
+        }
+        return -1;
+    }
+    wal->size += batch->len;
+
+    return 0;
+}
+
+static int
+vsa_wal_truncate(vsa_wal_t * wal)
+{
+    if (ftruncate(wal->fd, sizeof (vsa_wal_header_t)) || fdatasync(wal->fd)) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    wal->size = wal->compacted = sizeof (vsa_wal_header_t);
+
+    return 0;
+}
+
+/*
+ * Rewrites the log with the last record of each object only, into a new file renamed over the log. Only the log
+ * thread writes to the log, so records committed meanwhile simply wait in memory for the next batch.
+ */
+static int
+vsa_wal_compact(vsa_wal_t * wal)
+{
+    int                     fd;
+    char                   *tmp;
+    size_t                  len, oids_len, payload_len;
+    guint32                 type;
+    oid                     oids[MAX_OID_LEN];
+    const unsigned char    *map, *p, *end, *record, *body, *payload;
+    vsa_wal_record_t        header;
+    gpointer                value;
+    GByteArray             *out;
+    GHashTable             *last;
+    GHashTableIter          iter;
+
+    map = mmap(NULL, wal->size, PROT_READ, MAP_PRIVATE, wal->fd, 0);
+    if (MAP_FAILED == map) {
+        vsa_log_debugln("%s", strerror(errno));
+        return -1;
+    }
+    p = map + sizeof (vsa_wal_header_t);
+    end = map + wal->size;
+
+    // Keyed by the OID bytes of each record, so that later records replace earlier ones.
+    last = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref, NULL);
+    for (record = p; (body = vsa_wal_next(&p, end, &len)); record = p) {
+        if (vsa_wal_decode(body, len, oids, &oids_len, &type, &payload, &payload_len)) {
+            continue;
+        }
+        g_hash_table_replace(last, g_bytes_new_static(body, sizeof (guint64) + oids_len * sizeof (oid)),
+                             (gpointer) record);
+    }
+
+    out = g_byte_array_new();
+    g_byte_array_append(out, map, sizeof (vsa_wal_header_t));
+    g_hash_table_iter_init(&iter, last);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        memcpy(&header, value, sizeof (header));
+        g_byte_array_append(out, value, sizeof (header) + header.len);
+    }
+    g_hash_table_destroy(last);
+    munmap((void *) map, wal->size);
+
+    tmp = g_strdup_printf("%s.tmp", wal->path);
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        vsa_log_debugln("%s: %s", tmp, strerror(errno));
+        g_free(tmp);
+        g_byte_array_free(out, TRUE);
+        return -1;
+    }
+
+    if (vsa_wal_write(fd, out->data, out->len) || fdatasync(fd) || rename(tmp, wal->path)) {
+        vsa_log_debugln("%s: %s", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        g_free(tmp);
+        g_byte_array_free(out, TRUE);
+        return -1;
+    }
+    if (vsa_wal_sync_dir(wal->path)) {
+        vsa_log_debugln("%s", strerror(errno));
+    }
+    g_free(tmp);
+
+    vsa_log_infoln("compacted %s from %lld to %u bytes", wal->path, (long long) wal->size, out->len);
+
+    close(wal->fd);
+    wal->fd = fd;
+    wal->size = wal->compacted = out->len;
+    g_byte_array_free(out, TRUE);
+
+    return 0;
+}
+
+static gpointer
+vsa_wal_thread(gpointer data)
+{
+    int                     reset, stopping;
+    gint64                  deadline;
+    GByteArray             *batch;
+    vsa_wal_t              *wal;
+
+    wal = data;
+
+    g_mutex_lock(&wal->lock);
+    do {
+        while (!wal->pending->len && !wal->reset && !wal->stopping) {
+            g_cond_wait(&wal->cond, &wal->lock);
+        }
+
+        // SETs committed meanwhile join the batch and share its fsync.
+        deadline = g_get_monotonic_time() + wal->interval * G_TIME_SPAN_MILLISECOND;
+        while (wal->interval && !wal->stopping && g_cond_wait_until(&wal->cond, &wal->lock, deadline)) {
+        }
+
+        batch = wal->pending;
+        wal->pending = wal->spare;
+        reset = wal->reset;
+        wal->reset = 0;
+        stopping = wal->stopping;
+        g_mutex_unlock(&wal->lock);
+
+        if (reset && vsa_wal_truncate(wal)) {
+            vsa_log_warnln("couldn't truncate %s", wal->path);
+        }
+        if (batch->len && vsa_wal_flush(wal, batch)) {
+            vsa_log_warnln("couldn't write %u bytes of SETs to %s", batch->len, wal->path);
+        }
+        g_byte_array_set_size(batch, 0);
+
+        if (wal->size - wal->compacted >= VSA_WAL_COMPACT_SIZE && vsa_wal_compact(wal)) {
+            vsa_log_warnln("couldn't compact %s", wal->path);
+            // Not retried before the log grows as much again.
+            wal->compacted = wal->size;
+        }
+
+        g_mutex_lock(&wal->lock);
+        wal->spare = batch;
+    } while (!stopping || wal->pending->len);
+    g_mutex_unlock(&wal->lock);
+
+    return NULL;
+}
+
+/*
+ * Opens the log at path, creating it if needed, for SETs to be appended to it. interval is how long, in milliseconds,
+ * the first SET of a batch waits for others before the batch is written and fsynced. With 0, only the SETs committed
+ * while the previous batch was being fsynced share one.
+ */
+vsa_wal_t              *
+vsa_wal_open(const char *path, unsigned interval)
+{
+    struct stat             st;
+    GError                 *gerror;
+    vsa_wal_t              *wal;
+    vsa_wal_header_t        header;
+
+    wal = calloc(1, sizeof (vsa_wal_t));
+    if (!wal) {
+        vsa_log_debugln("%s", strerror(errno));
+        return NULL;
+    }
+    wal->interval = interval;
+
+    wal->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (-1 == wal->fd) {
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        free(wal);
+        return NULL;
+    }
+    if (fstat(wal->fd, &st)) {
+        vsa_log_debugln("%s", strerror(errno));
+        goto failed;
+    }
+    wal->size = st.st_size;
+
+    if (!wal->size) {
+        memset(&header, 0, sizeof (header));
+        memcpy(header.magic, VSA_WAL_MAGIC, sizeof (VSA_WAL_MAGIC));
+        header.version = VSA_WAL_VERSION;
+        header.oid_size = sizeof (oid);
+        if (vsa_wal_write(wal->fd, &header, sizeof (header)) || fdatasync(wal->fd)) {
+            vsa_log_debugln("%s", strerror(errno));
+            goto failed;
+        }
+        wal->size = sizeof (header);
+    }
+    // A log left large by the previous process is compacted along with the first batch.
+    wal->compacted = sizeof (header);
+
+    wal->path = strdup(path);
+    if (!wal->path) {
+        vsa_log_debugln("%s", strerror(errno));
+        goto failed;
+    }
+    wal->pending = g_byte_array_new();
+    wal->spare = g_byte_array_new();
+    g_mutex_init(&wal->lock);
+    g_cond_init(&wal->cond);
+
+    gerror = NULL;
+    wal->thread = g_thread_try_new("wal", vsa_wal_thread, wal, &gerror);
+    if (!wal->thread) {
+        vsa_log_debugln("%s", gerror->message);
+        g_error_free(gerror);
+        g_mutex_clear(&wal->lock);
+        g_cond_clear(&wal->cond);
+        g_byte_array_free(wal->pending, TRUE);
+        g_byte_array_free(wal->spare, TRUE);
+        goto failed;
+    }
+
+    return wal;
+
+  failed:
+    close(wal->fd);
+    free(wal->path);
+    free(wal);
+
+    return NULL;
+}
+
+// Writes out and fsyncs the SETs still pending, then closes the log.
+void                   *
+vsa_wal_close(vsa_wal_t * wal)
+{
+    if (!wal) {
+        return NULL;
+    }
+
+    g_mutex_lock(&wal->lock);
+    wal->stopping = 1;
+    g_cond_signal(&wal->cond);
+    g_mutex_unlock(&wal->lock);
+    g_thread_join(wal->thread);
+
+    g_mutex_clear(&wal->lock);
+    g_cond_clear(&wal->cond);
+    g_byte_array_free(wal->pending, TRUE);
+    g_byte_array_free(wal->spare, TRUE);
+    close(wal->fd);
+    free(wal->path);
+    free(wal);
+
+    return NULL;
+}
+
+/*
+ * Applies the SETs logged at path to the objects of index, and sets *applied to how many were. SETs to objects index
+ * doesn't have, or whose type has changed since, are ignored. A torn record left by a crash ends the log and is cut
+ * off. It must run before the index is served: values are replaced in place.
+ */
+int
+vsa_wal_replay(const char *path, vsa_index_t * index, size_t *applied)
+{
+    int                     fd, ret;
+    size_t                  len, oids_len, payload_len;
+    guint32                 type;
+    oid                     oids[MAX_OID_LEN];
+    struct stat             st;
+    const unsigned char    *map, *p, *end, *body, *payload;
+    vsa_wal_header_t        header;
+    vsa_object_t           *object;
+    vsa_value_t            *value;
+
+    *applied = 0;
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if (-1 == fd) {
+        if (ENOENT == errno) {
+            return 0;
+        }
+        vsa_log_debugln("%s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st)) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // Only a crash while the log was being created leaves less than a header.
+    if ((size_t) st.st_size < sizeof (header)) {
+        ret = st.st_size && ftruncate(fd, 0) ? -1 : 0;
+        if (ret) {
+            vsa_log_debugln("%s", strerror(errno));
+        }
+        close(fd);
+        return ret;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == map) {
+        vsa_log_debugln("%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    p = map;
+    end = map + st.st_size;
+
+    memcpy(&header, p, sizeof (header));
+    p += sizeof (header);
+    if (memcmp(header.magic, VSA_WAL_MAGIC, sizeof (VSA_WAL_MAGIC)) || VSA_WAL_VERSION != header.version
+        || sizeof (oid) != header.oid_size) {
+        vsa_log_debugln("%s: not a log of this vsa version", path);
+        munmap((void *) map, st.st_size);
+        close(fd);
+        return -1;
+    }
+
+    ret = 0;
+    while ((body = vsa_wal_next(&p, end, &len))) {
+        if (vsa_wal_decode(body, len, oids, &oids_len, &type, &payload, &payload_len)) {
+            vsa_log_debugln("%s: invalid record", path);
+            continue;
+        }
+
+        object = vsa_index_get(index, oids, oids_len);
+        if (!object || object->value->type != type) {
+            continue;
+        }
+
+        value = vsa_value_new_payload(type, payload, payload_len);
+        if (!value) {
+            ret = -1;
+            break;
+        }
+        vsa_value_free(object->value);
+        object->value = value;
+        (*applied)++;
+    }
+
+    if (!ret && p != end) {
+        vsa_log_warnln("%s: discarding a torn record of %zu bytes", path, (size_t) (end - p));
+        if (ftruncate(fd, p - map)) {
+            vsa_log_debugln("%s", strerror(errno));
+            ret = -1;
+        }
+    }
+
+    munmap((void *) map, st.st_size);
+    close(fd);
+
+    return ret;
+}
+
+// Appends the current value of object to the log. It doesn't wait for it to be written.
+int
+vsa_wal_append(vsa_wal_t * wal, vsa_object_t * object)
+{
+    guint32                 type;
+    guint64                 len;
+    size_t                  payload_len, offset;
+    const void             *payload;
+    vsa_wal_record_t        record;
+
+    if (vsa_value_get_payload(object->value, &payload, &payload_len)) {
+        return -1;
+    }
+    type = object->value->type;
+    record.len = sizeof (len) + object->tree->len * sizeof (oid) + sizeof (type) + sizeof (len) + payload_len;
+
+    g_mutex_lock(&wal->lock);
+    offset = wal->pending->len;
+    g_byte_array_set_size(wal->pending, offset + sizeof (record));
+    len = object->tree->len;
+    g_byte_array_append(wal->pending, (const guint8 *) &len, sizeof (len));
+    g_byte_array_append(wal->pending, (const guint8 *) object->tree->oids, object->tree->len * sizeof (oid));
+    g_byte_array_append(wal->pending, (const guint8 *) &type, sizeof (type));
+    len = payload_len;
+    g_byte_array_append(wal->pending, (const guint8 *) &len, sizeof (len));
+    g_byte_array_append(wal->pending, payload, payload_len);
+    record.check = vsa_wal_hash(wal->pending->data + offset + sizeof (record), record.len);
+    memcpy(wal->pending->data + offset, &record, sizeof (record));
+    if (!offset) {
+        g_cond_signal(&wal->cond);
+    }
+    g_mutex_unlock(&wal->lock);
+
+    return 0;
+}
+
+// A vsa_index_set_cb_t appending each committed SET to the log passed as data.
+void
+vsa_wal_set_cb(vsa_object_t * object, void *data)
+{
+    if (vsa_wal_append(data, object)) {
+        vsa_log_warnln(VSA_WAL_APPEND_ERROR_MSG);
+    }
+}
+
+/*
+ * Empties the log, SETs appended but not yet written included, for when the objects it applies to are replaced
+ * anyway, as on a reload.
+ */
+void
+vsa_wal_reset(vsa_wal_t * wal)
+{
+    g_mutex_lock(&wal->lock);
+    g_byte_array_set_size(wal->pending, 0);
+    wal->reset = 1;
+    g_cond_signal(&wal->cond);
+    g_mutex_unlock(&wal->lock);
+}
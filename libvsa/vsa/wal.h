@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_WAL_H
+#define VSA_WAL_H
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include <vsa/index.h>
+
+#define VSA_WAL_OPEN_ERROR_MSG "vsa_wal_open() failed"
+#define VSA_WAL_REPLAY_ERROR_MSG "vsa_wal_replay() failed"
+#define VSA_WAL_APPEND_ERROR_MSG "vsa_wal_append() failed"
+
+#define VSA_WAL_MAGIC "VSAWAL"
+#define VSA_WAL_VERSION 1
+
+// How long, in milliseconds, committed SETs wait by default for others to share their fsync.
+#define VSA_WAL_SYNC_INTERVAL 10
+
+// How much the log may grow past its last compacted size before being compacted again.
+#define VSA_WAL_COMPACT_SIZE (16 << 20)
+
+typedef struct vsa_wal_header_s vsa_wal_header_t;
+typedef struct vsa_wal_record_s vsa_wal_record_t;
+typedef struct vsa_wal_s vsa_wal_t;
+
+/*
+ * A log is this header followed by records, each one a vsa_wal_record_t followed by len bytes holding an object as a
+ * snapshot stores it: OID length and sub-identifiers, then value type, payload length and payload. check is the
+ * FNV-1a hash of those bytes, so that a record torn by a crash ends the log instead of being replayed.
+ */
+struct vsa_wal_header_s {
+    char                    magic[8];
+    guint32                 version;
+    guint32                 oid_size;
+};
+
+struct vsa_wal_record_s {
+    guint32                 len;
+    guint32                 check;
+};
+
+/*
+ * A write-ahead log of committed SETs. Records are appended to memory by the thread serving requests, which never
+ * waits on the disk, and a background thread writes them out and fsyncs them in batches: every SET committed within
+ * the same interval shares a single fsync, and a crash loses at most that interval. The same thread compacts the log
+ * down to the last value of each object once it grows by VSA_WAL_COMPACT_SIZE.
+ */
+struct vsa_wal_s {
+    char                   *path;
+    int                     fd;
+    unsigned                interval;
+    off_t                   size;
+    off_t                   compacted;
+    GByteArray             *pending;
+    GByteArray             *spare;
+    int                     reset;
+    int                     stopping;
+    GThread                *thread;
+    GMutex                  lock;
+    GCond                   cond;
+};
+
+vsa_wal_t              *vsa_wal_open(const char *path, unsigned interval);
+void                   *vsa_wal_close(vsa_wal_t * wal);
+int                     vsa_wal_replay(const char *path, vsa_index_t * index, size_t *applied);
+int                     vsa_wal_append(vsa_wal_t * wal, vsa_object_t * object);
+void                    vsa_wal_set_cb(vsa_object_t * object, void *data);
+void                    vsa_wal_reset(vsa_wal_t * wal);
+
+#endif // VSA_WAL_H
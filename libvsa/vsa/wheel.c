@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <vsa/wheel.h>
+
+#define VSA_WHEEL_SLOT(wheel, level, tick) \
+    (&(wheel)->slots[level][(tick) >> ((level) * VSA_WHEEL_BITS) & (VSA_WHEEL_SLOTS - 1)])
+
+static void             vsa_wheel_insert(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry);
+static void             vsa_wheel_tick(vsa_wheel_t * wheel, vsa_wheel_cb_t cb, void *data);
+
+// Puts the entry in the lowest level whose slots, from the next tick to run on, reach its expiry.
+static void
+vsa_wheel_insert(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry)
+{
+    vsa_wheel_entry_t     **slot;
+    guint64                 ticks;
+    int                     level;
+
+    if (entry->expires < wheel->now) {
+        entry->expires = wheel->now;
+    }
+    ticks = entry->expires - wheel->now;
+
+    for (level = 0; level < VSA_WHEEL_LEVELS - 1 && ticks >> ((level + 1) * VSA_WHEEL_BITS); level++);
+
+    slot = VSA_WHEEL_SLOT(wheel, level, entry->expires);
+    entry->next = *slot;
+    if (*slot) {
+        (*slot)->pprev = &entry->next;
+    }
+    entry->pprev = slot;
+    *slot = entry;
+}
+
+/*
+ * Runs the next tick. Whenever a level wraps around, the next slot of the level above is spread over the levels below,
+ * so that every entry reaches the lowest level by the tick it expires on.
+ */
+static void
+vsa_wheel_tick(vsa_wheel_t * wheel, vsa_wheel_cb_t cb, void *data)
+{
+    vsa_wheel_entry_t      *entry, *next, *expired, **slot;
+
+    for (int level = 1; level < VSA_WHEEL_LEVELS; level++) {
+        if (wheel->now & ((G_GUINT64_CONSTANT(1) << (level * VSA_WHEEL_BITS)) - 1)) {
+            break;
+        }
+        slot = VSA_WHEEL_SLOT(wheel, level, wheel->now);
+        for (entry = *slot, *slot = NULL; entry; entry = next) {
+            next = entry->next;
+            vsa_wheel_insert(wheel, entry);
+        }
+    }
+
+    // Moved to a list of their own, where callbacks may still remove them, so that entries added meanwhile wait.
+    slot = VSA_WHEEL_SLOT(wheel, 0, wheel->now);
+    expired = *slot;
+    *slot = NULL;
+    if (expired) {
+        expired->pprev = &expired;
+    }
+    wheel->now++;
+
+    while ((entry = expired)) {
+        vsa_wheel_remove(wheel, entry);
+        cb(entry, data);
+    }
+}
+
+guint64
+vsa_wheel_clock(void)
+{
+    struct timespec         ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+vsa_wheel_init(vsa_wheel_t * wheel)
+{
+    memset(wheel, 0, sizeof (*wheel));
+    wheel->now = vsa_wheel_clock();
+}
+
+// Makes the entry expire ticks milliseconds after now, the current vsa_wheel_clock().
+void
+vsa_wheel_add(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry, guint64 now, guint64 ticks)
+{
+    // An empty wheel has nothing to run up to now, so it jumps there.
+    if (!wheel->len && now > wheel->now) {
+        wheel->now = now;
+    }
+
+    entry->expires = now + ticks;
+    if (entry->expires > wheel->now + VSA_WHEEL_MAX_TICKS) {
+        entry->expires = wheel->now + VSA_WHEEL_MAX_TICKS;
+    }
+    vsa_wheel_insert(wheel, entry);
+    wheel->len++;
+}
+
+void
+vsa_wheel_remove(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry)
+{
+    *entry->pprev = entry->next;
+    if (entry->next) {
+        entry->next->pprev = entry->pprev;
+    }
+    entry->next = NULL;
+    entry->pprev = NULL;
+    wheel->len--;
+}
+
+// Calls cb with each entry expired by now, once removed from the wheel.
+void
+vsa_wheel_run(vsa_wheel_t * wheel, guint64 now, vsa_wheel_cb_t cb, void *data)
+{
+    while (wheel->len && wheel->now <= now) {
+        vsa_wheel_tick(wheel, cb, data);
+    }
+}
+
+// Calls cb with each entry, expired or not, once removed from the wheel.
+void
+vsa_wheel_clear(vsa_wheel_t * wheel, vsa_wheel_cb_t cb, void *data)
+{
+    vsa_wheel_entry_t      *entry;
+
+    for (int level = 0; level < VSA_WHEEL_LEVELS; level++) {
+        for (int i = 0; i < VSA_WHEEL_SLOTS; i++) {
+            while ((entry = wheel->slots[level][i])) {
+                vsa_wheel_remove(wheel, entry);
+                cb(entry, data);
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VSA_WHEEL_H
+#define VSA_WHEEL_H
+
+#include <glib.h>
+
+// Levels of slots, each slot of a level spanning all the slots of the level below, in 1 ms ticks.
+#define VSA_WHEEL_BITS 6
+#define VSA_WHEEL_SLOTS (1 << VSA_WHEEL_BITS)
+#define VSA_WHEEL_LEVELS 4
+
+// The furthest an entry can expire, about 4.6 hours. Later ones expire then.
+#define VSA_WHEEL_MAX_TICKS ((G_GUINT64_CONSTANT(1) << (VSA_WHEEL_BITS * VSA_WHEEL_LEVELS)) - 1)
+
+typedef struct vsa_wheel_entry_s vsa_wheel_entry_t;
+typedef struct vsa_wheel_s vsa_wheel_t;
+
+typedef void            (*vsa_wheel_cb_t) (vsa_wheel_entry_t * entry, void *data);
+
+// Embedded in what is timed, which data points to.
+struct vsa_wheel_entry_s {
+    vsa_wheel_entry_t      *next;
+    vsa_wheel_entry_t     **pprev;
+    guint64                 expires;
+    void                   *data;
+};
+
+/*
+ * A hierarchical timer wheel: adding, removing and expiring an entry take constant time, whatever the number of
+ * entries. now is the next tick to run, in milliseconds of vsa_wheel_clock().
+ */
+struct vsa_wheel_s {
+    vsa_wheel_entry_t      *slots[VSA_WHEEL_LEVELS][VSA_WHEEL_SLOTS];
+    guint64                 now;
+    size_t                  len;
+};
+
+guint64                 vsa_wheel_clock(void);
+void                    vsa_wheel_init(vsa_wheel_t * wheel);
+void                    vsa_wheel_add(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry, guint64 now, guint64 ticks);
+void                    vsa_wheel_remove(vsa_wheel_t * wheel, vsa_wheel_entry_t * entry);
+void                    vsa_wheel_run(vsa_wheel_t * wheel, guint64 now, vsa_wheel_cb_t cb, void *data);
+void                    vsa_wheel_clear(vsa_wheel_t * wheel, vsa_wheel_cb_t cb, void *data);
+
+#endif // VSA_WHEEL_H
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2022 Dalton Martins <daltonvlm@gmail.com>
+ *
+ * This file is part of Virtual SNMP Agent.
+ *
+ * Virtual SNMP Agent is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Virtual SNMP Agent is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Virtual SNMP Agent.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <vsa/dump.h>
+#include <vsa/log.h>
+#include <vsa/parser.h>
+#include <vsa/snapshot.h>
+#include <vsa/sort.h>
+
+typedef struct options_s options_t;
+typedef struct output_s output_t;
+
+struct options_s {
+    char                   *output;
+    vsa_dump_format_t       format;
+    size_t                  memory;
+    char                   *tmpdir;
+};
+
+struct output_s {
+    FILE                   *fp;
+    vsa_dump_format_t       format;
+    guint64                 len;
+};
+
+char                   *program_invocation_name = "vsa-sort";
+
+int                     write_cb(vsa_object_t * object, void *data);
+size_t                  parse_size(const char *str);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+int
+write_cb(vsa_object_t * object, void *data)
+{
+    int                     ret;
+    output_t               *output;
+
+    output = data;
+
+    if (VSA_DUMP_SNAPSHOT == output->format) {
+        ret = vsa_snapshot_write_object(output->fp, object);
+    } else {
+        ret = vsa_dump_write_object(output->fp, object);
+    }
+    vsa_object_free(object);
+    output->len++;
+
+    return ret;
+}
+
+size_t
+parse_size(const char *str)
+{
+    char                   *p;
+    unsigned long long      size;
+
+    errno = 0;
+    size = strtoull(str, &p, 10);
+    if (errno || p == str) {
+        vsa_logln(stderr, "invalid size '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+
+    switch (*p) {
+    case 'G':
+    case 'g':
+        size <<= 10;
+        // fall through
+    case 'M':
+    case 'm':
+        size <<= 10;
+        // fall through
+    case 'K':
+    case 'k':
+        size <<= 10;
+        p++;
+        break;
+
+    default:
+        break;
+    }
+
+    if (*p) {
+        vsa_logln(stderr, "invalid size '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+
+    return size;
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
+{
+    char                    c;
+    int                     index;
+
+    struct option           long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "version", no_argument, NULL, 'v' },
+        { "output", required_argument, NULL, 'o' },
+        { "format", required_argument, NULL, 'f' },
+        { "memory", required_argument, NULL, 'm' },
+        { "tmpdir", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, ":hvo:f:m:T:", long_options, &index)) != -1) {
+        switch (c) {
+        case 'h':
+            usage(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+            vsa_logln(stdout, PACKAGE_VERSION);
+            exit(EXIT_SUCCESS);
+
+        case 'o':
+            options->output = optarg;
+            break;
+
+        case 'f':
+            if (vsa_dump_format_from_str(optarg, &options->format)) {
+                vsa_logln(stderr, "invalid format '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'm':
+            options->memory = parse_size(optarg);
+            break;
+
+        case 'T':
+            options->tmpdir = optarg;
+            break;
+
+        default:
+            vsa_logln(stderr, "invalid option");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc) {
+        vsa_logln(stderr, "missing file name");
+        exit(EXIT_FAILURE);
+    }
+
+    // Its header, written last, holds the number of objects.
+    if (VSA_DUMP_SNAPSHOT == options->format && !options->output) {
+        vsa_logln(stderr, "snapshots must be written to an --output file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void
+usage(int status)
+{
+    FILE                   *out;
+
+    out = status ? stderr : stdout;
+
+    /* *INDENT-OFF* */
+    fprintf(out,
+"vsa-sort - sort and deduplicate SNMP walk outputs\n\n"
+
+"    vsa-sort is part of " PACKAGE_FULL_NAME " toolset\n\n\n"
+
+
+"Usage: vsa-sort [OPTION].. FILE..\n\n"
+
+"The vsa-sort program merges the objects of one or more walk outputs, possibly unordered and overlapping, into a single\n"
+"walk in OID order with one object per OID. When an OID appears more than once, the last occurrence wins: the last one\n"
+"in a file, and the one in the last file. Walks larger than memory are sorted in runs spilled to temporary files.\n\n\n"
+
+
+"OPTIONS\n\n"
+
+"        -h, --help           Print this help message.\n"
+"        -v, --version        Print version.\n\n"
+
+"        -o, --output=FILE    Write to FILE instead of the standard output, which then shows progress.\n"
+"        -f, --format=FORMAT  Write a walk (walk, the default) or a binary snapshot (snapshot).\n"
+"        -m, --memory=SIZE    Sort runs of up to SIZE bytes of objects in memory (default 256M). SIZE may be suffixed\n"
+"                             with K, M or G.\n"
+"        -T, --tmpdir=DIR     Spill runs to DIR instead of $TMPDIR or /tmp.\n\n\n"
+
+
+PACKAGE_COPYRIGHT "\n\n"
+            );
+    /* *INDENT-ON* */
+    exit(status);
+}
+
+void
+run(int argc, char *argv[])
+{
+    vsa_sort_t             *sort;
+    options_t               options = { NULL, VSA_DUMP_WALK, VSA_SORT_MEMORY, NULL };
+    output_t                output = { stdout, VSA_DUMP_WALK, 0 };
+
+    parse_args(argc, argv, &options);
+    // Info messages go to the standard output, so they would end up in the walk written there.
+    if (!options.output) {
+        vsa_log_set_level(VSA_LOG_LEVEL_WARN);
+    }
+
+    sort = vsa_sort_new(options.tmpdir, options.memory);
+    if (!sort) {
+        vsa_log_errorln(VSA_SORT_NEW_ERROR_MSG);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        vsa_log_infoln("reading %s", argv[i]);
+        if (vsa_parser_parse_mib_foreach(argv[i], vsa_sort_add_cb, sort)) {
+            vsa_log_errorln("%s: " VSA_PARSER_PARSE_MIB_ERROR_MSG, argv[i]);
+        }
+    }
+    vsa_log_infoln("%zu objects read, %u runs spilled", sort->nobjects, sort->runs->len);
+
+    if (options.output) {
+        output.fp = fopen(options.output, "w");
+        if (!output.fp) {
+            vsa_log_errorln("%s: %s", options.output, strerror(errno));
+        }
+    }
+    setvbuf(output.fp, NULL, _IOFBF, VSA_DUMP_BUFFER_SIZE);
+    output.format = options.format;
+
+    if (VSA_DUMP_SNAPSHOT == output.format) {
+        vsa_snapshot_write_header(output.fp, 0);
+    }
+    if (vsa_sort_finish(sort, write_cb, &output)) {
+        vsa_log_errorln(VSA_SORT_FINISH_ERROR_MSG);
+    }
+    if (VSA_DUMP_SNAPSHOT == output.format) {
+        rewind(output.fp);
+        vsa_snapshot_write_header(output.fp, output.len);
+    }
+
+    if (ferror(output.fp) || fflush(output.fp) || (options.output && fclose(output.fp))) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+
+    vsa_log_infoln("%" G_GUINT64_FORMAT " objects written, %zu duplicates dropped", output.len, sort->nduplicates);
+    vsa_sort_free(sort);
+}
+
+int
+main(int argc, char *argv[])
+{
+    run(argc, argv);
+    return EXIT_SUCCESS;
+}
@@ -20,9 +20,15 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -31,58 +37,1206 @@
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 #include <net-snmp/agent/mib_modules.h>
 
+#include <vsa/cache.h>
+#include <vsa/delay.h>
+#include <vsa/dump.h>
+#include <vsa/epoch.h>
+#include <vsa/expr.h>
+#include <vsa/filter.h>
+#include <vsa/handover.h>
+#include <vsa/index.h>
 #include <vsa/log.h>
 #include <vsa/object.h>
 #include <vsa/parser.h>
+#include <vsa/profile.h>
+#include <vsa/snapshot.h>
+#include <vsa/stats.h>
+#include <vsa/store.h>
+#include <vsa/transport.h>
+#include <vsa/trap.h>
+#include <vsa/usm.h>
+#include <vsa/wal.h>
 
 #define VSA_FILE "VSA_FILE"
 
+// Where a process taking over binds the agent before switching to the socket handed over to it.
+#define VSA_TAKEOVER_PORTS "udp:127.0.0.1:0"
+#define VSA_TAKEOVER_PORTS6 "udp6:[::1]:0"
+
+// Seconds between a subagent's attempts to reach its master, so that it reconnects to a restarted one.
+#define VSA_AGENTX_PING_INTERVAL 5
+
+// The vsa.conf lines that select the objects to load, as --include and --exclude do.
+#define VSA_INCLUDE_TOKEN "includeSubtree"
+#define VSA_EXCLUDE_TOKEN "excludeSubtree"
+
+typedef struct options_s options_t;
+typedef struct agent_s agent_t;
+typedef struct reload_s reload_t;
+typedef struct dump_s dump_t;
+typedef struct handover_s handover_t;
+
+struct options_s {
+    char                   *mib;
+    size_t                  cache_size;
+    char                   *handover;
+    char                   *listen;
+    char                   *stats_oid;
+    char                   *stats_socket;
+    int                     profile;
+    char                   *profile_file;
+    int                     log_sync;
+    char                   *dump;
+    vsa_dump_format_t       dump_format;
+    char                   *wal;
+    unsigned                wal_interval;
+    int                     agentx_master;
+    int                     subagent;
+    char                   *agentx_socket;
+    vsa_filter_t           *filter;
+    vsa_delay_t            *delay;
+    GPtrArray              *trap_sinks;
+    double                  trap_rate;
+    char                   *trap_schedule;
+    char                   *expressions;
+    int                     fast_v3;
+    char                   *store;
+};
+
+struct agent_s {
+    options_t               options;
+    vsa_index_t            *index;
+    vsa_cache_t            *cache;
+    vsa_stats_t            *stats;
+    reload_t               *reload;
+    dump_t                 *dump;
+    handover_t             *handover;
+    vsa_wal_t              *wal;
+    vsa_filter_t           *filter;
+    vsa_trap_t             *trap;
+    vsa_usm_t              *usm;
+    vsa_store_t            *store;
+    vsa_store_map_t        *map;
+    int                     handover_sock;
+    int                     handover_conn;
+    int                     handed_over;
+};
+
+/*
+ * A reload running in the background. Once the main thread has acked it, the reload thread frees the retired index,
+ * or the update if it wasn't swapped in, and the main thread joins it before the next reload or exiting. map is the
+ * store mapping of the update's objects until then, and that of the index freed after.
+ */
+struct reload_s {
+    agent_t                *agent;
+    GThread                *thread;
+    vsa_store_t            *store;
+    vsa_store_map_t        *map;
+    vsa_index_t            *index;
+    vsa_index_t            *update;
+    vsa_index_t            *retired;
+    vsa_index_diff_t        diff;
+    int                     acked;
+    int                     fds[2];
+    GMutex                  lock;
+    GCond                   cond;
+};
+
+/*
+ * A dump running in the background. The dump thread reads the index from inside an epoch, so that neither a reload
+ * nor SETs free what it is writing, and the main thread joins it once notified.
+ */
+struct dump_s {
+    agent_t                *agent;
+    GThread                *thread;
+    int                     ret;
+    int                     fds[2];
+};
+
+// A handover in progress. Its snapshot is written by a thread of its own as a dump is, requests being served meanwhile.
+struct handover_s {
+    agent_t                *agent;
+    GThread                *thread;
+    int                     snapshot;
+    int                     ret;
+    int                     fds[2];
+};
+
 char                   *program_invocation_name = PACKAGE_NAME;
 
-void                    object_register_cb(gpointer data, gpointer user_data);
-char                   *parse_args(int argc, char *argv[]);
-void                    usage(int status);
-void                    run(int argc, char *argv[]);
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t reload_requested;
+static volatile sig_atomic_t dump_requested;
+
+// The filter that vsa.conf rules are added to while it is read for them.
+static vsa_filter_t *config_filter;
+
+void                    stop_cb(int signum);
+void                    reload_cb(int signum);
+void                    reload_start(agent_t * agent);
+gpointer                reload_thread(gpointer data);
+void                    reload_done_cb(int fd, void *data);
+void                    reload_finish(agent_t * agent);
+void                    dump_cb(int signum);
+void                    dump_start(agent_t * agent);
+gpointer                dump_thread(gpointer data);
+void                    dump_done_cb(int fd, void *data);
+void                    dump_finish(agent_t * agent);
+int                     socket_family(int sock);
+GList                  *takeover(agent_t * agent, int *socks, size_t *nsocks);
+char                   *takeover_ports(const int *socks, size_t nsocks);
+void                    takeover_finish(agent_t * agent, const int *socks, size_t nsocks);
+void                    handover_listen(agent_t * agent);
+void                    handover_accept_cb(int fd, void *data);
+gpointer                handover_thread(gpointer data);
+void                    handover_written_cb(int fd, void *data);
+void                    handover_finish(agent_t * agent);
+void                    handover_ready_cb(int fd, void *data);
+void                    stats_start(agent_t * agent);
+void                    wal_start(agent_t * agent);
+void                    set_cb(vsa_object_t * object, void *data);
+void                    filter_start(agent_t * agent);
+GList                  *load_objects(agent_t * agent, vsa_store_map_t ** map);
+void                    trap_start(agent_t * agent);
+void                    usm_start(agent_t * agent);
+void                    filter_config_cb(const char *token, char *line);
+void                    profile_report(agent_t * agent, vsa_profile_t * profile);
+size_t                  parse_size(const char *str);
+void                    parse_rule(const char *str, vsa_filter_rule_t rule, options_t * options);
+void                    parse_delay(const char *str, int loss, options_t * options);
+void                    parse_args(int argc, char *argv[], options_t * options);
+void                    usage(int status);
+void                    run(int argc, char *argv[]);
+
+void
+stop_cb(int signum)
+{
+    (void) signum;
+    running = 0;
+}
+
+void
+reload_cb(int signum)
+{
+    (void) signum;
+    reload_requested = 1;
+}
+
+void
+reload_start(agent_t * agent)
+{
+    reload_t               *reload;
+    GError                 *gerror;
+
+    if (agent->reload) {
+        if (!agent->reload->acked) {
+            vsa_log_warnln("a reload is already in progress");
+            return;
+        }
+        reload_finish(agent);
+    }
+
+    reload = calloc(1, sizeof (reload_t));
+    if (!reload) {
+        vsa_log_warnln("%s", strerror(errno));
+        return;
+    }
+    reload->agent = agent;
+    reload->store = agent->store;
+    reload->index = agent->index;
+    g_mutex_init(&reload->lock);
+    g_cond_init(&reload->cond);
+
+    if (pipe2(reload->fds, O_CLOEXEC)) {
+        vsa_log_warnln("%s", strerror(errno));
+        free(reload);
+        return;
+    }
+    register_readfd(reload->fds[0], reload_done_cb, reload);
+
+    gerror = NULL;
+    reload->thread = g_thread_try_new("reload", reload_thread, reload, &gerror);
+    if (!reload->thread) {
+        vsa_log_warnln("%s", gerror->message);
+        g_error_free(gerror);
+        unregister_readfd(reload->fds[0]);
+        close(reload->fds[0]);
+        close(reload->fds[1]);
+        free(reload);
+        return;
+    }
+
+    agent->reload = reload;
+    vsa_log_infoln("reloading %s", agent->options.mib);
+}
+
+gpointer
+reload_thread(gpointer data)
+{
+    GList                  *objects;
+    reload_t               *reload;
+    vsa_index_t            *update;
+
+    reload = data;
+
+    update = NULL;
+    objects = load_objects(reload->agent, &reload->map);
+    if (!objects) {
+        vsa_log_warnln(VSA_PARSER_PARSE_MIB_ERROR_MSG);
+    } else {
+        update = vsa_index_new(objects);
+        if (!update) {
+            vsa_log_warnln(VSA_INDEX_NEW_ERROR_MSG);
+            g_list_free_full(objects, vsa_object_free_cb);
+        }
+    }
+
+    // Compiled again, for the objects of the update.
+    if (update && reload->agent->options.expressions
+        && vsa_expr_load(update, reload->agent->options.expressions)) {
+        vsa_log_warnln(VSA_EXPR_LOAD_ERROR_MSG);
+        update = vsa_index_free(update);
+    }
+
+    if (update && !vsa_epoch_enter()) {
+        vsa_index_diff(reload->index, update, &reload->diff);
+        vsa_epoch_exit();
+    }
+    vsa_epoch_unregister();
+
+    reload->update = update;
+    if (1 != write(reload->fds[1], "", 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    g_mutex_lock(&reload->lock);
+    while (!reload->acked) {
+        g_cond_wait(&reload->cond, &reload->lock);
+    }
+    g_mutex_unlock(&reload->lock);
+
+    // Requests still reading the replaced index must be done before it goes away, and its store file with it.
+    if (reload->retired) {
+        vsa_epoch_synchronize();
+        vsa_index_free(reload->retired);
+    } else if (update) {
+        vsa_index_free(update);
+    }
+    if (reload->store) {
+        vsa_store_release(reload->store, reload->map);
+    }
+
+    return NULL;
+}
+
+void
+reload_done_cb(int fd, void *data)
+{
+    char                    c;
+    agent_t                *agent;
+    reload_t               *reload;
+    vsa_index_t            *retired;
+    vsa_store_map_t        *map;
+
+    reload = data;
+    agent = reload->agent;
+
+    if (1 != read(fd, &c, 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+    unregister_readfd(fd);
+    close(fd);
+    reload->fds[0] = -1;
+
+    retired = NULL;
+    map = reload->map;
+    if (reload->update) {
+        retired = vsa_index_swap(agent->index, reload->update);
+    }
+    if (retired) {
+        map = agent->map;
+        agent->map = reload->map;
+        // A dump thread may be reading it.
+        g_atomic_pointer_set(&agent->index, reload->update);
+        if (agent->cache) {
+            vsa_cache_clear(agent->cache);
+        }
+        // The file being the reference again, SETs are forgotten rather than replayed over it on the next start.
+        if (agent->wal) {
+            vsa_wal_reset(agent->wal);
+        }
+        vsa_log_infoln("reloaded: %zu added, %zu removed, %zu changed, %zu unchanged", reload->diff.added,
+                       reload->diff.removed, reload->diff.changed, reload->diff.unchanged);
+    } else {
+        vsa_log_warnln("reload failed, keeping current objects");
+    }
+
+    g_mutex_lock(&reload->lock);
+    reload->retired = retired;
+    reload->map = map;
+    reload->acked = 1;
+    g_cond_signal(&reload->cond);
+    g_mutex_unlock(&reload->lock);
+}
+
+/*
+ * Waits for the reload thread and releases the reload. One that wasn't acked yet, as when exiting, is acked without
+ * taking its update, which the thread frees.
+ */
+void
+reload_finish(agent_t * agent)
+{
+    reload_t               *reload;
+
+    reload = agent->reload;
+
+    g_mutex_lock(&reload->lock);
+    reload->acked = 1;
+    g_cond_signal(&reload->cond);
+    g_mutex_unlock(&reload->lock);
+
+    g_thread_join(reload->thread);
+    if (-1 != reload->fds[0]) {
+        unregister_readfd(reload->fds[0]);
+        close(reload->fds[0]);
+    }
+    close(reload->fds[1]);
+    g_mutex_clear(&reload->lock);
+    g_cond_clear(&reload->cond);
+    free(reload);
+    agent->reload = NULL;
+}
+
+void
+dump_cb(int signum)
+{
+    (void) signum;
+    dump_requested = 1;
+}
+
+void
+dump_start(agent_t * agent)
+{
+    dump_t                 *dump;
+    GError                 *gerror;
+
+    if (!agent->options.dump) {
+        vsa_log_warnln("no dump file set, see --dump");
+        return;
+    }
+
+    if (agent->dump) {
+        vsa_log_warnln("a dump is already in progress");
+        return;
+    }
+
+    dump = calloc(1, sizeof (dump_t));
+    if (!dump) {
+        vsa_log_warnln("%s", strerror(errno));
+        return;
+    }
+    dump->agent = agent;
+
+    if (pipe2(dump->fds, O_CLOEXEC)) {
+        vsa_log_warnln("%s", strerror(errno));
+        free(dump);
+        return;
+    }
+    register_readfd(dump->fds[0], dump_done_cb, dump);
+
+    gerror = NULL;
+    dump->thread = g_thread_try_new("dump", dump_thread, dump, &gerror);
+    if (!dump->thread) {
+        vsa_log_warnln("%s", gerror->message);
+        g_error_free(gerror);
+        unregister_readfd(dump->fds[0]);
+        close(dump->fds[0]);
+        close(dump->fds[1]);
+        free(dump);
+        return;
+    }
+
+    agent->dump = dump;
+    vsa_log_infoln("dumping objects to %s", agent->options.dump);
+}
+
+// Writes to a temporary file renamed over the dump file, which thus never holds a partial dump.
+gpointer
+dump_thread(gpointer data)
+{
+    int                     fd;
+    char                   *path;
+    dump_t                 *dump;
+    options_t              *options;
+
+    dump = data;
+    options = &dump->agent->options;
+    dump->ret = -1;
+
+    path = g_strdup_printf("%s.%d", options->dump, getpid());
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        vsa_log_warnln("%s: %s", path, strerror(errno));
+    } else if (!vsa_epoch_enter()) {
+        dump->ret = vsa_dump_write(g_atomic_pointer_get(&dump->agent->index), fd, options->dump_format);
+        vsa_epoch_exit();
+        vsa_epoch_unregister();
+
+        if (close(fd)) {
+            vsa_log_warnln("%s: %s", path, strerror(errno));
+            dump->ret = -1;
+        }
+        if (!dump->ret && rename(path, options->dump)) {
+            vsa_log_warnln("%s: %s", options->dump, strerror(errno));
+            dump->ret = -1;
+        }
+        if (dump->ret) {
+            unlink(path);
+        }
+    } else {
+        vsa_log_warnln(VSA_EPOCH_ENTER_ERROR_MSG);
+        close(fd);
+        unlink(path);
+    }
+    g_free(path);
+
+    if (1 != write(dump->fds[1], "", 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+void
+dump_done_cb(int fd, void *data)
+{
+    char                    c;
+    dump_t                 *dump;
+
+    dump = data;
+    if (1 != read(fd, &c, 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    if (dump->ret) {
+        vsa_log_warnln("dump failed");
+    } else {
+        vsa_log_infoln("objects dumped to %s", dump->agent->options.dump);
+    }
+    dump_finish(dump->agent);
+}
+
+// Waits for the dump thread and releases the dump.
+void
+dump_finish(agent_t * agent)
+{
+    dump_t                 *dump;
+
+    dump = agent->dump;
+    g_thread_join(dump->thread);
+    unregister_readfd(dump->fds[0]);
+    close(dump->fds[0]);
+    close(dump->fds[1]);
+    free(dump);
+    agent->dump = NULL;
+}
+
+// The address family of a bound socket, or -1.
+int
+socket_family(int sock)
+{
+    struct sockaddr_storage addr;
+    socklen_t               len;
+
+    len = sizeof (addr);
+    if (getsockname(sock, (struct sockaddr *) &addr, &len)) {
+        return -1;
+    }
+
+    return addr.ss_family;
+}
+
+/*
+ * Connects to the process serving at the handover path and receives its objects snapshot and bound sockets. Returns
+ * NULL with *nsocks set to 0 when there's no process to take over from.
+ */
+GList                  *
+takeover(agent_t * agent, int *socks, size_t *nsocks)
+{
+    int                     conn, fds[VSA_HANDOVER_MAX_FDS];
+    size_t                  nfds;
+    GList                  *objects;
+
+    *nsocks = 0;
+
+    conn = vsa_handover_connect(agent->options.handover);
+    if (-1 == conn) {
+        if (ENOENT == errno || ECONNREFUSED == errno) {
+            return NULL;
+        }
+        vsa_log_errorln(VSA_HANDOVER_CONNECT_ERROR_MSG);
+    }
+
+    vsa_log_infoln("taking over from %s", agent->options.handover);
+    if (vsa_handover_receive(conn, fds, &nfds)) {
+        vsa_log_errorln(VSA_HANDOVER_RECEIVE_ERROR_MSG);
+    }
+    if (nfds < 2) {
+        vsa_log_errorln("expected a snapshot and sockets, got %zu descriptors", nfds);
+    }
+
+    objects = vsa_snapshot_read(fds[0]);
+    close(fds[0]);
+    if (!objects) {
+        vsa_log_errorln(VSA_SNAPSHOT_READ_ERROR_MSG);
+    }
+
+    agent->handover_conn = conn;
+    *nsocks = nfds - 1;
+    memcpy(socks, fds + 1, *nsocks * sizeof (int));
+
+    return objects;
+}
+
+/*
+ * The addresses the agent starts on before switching to the sockets handed over to it, which are still bound by the
+ * previous process: one of the same family per socket.
+ */
+char                   *
+takeover_ports(const int *socks, size_t nsocks)
+{
+    int                     family;
+    GString                *ports;
+
+    ports = g_string_new(NULL);
+    for (size_t i = 0; i < nsocks; i++) {
+        family = socket_family(socks[i]);
+        if (AF_INET != family && AF_INET6 != family) {
+            vsa_log_errorln("can't take over a socket of family %d", family);
+        }
+        g_string_append_printf(ports, "%s%s", i ? "," : "", AF_INET6 == family ? VSA_TAKEOVER_PORTS6 :
+                               VSA_TAKEOVER_PORTS);
+    }
+
+    return g_string_free(ports, FALSE);
+}
+
+// Switches the agent over to the sockets handed over to it, each onto a transport of its family, then lets the previous
+// process go.
+void
+takeover_finish(agent_t * agent, const int *socks, size_t nsocks)
+{
+    int                     used[VSA_HANDOVER_MAX_FDS];
+    size_t                  n, j;
+    netsnmp_transport      *transports[VSA_HANDOVER_MAX_FDS];
+
+    n = vsa_transport_get_agent(transports, G_N_ELEMENTS(transports));
+    if (n != nsocks) {
+        vsa_log_errorln("%zu sockets handed over for %zu transports", nsocks, n);
+    }
+
+    memset(used, 0, sizeof (used));
+    for (size_t i = 0; i < nsocks; i++) {
+        for (j = 0; j < n; j++) {
+            if (!used[j] && socket_family(transports[j]->sock) == socket_family(socks[i])) {
+                break;
+            }
+        }
+        if (j == n) {
+            vsa_log_errorln("no transport for a socket of family %d", socket_family(socks[i]));
+        }
+        if (-1 == dup2(socks[i], transports[j]->sock)) {
+            vsa_log_errorln("%s", strerror(errno));
+        }
+        close(socks[i]);
+        used[j] = 1;
+    }
+
+    if (1 != write(agent->handover_conn, "", 1)) {
+        vsa_log_errorln("%s", strerror(errno));
+    }
+    close(agent->handover_conn);
+    agent->handover_conn = -1;
+}
+
+void
+handover_listen(agent_t * agent)
+{
+    agent->handover_sock = vsa_handover_listen(agent->options.handover);
+    if (-1 == agent->handover_sock) {
+        vsa_log_errorln(VSA_HANDOVER_LISTEN_ERROR_MSG);
+    }
+    register_readfd(agent->handover_sock, handover_accept_cb, agent);
+}
+
+// Starts writing the snapshot for the new process that connected, the objects being sent along once it is written.
+void
+handover_accept_cb(int fd, void *data)
+{
+    int                     conn;
+    agent_t                *agent;
+    handover_t             *handover;
+    GError                 *gerror;
+
+    agent = data;
+
+    conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+    if (-1 == conn) {
+        vsa_log_warnln("%s", strerror(errno));
+        return;
+    }
+
+    if (-1 != agent->handover_conn) {
+        vsa_log_warnln("a handover is already in progress");
+        close(conn);
+        return;
+    }
+
+    handover = calloc(1, sizeof (handover_t));
+    if (!handover) {
+        vsa_log_warnln("%s", strerror(errno));
+        close(conn);
+        return;
+    }
+    handover->agent = agent;
+
+    handover->snapshot = memfd_create("vsa-snapshot", MFD_CLOEXEC);
+    if (-1 == handover->snapshot) {
+        vsa_log_warnln("%s", strerror(errno));
+        free(handover);
+        close(conn);
+        return;
+    }
+
+    if (pipe2(handover->fds, O_CLOEXEC)) {
+        vsa_log_warnln("%s", strerror(errno));
+        close(handover->snapshot);
+        free(handover);
+        close(conn);
+        return;
+    }
+    register_readfd(handover->fds[0], handover_written_cb, handover);
+
+    // The new process serves the snapshot: a SET applied after it is taken would be lost.
+    agent->index->readonly = 1;
+
+    gerror = NULL;
+    handover->thread = g_thread_try_new("handover", handover_thread, handover, &gerror);
+    if (!handover->thread) {
+        vsa_log_warnln("%s", gerror->message);
+        g_error_free(gerror);
+        agent->index->readonly = 0;
+        unregister_readfd(handover->fds[0]);
+        close(handover->fds[0]);
+        close(handover->fds[1]);
+        close(handover->snapshot);
+        free(handover);
+        close(conn);
+        return;
+    }
+
+    vsa_log_infoln("handing over to a new process");
+    agent->handover = handover;
+    agent->handover_conn = conn;
+}
+
+// Reads the index from inside an epoch, as the dump thread does.
+gpointer
+handover_thread(gpointer data)
+{
+    handover_t             *handover;
+
+    handover = data;
+    handover->ret = -1;
+
+    if (!vsa_epoch_enter()) {
+        handover->ret = vsa_snapshot_write(g_atomic_pointer_get(&handover->agent->index), handover->snapshot);
+        vsa_epoch_exit();
+        vsa_epoch_unregister();
+    } else {
+        vsa_log_warnln(VSA_EPOCH_ENTER_ERROR_MSG);
+    }
+
+    if (1 != write(handover->fds[1], "", 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+// Sends the snapshot written and every socket the agent receives requests on to the new process.
+void
+handover_written_cb(int fd, void *data)
+{
+    char                    c;
+    int                     fds[VSA_HANDOVER_MAX_FDS], ret;
+    size_t                  n;
+    agent_t                *agent;
+    handover_t             *handover;
+    netsnmp_transport      *transports[VSA_HANDOVER_MAX_FDS - 1];
+
+    handover = data;
+    agent = handover->agent;
+    if (1 != read(fd, &c, 1)) {
+        vsa_log_warnln("%s", strerror(errno));
+    }
+
+    ret = handover->ret;
+    if (ret) {
+        vsa_log_warnln(VSA_SNAPSHOT_WRITE_ERROR_MSG);
+    } else {
+        n = vsa_transport_get_agent(transports, G_N_ELEMENTS(transports));
+        if (!n || n > G_N_ELEMENTS(transports)) {
+            vsa_log_warnln("can't hand %zu sockets over", n);
+            ret = -1;
+        } else {
+            fds[0] = handover->snapshot;
+            for (size_t i = 0; i < n; i++) {
+                fds[i + 1] = transports[i]->sock;
+            }
+            ret = vsa_handover_send(agent->handover_conn, fds, n + 1);
+            if (ret) {
+                vsa_log_warnln(VSA_HANDOVER_SEND_ERROR_MSG);
+            }
+        }
+    }
+    handover_finish(agent);
+
+    if (ret) {
+        vsa_log_warnln("handover aborted, still serving");
+        agent->index->readonly = 0;
+        close(agent->handover_conn);
+        agent->handover_conn = -1;
+        return;
+    }
+    register_readfd(agent->handover_conn, handover_ready_cb, agent);
+}
+
+// Waits for the handover thread and releases the handover, but not its connection.
+void
+handover_finish(agent_t * agent)
+{
+    handover_t             *handover;
+
+    handover = agent->handover;
+    g_thread_join(handover->thread);
+    unregister_readfd(handover->fds[0]);
+    close(handover->fds[0]);
+    close(handover->fds[1]);
+    close(handover->snapshot);
+    free(handover);
+    agent->handover = NULL;
+}
+
+// The new process writes a byte once it serves the socket, or closes the connection if it failed to take over.
+void
+handover_ready_cb(int fd, void *data)
+{
+    char                    c;
+    agent_t                *agent;
+
+    agent = data;
+
+    unregister_readfd(fd);
+    if (1 == read(fd, &c, 1)) {
+        vsa_log_infoln("the new process is serving, exiting");
+        agent->handed_over = 1;
+        running = 0;
+    } else {
+        vsa_log_warnln("handover aborted, still serving");
+        agent->index->readonly = 0;
+    }
+    close(fd);
+    agent->handover_conn = -1;
+}
+
+void
+stats_start(agent_t * agent)
+{
+    oid                    *root;
+    size_t                  len;
+    netsnmp_transport      *transport;
+
+    transport = vsa_transport_get_main();
+    if (!transport) {
+        vsa_log_errorln(VSA_TRANSPORT_GET_MAIN_ERROR_MSG);
+    }
+
+    agent->stats = vsa_stats_new();
+    if (!agent->stats) {
+        vsa_log_errorln(VSA_STATS_NEW_ERROR_MSG);
+    }
+    agent->stats->index = &agent->index;
+    if (vsa_stats_attach(agent->stats, main_session, transport)) {
+        vsa_log_errorln(VSA_STATS_ATTACH_ERROR_MSG);
+    }
+
+    if (agent->options.stats_oid) {
+        root = vsa_parser_parse_oid(agent->options.stats_oid, &len);
+        if (!root) {
+            vsa_log_errorln("invalid OID '%s'", agent->options.stats_oid);
+        }
+        if (vsa_stats_register(agent->stats, root, len)) {
+            vsa_log_errorln(VSA_STATS_REGISTER_ERROR_MSG);
+        }
+        free(root);
+        vsa_log_infoln("serving statistics under %s", agent->options.stats_oid);
+    }
+
+    if (agent->options.stats_socket) {
+        if (vsa_stats_listen(agent->stats, agent->options.stats_socket)) {
+            vsa_log_errorln(VSA_STATS_LISTEN_ERROR_MSG);
+        }
+        vsa_log_infoln("serving statistics on %s", agent->options.stats_socket);
+    }
+}
+
+// Replays the SETs logged by previous runs over the objects, then logs new ones.
+void
+wal_start(agent_t * agent)
+{
+    size_t                  applied;
+
+    if (vsa_wal_replay(agent->options.wal, agent->index, &applied)) {
+        vsa_log_errorln(VSA_WAL_REPLAY_ERROR_MSG);
+    }
+    vsa_log_infoln("%zu SETs replayed from %s", applied, agent->options.wal);
+
+    agent->wal = vsa_wal_open(agent->options.wal, agent->options.wal_interval);
+    if (!agent->wal) {
+        vsa_log_errorln(VSA_WAL_OPEN_ERROR_MSG);
+    }
+    agent->index->set_cb = set_cb;
+    agent->index->set_data = agent;
+}
+
+// Logs a SET applied to the objects and drops the cached responses it made stale, whichever transport it came in on.
+void
+set_cb(vsa_object_t * object, void *data)
+{
+    agent_t                *agent;
+
+    agent = data;
+    if (agent->wal) {
+        vsa_wal_set_cb(object, agent->wal);
+    }
+    if (agent->cache) {
+        vsa_cache_clear(agent->cache);
+    }
+}
+
+/*
+ * Builds the notifications from the objects as they are now, those of the --trap-schedule file or else linkDown and
+ * linkUp for each interface, and starts sending them from their own thread. The sinks are only opened once
+ * init_snmp() has set up the SNMPv3 users and engine ID.
+ */
+void
+trap_start(agent_t * agent)
+{
+    agent->trap = vsa_trap_new();
+    if (!agent->trap) {
+        vsa_log_errorln(VSA_TRAP_NEW_ERROR_MSG);
+    }
+
+    for (guint i = 0; i < agent->options.trap_sinks->len; i++) {
+        if (vsa_trap_add_sink(agent->trap, g_ptr_array_index(agent->options.trap_sinks, i))) {
+            vsa_log_errorln(VSA_TRAP_ADD_SINK_ERROR_MSG);
+        }
+    }
+
+    if (agent->options.trap_schedule) {
+        if (vsa_trap_load_schedule(agent->trap, agent->index, agent->options.trap_schedule)) {
+            vsa_log_errorln(VSA_TRAP_LOAD_SCHEDULE_ERROR_MSG);
+        }
+    } else if (vsa_trap_add_links(agent->trap, agent->index)) {
+        vsa_log_errorln(VSA_TRAP_ADD_LINKS_ERROR_MSG);
+    }
+
+    if (vsa_trap_start(agent->trap, agent->options.trap_rate)) {
+        vsa_log_errorln(VSA_TRAP_START_ERROR_MSG);
+    }
+    vsa_log_infoln("sending %u notifications to %u sinks", agent->trap->templates->len, agent->trap->sinks->len);
+}
 
+// Serves the SNMPv3 requests it can from the index, the users being those init_snmp() has read from vsa.conf.
 void
-object_register_cb(gpointer data, gpointer user_data)
+usm_start(agent_t * agent)
 {
-    static char             buf[BUFSIZ];
-    int                     nchars;
-    static unsigned         count = 1;
-    unsigned               *pnobjects;
+    netsnmp_transport      *transport;
+
+    transport = vsa_transport_get_main();
+    if (!transport) {
+        vsa_log_errorln(VSA_TRANSPORT_GET_MAIN_ERROR_MSG);
+    }
+
+    agent->usm = vsa_usm_new();
+    if (!agent->usm) {
+        vsa_log_errorln(VSA_USM_NEW_ERROR_MSG);
+    }
+    agent->usm->index = &agent->index;
+    if (vsa_usm_attach(agent->usm, transport)) {
+        vsa_log_errorln(VSA_USM_ATTACH_ERROR_MSG);
+    }
+}
 
-    pnobjects = (unsigned *) user_data;
+/*
+ * Builds the filter of the objects to load from the rules of vsa.conf and those of the command line, which take
+ * precedence. vsa.conf is read for them here, since the objects are loaded before init_snmp() reads it.
+ */
+void
+filter_start(agent_t * agent)
+{
+    char                   *dirs, *dir, *saveptr, *path;
+    int                     warnings;
+    const char             *suffixes[] = { ".conf", ".local.conf" };
 
-    nchars = snprintf(buf, sizeof (buf), "%u / %u registered", count, *pnobjects);
-    vsa_log_info("%s\r", buf);
+    agent->filter = vsa_filter_new();
+    if (!agent->filter) {
+        vsa_log_errorln(VSA_FILTER_NEW_ERROR_MSG);
+    }
 
-    if (-1 == vsa_object_register(data)) {
-        char                   *object_str;
+    register_config_handler(program_invocation_name, VSA_INCLUDE_TOKEN, filter_config_cb, NULL, "OID");
+    register_config_handler(program_invocation_name, VSA_EXCLUDE_TOKEN, filter_config_cb, NULL, "OID");
 
-        object_str = vsa_object_to_str(data);
-        if (!object_str) {
-            vsa_log_warnln(VSA_OBJECT_TO_STR_ERROR_MSG);
+    // Same search path as net-snmp. Its own tokens aren't registered yet, so they aren't reported as unknown.
+    warnings = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NO_TOKEN_WARNINGS);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NO_TOKEN_WARNINGS, 1);
+    config_filter = agent->filter;
+    dirs = g_strdup(get_configuration_directory());
+    for (dir = strtok_r(dirs, ENV_SEPARATOR, &saveptr); dir; dir = strtok_r(NULL, ENV_SEPARATOR, &saveptr)) {
+        for (size_t i = 0; i < G_N_ELEMENTS(suffixes); i++) {
+            path = g_strconcat(dir, "/", program_invocation_name, suffixes[i], NULL);
+            if (!access(path, R_OK)) {
+                read_config_with_type(path, program_invocation_name);
+            }
+            g_free(path);
         }
-        vsa_log_warnln(VSA_OBJECT_REGISTER_ERROR_MSG " for '%s'", object_str ? object_str : "(?)");
     }
+    g_free(dirs);
+    config_filter = NULL;
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NO_TOKEN_WARNINGS, warnings);
 
-    if (count == *pnobjects) {
-        memset(buf, ' ', nchars);
-        vsa_log_infoln("done%s\r", buf);
+    if (agent->options.filter && vsa_filter_merge(agent->filter, agent->options.filter)) {
+        vsa_log_errorln(VSA_FILTER_MERGE_ERROR_MSG);
+    }
+    // The store holds whole walks, filtered as they are loaded from it.
+    if (!vsa_filter_is_empty(agent->filter) && !agent->options.store) {
+        vsa_parser_set_filter(agent->filter);
     }
-    count++;
 }
 
-char                   *
-parse_args(int argc, char *argv[])
+void
+filter_config_cb(const char *token, char *line)
+{
+    size_t                  len;
+    oid                    *oids;
+
+    // The rules are only taken from the first read, init_snmp() reading vsa.conf again once the objects are loaded.
+    if (!config_filter) {
+        return;
+    }
+
+    oids = vsa_parser_parse_oid(g_strstrip(line), &len);
+    if (!oids || !len || len > MAX_OID_LEN) {
+        config_perror("invalid OID");
+        free(oids);
+        return;
+    }
+    if (vsa_filter_add(config_filter, strcmp(token, VSA_INCLUDE_TOKEN) ? VSA_FILTER_EXCLUDE : VSA_FILTER_INCLUDE, oids,
+                       len)) {
+        vsa_log_errorln(VSA_FILTER_ADD_ERROR_MSG);
+    }
+    free(oids);
+}
+
+// The objects of the walk file, parsed or loaded from the store.
+GList                  *
+load_objects(agent_t * agent, vsa_store_map_t ** map)
+{
+    *map = NULL;
+    if (!agent->store) {
+        return vsa_parser_parse_mib(agent->options.mib);
+    }
+
+    return vsa_store_load(agent->store, agent->options.mib, vsa_filter_is_empty(agent->filter) ? NULL : agent->filter,
+                          map);
+}
+
+void
+profile_report(agent_t * agent, vsa_profile_t * profile)
+{
+    char                   *json;
+    FILE                   *fp;
+
+    if (!agent->options.profile_file) {
+        vsa_profile_print(profile, stderr);
+        return;
+    }
+
+    json = vsa_profile_to_json(profile);
+    fp = fopen(agent->options.profile_file, "w");
+    if (!fp) {
+        vsa_log_warnln("couldn't open %s: %s", agent->options.profile_file, strerror(errno));
+        free(json);
+        return;
+    }
+    fputs(json, fp);
+    if (fclose(fp)) {
+        vsa_log_warnln("couldn't write %s: %s", agent->options.profile_file, strerror(errno));
+    }
+    free(json);
+}
+
+size_t
+parse_size(const char *str)
+{
+    char                   *p;
+    unsigned long long      size;
+
+    errno = 0;
+    size = strtoull(str, &p, 10);
+    if (errno || p == str) {
+        vsa_logln(stderr, "invalid size '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+
+    switch (*p) {
+    case 'G':
+    case 'g':
+        size <<= 10;
+        // fall through
+    case 'M':
+    case 'm':
+        size <<= 10;
+        // fall through
+    case 'K':
+    case 'k':
+        size <<= 10;
+        p++;
+        break;
+
+    default:
+        break;
+    }
+
+    if (*p) {
+        vsa_logln(stderr, "invalid size '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+
+    return size;
+}
+
+void
+parse_rule(const char *str, vsa_filter_rule_t rule, options_t * options)
+{
+    size_t                  len;
+    oid                    *oids;
+
+    oids = vsa_parser_parse_oid(str, &len);
+    if (!oids || !len || len > MAX_OID_LEN) {
+        vsa_logln(stderr, "invalid OID '%s'", str);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!options->filter) {
+        options->filter = vsa_filter_new();
+        if (!options->filter) {
+            vsa_log_errorln(VSA_FILTER_NEW_ERROR_MSG);
+        }
+    }
+    if (vsa_filter_add(options->filter, rule, oids, len)) {
+        vsa_log_errorln(VSA_FILTER_ADD_ERROR_MSG);
+    }
+    free(oids);
+}
+
+// [OID=]SPEC, the latency or loss of the responses under OID, or of all of them.
+void
+parse_delay(const char *str, int loss, options_t * options)
+{
+    const char             *spec;
+    char                   *root, *p;
+    size_t                  len;
+    oid                    *oids;
+    double                  percent;
+
+    spec = strchr(str, '=');
+    if (spec) {
+        root = g_strndup(str, spec - str);
+        oids = vsa_parser_parse_oid(root, &len);
+        if (!oids || !len || len > MAX_OID_LEN) {
+            vsa_logln(stderr, "invalid OID '%s'", root);
+            exit(EXIT_FAILURE);
+        }
+        g_free(root);
+        spec++;
+    } else {
+        oids = NULL;
+        len = 0;
+        spec = str;
+    }
+
+    if (!options->delay) {
+        options->delay = vsa_delay_new(VSA_DELAY_MAX_PENDING);
+        if (!options->delay) {
+            vsa_log_errorln(VSA_DELAY_NEW_ERROR_MSG);
+        }
+    }
+
+    if (loss) {
+        percent = strtod(spec, &p);
+        if ('%' == *p) {
+            p++;
+        }
+        if (p == spec || *p || vsa_delay_set_loss(options->delay, oids, len, percent / 100)) {
+            vsa_logln(stderr, "invalid loss '%s'", spec);
+            exit(EXIT_FAILURE);
+        }
+    } else if (vsa_delay_set_latency(options->delay, oids, len, spec)) {
+        vsa_logln(stderr, "invalid delay '%s'", spec);
+        exit(EXIT_FAILURE);
+    }
+    free(oids);
+}
+
+void
+parse_args(int argc, char *argv[], options_t * options)
 {
-    char                    c, *mib;
+    char                    c, *mib, *p;
     int                     index;
+    unsigned long           interval;
+    double                  rate;
+    vsa_log_level_t         level;
 
-    struct option           options[] = {
+    struct option           long_options[] = {
         { "help", no_argument, NULL, 'h' },
         { "version", no_argument, NULL, 'v' },
+        { "cache", required_argument, NULL, 'C' },
+        { "handover", required_argument, NULL, 'H' },
+        { "listen", required_argument, NULL, 'l' },
+        { "stats-oid", optional_argument, NULL, 'O' },
+        { "stats-socket", required_argument, NULL, 'S' },
+        { "profile-startup", optional_argument, NULL, 'P' },
+        { "log-level", required_argument, NULL, 'L' },
+        { "log-sync", no_argument, NULL, 's' },
+        { "dump", required_argument, NULL, 'd' },
+        { "dump-format", required_argument, NULL, 'D' },
+        { "wal", required_argument, NULL, 'w' },
+        { "wal-interval", required_argument, NULL, 'W' },
+        { "agentx-master", optional_argument, NULL, 'X' },
+        { "agentx", optional_argument, NULL, 'x' },
+        { "shard", required_argument, NULL, 't' },
+        { "include", required_argument, NULL, 'i' },
+        { "exclude", required_argument, NULL, 'e' },
+        { "delay", required_argument, NULL, 'y' },
+        { "loss", required_argument, NULL, 'z' },
+        { "trap-sink", required_argument, NULL, 'T' },
+        { "trap-rate", required_argument, NULL, 'r' },
+        { "trap-schedule", required_argument, NULL, 'R' },
+        { "expressions", required_argument, NULL, 'E' },
+        { "fast-v3", no_argument, NULL, 'F' },
+        { "store", optional_argument, NULL, 'm' },
         { NULL, 0, NULL, 0 }
     };
 
@@ -92,7 +1246,8 @@ parse_args(int argc, char *argv[])
         usage(EXIT_FAILURE);
     }
 
-    while ((c = getopt_long(argc, argv, ":hv", options, &index)) != -1) {
+    while ((c = getopt_long(argc, argv, ":hvC:H:l:O::S:P::L:sd:D:w:W:X::x::t:i:e:y:z:T:r:R:E:Fm::", long_options,
+                            &index)) != -1) {
         switch (c) {
         case 'h':
             usage(EXIT_SUCCESS);
@@ -102,6 +1257,125 @@ parse_args(int argc, char *argv[])
             vsa_logln(stdout, PACKAGE_VERSION);
             exit(EXIT_SUCCESS);
 
+        case 'C':
+            options->cache_size = parse_size(optarg);
+            break;
+
+        case 'H':
+            options->handover = optarg;
+            break;
+
+        case 'l':
+            options->listen = optarg;
+            break;
+
+        case 'O':
+            options->stats_oid = optarg ? optarg : VSA_STATS_ROOT;
+            break;
+
+        case 'S':
+            options->stats_socket = optarg;
+            break;
+
+        case 'P':
+            options->profile = 1;
+            options->profile_file = optarg;
+            break;
+
+        case 'L':
+            if (vsa_log_level_from_str(optarg, &level)) {
+                vsa_logln(stderr, "invalid log level '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            vsa_log_set_level(level);
+            break;
+
+        case 's':
+            options->log_sync = 1;
+            break;
+
+        case 'd':
+            options->dump = optarg;
+            break;
+
+        case 'D':
+            if (vsa_dump_format_from_str(optarg, &options->dump_format)) {
+                vsa_logln(stderr, "invalid dump format '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'w':
+            options->wal = optarg;
+            break;
+
+        case 'W':
+            errno = 0;
+            interval = strtoul(optarg, &p, 10);
+            if (errno || p == optarg || *p || interval > G_MAXUINT) {
+                vsa_logln(stderr, "invalid interval '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            options->wal_interval = interval;
+            break;
+
+        case 'X':
+            options->agentx_master = 1;
+            options->agentx_socket = optarg;
+            break;
+
+        case 'x':
+            options->subagent = 1;
+            options->agentx_socket = optarg;
+            break;
+
+        case 't':
+        case 'i':
+            parse_rule(optarg, VSA_FILTER_INCLUDE, options);
+            break;
+
+        case 'e':
+            parse_rule(optarg, VSA_FILTER_EXCLUDE, options);
+            break;
+
+        case 'y':
+        case 'z':
+            parse_delay(optarg, 'z' == c, options);
+            break;
+
+        case 'T':
+            if (!options->trap_sinks) {
+                options->trap_sinks = g_ptr_array_new();
+            }
+            g_ptr_array_add(options->trap_sinks, optarg);
+            break;
+
+        case 'r':
+            errno = 0;
+            rate = strtod(optarg, &p);
+            if (errno || p == optarg || *p || !(rate > 0)) {
+                vsa_logln(stderr, "invalid rate '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            options->trap_rate = rate;
+            break;
+
+        case 'R':
+            options->trap_schedule = optarg;
+            break;
+
+        case 'E':
+            options->expressions = optarg;
+            break;
+
+        case 'F':
+            options->fast_v3 = 1;
+            break;
+
+        case 'm':
+            options->store = optarg ? optarg : VSA_STORE_DIR;
+            break;
+
         default:
             vsa_logln(stderr, "invalid option");
             exit(EXIT_FAILURE);
@@ -113,7 +1387,44 @@ parse_args(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    return argv[optind];
+    options->mib = argv[optind];
+
+    if (options->subagent && options->agentx_master) {
+        vsa_logln(stderr, "--agentx and --agentx-master are exclusive");
+        exit(EXIT_FAILURE);
+    }
+    // Those work on the SNMP socket, which a subagent doesn't have.
+    if (options->subagent && (options->cache_size || options->handover || options->listen || options->stats_oid
+                              || options->stats_socket || options->delay || options->fast_v3)) {
+        vsa_logln(stderr,
+                  "--cache, --delay, --fast-v3, --handover, --listen, --loss and --stats-* don't apply to --agentx");
+        exit(EXIT_FAILURE);
+    }
+    // Cache hits are answered as requests come in, never going through the delays.
+    if (options->cache_size && options->delay) {
+        vsa_logln(stderr, "--cache and --delay/--loss are exclusive");
+        exit(EXIT_FAILURE);
+    }
+    // Cached responses would keep the values computed when they were cached.
+    if (options->cache_size && options->expressions) {
+        vsa_logln(stderr, "--cache and --expressions are exclusive");
+        exit(EXIT_FAILURE);
+    }
+#ifndef VSA_OPENSSL
+    if (options->fast_v3) {
+        vsa_logln(stderr, "--fast-v3 requires " PACKAGE " to be built with OpenSSL");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    // The fast path only sees the index: GETNEXTs would skip the other subtrees, and responses the delays.
+    if (options->fast_v3 && (options->stats_oid || options->agentx_master || options->delay)) {
+        vsa_logln(stderr, "--fast-v3 and --agentx-master/--delay/--loss/--stats-oid are exclusive");
+        exit(EXIT_FAILURE);
+    }
+    if (!options->trap_sinks != !(options->trap_rate > 0 || options->trap_schedule)) {
+        vsa_logln(stderr, "--trap-sink needs --trap-rate or --trap-schedule, and they need --trap-sink");
+        exit(EXIT_FAILURE);
+    }
 }
 
 void
@@ -140,11 +1451,112 @@ PACKAGE " - run virtual copies of SNMP agents from their SNMP walk outputs\n\n"
 "OPTIONS\n\n"
 
 "        -h, --help         Print this help message.\n"
-"        -v, --version      Print version.\n\n\n"
+"        -v, --version      Print version.\n\n"
+
+"        -C, --cache=SIZE   Cache up to SIZE bytes of encoded responses to repeated SNMPv1/v2c GET requests. SIZE may\n"
+"                           be suffixed with K, M or G. Entries are invalidated by SETs and the least recently used\n"
+"                           ones are evicted first. Disabled by default.\n\n"
+
+"        -l, --listen=ADDRESS\n"
+"                           Listen on ADDRESS, in net-snmp address syntax (e.g. udp:127.0.0.1:1161), instead of the\n"
+"                           agentaddress set in " PACKAGE ".conf or port 161.\n\n"
+
+"        -H, --handover=PATH\n"
+"                           Listen on the Unix socket PATH for a new " PACKAGE " process to hand the agent over to. When a\n"
+"                           process is already listening on PATH, take over its sockets and objects instead of parsing\n"
+"                           FILE, and make it exit once this one is serving.\n\n"
+
+"        -O, --stats-oid[=OID]\n"
+"                           Serve request, traffic and latency statistics as scalars under OID, which defaults to\n"
+"                           " VSA_STATS_ROOT ".\n\n"
+
+"        -S, --stats-socket=PATH\n"
+"                           Write the same statistics as a JSON object to every client connecting to the Unix socket\n"
+"                           PATH.\n\n"
+
+"        -P, --profile-startup[=FILE]\n"
+"                           Measure the wall time, CPU time, heap and resident memory growth of each startup\n"
+"                           phase and count the objects loaded per type. The report is printed once " PACKAGE " is\n"
+"                           serving, or written to FILE as JSON.\n\n"
+
+"        -L, --log-level=LEVEL\n"
+"                           Log messages up to LEVEL: error, warn, info or debug (the default).\n\n"
+
+"        -s, --log-sync     Write log messages as they are logged instead of from a background thread.\n\n"
+
+"        -d, --dump=PATH    Write the current objects, SET values included, to PATH on SIGUSR1.\n\n"
+
+"        -D, --dump-format=FORMAT\n"
+"                           Dump objects as a walk that " PACKAGE " can load (walk, the default) or as a binary\n"
+"                           snapshot (snapshot).\n\n"
+
+"        -w, --wal=PATH     Log committed SETs to PATH and replay them over the objects of FILE on start, so that they\n"
+"                           survive restarts. A reload discards them.\n\n"
+
+"        -W, --wal-interval=MS\n"
+"                           Write and fsync logged SETs in batches, at most MS milliseconds after the first SET of a\n"
+"                           batch (default: " G_STRINGIFY(VSA_WAL_SYNC_INTERVAL) "). A crash loses at most that much.\n\n"
+
+"        -i, --include=OID  Load only the objects under OID and the other included OIDs. May be given more than once.\n\n"
+
+"        -e, --exclude=OID  Don't load the objects under OID. May be given more than once. An object follows the longest\n"
+"                           included or excluded OID it is under. The " VSA_INCLUDE_TOKEN " OID and " VSA_EXCLUDE_TOKEN " OID lines\n"
+"                           of " PACKAGE ".conf add to those, the command line taking precedence on the same OID.\n\n"
+
+"        -t, --shard=OID    Load and serve only the objects under OID, as --include does. May be given more than once.\n\n"
+
+"        -y, --delay=[OID=]MS|MIN-MAX|MEAN~STDDEV|~MEAN\n"
+"                           Hold responses for a fixed, uniform, normal or exponential random number of milliseconds,\n"
+"                           without blocking other requests. With OID, only those whose first varbind is under it, the\n"
+"                           longest OID applying. May be given more than once. Excludes --cache.\n\n"
+
+"        -z, --loss=[OID=]PERCENT\n"
+"                           Drop PERCENT of the responses, or of those under OID as for --delay.\n\n"
+
+"        -T, --trap-sink=ARGS\n"
+"                           Send notifications to the sink that ARGS gives as snmpd.conf's trapsess does, e.g.\n"
+"                           \"-v 2c -c public 10.0.0.1:162\", -Ci sending informs and retrying them. SNMPv2c and SNMPv3,\n"
+"                           which needs a net-snmp built with --enable-reentrant. May be given more than once.\n\n"
+
+"        -r, --trap-rate=N  Send N notifications per second, cycling through the --trap-schedule ones or else a linkDown\n"
+"                           and a linkUp for each ifIndex object. Their varbinds have the values of the objects at start.\n\n"
+
+"        -R, --trap-schedule=FILE\n"
+"                           Send the notifications of FILE, whose OFFSET NOTIFICATION [OBJECT]... lines send the\n"
+"                           NOTIFICATION OID with the OBJECT varbinds OFFSET milliseconds after start.\n\n"
+
+"        -E, --expressions=FILE\n"
+"                           Serve the values that the OID = EXPRESSION lines of FILE compute when read, an OID that\n"
+"                           isn't an object applying to each object under it. Excludes --cache.\n\n"
+
+"        -F, --fast-v3      Answer SNMPv3 GET, GETNEXT and GETBULK requests authenticated with HMAC-MD5, SHA or SHA-2\n"
+"                           and encrypted with AES-128, if at all, without going through net-snmp, reusing per-user HMAC\n"
+"                           and cipher contexts. Requests it can't answer are left to net-snmp. Excludes --agentx-master,\n"
+"                           --delay, --loss and --stats-oid.\n\n"
+
+"        -m, --store[=DIR]  Load FILE from the store in DIR, which defaults to " VSA_STORE_DIR ", parsing it into the store\n"
+"                           first if no agent did yet. The objects of a store file share their OIDs and values with every\n"
+"                           agent loading the same walk, containers mounting DIR included, only those that SETs change\n"
+"                           being private. DIR should be on a tmpfs.\n\n"
+
+"        -X, --agentx-master[=SOCKET]\n"
+"                           Also serve the subtrees that " PACKAGE " --agentx subagents register on SOCKET, which defaults to\n"
+"                           net-snmp's AgentX socket.\n\n"
+
+"        -x, --agentx[=SOCKET]\n"
+"                           Serve the objects as an AgentX subagent of the master agent on SOCKET instead of answering\n"
+"                           SNMP requests itself, reconnecting whenever the master restarts.\n\n\n"
 
 
 "FILE is the name of the file that contains an SNMP walk output. The name can also be passed through the " VSA_FILE " environment\n"
-"variable.\n\n\n"
+"variable. FILE may be compressed with gzip or zstd, in which case it is decompressed while it is parsed.\n\n\n"
+
+
+"SIGNALS\n\n"
+
+"        SIGHUP             Reload FILE in the background, then switch to the new objects at once.\n"
+"        SIGUSR1            Dump the objects to the --dump file in the background.\n"
+"        SIGINT, SIGTERM    Stop " PACKAGE ".\n\n\n"
 
 
 PACKAGE_COPYRIGHT "\n\n"
@@ -156,34 +1568,272 @@ PACKAGE_COPYRIGHT "\n\n"
 void
 run(int argc, char *argv[])
 {
-    char                   *mib;
-    guint                   nobjects;
+    int                     socks[VSA_HANDOVER_MAX_FDS];
+    char                   *ports;
+    size_t                  nsocks;
     GList                  *objects;
+    netsnmp_transport      *transport;
+    vsa_profile_t          *profile;
+    agent_t                 agent = {
+        { NULL, 0, NULL, NULL, NULL, NULL, 0, NULL, 0, NULL, VSA_DUMP_WALK, NULL, VSA_WAL_SYNC_INTERVAL, 0, 0, NULL,
+         NULL, NULL, NULL, 0, NULL, NULL, 0, NULL },
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, -1, -1, 0
+    };
+
+    parse_args(argc, argv, &agent.options);
+
+    if (!agent.options.log_sync && vsa_log_start()) {
+        vsa_log_errorln(VSA_LOG_START_ERROR_MSG);
+    }
+
+    filter_start(&agent);
+
+    if (agent.options.store) {
+        agent.store = vsa_store_new(agent.options.store);
+        if (!agent.store) {
+            vsa_log_errorln(VSA_STORE_NEW_ERROR_MSG);
+        }
+    }
+
+    profile = NULL;
+    if (agent.options.profile) {
+        profile = vsa_profile_new();
+        if (!profile) {
+            vsa_log_errorln(VSA_PROFILE_NEW_ERROR_MSG);
+        }
+    }
 
-    mib = parse_args(argc, argv);
+    objects = NULL;
+    nsocks = 0;
+    if (agent.options.handover) {
+        vsa_profile_begin(profile, "takeover");
+        objects = takeover(&agent, socks, &nsocks);
+        vsa_profile_end(profile);
+    }
 
-    objects = vsa_parser_parse_mib(mib);
     if (!objects) {
-        vsa_log_errorln(VSA_LOG_INTERNAL_ERROR_MSG);
+        vsa_profile_begin(profile, agent.store ? "store" : "parse");
+        objects = load_objects(&agent, &agent.map);
+        if (!objects) {
+            vsa_log_errorln(VSA_LOG_INTERNAL_ERROR_MSG);
+        }
+        vsa_profile_end(profile);
+    }
+    if (profile) {
+        vsa_profile_count_objects(profile, objects);
+    }
+
+    vsa_log_infoln("indexing objects");
+    vsa_profile_begin(profile, "index");
+    agent.index = vsa_index_new(objects);
+    if (!agent.index) {
+        vsa_log_errorln(VSA_INDEX_NEW_ERROR_MSG);
+    }
+    vsa_profile_end(profile);
+    vsa_log_infoln("%zu objects indexed, %zu duplicates ignored", agent.index->len, agent.index->nduplicates);
+
+    if (agent.options.wal) {
+        vsa_profile_begin(profile, "replay");
+        wal_start(&agent);
+        vsa_profile_end(profile);
+    }
+
+    if (agent.options.expressions) {
+        vsa_profile_begin(profile, "expressions");
+        if (vsa_expr_load(agent.index, agent.options.expressions)) {
+            vsa_log_errorln(VSA_EXPR_LOAD_ERROR_MSG);
+        }
+        vsa_profile_end(profile);
+        vsa_log_infoln("%u objects computed", agent.index->exprs ? g_hash_table_size(agent.index->exprs) : 0);
     }
-    nobjects = g_list_length(objects);
 
     snmp_enable_stderrlog();
+    if (agent.options.subagent) {
+        netsnmp_ds_set_boolean(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_ROLE, SUB_AGENT);
+        netsnmp_ds_set_int(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_AGENTX_PING_INTERVAL, VSA_AGENTX_PING_INTERVAL);
+    } else if (agent.options.agentx_master) {
+        netsnmp_ds_set_boolean(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_AGENTX_MASTER, 1);
+    }
+    if (agent.options.agentx_socket) {
+        netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_X_SOCKET, agent.options.agentx_socket);
+    }
+    vsa_profile_begin(profile, "init_agent");
     init_agent(program_invocation_name);
+    vsa_profile_end(profile);
 
     vsa_log_infoln("registering objects");
-    g_list_foreach(objects, object_register_cb, &nobjects);
+    vsa_profile_begin(profile, "register");
+    if (vsa_index_register(agent.index)) {
+        vsa_log_errorln(VSA_INDEX_REGISTER_ERROR_MSG);
+    }
+    vsa_profile_end(profile);
 
+    vsa_profile_begin(profile, "init_snmp");
     init_snmp(program_invocation_name);
-    if (init_master_agent()) {
-        vsa_log_errorln("couldn't init master agent");
+    vsa_profile_end(profile);
+    if (nsocks) {
+        // The ports are still bound by the previous process, so the agent starts elsewhere and then switches sockets.
+        ports = takeover_ports(socks, nsocks);
+        netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_PORTS, ports);
+        g_free(ports);
+    } else if (agent.options.listen) {
+        netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, NETSNMP_DS_AGENT_PORTS, agent.options.listen);
+    }
+    // A subagent has no SNMP socket: its requests come from the master, over AgentX.
+    if (!agent.options.subagent) {
+        vsa_profile_begin(profile, "init_master_agent");
+        if (init_master_agent()) {
+            vsa_log_errorln("couldn't init master agent");
+        }
+        vsa_profile_end(profile);
+#ifdef VSA_USDT
+        transport = vsa_transport_get_main();
+        if (!transport) {
+            vsa_log_errorln(VSA_TRANSPORT_GET_MAIN_ERROR_MSG);
+        }
+        if (vsa_transport_trace(transport)) {
+            vsa_log_errorln(VSA_TRANSPORT_TRACE_ERROR_MSG);
+        }
+#endif
+    }
+    if (nsocks) {
+        takeover_finish(&agent, socks, nsocks);
+    }
+    if (agent.options.handover) {
+        handover_listen(&agent);
+    }
+
+    // Attached before the cache so that its hooks see every packet.
+    if (agent.options.stats_oid || agent.options.stats_socket) {
+        stats_start(&agent);
+    }
+
+    // Attached before the cache, which drops its entries on the encrypted PDUs it sees.
+    if (agent.options.fast_v3) {
+        usm_start(&agent);
+    }
+
+    if (agent.options.cache_size) {
+        transport = vsa_transport_get_main();
+        if (!transport) {
+            vsa_log_errorln(VSA_TRANSPORT_GET_MAIN_ERROR_MSG);
+        }
+
+        agent.cache = vsa_cache_new(agent.options.cache_size);
+        if (!agent.cache) {
+            vsa_log_errorln(VSA_CACHE_NEW_ERROR_MSG);
+        }
+        if (vsa_cache_attach(agent.cache, transport)) {
+            vsa_log_errorln(VSA_CACHE_ATTACH_ERROR_MSG);
+        }
+        // Only the main transport's requests are answered from the cache, but a SET on any other clears it too.
+        agent.index->set_cb = set_cb;
+        agent.index->set_data = &agent;
+        if (agent.stats) {
+            agent.stats->cache = agent.cache;
+        }
+    }
+
+    // Attached after the statistics, so that their latencies are the agent's own.
+    if (agent.options.delay) {
+        transport = vsa_transport_get_main();
+        if (!transport) {
+            vsa_log_errorln(VSA_TRANSPORT_GET_MAIN_ERROR_MSG);
+        }
+        if (vsa_delay_attach(agent.options.delay, transport)) {
+            vsa_log_errorln(VSA_DELAY_ATTACH_ERROR_MSG);
+        }
+    }
+
+    if (agent.options.trap_sinks) {
+        trap_start(&agent);
+    }
+
+    signal(SIGINT, stop_cb);
+    signal(SIGTERM, stop_cb);
+    signal(SIGHUP, reload_cb);
+    signal(SIGUSR1, dump_cb);
+
+    if (profile) {
+        profile->duplicates = agent.index->nduplicates;
+        profile_report(&agent, profile);
+        profile = vsa_profile_free(profile);
     }
 
     vsa_log_infoln("running");
-    while (1) {
-        agent_check_and_process(0);
+    while (running) {
+        agent_check_and_process(1);
+        vsa_epoch_reclaim();
+
+        if (reload_requested) {
+            reload_requested = 0;
+            reload_start(&agent);
+        }
+
+        if (dump_requested) {
+            dump_requested = 0;
+            dump_start(&agent);
+        }
+    }
+
+    vsa_log_infoln("cursor hits: %lu of %lu GETNEXT lookups (%.1f%%)", agent.index->cursor_hits,
+                   agent.index->cursor_hits + agent.index->cursor_misses,
+                   agent.index->cursor_hits ? 100.0 * agent.index->cursor_hits / (agent.index->cursor_hits +
+                                                                                  agent.index->cursor_misses) : 0.0);
+
+    if (agent.options.delay) {
+        vsa_log_infoln("delayed %lu responses and dropped %lu, %lu sent right away past %zu held",
+                       agent.options.delay->delayed, agent.options.delay->dropped, agent.options.delay->overflows,
+                       agent.options.delay->max_pending);
+    }
+
+    if (agent.usm) {
+        vsa_log_infoln("answered %lu SNMPv3 requests, %lu left to net-snmp", agent.usm->answered, agent.usm->passed);
+    }
+
+    if (agent.trap) {
+        vsa_trap_stop(agent.trap);
+        vsa_log_infoln("sent %lu notifications, %lu errors, %lu informs acked, %lu resent, %lu timed out",
+                       agent.trap->sent, agent.trap->errors, agent.trap->acked, agent.trap->retransmitted,
+                       agent.trap->timeouts);
+    }
+
+    if (-1 != agent.handover_sock) {
+        unregister_readfd(agent.handover_sock);
+        close(agent.handover_sock);
+        // Once handed over, the path belongs to the new process.
+        if (!agent.handed_over) {
+            unlink(agent.options.handover);
+        }
+    }
+
+    if (agent.dump) {
+        dump_finish(&agent);
+    }
+    if (agent.handover) {
+        handover_finish(&agent);
+    }
+    // The reload thread reads the index, the filter and the store.
+    if (agent.reload) {
+        reload_finish(&agent);
+    }
+
+    vsa_stats_free(agent.stats);
+    vsa_cache_free(agent.cache);
+    vsa_usm_free(agent.usm);
+    vsa_delay_free(agent.options.delay);
+    vsa_trap_free(agent.trap);
+    if (agent.options.trap_sinks) {
+        g_ptr_array_free(agent.options.trap_sinks, TRUE);
     }
+    vsa_wal_close(agent.wal);
+    vsa_index_free(agent.index);
+    vsa_store_free(agent.store);
+    vsa_parser_set_filter(NULL);
+    vsa_filter_free(agent.filter);
+    vsa_filter_free(agent.options.filter);
     snmp_shutdown(program_invocation_name);
+    vsa_log_stop();
 }
 
 int